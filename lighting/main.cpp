@@ -7,6 +7,9 @@
 #include <string>
 #include "Vector3.h"
 #include "Matrix4.h"
+#include "Geometry.h"
+#include "ProgramReflection.h"
+#include "IndirectRenderer.h"
 #include <algorithm>
 
 using namespace std;
@@ -34,9 +37,43 @@ struct Camera
 	float zoom; ///< an additional scaling parameter
 };
 
-// TODO: Now materials and light properties are hard coded in display(), I
-// would suggest you to create a struct/class and methods to store and set them
-// on the shaders.
+/// The per-frame uniform block of the shaders (camera and lights). The
+/// members follow the std140 layout: a vec3 takes 16 bytes, unless it is
+/// followed by a float which then fills its last 4 bytes
+struct FrameBlock
+{
+	Matrix4f transformation;  ///< the model-view-projection transformation
+	Vector3f cameraPosition;  ///< the position of the camera
+	float pad0;				  ///< (padding)
+	Vector3f dLightDirection; ///< the direction of the directional light
+	float pad1;				  ///< (padding)
+	Vector3f dLightAColor;	  ///< the ambient color of the directional light
+	float dLightAIntensity;	  ///< the ambient intensity of the directional light
+	Vector3f dLightDColor;	  ///< the diffuse color of the directional light
+	float dLightDIntensity;	  ///< the diffuse intensity of the directional light
+	Vector3f dLightSColor;	  ///< the specular color of the directional light
+	float dLightSIntensity;	  ///< the specular intensity of the directional light
+	// TODO: add the headlight
+};
+
+/// A copy of an object drawn with instancing (or indirectly), as read by the
+/// per-instance attributes of the instanced shader
+struct Instance
+{
+	Matrix4f model; ///< the model transformation (rotation and translation only)
+	float material; ///< the index of the material in the materials block
+};
+
+/// A material, as stored in the materials uniform block of the shaders (std140)
+struct Material
+{
+	Vector3f aColor; ///< the ambient color
+	float pad0;		 ///< (padding)
+	Vector3f dColor; ///< the diffuse color
+	float pad1;		 ///< (padding)
+	Vector3f sColor; ///< the specular color
+	float shininess; ///< the specular exponent
+};
 
 // --- OpenGL callbacks ---------------------------------------------------------------------------
 void display(GLFWwindow *);
@@ -47,44 +84,71 @@ void motion(GLFWwindow *, double, double);
 
 // --- Other methods ------------------------------------------------------------------------------
 void initBuffers();
+void initInstances(int);
+void addInstanceAttributes(Geometry &);
 bool initShaders();
+GLuint createProgram(const string &, const string &);
+void setMaterial(int);
 Matrix4f computeCameraTransform(const Camera &);
 string readTextFile(const string &);
 
 // --- Global variables ---------------------------------------------------------------------------
 // Shader program
 GLuint ShaderProgram = 0;
-GLint TrLoc = -1;
-GLint CameraPositionLoc = -1;
-GLint DLightDirLoc = -1;
-GLint DLightAColorLoc = -1;
-GLint DLightDColorLoc = -1;
-GLint DLightSColorLoc = -1;
-GLint DLightAIntensityLoc = -1;
-GLint DLightDIntensityLoc = -1;
-GLint DLightSIntensityLoc = -1;
-GLint MaterialAColorLoc = -1;
-GLint MaterialDColorLoc = -1;
-GLint MaterialSColorLoc = -1;
-GLint MaterialShineLoc = -1;
-// TODO: add the ones for the headlight
+GLuint InstancedProgram = 0; ///< The shader program compiled with INSTANCED defined
+
+ProgramReflection Uniforms; ///< The active uniforms of ShaderProgram (updated by initShaders())
+const int MaterialIndexUniform = Uniforms.addUniform("material_index"); ///< Uniforms[] handle
+ProgramReflection InstancedUniforms; ///< The active uniforms of InstancedProgram
+
+// Uniform blocks
+const GLuint FRAME_BINDING = 0;	   ///< The binding point of the per-frame block
+const GLuint MATERIALS_BINDING = 1; ///< The binding point of the materials block
+FrameBlock Frame;					///< The per-frame block, uploaded by display()
+GLuint FrameUBO = 0;				///< The buffer of the per-frame block
+GLuint MaterialsUBO = 0;			///< The buffer of the materials block
+
+// Materials (indices in the materials block)
+const int MAX_MATERIALS = 16; ///< The size of the materials block, as in the shader
+const int GRASS_MATERIAL = 0;
+const int PYRAMID_MATERIAL = 1;
+const int WALL_MATERIAL = 2;
 
 // Model of the pyramid
 const int PYRAMID_VERTS_NUM = 5;
 const int PYRAMID_TRIS_NUM = 6;
 GLuint PyramidVBO = 0;
 GLuint PyramidIBO = 0;
+Geometry Pyramid; ///< The pyramid model and its per-instance attributes
 // Model of the grass
 const int GRASS_VERTS_NUM = 9;
 const int GRASS_TRIS_NUM = 8;
 GLuint GrassVBO = 0;
 GLuint GrassIBO = 0;
+Geometry Grass;
 // Model of the wall
 const int WALL_SIDE_VERTS_NUM = 16;
 const int WALL_VERTS_NUM = WALL_SIDE_VERTS_NUM * WALL_SIDE_VERTS_NUM;
 const int WALL_TRIS_NUM = (WALL_SIDE_VERTS_NUM - 1) * (WALL_SIDE_VERTS_NUM - 1) * 2;
 GLuint WallVBO = 0;
 GLuint WallIBO = 0;
+Geometry Wall;
+
+// Copies of the objects: the pyramids (drawn with a single call), then the
+// grass and the wall (only used by the indirect renderer)
+vector<Instance> Instances; ///< The copies (one pyramid, except in stress mode)
+int PyramidsNum = 0;		///< The number of pyramids, the first of Instances
+GLuint InstanceVBO = 0;		///< The per-instance attributes of the copies
+
+// Indirect rendering: all the models are packed in one arena and the
+// whole scene is drawn with a single glMultiDrawElementsIndirect()
+bool UseIndirect = false;		 ///< Draw the scene with Renderer (toggled with I)
+MeshArena Arena(sizeof(Vertex)); ///< The vertices and indices of all the models
+int PyramidMesh = -1;			 ///< The pyramid in Arena
+int GrassMesh = -1;				 ///< The grass in Arena
+int WallMesh = -1;				 ///< The wall in Arena
+Geometry ArenaGeometry;			 ///< Arena and the per-instance attributes
+IndirectRenderer Renderer;		 ///< The draw commands, written every frame
 
 // Mouse control
 double MouseX, MouseY;
@@ -93,10 +157,26 @@ int MouseButton = -1;
 // Camera
 Camera Cam;
 
+// Stress test: the scene gets this many pyramids and the frame time is
+// reported every second (0 for the normal scene)
+int StressPyramidsNum = 0;
+
 // --- main() -------------------------------------------------------------------------------------
 /// The entry point of the application
 int main(int argc, char **argv)
 {
+	// The optional arguments are a number of pyramids for the stress test
+	// and "indirect" to start with the indirect renderer
+	for (int i = 1; i < argc; ++i)
+	{
+		if (string(argv[i]) == "indirect")
+			UseIndirect = true;
+		else
+		{
+			StressPyramidsNum = max(0, atoi(argv[i]));
+			cout << "Stress test with " << StressPyramidsNum << " pyramids" << endl;
+		}
+	}
 
 	// Initialize glfw and create a simple window
 	if (!glfwInit())
@@ -115,6 +195,10 @@ int main(int argc, char **argv)
 
 	glfwMakeContextCurrent(window);
 
+	// Don't wait for the vertical sync when measuring the frame time
+	if (StressPyramidsNum > 0)
+		glfwSwapInterval(0);
+
 	// Set callbacks
 	glfwSetKeyCallback(window, keyboard);
 	glfwSetMouseButtonCallback(window, mouse);
@@ -145,6 +229,15 @@ int main(int argc, char **argv)
 	Cam.zFar = 100.f;
 	Cam.zoom = 1.f;
 
+	// Directional light
+	Frame.dLightDirection.set(0.5f, -0.5f, -1.0f);
+	Frame.dLightAColor.set(0.05f, 0.03f, 0.0f);
+	Frame.dLightDColor.set(0.5f, 0.4f, 0.3f);
+	Frame.dLightSColor.set(0.6f, 0.6f, 0.7f);
+	Frame.dLightAIntensity = 1.0f;
+	Frame.dLightDIntensity = 1.0f;
+	Frame.dLightSIntensity = 1.0f;
+
 	// OpenGL
 	GLFWcursor *cursor = glfwCreateStandardCursor(GLFW_CROSSHAIR_CURSOR);
 	if (cursor != NULL)
@@ -160,11 +253,24 @@ int main(int argc, char **argv)
 	}
 
 	// Start the main event loop
+	double reportTime = glfwGetTime();
+	int frames = 0;
 	while (!glfwWindowShouldClose(window))
 	{
 		display(window);
 		// idle();
 		glfwPollEvents();
+
+		// Report the average frame time of the stress test every second
+		++frames;
+		double now = glfwGetTime();
+		if (StressPyramidsNum > 0 && now - reportTime >= 1.0)
+		{
+			cout << PyramidsNum << " pyramids" << (UseIndirect ? " (indirect): " : ": ")
+				 << 1000.0 * (now - reportTime) / frames << " ms per frame" << endl;
+			reportTime = now;
+			frames = 0;
+		}
 	}
 
 	glfwDestroyCursor(cursor);
@@ -193,74 +299,54 @@ void display(GLFWwindow *window)
 	assert(ShaderProgram != 0);
 	glUseProgram(ShaderProgram);
 
-	// Set the camera position and transformation
+	// Set the camera position and transformation, then upload the whole
+	// per-frame block (camera and lights) with a single call
 	Cam.ar = (1.0f * width) / height;
-	Matrix4f transformation = computeCameraTransform(Cam);
-
-	glUniform3fv(CameraPositionLoc, 1, Cam.position.get());
-	glUniformMatrix4fv(TrLoc, 1, GL_FALSE, transformation.get());
-
-	// Set the light parameters
-	glUniform3f(DLightDirLoc, 0.5f, -0.5f, -1.0f);
-	glUniform3f(DLightAColorLoc, 0.05f, 0.03f, 0.0f);
-	glUniform3f(DLightDColorLoc, 0.5f, 0.4f, 0.3f);
-	glUniform3f(DLightSColorLoc, 0.6f, 0.6f, 0.7f);
-	glUniform1f(DLightAIntensityLoc, 1.0f);
-	glUniform1f(DLightDIntensityLoc, 1.0f);
-	glUniform1f(DLightSIntensityLoc, 1.0f);
-
-	// Enable the vertex attributes and set their format
-	glEnableVertexAttribArray(0);
-	glEnableVertexAttribArray(1);
-
-	// Set the material parameters for the grass
-	glUniform3f(MaterialAColorLoc, 0.9f, 1.0f, 0.9f);
-	glUniform3f(MaterialDColorLoc, 0.3f, 1.0f, 0.3f);
-	glUniform3f(MaterialSColorLoc, 0.1f, 0.1f, 0.1f);
-	glUniform1f(MaterialShineLoc, 10.0f);
-
-	// Draw the grass
-	glBindBuffer(GL_ARRAY_BUFFER, GrassVBO);
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, // glVertexAttribPointer needs to be repeated for every mesh!
-						  sizeof(Vertex), reinterpret_cast<const GLvoid *>(0));
-	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE,
-						  sizeof(Vertex), reinterpret_cast<const GLvoid *>(sizeof(Vector3f)));
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, GrassIBO);
-	glDrawElements(GL_TRIANGLES, 3 * GRASS_TRIS_NUM, GL_UNSIGNED_INT, 0);
+	Frame.transformation = computeCameraTransform(Cam);
+	Frame.cameraPosition = Cam.position;
 
-	// Set the material parameters for the pyramid
-	glUniform3f(MaterialAColorLoc, 0.5f, 0.5f, 0.5f);
-	glUniform3f(MaterialDColorLoc, 1.0f, 0.8f, 0.8f);
-	glUniform3f(MaterialSColorLoc, 0.5f, 0.5f, 0.5f);
-	glUniform1f(MaterialShineLoc, 20.0f);
+	glBindBuffer(GL_UNIFORM_BUFFER, FrameUBO);
+	glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(FrameBlock), &Frame);
 
-	// Draw the pyramid
-	glBindBuffer(GL_ARRAY_BUFFER, PyramidVBO);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, PyramidIBO);
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, // glVertexAttribPointer needs to be repeated for every mesh!
-						  sizeof(Vertex), reinterpret_cast<const GLvoid *>(0));
-	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE,
-						  sizeof(Vertex), reinterpret_cast<const GLvoid *>(sizeof(Vector3f)));
-	glDrawElements(GL_TRIANGLES, 3 * PYRAMID_TRIS_NUM, GL_UNSIGNED_INT, 0);
-
-	// Set the material parameters for the wall
-	glUniform3f(MaterialAColorLoc, 0.5f, 0.5f, 0.5f);
-	glUniform3f(MaterialDColorLoc, 0.6f, 0.6f, 0.6f);
-	glUniform3f(MaterialSColorLoc, 1.0f, 1.0f, 1.0f);
-	glUniform1f(MaterialShineLoc, 50.0f);
-
-	// Draw the wall
-	glBindBuffer(GL_ARRAY_BUFFER, WallVBO);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, WallIBO);
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, // glVertexAttribPointer needs to be repeated for every mesh!
-						  sizeof(Vertex), reinterpret_cast<const GLvoid *>(0));
-	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE,
-						  sizeof(Vertex), reinterpret_cast<const GLvoid *>(sizeof(Vector3f)));
-	glDrawElements(GL_TRIANGLES, 3 * WALL_TRIS_NUM, GL_UNSIGNED_INT, 0);
+	if (UseIndirect)
+	{
+		// Draw the whole scene with the instanced shader and a single call:
+		// one command per model of the arena, its base instance selects the
+		// transformations and materials of its copies in InstanceVBO
+		glUseProgram(InstancedProgram);
+		Renderer.begin();
+		Renderer.draw(Arena.getMesh(GrassMesh), 1, PyramidsNum);
+		Renderer.draw(Arena.getMesh(WallMesh), 1, PyramidsNum + 1);
+		Renderer.draw(Arena.getMesh(PyramidMesh), PyramidsNum, 0);
+
+		ArenaGeometry.bind();
+		Renderer.submit(GL_TRIANGLES, GL_UNSIGNED_INT);
+		Renderer.end();
+		ArenaGeometry.unbind();
+	}
+	else
+	{
+		// Draw the grass (binding its geometry sets the buffers and the
+		// vertex format recorded in initBuffers())
+		setMaterial(GRASS_MATERIAL);
+		Grass.bind();
+		glDrawElements(GL_TRIANGLES, 3 * GRASS_TRIS_NUM, GL_UNSIGNED_INT, 0);
+
+		// Draw the wall
+		setMaterial(WALL_MATERIAL);
+		Wall.bind();
+		glDrawElements(GL_TRIANGLES, 3 * WALL_TRIS_NUM, GL_UNSIGNED_INT, 0);
+
+		// Draw all the pyramids at once with the instanced shader, which
+		// reads the transformation and material of each copy from InstanceVBO
+		glUseProgram(InstancedProgram);
+		Pyramid.bind();
+		glDrawElementsInstanced(GL_TRIANGLES, 3 * PYRAMID_TRIS_NUM, GL_UNSIGNED_INT, 0,
+								PyramidsNum);
+		Pyramid.unbind();
+	}
 
 	// clean-up
-	glDisableVertexAttribArray(0);
-	glDisableVertexAttribArray(1);
 	glUseProgram(0);
 
 	// Lock the mouse at the center of the screen
@@ -321,6 +407,13 @@ void keyboard(GLFWwindow *window, int key, int scancode, int action, int mods)
 	case GLFW_KEY_O: // change to polygon rendering
 		glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
 		break;
+	case GLFW_KEY_I: // toggle the indirect renderer
+		if (action == GLFW_PRESS)
+		{
+			UseIndirect = !UseIndirect && Renderer.isCreated();
+			cout << "Indirect rendering " << (UseIndirect ? "on" : "off") << endl;
+		}
+		break;
 	case GLFW_KEY_G: // show the current OpenGL version
 		cout << "OpenGL version " << glGetString(GL_VERSION) << endl;
 		break;
@@ -451,6 +544,9 @@ void initBuffers()
 				 pyramidTris,
 				 GL_STATIC_DRAW);
 
+	// Copy it to the arena too
+	PyramidMesh = Arena.addMesh(pyramidVerts, PYRAMID_VERTS_NUM, pyramidTris, 3 * PYRAMID_TRIS_NUM);
+
 	// Prepare the vertices of the grass
 	Vertex grassVerts[GRASS_VERTS_NUM];
 	grassVerts[0].position.set(-10.f, -0.5f, -10.f);
@@ -498,6 +594,7 @@ void initBuffers()
 				 3 * GRASS_TRIS_NUM * sizeof(unsigned int),
 				 grassTris,
 				 GL_STATIC_DRAW);
+	GrassMesh = Arena.addMesh(grassVerts, GRASS_VERTS_NUM, grassTris, 3 * GRASS_TRIS_NUM);
 
 	// Prepare the vertices of the wall
 	Vertex wallVerts[WALL_VERTS_NUM];
@@ -552,45 +649,196 @@ void initBuffers()
 				 3 * WALL_TRIS_NUM * sizeof(unsigned int),
 				 wallTris,
 				 GL_STATIC_DRAW);
+	WallMesh = Arena.addMesh(wallVerts, WALL_VERTS_NUM, wallTris, 3 * WALL_TRIS_NUM);
+	Arena.create();
+
+	// Create the per-instance attributes of the copies of the objects
+	initInstances(StressPyramidsNum);
+	glGenBuffers(1, &InstanceVBO);
+	glBindBuffer(GL_ARRAY_BUFFER, InstanceVBO);
+	glBufferData(GL_ARRAY_BUFFER,
+				 Instances.size() * sizeof(Instance),
+				 &Instances[0],
+				 GL_STATIC_DRAW);
+
+	// The pyramid and the arena also read the model transformation of the
+	// copies and their material
+	addInstanceAttributes(Pyramid);
+	addInstanceAttributes(ArenaGeometry);
+
+	// Record the vertex format of every mesh once: a position and a normal
+	Geometry *geometries[] = {&Pyramid, &Grass, &Wall, &ArenaGeometry};
+	GLuint vbos[] = {PyramidVBO, GrassVBO, WallVBO, Arena.getVBO()};
+	GLuint ibos[] = {PyramidIBO, GrassIBO, WallIBO, Arena.getIBO()};
+	for (int i = 0; i < 4; ++i)
+	{
+		geometries[i]->addAttribute(0, 3, GL_FLOAT, GL_FALSE,
+									sizeof(Vertex), offsetof(Vertex, position));
+		geometries[i]->addAttribute(1, 3, GL_FLOAT, GL_FALSE,
+									sizeof(Vertex), offsetof(Vertex, normal));
+		geometries[i]->create(vbos[i], ibos[i]);
+	}
+
+	// Create the buffer of the per-frame uniform block, filled by display()
+	glGenBuffers(1, &FrameUBO);
+	glBindBuffer(GL_UNIFORM_BUFFER, FrameUBO);
+	glBufferData(GL_UNIFORM_BUFFER, sizeof(FrameBlock), nullptr, GL_DYNAMIC_DRAW);
+	glBindBufferBase(GL_UNIFORM_BUFFER, FRAME_BINDING, FrameUBO);
+
+	// Prepare the materials
+	Material materials[MAX_MATERIALS] = {};
+	materials[GRASS_MATERIAL].aColor.set(0.9f, 1.0f, 0.9f);
+	materials[GRASS_MATERIAL].dColor.set(0.3f, 1.0f, 0.3f);
+	materials[GRASS_MATERIAL].sColor.set(0.1f, 0.1f, 0.1f);
+	materials[GRASS_MATERIAL].shininess = 10.0f;
+	materials[PYRAMID_MATERIAL].aColor.set(0.5f, 0.5f, 0.5f);
+	materials[PYRAMID_MATERIAL].dColor.set(1.0f, 0.8f, 0.8f);
+	materials[PYRAMID_MATERIAL].sColor.set(0.5f, 0.5f, 0.5f);
+	materials[PYRAMID_MATERIAL].shininess = 20.0f;
+	materials[WALL_MATERIAL].aColor.set(0.5f, 0.5f, 0.5f);
+	materials[WALL_MATERIAL].dColor.set(0.6f, 0.6f, 0.6f);
+	materials[WALL_MATERIAL].sColor.set(1.0f, 1.0f, 1.0f);
+	materials[WALL_MATERIAL].shininess = 50.0f;
+
+	// Store them in the buffer of the materials block, which stays bound:
+	// the shader picks the material of every draw by its index
+	glGenBuffers(1, &MaterialsUBO);
+	glBindBuffer(GL_UNIFORM_BUFFER, MaterialsUBO);
+	glBufferData(GL_UNIFORM_BUFFER, sizeof(materials), materials, GL_STATIC_DRAW);
+	glBindBufferBase(GL_UNIFORM_BUFFER, MATERIALS_BINDING, MaterialsUBO);
+
+	// Map the indirect buffer for the three commands of a frame
+	if (!Renderer.create(3))
+	{
+		cout << "Indirect rendering isn't supported (it needs OpenGL 4.4)." << endl;
+		UseIndirect = false;
+	}
 } /* initBuffers() */
 
-/// Initialize shaders. Return false if initialization fail
+/// Place the copies of the objects: the pyramid of the scene, or a grid of
+/// count pyramids with various orientations and materials for the stress
+/// test, followed by the grass and the wall
+void initInstances(int count)
+{
+	Instances.clear();
+	if (count == 0)
+	{
+		Instance instance; // at the origin
+		instance.material = PYRAMID_MATERIAL;
+		Instances.push_back(instance);
+	}
+
+	// The pyramid model is centered in (0, 0, -4.5): move it to the origin,
+	// turn it and put it in its cell of the grid, on the grass
+	const int SIDE = static_cast<int>(ceil(sqrt(static_cast<double>(count))));
+	Matrix4f toOrigin = Matrix4f::createTranslation(Vector3f(0.f, 0.f, 4.5f));
+	for (int i = 0; i < count; ++i)
+	{
+		Vector3f cell(1.5f * (i % SIDE - SIDE / 2), 0.f, -4.5f - 1.5f * (i / SIDE));
+		Instance instance;
+		instance.model = Matrix4f::createTranslation(cell) *
+						 Matrix4f::createRotation(37.f * i, Vector3f(0.f, 1.f, 0.f)) *
+						 toOrigin;
+		instance.material = static_cast<float>(i % 3);
+		Instances.push_back(instance);
+	}
+	PyramidsNum = static_cast<int>(Instances.size());
+
+	// The grass and the wall, where they are modelled
+	Instance grass, wall;
+	grass.material = GRASS_MATERIAL;
+	wall.material = WALL_MATERIAL;
+	Instances.push_back(grass);
+	Instances.push_back(wall);
+} /* initInstances() */
+
+/// Add the per-instance attributes to a geometry: the model transformation
+/// of the copies (one column per attribute) and their material, read from
+/// InstanceVBO starting with the first pyramid
+void addInstanceAttributes(Geometry &geometry)
+{
+	for (int c = 0; c < 4; ++c)
+		geometry.addInstanceAttribute(InstanceVBO, 2 + c, 4, GL_FLOAT, GL_FALSE,
+									  sizeof(Instance), offsetof(Instance, model) + 4 * c * sizeof(float));
+	geometry.addInstanceAttribute(InstanceVBO, 6, 1, GL_FLOAT, GL_FALSE,
+								  sizeof(Instance), offsetof(Instance, material));
+} /* addInstanceAttributes() */
+
+/// Initialize shaders: the shader program and its instanced variant. Return
+/// false if initialization fail
 bool initShaders()
 {
-	// Create the shader program and check for errors
+	// Read the source code of the shaders
+	string vertCode = readTextFile("shader.v.glsl");
+	string fragCode = readTextFile("shader.f.glsl");
+	if (vertCode.empty() || fragCode.empty())
+		return false;
+
+	// The instanced variant defines INSTANCED right after the #version line
+	// (#line keeps the line numbers of the error messages)
+	string instancedCode = vertCode;
+	instancedCode.insert(instancedCode.find('\n') + 1, "#define INSTANCED\n#line 2\n");
+
+	// Create both programs before replacing either, so that a reload fails
+	// as a whole
+	GLuint program = createProgram(vertCode, fragCode);
+	if (program == 0)
+		return false;
+	GLuint instancedProgram = createProgram(instancedCode, fragCode);
+	if (instancedProgram == 0)
+	{
+		glDeleteProgram(program);
+		return false;
+	}
+
+	// Replace the programs in use and read their active uniforms
 	if (ShaderProgram != 0)
 		glDeleteProgram(ShaderProgram);
-	ShaderProgram = glCreateProgram();
-	if (ShaderProgram == 0)
+	if (InstancedProgram != 0)
+		glDeleteProgram(InstancedProgram);
+	ShaderProgram = program;
+	InstancedProgram = instancedProgram;
+	Uniforms.reflect(ShaderProgram);
+	InstancedUniforms.reflect(InstancedProgram);
+
+	// Connect the uniform blocks to the buffers bound at their binding
+	// points (GLSL 3.30 can't set the bindings in the shader). The blocks
+	// must have the size of the structures filling them
+	ProgramReflection *reflections[] = {&Uniforms, &InstancedUniforms};
+	for (int i = 0; i < 2; ++i)
 	{
-		cerr << "Error: cannot create shader program." << endl;
-		return false;
+		ProgramReflection &uniforms = *reflections[i];
+		uniforms.bindBlock("Frame", FRAME_BINDING);
+		uniforms.bindBlock("Materials", MATERIALS_BINDING);
+		assert(uniforms.findBlock("Frame") != -1 &&
+			   uniforms.getBlock(uniforms.findBlock("Frame")).dataSize == sizeof(FrameBlock));
+		assert(uniforms.findBlock("Materials") == -1 ||
+			   uniforms.getBlock(uniforms.findBlock("Materials")).dataSize == MAX_MATERIALS * sizeof(Material));
 	}
 
+	return true;
+} /* initShaders() */
+
+/// Compile and link a shader program from the source code of its shaders.
+/// Return 0 if it fails
+GLuint createProgram(const string &vertCode, const string &fragCode)
+{
 	// Create the shader objects and check for errors
 	GLuint vertShader = glCreateShader(GL_VERTEX_SHADER);
 	GLuint fragShader = glCreateShader(GL_FRAGMENT_SHADER);
 	if (vertShader == 0 || fragShader == 0)
 	{
 		cerr << "Error: cannot create shader objects." << endl;
-		return false;
+		return 0;
 	}
 
-	// Read and set the source code for the vertex shader
-	string text = readTextFile("shader.v.glsl");
-	const char *code = text.c_str();
-	int length = static_cast<int>(text.length());
-	if (length == 0)
-		return false;
+	// Set the source code of the shaders
+	const char *code = vertCode.c_str();
+	int length = static_cast<int>(vertCode.length());
 	glShaderSource(vertShader, 1, &code, &length);
-
-	// Read and set the source code for the fragment shader
-	string text2 = readTextFile("shader.f.glsl");
-	const char *code2 = text2.c_str();
-	length = static_cast<int>(text2.length());
-	if (length == 0)
-		return false;
-	glShaderSource(fragShader, 1, &code2, &length);
+	code = fragCode.c_str();
+	length = static_cast<int>(fragCode.length());
+	glShaderSource(fragShader, 1, &code, &length);
 
 	// Compile the shaders
 	glCompileShader(vertShader);
@@ -605,7 +853,9 @@ bool initShaders()
 		glGetShaderInfoLog(vertShader, 1024, nullptr, errorLog);
 		cerr << "Error: cannot compile vertex shader.\nError log:\n"
 			 << errorLog << endl;
-		return false;
+		glDeleteShader(vertShader);
+		glDeleteShader(fragShader);
+		return 0;
 	}
 	glGetShaderiv(fragShader, GL_COMPILE_STATUS, &success);
 	if (!success)
@@ -613,60 +863,63 @@ bool initShaders()
 		glGetShaderInfoLog(fragShader, 1024, nullptr, errorLog);
 		cerr << "Error: cannot compile fragment shader.\nError log:\n"
 			 << errorLog << endl;
-		return false;
+		glDeleteShader(vertShader);
+		glDeleteShader(fragShader);
+		return 0;
+	}
+
+	// Create the shader program and check for errors
+	GLuint program = glCreateProgram();
+	if (program == 0)
+	{
+		cerr << "Error: cannot create shader program." << endl;
+		glDeleteShader(vertShader);
+		glDeleteShader(fragShader);
+		return 0;
 	}
 
 	// Attach the shader to the program and link it
-	glAttachShader(ShaderProgram, vertShader);
-	glAttachShader(ShaderProgram, fragShader);
-	glLinkProgram(ShaderProgram);
+	glAttachShader(program, vertShader);
+	glAttachShader(program, fragShader);
+	glLinkProgram(program);
+
+	// Shaders can be deleted now (they are freed with the program)
+	glDeleteShader(vertShader);
+	glDeleteShader(fragShader);
 
 	// Check for linking error
-	glGetProgramiv(ShaderProgram, GL_LINK_STATUS, &success);
+	glGetProgramiv(program, GL_LINK_STATUS, &success);
 	if (!success)
 	{
-		glGetProgramInfoLog(ShaderProgram, 1024, nullptr, errorLog);
+		glGetProgramInfoLog(program, 1024, nullptr, errorLog);
 		cerr << "Error: cannot link shader program.\nError log:\n"
 			 << errorLog << endl;
-		return false;
+		glDeleteProgram(program);
+		return 0;
 	}
 
 	// Make sure that the shader program can run
-	glValidateProgram(ShaderProgram);
+	glValidateProgram(program);
 
 	// Check for validation error
-	glGetProgramiv(ShaderProgram, GL_VALIDATE_STATUS, &success);
+	glGetProgramiv(program, GL_VALIDATE_STATUS, &success);
 	if (!success)
 	{
-		glGetProgramInfoLog(ShaderProgram, 1024, nullptr, errorLog);
+		glGetProgramInfoLog(program, 1024, nullptr, errorLog);
 		cerr << "Error: cannot validate shader program.\nError log:\n"
 			 << errorLog << endl;
-		return false;
+		glDeleteProgram(program);
+		return 0;
 	}
 
-	// Get the location of the uniform variables
-	TrLoc = glGetUniformLocation(ShaderProgram, "transformation");
-	assert(TrLoc != -1); // check for errors (variable not found)
-
-	CameraPositionLoc = glGetUniformLocation(ShaderProgram, "camera_position");
-	DLightDirLoc = glGetUniformLocation(ShaderProgram, "d_light_direction");
-	DLightAColorLoc = glGetUniformLocation(ShaderProgram, "d_light_a_color");
-	DLightDColorLoc = glGetUniformLocation(ShaderProgram, "d_light_d_color");
-	DLightSColorLoc = glGetUniformLocation(ShaderProgram, "d_light_s_color");
-	DLightAIntensityLoc = glGetUniformLocation(ShaderProgram, "d_light_a_intensity");
-	DLightDIntensityLoc = glGetUniformLocation(ShaderProgram, "d_light_d_intensity");
-	DLightSIntensityLoc = glGetUniformLocation(ShaderProgram, "d_light_s_intensity");
-	MaterialAColorLoc = glGetUniformLocation(ShaderProgram, "material_a_color");
-	MaterialDColorLoc = glGetUniformLocation(ShaderProgram, "material_d_color");
-	MaterialSColorLoc = glGetUniformLocation(ShaderProgram, "material_s_color");
-	MaterialShineLoc = glGetUniformLocation(ShaderProgram, "material_shininess");
-
-	// Shaders can be deleted now
-	glDeleteShader(vertShader);
-	glDeleteShader(fragShader);
+	return program;
+} /* createProgram() */
 
-	return true;
-} /* initShaders() */
+/// Use the specified material (one of the *_MATERIAL indices) for the next draws
+void setMaterial(int material)
+{
+	glUniform1i(Uniforms[MaterialIndexUniform], material);
+} /* setMaterial() */
 
 /// Return the transformation matrix corresponding to the specified camera
 Matrix4f computeCameraTransform(const Camera &cam)
@@ -7,46 +7,83 @@
 // shader. It would be more computationally expensive, but the results look 
 // far better.
 
-// model-view transformation
-uniform mat4 transformation;
-
-// Camera position
-uniform vec3 camera_position;
-
-// Directional light
-uniform vec3 d_light_direction;
-uniform vec3 d_light_a_color;
-uniform float d_light_a_intensity;
-uniform vec3 d_light_d_color;
-uniform float d_light_d_intensity;
-uniform vec3 d_light_s_color;
-uniform float d_light_s_intensity;
-
-// Head-mounted light //TODO: implement it yourself!
-//uniform vec3 p_light_a_color;
-//uniform float p_light_a_intensity;
-//uniform vec3 p_light_d_color;
-//uniform float p_light_d_intensity;
-//uniform vec3 p_light_s_color;
-//uniform float p_light_s_intensity;
-// TODO: other parameters
+// The uniforms are grouped in uniform blocks (std140 layout), so that the
+// application sets each block at once from a buffer object (UBO). The
+// members are still referred to by their names.
+
+// Per-frame values: camera and lights
+layout (std140) uniform Frame {
+	// model-view transformation
+	mat4 transformation;
+
+	// Camera position
+	vec3 camera_position;
+
+	// Directional light
+	vec3 d_light_direction;
+	vec3 d_light_a_color;
+	float d_light_a_intensity;
+	vec3 d_light_d_color;
+	float d_light_d_intensity;
+	vec3 d_light_s_color;
+	float d_light_s_intensity;
+
+	// Head-mounted light //TODO: implement it yourself!
+	//vec3 p_light_a_color;
+	//float p_light_a_intensity;
+	//vec3 p_light_d_color;
+	//float p_light_d_intensity;
+	//vec3 p_light_s_color;
+	//float p_light_s_intensity;
+	// TODO: other parameters
+};
 
 // Object material
 // Notice that all of this values may be also specified per-vertex or 
 //  through a texture.
-uniform vec3 material_a_color;
-uniform vec3 material_d_color;
-uniform vec3 material_s_color;
-uniform float material_shininess;
+struct Material {
+	vec3 a_color;
+	vec3 d_color;
+	vec3 s_color;
+	float shininess;
+};
+
+// All the materials, the one of the object being drawn is selected by index
+const int MAX_MATERIALS = 16;
+layout (std140) uniform Materials {
+	Material materials[MAX_MATERIALS];
+};
 
 // vertex attributes
-layout (location = 0) in vec3 position; 
-layout (location = 1) in vec3 normal; 
+layout (location = 0) in vec3 vertex_position; 
+layout (location = 1) in vec3 vertex_normal; 
+
+// The application compiles this shader twice: as it is, to draw a single
+// object, and with INSTANCED defined, to draw many copies of an object with
+// glDrawElementsInstanced(). The copies differ by their model transformation
+// and material, read from per-instance attributes.
+#ifdef INSTANCED
+layout (location = 2) in mat4 instance_model; // uses locations 2 to 5
+layout (location = 6) in float instance_material;
+#else
+uniform int material_index;
+#endif
 
 // compute the color here and pass it to the fragment shader
 out vec4 fcolor;
 
 void main() {
+	// the position and normal of the vertex in world coordinates
+#ifdef INSTANCED
+	vec3 position = (instance_model * vec4(vertex_position, 1.)).xyz;
+	vec3 normal = mat3(instance_model) * vertex_normal; // rotations and translations only
+	Material material = materials[int(instance_material)];
+#else
+	vec3 position = vertex_position;
+	vec3 normal = vertex_normal;
+	Material material = materials[material_index];
+#endif
+
 	// transform the vertex
     gl_Position = transformation * vec4(position, 1.);	
 	
@@ -79,14 +116,14 @@ void main() {
 	// compute the color contribution	
 	vec3 color;
 	vec3 amb_color = clamp(
-			material_a_color * d_light_a_color * d_light_a_intensity,
+			material.a_color * d_light_a_color * d_light_a_intensity,
 			0.0, 1.0);
 	vec3 diff_color = clamp(
-			material_d_color * dot_d_light_normal * d_light_d_intensity,
+			material.d_color * dot_d_light_normal * d_light_d_intensity,
 			0.0, 1.0);
 	vec3 spec_color = clamp(
-			material_s_color *  
-			pow(dot(d_reflected_dir_nn, view_dir_nn), material_shininess),
+			material.s_color *  
+			pow(dot(d_reflected_dir_nn, view_dir_nn), material.shininess),
 			0.0, 1.0);
 	color = clamp(
 			amb_color + diff_color + spec_color,
@@ -107,14 +144,14 @@ void main() {
 	
 	// compute the color contribution	
 	amb_color = clamp(
-			material_a_color * d_light_a_color * d_light_a_intensity,
+			material.a_color * d_light_a_color * d_light_a_intensity,
 			0.0, 1.0);
 	diff_color = clamp(
-			material_d_color * dot_p_light_normal * d_light_d_intensity,
+			material.d_color * dot_p_light_normal * d_light_d_intensity,
 			0.0, 1.0);
 	spec_color = clamp(
-			material_s_color *  
-			pow(dot(d_reflected_dir_nn, view_dir_nn), material_shininess),
+			material.s_color *  
+			pow(dot(d_reflected_dir_nn, view_dir_nn), material.shininess),
 			0.0, 1.0);
 	color = clamp(
 			amb_color + diff_color + spec_color,
@@ -0,0 +1,272 @@
+#ifndef __INDIRECT_RENDERER_H__
+#define __INDIRECT_RENDERER_H__
+
+#include <GL/glew.h>
+
+#include <cassert>
+#include <cstddef>
+#include <vector>
+
+/// The parameters of one draw of glMultiDrawElementsIndirect(), as read by
+/// the GPU from the indirect buffer
+struct DrawElementsIndirectCommand
+{
+	GLuint count;		  ///< the number of indices
+	GLuint instanceCount; ///< the number of instances
+	GLuint firstIndex;	  ///< the first index, counted in indices (not bytes)
+	GLint baseVertex;	  ///< added to every index
+	GLuint baseInstance;  ///< the first instance read by the per-instance attributes
+};
+
+/// Several meshes packed into one shared vertex buffer and one shared index
+/// buffer, so that they can all be drawn with the same vertex format and a
+/// single multi-draw call. The indices of a mesh stay relative to its own
+/// vertices: a draw adds the mesh's base vertex.
+///
+/// Usage: addMesh() for every mesh, then create(). Record the vertex format
+/// of getVBO() and getIBO() in a Geometry.
+class MeshArena
+{
+public:
+	/// A mesh in the arena, the arguments of its draw command
+	struct Mesh
+	{
+		GLuint count;	   ///< the number of indices
+		GLuint firstIndex; ///< the position of the first index in the IBO
+		GLint baseVertex;  ///< the position of the first vertex in the VBO
+	};
+
+	/// Create an empty arena for vertices of vertexSize bytes
+	explicit MeshArena(GLsizei vertexSize) : mVertexSize(vertexSize), mVBO(0), mIBO(0) {}
+
+	/// Copy a mesh into the arena and return its handle. The vertices have
+	/// the size given to the constructor, the indices are 32 bit
+	int addMesh(const void *vertices, GLsizei vertexCount, const GLuint *indices, GLsizei indexCount)
+	{
+		assert(mVBO == 0);
+		Mesh mesh;
+		mesh.count = indexCount;
+		mesh.firstIndex = static_cast<GLuint>(mIndices.size());
+		mesh.baseVertex = static_cast<GLint>(mVertices.size() / mVertexSize);
+		mMeshes.push_back(mesh);
+
+		const unsigned char *bytes = static_cast<const unsigned char *>(vertices);
+		mVertices.insert(mVertices.end(), bytes, bytes + vertexCount * mVertexSize);
+		mIndices.insert(mIndices.end(), indices, indices + indexCount);
+		return static_cast<int>(mMeshes.size()) - 1;
+	}
+
+	/// Upload the meshes to the VBO and the IBO. No mesh can be added after
+	void create()
+	{
+		glGenBuffers(1, &mVBO);
+		glBindBuffer(GL_ARRAY_BUFFER, mVBO);
+		glBufferData(GL_ARRAY_BUFFER, mVertices.size(), mVertices.empty() ? nullptr : &mVertices[0],
+					 GL_STATIC_DRAW);
+
+		glGenBuffers(1, &mIBO);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mIBO);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, mIndices.size() * sizeof(GLuint),
+					 mIndices.empty() ? nullptr : &mIndices[0], GL_STATIC_DRAW);
+
+		// The GPU has its copy now
+		std::vector<unsigned char>().swap(mVertices);
+		std::vector<GLuint>().swap(mIndices);
+	}
+
+	/// Delete the buffers and forget the meshes
+	void destroy()
+	{
+		if (mVBO != 0)
+			glDeleteBuffers(1, &mVBO);
+		if (mIBO != 0)
+			glDeleteBuffers(1, &mIBO);
+		mVBO = 0;
+		mIBO = 0;
+		mMeshes.clear();
+		mVertices.clear();
+		mIndices.clear();
+	}
+
+	/// Return the mesh with the given handle
+	const Mesh &getMesh(int handle) const { return mMeshes[handle]; }
+
+	/// Return the vertex buffer object (0 before create())
+	GLuint getVBO() const { return mVBO; }
+
+	/// Return the index buffer object (0 before create())
+	GLuint getIBO() const { return mIBO; }
+
+private:
+	GLsizei mVertexSize;				  ///< The size of a vertex
+	GLuint mVBO;						  ///< The vertex buffer object
+	GLuint mIBO;						  ///< The index buffer object
+	std::vector<Mesh> mMeshes;			  ///< The meshes, by handle
+	std::vector<unsigned char> mVertices; ///< The vertices waiting for create()
+	std::vector<GLuint> mIndices;		  ///< The indices waiting for create()
+};
+
+/// Draw commands written straight into GPU memory and issued with
+/// glMultiDrawElementsIndirect(), so that a whole pass costs one call
+/// whatever the number of meshes.
+///
+/// The indirect buffer is mapped once and stays mapped (persistent mapping).
+/// It is split in FRAMES regions, one per frame in flight: a frame writes
+/// its commands to the next region after waiting for the fence of the draws
+/// which read it FRAMES frames ago, so the CPU never overwrites commands the
+/// GPU hasn't read yet, and it only waits if the GPU is that far behind.
+///
+/// Usage: create() once, then every frame begin(), draw() for every mesh,
+/// submit() at the end of every pass (with the geometry of the meshes bound)
+/// and end().
+class IndirectRenderer
+{
+public:
+	/// The number of regions of the indirect buffer (triple buffering)
+	static const int FRAMES = 3;
+
+	/// Create an empty renderer (create() must be called before begin())
+	IndirectRenderer()
+		: mBuffer(0), mCommands(nullptr), mMaxCommands(0), mRegion(0), mCount(0), mSubmitted(0)
+	{
+		for (int i = 0; i < FRAMES; ++i)
+			mFences[i] = 0;
+	}
+
+	/// Create and map the indirect buffer, for up to maxCommands commands per
+	/// frame. Return false if the context doesn't support it
+	bool create(GLsizei maxCommands)
+	{
+		if (!isSupported())
+			return false;
+
+		destroy();
+		mMaxCommands = maxCommands;
+		GLsizeiptr size = FRAMES * maxCommands * sizeof(DrawElementsIndirectCommand);
+		const GLbitfield FLAGS = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		glGenBuffers(1, &mBuffer);
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, mBuffer);
+		glBufferStorage(GL_DRAW_INDIRECT_BUFFER, size, nullptr, FLAGS);
+		mCommands = static_cast<DrawElementsIndirectCommand *>(
+			glMapBufferRange(GL_DRAW_INDIRECT_BUFFER, 0, size, FLAGS));
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+
+		if (!mCommands)
+		{
+			destroy();
+			return false;
+		}
+		mRegion = FRAMES - 1;
+		return true;
+	}
+
+	/// Start a frame: move to the next region of the indirect buffer, once
+	/// the GPU is done with it
+	void begin()
+	{
+		assert(mCommands);
+		mRegion = (mRegion + 1) % FRAMES;
+		mCount = 0;
+		mSubmitted = 0;
+
+		GLsync &fence = mFences[mRegion];
+		if (fence == 0)
+			return;
+		GLenum status = glClientWaitSync(fence, 0, 0);
+		while (status == GL_TIMEOUT_EXPIRED)
+			status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000); // 1 ms
+		glDeleteSync(fence);
+		fence = 0;
+	}
+
+	/// Add a draw command. Indices are counted in indices, not bytes
+	void draw(GLuint count, GLuint instanceCount, GLuint firstIndex, GLint baseVertex = 0,
+			  GLuint baseInstance = 0)
+	{
+		assert(mCount < mMaxCommands);
+		DrawElementsIndirectCommand &command = mCommands[mRegion * mMaxCommands + mCount++];
+		command.count = count;
+		command.instanceCount = instanceCount;
+		command.firstIndex = firstIndex;
+		command.baseVertex = baseVertex;
+		command.baseInstance = baseInstance;
+	}
+
+	/// Add a draw command for instanceCount instances of a mesh of an arena
+	void draw(const MeshArena::Mesh &mesh, GLuint instanceCount = 1, GLuint baseInstance = 0)
+	{
+		draw(mesh.count, instanceCount, mesh.firstIndex, mesh.baseVertex, baseInstance);
+	}
+
+	/// Draw the commands added since the last submit() with a single call,
+	/// using the bound vertex format, index buffer and program
+	void submit(GLenum mode, GLenum indexType)
+	{
+		if (mCount == mSubmitted)
+			return;
+
+		size_t offset = (mRegion * mMaxCommands + mSubmitted) * sizeof(DrawElementsIndirectCommand);
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, mBuffer);
+		glMultiDrawElementsIndirect(mode, indexType, reinterpret_cast<const GLvoid *>(offset),
+									mCount - mSubmitted, 0);
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+		mSubmitted = mCount;
+	}
+
+	/// End the frame: the region can be written again once the GPU has
+	/// executed the draws submitted so far
+	void end()
+	{
+		assert(mFences[mRegion] == 0);
+		mFences[mRegion] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	}
+
+	/// Unmap and delete the indirect buffer. It isn't done by a destructor
+	/// because the OpenGL context may be gone by then
+	void destroy()
+	{
+		for (int i = 0; i < FRAMES; ++i)
+		{
+			if (mFences[i] != 0)
+				glDeleteSync(mFences[i]);
+			mFences[i] = 0;
+		}
+		if (mBuffer != 0)
+		{
+			if (mCommands)
+			{
+				glBindBuffer(GL_DRAW_INDIRECT_BUFFER, mBuffer);
+				glUnmapBuffer(GL_DRAW_INDIRECT_BUFFER);
+				glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+			}
+			glDeleteBuffers(1, &mBuffer);
+		}
+		mBuffer = 0;
+		mCommands = nullptr;
+		mMaxCommands = 0;
+	}
+
+	/// Return true once create() has succeeded
+	bool isCreated() const { return mCommands != nullptr; }
+
+	/// Return the number of commands added in the current frame
+	GLsizei getNumCommands() const { return mCount; }
+
+	/// Return true if the current OpenGL context supports persistently mapped
+	/// buffers and multi-draw indirect with a base instance (OpenGL 4.4)
+	static bool isSupported()
+	{
+		return GLEW_ARB_buffer_storage && GLEW_ARB_multi_draw_indirect && GLEW_ARB_base_instance;
+	}
+
+private:
+	GLuint mBuffer;							///< The indirect buffer
+	DrawElementsIndirectCommand *mCommands; ///< Its persistent mapping
+	GLsizei mMaxCommands;					///< The size of a region, in commands
+	GLsync mFences[FRAMES];					///< Signaled when the GPU is done with a region
+	int mRegion;							///< The region of the current frame
+	GLsizei mCount;							///< The commands added in the current frame
+	GLsizei mSubmitted;						///< The commands of the current frame already drawn
+};
+
+#endif
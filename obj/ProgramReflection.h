@@ -0,0 +1,256 @@
+#ifndef __PROGRAM_REFLECTION_H__
+#define __PROGRAM_REFLECTION_H__
+
+#include <GL/glew.h>
+
+#include <cassert>
+#include <cstring>
+#include <string>
+#include <vector>
+
+/// The active uniforms, uniform blocks and vertex attributes of a shader program, read once
+/// after it is linked so that no glGetUniformLocation() is needed per frame.
+///
+/// Uniforms used by the application are registered by name and then referred
+/// to by handle: Uniforms[handle] is the location in the current program. The
+/// handles stay valid when the program is re-linked (e.g. to reload the
+/// shaders), only reflect() has to be called again.
+class ProgramReflection
+{
+public:
+	/// An active uniform or vertex attribute
+	struct Variable
+	{
+		std::string name; ///< the name, without a trailing "[0]" for arrays
+		GLint location;	  ///< the location, -1 inside a uniform block
+		GLenum type;	  ///< the type, e.g. GL_FLOAT_VEC3
+		GLint size;		  ///< the number of array elements, 1 if not an array
+	};
+
+	/// An active uniform block
+	struct Block
+	{
+		std::string name; ///< the name of the block (not of its instance)
+		GLuint index;	  ///< the index to pass to glUniformBlockBinding()
+		GLint dataSize;	  ///< the size of the buffer data needed by the block
+	};
+
+	/// Register the given uniforms, uniform names[i] gets the handle i
+	ProgramReflection(const char *const *names = nullptr, int count = 0) : mProgram(0)
+	{
+		for (int i = 0; i < count; ++i)
+			addUniform(names[i]);
+	}
+
+	/// Register a uniform and return its handle. Its location is -1 while
+	/// the program has no such active uniform (glUniform*() then ignores it)
+	int addUniform(const char *name)
+	{
+		mNames.push_back(name);
+		int variable = mUniforms.find(name);
+		mLocations.push_back(variable < 0 ? -1 : mUniforms.variables[variable].location);
+		return static_cast<int>(mLocations.size()) - 1;
+	}
+
+	/// Read the active variables of a linked program and update the locations
+	/// of the registered uniforms. To be called after every (re-)link
+	void reflect(GLuint program)
+	{
+		mProgram = program;
+		readUniforms();
+		readBlocks();
+		readAttributes();
+
+		for (size_t i = 0; i < mNames.size(); ++i)
+		{
+			int variable = mUniforms.find(mNames[i].c_str());
+			mLocations[i] = (variable < 0) ? -1 : mUniforms.variables[variable].location;
+		}
+	}
+
+	/// Return the location of a registered uniform in the current program
+	GLint operator[](int handle) const
+	{
+		assert(handle >= 0 && handle < static_cast<int>(mLocations.size()));
+		return mLocations[handle];
+	}
+
+	/// Connect the named uniform block to a binding point (the buffer bound
+	/// there with glBindBufferBase/Range() feeds the block). Return false if
+	/// the program has no such active block
+	bool bindBlock(const char *name, GLuint binding) const
+	{
+		int block = mBlocks.find(name);
+		if (block < 0)
+			return false;
+		glUniformBlockBinding(mProgram, mBlocks.variables[block].index, binding);
+		return true;
+	}
+
+	/// Return the index of the named active uniform, -1 if there is none
+	int findUniform(const char *name) const { return mUniforms.find(name); }
+
+	/// Return the index of the named active uniform block, -1 if there is none
+	int findBlock(const char *name) const { return mBlocks.find(name); }
+
+	/// Return the index of the named active vertex attribute, -1 if there is none
+	int findAttribute(const char *name) const { return mAttributes.find(name); }
+
+	/// Return the active uniform with the given index
+	const Variable &getUniform(int i) const { return mUniforms.variables[i]; }
+
+	/// Return the active uniform block with the given index
+	const Block &getBlock(int i) const { return mBlocks.variables[i]; }
+
+	/// Return the active vertex attribute with the given index
+	const Variable &getAttribute(int i) const { return mAttributes.variables[i]; }
+
+	/// Return the number of active uniforms
+	int getNumUniforms() const { return static_cast<int>(mUniforms.variables.size()); }
+
+	/// Return the number of active uniform blocks
+	int getNumBlocks() const { return static_cast<int>(mBlocks.variables.size()); }
+
+	/// Return the number of active vertex attributes
+	int getNumAttributes() const { return static_cast<int>(mAttributes.variables.size()); }
+
+	/// Return the program reflected last
+	GLuint getProgram() const { return mProgram; }
+
+private:
+	/// Variables (or blocks) with an open addressing hash table over their names
+	template <class T>
+	struct Table
+	{
+		std::vector<T> variables;
+		std::vector<int> slots; ///< indices in variables, -1 if empty
+
+		/// Index the variables, the table is kept at most half full
+		void build()
+		{
+			size_t size = 8;
+			while (size < 2 * variables.size())
+				size *= 2;
+			slots.assign(size, -1);
+
+			for (size_t i = 0; i < variables.size(); ++i)
+			{
+				size_t slot = hash(variables[i].name.c_str()) & (size - 1);
+				while (slots[slot] != -1)
+					slot = (slot + 1) & (size - 1);
+				slots[slot] = static_cast<int>(i);
+			}
+		}
+
+		/// Return the index of the named variable, -1 if there is none
+		int find(const char *name) const
+		{
+			if (slots.empty())
+				return -1;
+
+			size_t slot = hash(name) & (slots.size() - 1);
+			while (slots[slot] != -1)
+			{
+				if (variables[slots[slot]].name == name)
+					return slots[slot];
+				slot = (slot + 1) & (slots.size() - 1);
+			}
+			return -1;
+		}
+
+		/// FNV-1a
+		static size_t hash(const char *name)
+		{
+			unsigned int h = 2166136261u;
+			for (; *name; ++name)
+				h = (h ^ static_cast<unsigned char>(*name)) * 16777619u;
+			return h;
+		}
+	};
+
+	/// Read the name, type and size of an active variable. Arrays are
+	/// reported as "name[0]", they are stored as "name"
+	template <class GetActive>
+	static Variable readVariable(GLuint program, GLuint index, std::vector<GLchar> &buffer,
+								 GetActive getActive)
+	{
+		GLsizei length = 0;
+		Variable variable;
+		getActive(program, index, static_cast<GLsizei>(buffer.size()), &length,
+				  &variable.size, &variable.type, &buffer[0]);
+		if (length > 3 && std::strcmp(&buffer[length - 3], "[0]") == 0)
+			length -= 3;
+		variable.name.assign(&buffer[0], length);
+		return variable;
+	}
+
+	/// Read the active uniforms and their locations
+	void readUniforms()
+	{
+		GLint count = 0, maxLength = 0;
+		glGetProgramiv(mProgram, GL_ACTIVE_UNIFORMS, &count);
+		glGetProgramiv(mProgram, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+		std::vector<GLchar> buffer(maxLength + 1);
+
+		mUniforms.variables.clear();
+		for (GLint i = 0; i < count; ++i)
+		{
+			Variable uniform = readVariable(mProgram, i, buffer, glGetActiveUniform);
+			uniform.location = glGetUniformLocation(mProgram, uniform.name.c_str());
+			mUniforms.variables.push_back(uniform);
+		}
+		mUniforms.build();
+	}
+
+	/// Read the active uniform blocks and their sizes
+	void readBlocks()
+	{
+		GLint count = 0, maxLength = 0;
+		glGetProgramiv(mProgram, GL_ACTIVE_UNIFORM_BLOCKS, &count);
+		glGetProgramiv(mProgram, GL_ACTIVE_UNIFORM_BLOCK_MAX_NAME_LENGTH, &maxLength);
+		std::vector<GLchar> buffer(maxLength + 1);
+
+		mBlocks.variables.clear();
+		for (GLint i = 0; i < count; ++i)
+		{
+			GLsizei length = 0;
+			Block block;
+			block.index = i;
+			glGetActiveUniformBlockName(mProgram, i, static_cast<GLsizei>(buffer.size()), &length, &buffer[0]);
+			block.name.assign(&buffer[0], length);
+			glGetActiveUniformBlockiv(mProgram, i, GL_UNIFORM_BLOCK_DATA_SIZE, &block.dataSize);
+			mBlocks.variables.push_back(block);
+		}
+		mBlocks.build();
+	}
+
+	/// Read the active vertex attributes and their locations, the built-in
+	/// ones (e.g. gl_VertexID) are left out
+	void readAttributes()
+	{
+		GLint count = 0, maxLength = 0;
+		glGetProgramiv(mProgram, GL_ACTIVE_ATTRIBUTES, &count);
+		glGetProgramiv(mProgram, GL_ACTIVE_ATTRIBUTE_MAX_LENGTH, &maxLength);
+		std::vector<GLchar> buffer(maxLength + 1);
+
+		mAttributes.variables.clear();
+		for (GLint i = 0; i < count; ++i)
+		{
+			Variable attribute = readVariable(mProgram, i, buffer, glGetActiveAttrib);
+			if (attribute.name.compare(0, 3, "gl_") == 0)
+				continue;
+			attribute.location = glGetAttribLocation(mProgram, attribute.name.c_str());
+			mAttributes.variables.push_back(attribute);
+		}
+		mAttributes.build();
+	}
+
+	GLuint mProgram;				 ///< The program reflected last
+	Table<Variable> mUniforms;		 ///< The active uniforms
+	Table<Block> mBlocks;			 ///< The active uniform blocks
+	Table<Variable> mAttributes;	 ///< The active vertex attributes
+	std::vector<std::string> mNames; ///< The registered uniforms, by handle
+	std::vector<GLint> mLocations;	 ///< Their locations in mProgram, by handle
+};
+
+#endif
@@ -0,0 +1,113 @@
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "model_obj.h"
+
+using namespace std;
+
+/// The number of times every measure is repeated
+int Runs = 10;
+
+/// The models to measure
+vector<string> FileNames;
+
+/// Return the time elapsed since start, in milliseconds
+double elapsed(chrono::steady_clock::time_point start)
+{
+	return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+}
+
+/// Time import() on a single thread, from a copy of the file in memory so
+/// that only the parsing and the building of the vertices are measured, and
+/// print the average
+void benchImport(const string &fileName)
+{
+	ifstream file(fileName.c_str(), ios::binary);
+	vector<char> data((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+	string directory = fileName.substr(0, fileName.find_last_of("/\\") + 1);
+
+	double total = 0.0;
+	int vertices = 0;
+	for (int run = 0; run < Runs; ++run)
+	{
+		ModelOBJ model;
+		model.setNumberOfThreads(1);
+
+		chrono::steady_clock::time_point start = chrono::steady_clock::now();
+		if (data.empty() || !model.import(&data[0], data.size(), false, directory.c_str()))
+		{
+			cerr << "Error: cannot load " << fileName << endl;
+			return;
+		}
+		total += elapsed(start);
+		vertices = model.getNumberOfVertices();
+	}
+	cout << "import() " << fileName << " (" << vertices << " vertices)" << endl;
+	cout << "  " << setw(12) << left << "1 thread" << right << fixed << setprecision(3) << setw(10)
+		 << total / Runs << " ms" << endl;
+}
+
+/// Time generateTangents() with every tangent method, on a freshly imported
+/// model for every run, and print the average
+void benchTangents(const string &fileName)
+{
+	const ModelOBJ::TangentMethod methods[] = {ModelOBJ::TANGENTS_SERIAL, ModelOBJ::TANGENTS_PARALLEL,
+											   ModelOBJ::TANGENTS_MIKKTSPACE};
+	const char *names[] = {"serial", "parallel", "MikkTSpace"};
+
+	cout << "generateTangents() " << fileName << endl;
+	for (int i = 0; i < 3; ++i)
+	{
+		double total = 0.0;
+		for (int run = 0; run < Runs; ++run)
+		{
+			ModelOBJ model;
+			model.setTangentMethod(methods[i]);
+			if (!model.import(fileName.c_str()))
+			{
+				cerr << "Error: cannot load " << fileName << endl;
+				return;
+			}
+
+			chrono::steady_clock::time_point start = chrono::steady_clock::now();
+			model.generateTangents();
+			total += elapsed(start);
+		}
+		cout << "  " << setw(12) << left << names[i] << right << fixed << setprecision(3) << setw(10)
+			 << total / Runs << " ms" << endl;
+	}
+}
+
+/// Parse the command line: [runs] [model.obj ...]
+void parseArguments(int argc, char **argv)
+{
+	int first = 1;
+	if (argc > 1 && atoi(argv[1]) > 0)
+	{
+		Runs = atoi(argv[1]);
+		first = 2;
+	}
+	for (int i = first; i < argc; ++i)
+		FileNames.push_back(argv[i]);
+	if (FileNames.empty())
+		FileNames.push_back("capsule/capsule.obj");
+}
+
+int main(int argc, char **argv)
+{
+	parseArguments(argc, argv);
+	cout << "Average of " << Runs << " runs" << endl;
+
+	for (size_t i = 0; i < FileNames.size(); ++i)
+	{
+		benchImport(FileNames[i]);
+		benchTangents(FileNames[i]);
+	}
+
+	return EXIT_SUCCESS;
+}
@@ -1,15 +1,54 @@
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
 #include <fstream>
 #include <iostream>
 #include <string>
+#include <thread>
+#include <vector>
 
 #include "model_obj.h"
+#include "spsc_queue.h"
 #include "Vector3.h"
+#include "Matrix4.h"
+#include "Geometry.h"
+#include "ProgramReflection.h"
+#include "IndirectRenderer.h"
 
 using namespace std;
 
+/// A simple structure to handle a moving camera (perspective projection)
+struct Camera
+{
+	Vector3f position; ///< the position of the camera
+	Vector3f target;   ///< the direction the camera is looking at
+	Vector3f up;	   ///< the up vector of the camera
+
+	float fov; ///< camera field of view
+	float ar;  ///< camera aspect ratio
+
+	float zNear, zFar; ///< depth of the near and far plane
+
+	float zoom; ///< an additional scaling parameter
+};
+
+/// A model prepared by the loader thread, waiting to be uploaded to the GPU
+struct ModelUpload
+{
+	ModelOBJ *model; ///< the model, null if it couldn't be loaded
+	vector<unsigned char> vertices; ///< the packed vertices
+	GLsizei vertexStride; ///< the size of a packed vertex
+	ModelOBJ::AttributePointer vertexAttributes[ModelOBJ::NUMBER_OF_ATTRIBUTES]; ///< the packed vertex format
+	GLsizeiptr indexBytes; ///< the size of the full detail indices
+	GLsizeiptr lodIndexBytes; ///< the size of the level of detail indices
+	GLsizeiptr uploaded; ///< the bytes uploaded so far
+	GLuint vbo, ibo; ///< the buffers being filled
+};
+
 // --- OpenGL callbacks ---------------------------------------------------------------------------
 void display(GLFWwindow *);
 void idle(GLFWwindow *);
@@ -18,18 +57,49 @@ void mouse(GLFWwindow *, int, int, int);
 void motion(GLFWwindow *, double, double);
 
 // --- Other methods ------------------------------------------------------------------------------
-bool initMesh();
+void loadModel(string);
+void uploadModels();
+bool uploadSlice(ModelUpload &);
+void drawRanges();
 bool initShaders();
+Matrix4f computeCameraTransform(const Camera &);
+void pick(GLFWwindow *, double, double);
 string readTextFile(const string &);
 
 // --- Global variables ---------------------------------------------------------------------------
 // 3D model
-ModelOBJ Model; ///< A 3D model
-GLuint VBO = 0; ///< A vertex buffer object
-GLuint IBO = 0; ///< An index buffer object
+ModelOBJ *Model = nullptr; ///< A 3D model (null until it has been loaded and uploaded)
+Geometry ModelGeometry; ///< The VBO and IBO of the model and its packed vertex format
+GLenum IndexType = GL_UNSIGNED_INT; ///< The type of the indices in the IBO
+int CurrentLod = 0; ///< The level of detail drawn (0 is the full detail model)
+
+// Meshlet culling
+bool CullMeshlets = true;			  ///< Draw only the meshlets that may be visible
+vector<int> VisibleMeshlets;		  ///< The meshlets that passed the culling test
+vector<GLsizei> DrawCounts;			  ///< The index counts of the culled draw
+vector<const GLvoid *> DrawOffsets; ///< The index buffer offsets of the culled draw
+vector<ModelOBJ::Draw> Draws;		  ///< The visible meshes sorted by state, without meshlet culling
+
+// Indirect rendering: the ranges drawn are written to a persistently mapped
+// indirect buffer instead of being passed to glMultiDrawElements()
+bool UseIndirect = false;	  ///< Draw with ModelCommands (toggled with I)
+IndirectRenderer ModelCommands; ///< The draw commands of the model, written every frame
+
+// Background loading
+thread LoaderThread;						///< Loads and prepares the model
+atomic<bool> StopLoading(false);			///< Asks the loader thread to give up
+SpscQueue<ModelUpload *> LoadedModels(4);	///< Models ready for upload, from the loader thread
+ModelUpload *CurrentUpload = nullptr;		///< The model being uploaded
+const double UploadBudget = 0.002;			///< The time spent uploading per frame, in seconds
+const GLsizeiptr UploadSliceSize = 256 * 1024; ///< The bytes uploaded per glBufferSubData() call
 
 // Shaders
 GLuint ShaderProgram = 0; ///< A shader program
+ProgramReflection Uniforms; ///< The active uniforms of ShaderProgram (updated by initShaders())
+const int TransformationUniform = Uniforms.addUniform("transformation"); ///< Uniforms[] handle
+
+// Camera
+Camera Cam;
 
 // Vertex transformation
 Vector3f Translation; ///< Translation
@@ -74,6 +144,16 @@ int main(int argc, char **argv)
 
 	Translation.set(0, 0, 0);
 	Scaling = 1.0f;
+
+	// Camera
+	Cam.position.set(0.f, 0.f, 5.f);
+	Cam.target.set(0.f, 0.f, -1.f);
+	Cam.up.set(0.f, 1.f, 0.f);
+	Cam.fov = 30.f;
+	Cam.ar = 1.f; // will be correctly initialized in the "display()" method
+	Cam.zNear = 0.1f;
+	Cam.zFar = 100.f;
+	Cam.zoom = 1.f;
 	// Initialize program variables
 	// OpenGL
 	glClearColor(0.1f, 0.3f, 0.1f, 0.0f); // background color
@@ -83,16 +163,38 @@ int main(int argc, char **argv)
 	glCullFace(GL_BACK);				  // back-faces should be removed
 	glPolygonMode(GL_FRONT, GL_LINE);	  // draw polygons as wireframe
 
-	if (!initShaders() || !initMesh())
+	if (!initShaders())
 		return -1;
 
+	// Load the model in the background, the first frames are drawn while
+	// it is parsed and uploaded
+	LoaderThread = thread(loadModel, string("capsule/capsule.obj"));
+
 	while (!glfwWindowShouldClose(window))
 	{
+		uploadModels();
 		display(window);
 		// idle();
 		glfwPollEvents();
 	}
 
+	// Cancel the loading if it hasn't finished yet
+	StopLoading = true;
+	LoaderThread.join();
+
+	ModelUpload *upload = nullptr;
+	while (LoadedModels.pop(upload))
+	{
+		delete upload->model;
+		delete upload;
+	}
+	if (CurrentUpload)
+	{
+		delete CurrentUpload->model;
+		delete CurrentUpload;
+	}
+	delete Model;
+
 	glfwDestroyWindow(window);
 	glfwTerminate();
 
@@ -107,43 +209,98 @@ void display(GLFWwindow *window)
 	// Clear the screen
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
+	int width, height;
+	glfwGetWindowSize(window, &width, &height);
+
+	glViewport(0, 0, width, height);
+
+	// Nothing to draw until the model has been uploaded
+	if (!Model)
+	{
+		glfwSwapBuffers(window);
+		return;
+	}
+
 	// Enable the shader program
 	assert(ShaderProgram != 0);
 	glUseProgram(ShaderProgram);
 
-	// Set translation and scaling
-	GLint trULocation = glGetUniformLocation(ShaderProgram, "translation");
-	GLint sULocation = glGetUniformLocation(ShaderProgram, "scaling");
-	assert(trULocation != -1 && sULocation != -1);
-	glUniform3fv(trULocation, 1, Translation.get());
-	glUniform1f(sULocation, Scaling);
-
-	// Enable the vertex attributes and set their format
-	glEnableVertexAttribArray(0);
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE,
-						  sizeof(ModelOBJ::Vertex),
-						  reinterpret_cast<const GLvoid *>(0));
-
-	/*
-	glEnableVertexAttribArray(1);
-	glVertexAttribPointer(1, 2,	GL_FLOAT, GL_FALSE,
-		sizeof(ModelOBJ::Vertex),
-		reinterpret_cast<const GLvoid*>(sizeof(Vector3f)));*/
-
-	// Bind the buffers
-	glBindBuffer(GL_ARRAY_BUFFER, VBO);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, IBO);
-
-	// Draw the elements on the GPU
-	glDrawElements(
-		GL_TRIANGLES,
-		Model.getNumberOfIndices(),
-		GL_UNSIGNED_INT,
-		0);
-
-	// Disable the vertex attributes (not necessary but recommended)
-	glDisableVertexAttribArray(0);
-	glDisableVertexAttribArray(1);
+	// Set the transformation: the model is scaled and translated, then seen
+	// through the camera
+	Cam.ar = (1.0f * width) / height;
+	Matrix4f transformation = computeCameraTransform(Cam) *
+							  Matrix4f::createTranslation(Translation) *
+							  Matrix4f::createScaling(Scaling, Scaling, Scaling);
+
+	assert(Uniforms[TransformationUniform] != -1);
+	glUniformMatrix4fv(Uniforms[TransformationUniform], 1, GL_FALSE, transformation.get());
+
+	// Bind the buffers and the vertex format, recorded once when the model
+	// was uploaded
+	ModelGeometry.bind();
+	if (UseIndirect)
+		ModelCommands.begin();
+
+	// Draw the elements on the GPU (the levels of detail follow the full
+	// detail indices in the IBO). Culling needs the camera position in the
+	// model's coordinates.
+	Vector3f cameraPosition = (Cam.position - Translation) / Scaling;
+	if (CurrentLod == 0 && CullMeshlets && Model->getNumberOfMeshlets() > 0)
+	{
+		// Cull the meshlets on the CPU and draw the visible ones in a single
+		// call. Neighbouring meshlets are merged into one range.
+		VisibleMeshlets.resize(Model->getNumberOfMeshlets());
+		int visible = Model->cullMeshlets(transformation.get(), cameraPosition.get(), &VisibleMeshlets[0]);
+
+		DrawCounts.clear();
+		DrawOffsets.clear();
+		int end = -1;
+		for (int i = 0; i < visible; ++i)
+		{
+			const ModelOBJ::Meshlet &meshlet = Model->getMeshlet(VisibleMeshlets[i]);
+			if (meshlet.startIndex == end)
+				DrawCounts.back() += 3 * meshlet.triangleCount;
+			else
+			{
+				DrawCounts.push_back(3 * meshlet.triangleCount);
+				DrawOffsets.push_back(reinterpret_cast<const GLvoid *>(
+					static_cast<size_t>(meshlet.startIndex) * Model->getIndexSize()));
+			}
+			end = meshlet.startIndex + 3 * meshlet.triangleCount;
+		}
+
+		drawRanges();
+	}
+	else
+	{
+		// Cull whole meshes and sort them by state, opaque ones front to
+		// back. Consecutive draws with the same material go into one call,
+		// so a material's state would only be set once per call.
+		Model->buildDrawList(cameraPosition.get(), Draws, transformation.get(), CurrentLod);
+
+		size_t first = (CurrentLod > 0) ? Model->getNumberOfIndices() : 0;
+		DrawCounts.clear();
+		DrawOffsets.clear();
+		for (size_t i = 0; i < Draws.size(); ++i)
+		{
+			DrawCounts.push_back(3 * Draws[i].triangleCount);
+			DrawOffsets.push_back(reinterpret_cast<const GLvoid *>(
+				(first + Draws[i].startIndex) * Model->getIndexSize()));
+
+			if (i + 1 == Draws.size() || Draws[i + 1].pMaterial != Draws[i].pMaterial)
+			{
+				drawRanges();
+				DrawCounts.clear();
+				DrawOffsets.clear();
+			}
+		}
+	}
+
+	// Unbind the geometry (necessary: uploadModels() binds other index
+	// buffers, which would otherwise replace the model's one)
+	if (UseIndirect)
+		ModelCommands.end();
+	ModelGeometry.unbind();
 
 	// Disable the shader program (not necessary but recommended)
 	glUseProgram(0);
@@ -162,11 +319,32 @@ void keyboard(GLFWwindow *window, int key, int scancode, int action, int mods)
 {
 	switch (key)
 	{
+	case GLFW_KEY_C: // toggle the meshlet culling
+		if (action == GLFW_PRESS)
+		{
+			CullMeshlets = !CullMeshlets;
+			cout << "Meshlet culling " << (CullMeshlets ? "on" : "off") << endl;
+		}
+		break;
+	case GLFW_KEY_I: // toggle the indirect rendering
+		if (action == GLFW_PRESS)
+		{
+			UseIndirect = !UseIndirect && ModelCommands.isCreated();
+			cout << "Indirect rendering " << (UseIndirect ? "on" : "off") << endl;
+		}
+		break;
 	case GLFW_KEY_G: // show the current OpenGL version
 		cout << "OpenGL version " << glGetString(GL_VERSION) << endl;
 		break;
-	case GLFW_KEY_Q: // terminate the application
-		exit(0);
+	case GLFW_KEY_Q: // terminate the application (after stopping the loader thread)
+		glfwSetWindowShouldClose(window, GLFW_TRUE);
+		break;
+	case GLFW_KEY_L: // switch to the next level of detail
+		if (Model && action == GLFW_PRESS)
+		{
+			CurrentLod = (CurrentLod + 1) % (Model->getNumberOfLevelsOfDetail() + 1);
+			cout << "Level of detail " << CurrentLod << endl;
+		}
 		break;
 	case GLFW_KEY_R:
 		cout << "Re-loading shaders..." << endl;
@@ -185,6 +363,10 @@ void mouse(GLFWwindow *window, int button, int action, int mods)
 	{
 		MouseButton = button;
 		glfwGetCursorPos(window, &MouseX, &MouseY);
+
+		// Left click picks a triangle
+		if (Model && button == GLFW_MOUSE_BUTTON_LEFT)
+			pick(window, MouseX, MouseY);
 	}
 }
 
@@ -213,51 +395,229 @@ void motion(GLFWwindow *window, double xpos, double ypos)
 
 // ************************************************************************************************
 // *** Other methods implementation ***************************************************************
-/// Initialize buffer objects
-bool initMesh()
+/// Load and prepare the specified model. Runs on the loader thread, which
+/// hands the result over to the render loop through LoadedModels
+void loadModel(string fileName)
 {
+	ModelUpload *upload = new ModelUpload();
+	ModelOBJ *model = new ModelOBJ();
+
+	// Read the OBJ file a window at a time so a large file can be abandoned
+	// quickly when the application is closed
+	model->setImportWindowSize(16 << 20);
+	model->setImportCallback([](float, void *) { return !StopLoading; });
+
 	// Load the OBJ model
-	if (!Model.import("capsule/capsule.obj"))
+	if (!model->importCached(fileName.c_str()))
 	{
-		cerr << "Error: cannot load model." << endl;
-		return false;
+		if (!StopLoading)
+			cerr << "Error: cannot load model." << endl;
+		delete model;
+		model = nullptr;
 	}
 
-	// Notice that normals may not be stored in the model
-	// This issue will be dealt with in the next lecture
+	if (model)
+	{
+		// Reorder the triangles for the GPU's post-transform vertex cache and
+		// to reduce overdraw, group them into meshlets for culling, then reorder
+		// the vertices for fetch locality
+		ModelOBJ::PostTransformCacheStatistics before = model->getPostTransformCacheStatistics();
+		ModelOBJ::VertexFetchStatistics fetchBefore = model->getVertexFetchStatistics();
+		model->optimizePostTransformCache();
+		model->optimizeOverdraw();
+		model->buildMeshlets();
+		model->optimizeVertexFetch();
+		model->generateLevelsOfDetail(4);
+		model->buildBvh(); // for picking
+		ModelOBJ::PostTransformCacheStatistics after = model->getPostTransformCacheStatistics();
+		ModelOBJ::VertexFetchStatistics fetchAfter = model->getVertexFetchStatistics();
+		cout << "Vertex cache: ACMR " << before.acmr << " -> " << after.acmr
+			 << ", ATVR " << before.atvr << " -> " << after.atvr
+			 << ", overfetch " << fetchBefore.overfetch << " -> " << fetchAfter.overfetch << endl;
+
+		// Notice that normals may not be stored in the model
+		// This issue will be dealt with in the next lecture
+
+		// Pack the vertices: the shader only reads positions, so upload them as
+		// half floats (8 bytes per vertex instead of the 60 of ModelOBJ::Vertex)
+		ModelOBJ::VertexFormat format;
+		format.encodings[ModelOBJ::ATTRIBUTE_POSITION] = ModelOBJ::ENCODING_HALF_FLOAT;
+		format.encodings[ModelOBJ::ATTRIBUTE_TEXCOORD] = ModelOBJ::ENCODING_NONE;
+		format.encodings[ModelOBJ::ATTRIBUTE_NORMAL] = ModelOBJ::ENCODING_NONE;
+		format.encodings[ModelOBJ::ATTRIBUTE_TANGENT] = ModelOBJ::ENCODING_NONE;
+
+		upload->vertexStride = model->packVertices(format, upload->vertices, upload->vertexAttributes);
+		if (upload->vertexStride == 0)
+		{
+			cerr << "Error: cannot pack the vertices." << endl;
+			delete model;
+			model = nullptr;
+		}
+	}
 
-	// VBO
-	glGenBuffers(1, &VBO);
-	glBindBuffer(GL_ARRAY_BUFFER, VBO);
-	glBufferData(GL_ARRAY_BUFFER,
-				 Model.getNumberOfVertices() * sizeof(ModelOBJ::Vertex),
-				 Model.getVertexBuffer(),
-				 GL_STATIC_DRAW);
+	upload->model = model;
+	if (model)
+	{
+		upload->indexBytes = model->getNumberOfIndices() * model->getIndexSize();
+		upload->lodIndexBytes = model->getNumberOfLodIndices() * model->getIndexSize();
+	}
 
-	// IBO
-	glGenBuffers(1, &IBO);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, IBO);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER,
-				 3 * Model.getNumberOfTriangles() * sizeof(int),
-				 Model.getIndexBuffer(),
-				 GL_STATIC_DRAW);
+	// Wait for room in the queue (it only fills up if the render loop falls
+	// far behind)
+	while (!LoadedModels.push(upload))
+	{
+		if (StopLoading)
+		{
+			delete model;
+			delete upload;
+			return;
+		}
+		this_thread::sleep_for(chrono::milliseconds(1));
+	}
+} /* loadModel() */
 
-	return true;
-} /* initBuffers() */
+/// Upload the models the loader thread has finished, spending at most
+/// UploadBudget seconds per frame so that the frame rate doesn't drop
+void uploadModels()
+{
+	double start = glfwGetTime();
 
-/// Initialize shaders. Return false if initialization fail
-bool initShaders()
+	do
+	{
+		// Start on the next model
+		if (!CurrentUpload)
+		{
+			if (!LoadedModels.pop(CurrentUpload))
+				return;
+
+			if (!CurrentUpload->model)
+			{
+				delete CurrentUpload;
+				CurrentUpload = nullptr;
+				continue;
+			}
+
+			// Allocate the buffers, their content is uploaded in slices
+			glGenBuffers(1, &CurrentUpload->vbo);
+			glBindBuffer(GL_ARRAY_BUFFER, CurrentUpload->vbo);
+			glBufferData(GL_ARRAY_BUFFER, CurrentUpload->vertices.size(), 0, GL_STATIC_DRAW);
+
+			glGenBuffers(1, &CurrentUpload->ibo);
+			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, CurrentUpload->ibo);
+			glBufferData(GL_ELEMENT_ARRAY_BUFFER,
+						 CurrentUpload->indexBytes + CurrentUpload->lodIndexBytes,
+						 0,
+						 GL_STATIC_DRAW);
+			CurrentUpload->uploaded = 0;
+		}
+
+		if (!uploadSlice(*CurrentUpload))
+			continue;
+
+		// The model is complete: replace the one being drawn
+		if (Model)
+		{
+			GLuint vbo = ModelGeometry.getVBO();
+			GLuint ibo = ModelGeometry.getIBO();
+			glDeleteBuffers(1, &vbo);
+			glDeleteBuffers(1, &ibo);
+			ModelGeometry.destroy();
+			delete Model;
+		}
+
+		Model = CurrentUpload->model;
+
+		// Record the packed vertex format, attribute i goes to location i
+		for (int i = 0; i < ModelOBJ::NUMBER_OF_ATTRIBUTES; ++i)
+		{
+			const ModelOBJ::AttributePointer &attribute = CurrentUpload->vertexAttributes[i];
+			if (attribute.size > 0)
+				ModelGeometry.addAttribute(i, attribute.size, attribute.type,
+										   attribute.normalized ? GL_TRUE : GL_FALSE,
+										   CurrentUpload->vertexStride, attribute.offset);
+		}
+		ModelGeometry.create(CurrentUpload->vbo, CurrentUpload->ibo);
+
+		// The indirect buffer holds a command per range drawn: at most one
+		// per meshlet, or per mesh without meshlet culling
+		if (!ModelCommands.create(max(Model->getNumberOfMeshlets(), Model->getNumberOfMeshes())))
+			UseIndirect = false;
+
+		// 16 bit indices whenever the model has few enough vertices
+		IndexType = (Model->getIndexSize() == 2) ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+		CurrentLod = 0;
+
+		cout << "Model ready after " << glfwGetTime() << " s" << endl;
+
+		delete CurrentUpload;
+		CurrentUpload = nullptr;
+	} while (glfwGetTime() - start < UploadBudget);
+} /* uploadModels() */
+
+/// Draw the ranges of indices of DrawCounts and DrawOffsets with a single
+/// call, from the indirect buffer with UseIndirect
+void drawRanges()
 {
-	// Create the shader program and check for errors
-	if (ShaderProgram != 0)
-		glDeleteProgram(ShaderProgram);
-	ShaderProgram = glCreateProgram();
-	if (ShaderProgram == 0)
+	if (DrawCounts.empty())
+		return;
+
+	if (!UseIndirect)
 	{
-		cerr << "Error: cannot create shader program." << endl;
-		return false;
+		glMultiDrawElements(
+			GL_TRIANGLES,
+			&DrawCounts[0],
+			IndexType,
+			&DrawOffsets[0],
+			static_cast<GLsizei>(DrawCounts.size()));
+		return;
+	}
+
+	// The commands count the first index in indices, not bytes
+	for (size_t i = 0; i < DrawCounts.size(); ++i)
+		ModelCommands.draw(DrawCounts[i], 1,
+						   static_cast<GLuint>(reinterpret_cast<size_t>(DrawOffsets[i]) / Model->getIndexSize()));
+	ModelCommands.submit(GL_TRIANGLES, IndexType);
+} /* drawRanges() */
+
+/// Upload the next UploadSliceSize bytes of the model: the vertices to the
+/// VBO, then the indices followed by the indices of the levels of detail to
+/// the IBO. Return true once everything has been uploaded
+bool uploadSlice(ModelUpload &upload)
+{
+	GLsizeiptr vertexBytes = static_cast<GLsizeiptr>(upload.vertices.size());
+	GLsizeiptr offset = upload.uploaded;
+	GLsizeiptr size = 0;
+
+	if (offset < vertexBytes)
+	{
+		size = min(UploadSliceSize, vertexBytes - offset);
+		glBindBuffer(GL_ARRAY_BUFFER, upload.vbo);
+		glBufferSubData(GL_ARRAY_BUFFER, offset, size, &upload.vertices[offset]);
+	}
+	else if (offset < vertexBytes + upload.indexBytes)
+	{
+		offset -= vertexBytes;
+		size = min(UploadSliceSize, upload.indexBytes - offset);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, upload.ibo);
+		glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, offset, size,
+						static_cast<const char *>(upload.model->getIndexData()) + offset);
+	}
+	else if (offset < vertexBytes + upload.indexBytes + upload.lodIndexBytes)
+	{
+		offset -= vertexBytes + upload.indexBytes;
+		size = min(UploadSliceSize, upload.lodIndexBytes - offset);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, upload.ibo);
+		glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, upload.indexBytes + offset, size,
+						static_cast<const char *>(upload.model->getLodIndexData()) + offset);
 	}
 
+	upload.uploaded += size;
+	return upload.uploaded == vertexBytes + upload.indexBytes + upload.lodIndexBytes;
+} /* uploadSlice() */
+
+/// Initialize shaders. Return false if initialization fail
+bool initShaders()
+{
 	// Create the shader objects and check for errors
 	GLuint vertShader = glCreateShader(GL_VERTEX_SHADER);
 	GLuint fragShader = glCreateShader(GL_FRAGMENT_SHADER);
@@ -307,34 +667,50 @@ bool initShaders()
 		return false;
 	}
 
+	// Create the shader program and check for errors
+	GLuint program = glCreateProgram();
+	if (program == 0)
+	{
+		cerr << "Error: cannot create shader program." << endl;
+		return false;
+	}
+
 	// Attach the shader to the program and link it
-	glAttachShader(ShaderProgram, vertShader);
-	glAttachShader(ShaderProgram, fragShader);
-	glLinkProgram(ShaderProgram);
+	glAttachShader(program, vertShader);
+	glAttachShader(program, fragShader);
+	glLinkProgram(program);
 
 	// Check for linking error
-	glGetProgramiv(ShaderProgram, GL_LINK_STATUS, &success);
+	glGetProgramiv(program, GL_LINK_STATUS, &success);
 	if (!success)
 	{
-		glGetProgramInfoLog(ShaderProgram, 1024, nullptr, errorLog);
+		glGetProgramInfoLog(program, 1024, nullptr, errorLog);
 		cerr << "Error: cannot link shader program.\nError log:\n"
 			 << errorLog << endl;
+		glDeleteProgram(program);
 		return false;
 	}
 
 	// Make sure that the shader program can run
-	glValidateProgram(ShaderProgram);
+	glValidateProgram(program);
 
 	// Check for validation error
-	glGetProgramiv(ShaderProgram, GL_VALIDATE_STATUS, &success);
+	glGetProgramiv(program, GL_VALIDATE_STATUS, &success);
 	if (!success)
 	{
-		glGetProgramInfoLog(ShaderProgram, 1024, nullptr, errorLog);
+		glGetProgramInfoLog(program, 1024, nullptr, errorLog);
 		cerr << "Error: cannot validate shader program.\nError log:\n"
 			 << errorLog << endl;
+		glDeleteProgram(program);
 		return false;
 	}
 
+	// Replace the program in use and read its active uniforms
+	if (ShaderProgram != 0)
+		glDeleteProgram(ShaderProgram);
+	ShaderProgram = program;
+	Uniforms.reflect(ShaderProgram);
+
 	// Shaders can be deleted now
 	glDeleteShader(vertShader);
 	glDeleteShader(fragShader);
@@ -342,6 +718,78 @@ bool initShaders()
 	return true;
 } /* initShaders() */
 
+/// Return the transformation matrix corresponding to the specified camera
+Matrix4f computeCameraTransform(const Camera &cam)
+{
+	// camera rotation
+	Vector3f t = cam.target.getNormalized();
+	Vector3f u = cam.up.getNormalized();
+	Vector3f r = t.cross(u);
+	Matrix4f camR(r.x(), r.y(), r.z(), 0.f,
+				  u.x(), u.y(), u.z(), 0.f,
+				  -t.x(), -t.y(), -t.z(), 0.f,
+				  0.f, 0.f, 0.f, 1.f);
+
+	// camera translation
+	Matrix4f camT = Matrix4f::createTranslation(-cam.position);
+
+	// perspective projection
+	Matrix4f prj = Matrix4f::createPerspectivePrj(cam.fov, cam.ar, cam.zNear, cam.zFar);
+
+	// scaling due to zooming
+	Matrix4f camZoom = Matrix4f::createScaling(cam.zoom, cam.zoom, 1.f);
+
+	// Final transformation. Notice the multiplication order
+	// First vertices are moved in camera space
+	// Then the perspective projection puts them in clip space
+	// And a final zooming factor is applied in clip space
+	return camZoom * prj * camR * camT;
+
+} /* computeCameraTransform() */
+
+/// Print the triangle of the model under the specified window position
+void pick(GLFWwindow *window, double x, double y)
+{
+	int width, height;
+	glfwGetWindowSize(window, &width, &height);
+
+	// Direction of the ray through the position (the inverse of the camera
+	// transformation computed in computeCameraTransform())
+	float tanHalfFov = tanf(Cam.fov * 3.14159265f / 360.f);
+	float px = static_cast<float>(2.0 * x / width - 1.0) * tanHalfFov * Cam.ar / Cam.zoom;
+	float py = static_cast<float>(1.0 - 2.0 * y / height) * tanHalfFov / Cam.zoom;
+	Vector3f t = Cam.target.getNormalized();
+	Vector3f u = Cam.up.getNormalized();
+	Vector3f r = t.cross(u);
+	Vector3f direction = (t + r * px + u * py).getNormalized();
+
+	// Trace the ray in the model's coordinates
+	Vector3f origin = (Cam.position - Translation) / Scaling;
+	ModelOBJ::RayHit hit;
+	if (!Model->intersectRay(origin.get(), direction.get(), hit))
+	{
+		cout << "Nothing picked" << endl;
+		return;
+	}
+
+	const ModelOBJ::Mesh *picked = nullptr;
+	for (int i = 0; i < Model->getNumberOfMeshes(); ++i)
+	{
+		const ModelOBJ::Mesh &mesh = Model->getMesh(i);
+		if (3 * hit.triangle >= mesh.startIndex && 3 * hit.triangle < mesh.startIndex + 3 * mesh.triangleCount)
+			picked = &mesh;
+	}
+
+	cout << "Picked triangle " << hit.triangle;
+	if (picked)
+	{
+		const ModelOBJ::Group &group = Model->getGroup(picked->group);
+		cout << " (material " << picked->pMaterial->name << ", object '"
+			 << Model->getObject(group.object).name << "', group '" << group.name << "')";
+	}
+	cout << " at distance " << hit.t * Scaling << endl;
+} /* pick() */
+
 /// Read the specified file and return its content
 string readTextFile(const string &pathAndFileName)
 {
@@ -23,288 +23,6251 @@
 // The methods normalize() and scale() are based on source code from
 // http://www.mvps.org/directx/articles/scalemesh9.htm.
 //
-// The addVertex() method is based on source code from the Direct3D MeshFromOBJ
-// sample found in the DirectX SDK.
+// The addVertex() method was originally based on source code from the
+// Direct3D MeshFromOBJ sample found in the DirectX SDK.
 //
 // The generateTangents() method is based on public source code from
 // http://www.terathon.com/code/tangent.php.
 //
-// The importGeometryFirstPass(), importGeometrySecondPass(), and
-// importMaterials() methods are based on source code from Nate Robins' OpenGL
-// Tutors programs (http://www.xmission.com/~nate/tutors.html).
+// The generateTangentsMikkTSpace() method follows Morten S. Mikkelsen's
+// MikkTSpace reference implementation (http://www.mikktspace.com/).
+//
+// The importGeometry() and importMaterials() methods are based on source code
+// from Nate Robins' OpenGL Tutors programs
+// (http://www.xmission.com/~nate/tutors.html).
 //
 //-----------------------------------------------------------------------------
 
-#define _CRT_SECURE_NO_WARNINGS // suppress warnings for unsafe methods
+#define _CRT_SECURE_NO_WARNINGS // suppress warnings for unsafe methods
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <string>
+#include "model_obj.h"
+#include "thread_pool.h"
+
+#include <sys/stat.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define MODEL_OBJ_SSE2
+#include <emmintrin.h>
+#endif
+
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+    // Face formats. The format of a face is taken from its first corner and
+    // all following corners of the same face are read with that format.
+    enum TriangleType
+    {
+        TRIANGLE_POS,                   // v
+        TRIANGLE_POS_TEXCOORD,          // v/vt
+        TRIANGLE_POS_NORMAL,            // v//vn
+        TRIANGLE_POS_TEXCOORD_NORMAL    // v/vt/vn
+    };
+
+    // Windows smaller than this are always scanned on a single thread.
+    const size_t OBJ_MIN_CHUNK_SIZE = 256 * 1024;
+
+    // A triangulated face with its zero based OBJ indices. Relative indices
+    // are stored relative to the start of the chunk they were read from and
+    // flagged in 'relative' until the chunk's offsets are known. Corner k
+    // uses bit 3k for v, 3k + 1 for vt and 3k + 2 for vn. FACE_CONTINUED is
+    // set on every triangle of a polygon but the first.
+    //
+    // 'smoothing' is the number of the last 's' line, 0 for 's off', -1 if
+    // the file has no 's' line before the face, or SMOOTHING_INHERITED if
+    // it was set by an earlier chunk.
+    struct ObjTriangle
+    {
+        int v[3];
+        int vt[3];
+        int vn[3];
+        int material;
+        int group;
+        int smoothing;
+        int type;
+        int relative;
+    };
+
+    const int RELATIVE_INDICES = (1 << 9) - 1;
+    const int FACE_CONTINUED = 1 << 9;
+    const int SMOOTHING_INHERITED = -2;
+
+    // The records read from one line aligned range of the OBJ file.
+    struct ObjChunk
+    {
+        const char *pBegin;
+        const char *pEnd;
+
+        std::vector<float> vertexCoords;
+        std::vector<float> textureCoords;
+        std::vector<float> normals;
+        std::vector<ObjTriangle> triangles;
+
+        // 'usemtl' names in order of first use. A triangle's material is an
+        // index into this array, or -1 if the material was set by an earlier
+        // chunk.
+        std::vector<std::string> materialNames;
+        std::vector<std::string> materialLibraries;
+        int activeMaterial;
+
+        // The names of the 'o' and 'g' lines, and the (object, group) name
+        // pairs that faces were read with. A triangle's group is an index
+        // into 'groups', or -1 if the group was set by an earlier chunk. A
+        // name index of -1 likewise refers to the name at the end of the
+        // previous chunk.
+        std::vector<std::string> objectNames;
+        std::vector<std::string> groupNames;
+        std::vector<std::pair<int, int> > groups;
+        int activeObject;
+        int activeGroup;
+        int activeSmoothing;
+
+        // Filled in when the chunks are merged. The ids are the material
+        // slots of ModelOBJ::importGeometry() and indices of its groups.
+        std::vector<int> materialIds;
+        std::vector<int> groupIds;
+        int inheritedMaterial;
+        int inheritedGroup;
+        int inheritedSmoothing;
+        int firstVertex;
+        int firstTexCoord;
+        int firstNormal;
+        int firstTriangle;
+    };
+
+    const float g_powersOf10[] =
+    {
+        1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f, 1e6f, 1e7f, 1e8f, 1e9f, 1e10f
+    };
+
+    inline bool IsDigit(char c)
+    {
+        return c >= '0' && c <= '9';
+    }
+
+    inline bool IsSpace(char c)
+    {
+        return c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+    }
+
+    inline const char *SkipSpaces(const char *p, const char *pEnd)
+    {
+        while (p != pEnd && IsSpace(*p))
+            ++p;
+
+        return p;
+    }
+
+    inline const char *SkipToken(const char *p, const char *pEnd)
+    {
+        while (p != pEnd && !IsSpace(*p) && *p != '\n')
+            ++p;
+
+        return p;
+    }
+
+    inline const char *SkipLine(const char *p, const char *pEnd)
+    {
+        const char *pNewline = static_cast<const char *>(memchr(p, '\n', pEnd - p));
+        return pNewline ? pNewline + 1 : pEnd;
+    }
+
+    // Parses a decimal integer with an optional sign. On failure, which
+    // includes values too large for an int, 'p' is left untouched and false
+    // is returned.
+    bool ParseInt(const char *&p, const char *pEnd, int &value)
+    {
+        const int maximum = std::numeric_limits<int>::max();
+        const char *pCur = p;
+        bool negative = false;
+        int result = 0;
+
+        if (pCur != pEnd && (*pCur == '-' || *pCur == '+'))
+            negative = (*pCur++ == '-');
+
+        if (pCur == pEnd || !IsDigit(*pCur))
+            return false;
+
+        while (pCur != pEnd && IsDigit(*pCur))
+        {
+            int digit = *pCur++ - '0';
+
+            if (result > (maximum - digit) / 10)
+                return false;
+
+            result = result * 10 + digit;
+        }
+
+        value = negative ? -result : result;
+        p = pCur;
+        return true;
+    }
+
+    // Parses a floating point number without going through the C runtime.
+    // Numbers whose significant digits fit in 24 bits and that have a small
+    // decimal exponent (which covers what OBJ exporters write) are converted
+    // with a single correctly rounded float multiplication or division.
+    // Anything else is handed to strtof() so the result always matches what
+    // fscanf() returns.
+    bool ParseFloat(const char *&p, const char *pEnd, float &value)
+    {
+        const char *pCur = p;
+        bool negative = false;
+        bool exact = true;
+        unsigned long long mantissa = 0;
+        int digits = 0;
+        int exponent = 0;
+        int pendingZeros = 0;
+        int numDigits = 0;
+
+        if (pCur != pEnd && (*pCur == '-' || *pCur == '+'))
+            negative = (*pCur++ == '-');
+
+        while (pCur != pEnd && IsDigit(*pCur))
+        {
+            mantissa = mantissa * 10 + (*pCur++ - '0');
+            ++numDigits;
+
+            if (mantissa != 0 && ++digits > 18)
+                exact = false;
+        }
+
+        if (pCur != pEnd && *pCur == '.')
+        {
+            ++pCur;
+
+            while (pCur != pEnd && IsDigit(*pCur))
+            {
+                int digit = *pCur++ - '0';
+                ++numDigits;
+
+                // Trailing zeros are only applied once a non zero digit
+                // follows them, so "1.500000" is read as 15e-1.
+                if (digit == 0)
+                {
+                    ++pendingZeros;
+                    continue;
+                }
+
+                for (; pendingZeros > 0; --pendingZeros)
+                {
+                    mantissa *= 10;
+                    --exponent;
+
+                    if (mantissa != 0 && ++digits > 18)
+                        exact = false;
+                }
+
+                mantissa = mantissa * 10 + digit;
+                --exponent;
+
+                if (++digits > 18)
+                    exact = false;
+            }
+        }
+
+        if (numDigits == 0)
+        {
+            // Not a decimal number. Let the C runtime deal with "inf" and
+            // "nan".
+            if (pCur == pEnd || (*pCur != 'i' && *pCur != 'I' &&
+                *pCur != 'n' && *pCur != 'N'))
+                return false;
+
+            exact = false;
+        }
+        else if (pCur != pEnd && (*pCur == 'e' || *pCur == 'E'))
+        {
+            const char *pExponent = pCur + 1;
+            int scale = 0;
+
+            if (ParseInt(pExponent, pEnd, scale))
+            {
+                pCur = pExponent;
+
+                if (scale > 1000 || scale < -1000)
+                    exact = false;
+                else
+                    exponent += scale;
+            }
+            else
+            {
+                // No digits or an exponent too large for an int.
+                exact = false;
+            }
+        }
+
+        if (exact && mantissa <= (1ULL << 24) && exponent >= -10 && exponent <= 10)
+        {
+            float result = static_cast<float>(mantissa);
+
+            if (exponent < 0)
+                result /= g_powersOf10[-exponent];
+            else
+                result *= g_powersOf10[exponent];
+
+            value = negative ? -result : result;
+            p = pCur;
+            return true;
+        }
+
+        // Slow path.
+        char buffer[64] = {0};
+        const char *pToken = p;
+        const char *pTokenEnd = SkipToken(p, pEnd);
+        std::string token;
+        char *pParseEnd = 0;
+
+        if (pTokenEnd - pToken < static_cast<int>(sizeof(buffer)))
+        {
+            memcpy(buffer, pToken, pTokenEnd - pToken);
+            value = strtof(buffer, &pParseEnd);
+            p = pToken + (pParseEnd - buffer);
+        }
+        else
+        {
+            token.assign(pToken, pTokenEnd);
+            value = strtof(token.c_str(), &pParseEnd);
+            p = pToken + (pParseEnd - token.c_str());
+        }
+
+        return p != pToken;
+    }
+
+    // Parses a single face corner. The format of the corner is detected when
+    // 'type' is negative, otherwise the corner must match the given format.
+    // Missing indices are returned as 0.
+    bool ParseFaceCorner(const char *&p, const char *pEnd, int corner[3], int &type)
+    {
+        const char *pCur = p;
+        int detected = TRIANGLE_POS;
+
+        corner[0] = corner[1] = corner[2] = 0;
+
+        if (!ParseInt(pCur, pEnd, corner[0]))
+            return false;
+
+        if (pCur != pEnd && *pCur == '/')
+        {
+            ++pCur;
+
+            if (pCur != pEnd && *pCur == '/')
+            {
+                ++pCur;
+
+                if (ParseInt(pCur, pEnd, corner[2]))
+                    detected = TRIANGLE_POS_NORMAL;
+            }
+            else if (ParseInt(pCur, pEnd, corner[1]))
+            {
+                detected = TRIANGLE_POS_TEXCOORD;
+
+                if (pCur != pEnd && *pCur == '/')
+                {
+                    ++pCur;
+
+                    if (ParseInt(pCur, pEnd, corner[2]))
+                        detected = TRIANGLE_POS_TEXCOORD_NORMAL;
+                }
+            }
+        }
+
+        if (type < 0)
+            type = detected;
+        else if (type != detected)
+            return false;
+
+        p = pCur;
+        return true;
+    }
+
+    // Hashes an OBJ index triple for the vertex cache.
+    inline unsigned int HashIndexTriple(int v, int vt, int vn)
+    {
+        unsigned int h = static_cast<unsigned int>(v) * 0x9E3779B1u;
+        h ^= static_cast<unsigned int>(vt) * 0x85EBCA77u;
+        h ^= static_cast<unsigned int>(vn) * 0xC2B2AE3Du;
+        return h ^ (h >> 15);
+    }
+
+    // Parses the three components of a MTL color. Alpha is set to 1.
+    void ParseColor(const char *&p, const char *pEnd, float color[4])
+    {
+        for (int i = 0; i < 3; ++i)
+        {
+            p = SkipSpaces(p, pEnd);
+            ParseFloat(p, pEnd, color[i]);
+        }
+
+        color[3] = 1.0f;
+    }
+
+    // Returns the last whitespace separated token of the current line.
+    std::string LastToken(const char *p, const char *pEnd)
+    {
+        const char *pToken = p;
+        const char *pTokenEnd = p;
+
+        while (p != pEnd && *p != '\n')
+        {
+            p = SkipSpaces(p, pEnd);
+
+            if (p != pEnd && *p != '\n')
+            {
+                pToken = p;
+                p = SkipToken(p, pEnd);
+                pTokenEnd = p;
+            }
+        }
+
+        return std::string(pToken, pTokenEnd);
+    }
+
+    // Returns the rest of the current line without leading and trailing
+    // whitespace.
+    std::string RestOfLine(const char *p, const char *pEnd)
+    {
+        const char *pLineEnd = static_cast<const char *>(memchr(p, '\n', pEnd - p));
+
+        if (!pLineEnd)
+            pLineEnd = pEnd;
+
+        p = SkipSpaces(p, pLineEnd);
+
+        while (pLineEnd != p && IsSpace(pLineEnd[-1]))
+            --pLineEnd;
+
+        return std::string(p, pLineEnd);
+    }
+
+    // Converts a one based OBJ index into a zero based index. Negative
+    // indices are relative to the 'count' attributes the chunk has read so
+    // far. They get 'flag' set in 'relative' so the chunk's offset can be
+    // added once it is known.
+    inline int ResolveIndex(int index, int count, int &relative, int flag)
+    {
+        if (index >= 0)
+            return index - 1;
+
+        relative |= flag;
+        return index + count;
+    }
+
+    // Stores a parsed face corner as corner 'k' of the triangle.
+    inline void SetCorner(ObjTriangle &triangle, int k, const int corner[3],
+                          int numVertices, int numTexCoords, int numNormals)
+    {
+        triangle.relative &= ~(7 << (3 * k));
+        triangle.v[k] = ResolveIndex(corner[0], numVertices, triangle.relative, 1 << (3 * k));
+        triangle.vt[k] = ResolveIndex(corner[1], numTexCoords, triangle.relative, 2 << (3 * k));
+        triangle.vn[k] = ResolveIndex(corner[2], numNormals, triangle.relative, 4 << (3 * k));
+    }
+
+    void ParseObjChunk(ObjChunk &chunk)
+    {
+        std::map<std::string, int> materialSlots;
+        std::map<std::string, int>::const_iterator slot;
+
+        ObjTriangle triangle = {{0}, {0}, {0}, -1, -1, SMOOTHING_INHERITED, TRIANGLE_POS, 0};
+        int corner[3] = {0};
+        int activeMaterial = -1;
+        int activeObject = -1;
+        int activeGroup = -1;
+        bool groupChanged = false;
+        int numVertices = 0;
+        int numTexCoords = 0;
+        int numNormals = 0;
+        float value = 0.0f;
+        std::string name;
+
+        const char *p = chunk.pBegin;
+        const char *pEnd = chunk.pEnd;
+        const char *pToken = 0;
+
+        // Reserve space based on the typical size of the records.
+        chunk.vertexCoords.reserve((pEnd - p) / 32 * 3);
+        chunk.triangles.reserve((pEnd - p) / 64);
+
+        while (p != pEnd)
+        {
+            p = SkipSpaces(p, pEnd);
+            pToken = p;
+            p = SkipToken(p, pEnd);
+
+            if (p == pToken)
+            {
+                p = SkipLine(p, pEnd);
+                continue;
+            }
+
+            switch (pToken[0])
+            {
+            case 'f': // v, v//vn, v/vt, or v/vt/vn.
+                p = SkipSpaces(p, pEnd);
+                triangle.type = -1;
+                triangle.relative = 0;
+
+                if (!ParseFaceCorner(p, pEnd, corner, triangle.type))
+                    break;
+
+                triangle.material = activeMaterial;
+                SetCorner(triangle, 0, corner, numVertices, numTexCoords, numNormals);
+
+                for (int i = 1; ; ++i)
+                {
+                    p = SkipSpaces(p, pEnd);
+
+                    if (!ParseFaceCorner(p, pEnd, corner, triangle.type))
+                        break;
+
+                    SetCorner(triangle, 2, corner, numVertices, numTexCoords, numNormals);
+
+                    // Triangulate the polygon as a fan around its first corner.
+                    if (i >= 2)
+                    {
+                        // Groups are only recorded once a face uses them.
+                        if (groupChanged)
+                        {
+                            triangle.group = static_cast<int>(chunk.groups.size());
+                            chunk.groups.push_back(std::make_pair(activeObject, activeGroup));
+                            groupChanged = false;
+                        }
+
+                        chunk.triangles.push_back(triangle);
+                        triangle.relative |= FACE_CONTINUED;
+                    }
+
+                    triangle.v[1] = triangle.v[2];
+                    triangle.vt[1] = triangle.vt[2];
+                    triangle.vn[1] = triangle.vn[2];
+                    triangle.relative = (triangle.relative & ~(7 << 3)) |
+                        ((triangle.relative >> 3) & (7 << 3));
+                }
+                break;
+
+            case 'g': // g
+                if (p - pToken != 1)
+                    break;
+
+                activeGroup = static_cast<int>(chunk.groupNames.size());
+                chunk.groupNames.push_back(RestOfLine(p, pEnd));
+                groupChanged = true;
+                break;
+
+            case 'm': // mtllib
+                p = SkipSpaces(p, pEnd);
+                pToken = p;
+                p = SkipToken(p, pEnd);
+                chunk.materialLibraries.push_back(std::string(pToken, p));
+                break;
+
+            case 'o': // o
+                if (p - pToken != 1)
+                    break;
+
+                // A new object starts out in the unnamed group.
+                activeObject = static_cast<int>(chunk.objectNames.size());
+                chunk.objectNames.push_back(RestOfLine(p, pEnd));
+                activeGroup = static_cast<int>(chunk.groupNames.size());
+                chunk.groupNames.push_back(std::string());
+                groupChanged = true;
+                break;
+
+            case 's': // s
+                if (p - pToken != 1)
+                    break;
+
+                p = SkipSpaces(p, pEnd);
+                triangle.smoothing = 0;
+
+                // 's off' and 's 0' both turn smoothing off.
+                if (ParseInt(p, pEnd, triangle.smoothing) && triangle.smoothing < 0)
+                    triangle.smoothing = 0;
+                break;
+
+            case 'u': // usemtl
+                p = SkipSpaces(p, pEnd);
+                pToken = p;
+                p = SkipToken(p, pEnd);
+                name.assign(pToken, p);
+                slot = materialSlots.find(name);
+
+                if (slot == materialSlots.end())
+                {
+                    activeMaterial = static_cast<int>(chunk.materialNames.size());
+                    materialSlots[name] = activeMaterial;
+                    chunk.materialNames.push_back(name);
+                }
+                else
+                {
+                    activeMaterial = slot->second;
+                }
+                break;
+
+            case 'v': // v, vn, or vt.
+                switch (p - pToken == 1 ? '\0' : pToken[1])
+                {
+                case '\0': // v
+                    for (int i = 0; i < 3; ++i)
+                    {
+                        p = SkipSpaces(p, pEnd);
+                        value = 0.0f;
+                        ParseFloat(p, pEnd, value);
+                        chunk.vertexCoords.push_back(value);
+                    }
+                    ++numVertices;
+                    break;
+
+                case 'n': // vn
+                    for (int i = 0; i < 3; ++i)
+                    {
+                        p = SkipSpaces(p, pEnd);
+                        value = 0.0f;
+                        ParseFloat(p, pEnd, value);
+                        chunk.normals.push_back(value);
+                    }
+                    ++numNormals;
+                    break;
+
+                case 't': // vt
+                    for (int i = 0; i < 2; ++i)
+                    {
+                        p = SkipSpaces(p, pEnd);
+                        value = 0.0f;
+                        ParseFloat(p, pEnd, value);
+                        chunk.textureCoords.push_back(value);
+                    }
+                    ++numTexCoords;
+                    break;
+
+                default:
+                    break;
+                }
+                break;
+
+            default:
+                break;
+            }
+
+            p = SkipLine(p, pEnd);
+        }
+
+        chunk.activeMaterial = activeMaterial;
+        chunk.activeObject = activeObject;
+        chunk.activeGroup = activeGroup;
+        chunk.activeSmoothing = triangle.smoothing;
+    }
+
+    // Returns the directory part of a file name including the trailing
+    // separator, or an empty string.
+    std::string DirectoryOf(const char *pszFilename)
+    {
+        std::string filename = pszFilename;
+        std::string::size_type offset = filename.find_last_of('\\');
+
+        if (offset == std::string::npos)
+            offset = filename.find_last_of('/');
+
+        if (offset == std::string::npos)
+            return std::string();
+
+        return filename.substr(0, offset + 1);
+    }
+
+    // Returns the number of threads to use for a thread count setting where
+    // 0 means one thread per core.
+    int GetNumberOfThreads(int numberOfThreads)
+    {
+        return (numberOfThreads > 0) ?
+            numberOfThreads : ThreadPool::getHardwareConcurrency();
+    }
+
+    // Returns how many tasks to split count items into so that every task
+    // gets at least minPerTask items.
+    int GetNumberOfTasks(int numberOfThreads, int count, int minPerTask)
+    {
+        int numberOfTasks = std::min(GetNumberOfThreads(numberOfThreads),
+            count / minPerTask);
+
+        return (numberOfTasks < 1) ? 1 : numberOfTasks;
+    }
+
+    const int MIN_TRIANGLES_PER_TASK = 16384;
+    const int MIN_VERTICES_PER_TASK = 8192;
+    const int MAX_REDUCTION_RANGES = 8;
+
+    // Returns how many ranges to split count items into for a floating
+    // point reduction. Every range gets at least minPerRange items. Unlike
+    // GetNumberOfTasks() it doesn't depend on the number of threads, so the
+    // sums are added in the same order, and give the same result, on every
+    // machine. The thread pool runs one task per range.
+    int GetNumberOfRanges(int count, int minPerRange)
+    {
+        return std::max(1, std::min(MAX_REDUCTION_RANGES, count / minPerRange));
+    }
+    const int NORMALS_BATCH_SIZE = 256;
+
+    // Calculates the face normals of count triangles into separate x, y and
+    // z arrays, four triangles at a time. The arithmetic is the same as in
+    // the serial ModelOBJ::generateNormals(), so the results match it
+    // exactly.
+    void ComputeFaceNormals(const ModelOBJ::Vertex *pVertices, const int *pIndices,
+                            int count, float *pX, float *pY, float *pZ)
+    {
+        int i = 0;
+
+#if defined(MODEL_OBJ_SSE2)
+        for (; i + 4 <= count; i += 4)
+        {
+            const int *pTriangle = pIndices + i * 3;
+            __m128 p[3][3];
+
+            // Gather the positions of four triangles into registers.
+
+            for (int k = 0; k < 3; ++k)
+            {
+                const float *pA = pVertices[pTriangle[k]].position;
+                const float *pB = pVertices[pTriangle[3 + k]].position;
+                const float *pC = pVertices[pTriangle[6 + k]].position;
+                const float *pD = pVertices[pTriangle[9 + k]].position;
+
+                p[k][0] = _mm_set_ps(pD[0], pC[0], pB[0], pA[0]);
+                p[k][1] = _mm_set_ps(pD[1], pC[1], pB[1], pA[1]);
+                p[k][2] = _mm_set_ps(pD[2], pC[2], pB[2], pA[2]);
+            }
+
+            __m128 e1x = _mm_sub_ps(p[1][0], p[0][0]);
+            __m128 e1y = _mm_sub_ps(p[1][1], p[0][1]);
+            __m128 e1z = _mm_sub_ps(p[1][2], p[0][2]);
+
+            __m128 e2x = _mm_sub_ps(p[2][0], p[0][0]);
+            __m128 e2y = _mm_sub_ps(p[2][1], p[0][1]);
+            __m128 e2z = _mm_sub_ps(p[2][2], p[0][2]);
+
+            _mm_storeu_ps(pX + i, _mm_sub_ps(_mm_mul_ps(e1y, e2z), _mm_mul_ps(e1z, e2y)));
+            _mm_storeu_ps(pY + i, _mm_sub_ps(_mm_mul_ps(e1z, e2x), _mm_mul_ps(e1x, e2z)));
+            _mm_storeu_ps(pZ + i, _mm_sub_ps(_mm_mul_ps(e1x, e2y), _mm_mul_ps(e1y, e2x)));
+        }
+#endif
+
+        for (; i < count; ++i)
+        {
+            const float *p0 = pVertices[pIndices[i * 3]].position;
+            const float *p1 = pVertices[pIndices[i * 3 + 1]].position;
+            const float *p2 = pVertices[pIndices[i * 3 + 2]].position;
+
+            float e1x = p1[0] - p0[0];
+            float e1y = p1[1] - p0[1];
+            float e1z = p1[2] - p0[2];
+
+            float e2x = p2[0] - p0[0];
+            float e2y = p2[1] - p0[1];
+            float e2z = p2[2] - p0[2];
+
+            pX[i] = (e1y * e2z) - (e1z * e2y);
+            pY[i] = (e1z * e2x) - (e1x * e2z);
+            pZ[i] = (e1x * e2y) - (e1y * e2x);
+        }
+    }
+
+    // Normalizes count vectors stored as separate x, y and z arrays.
+    void NormalizeNormals(float *pX, float *pY, float *pZ, int count)
+    {
+        int i = 0;
+
+#if defined(MODEL_OBJ_SSE2)
+        const __m128 one = _mm_set1_ps(1.0f);
+
+        for (; i + 4 <= count; i += 4)
+        {
+            __m128 x = _mm_loadu_ps(pX + i);
+            __m128 y = _mm_loadu_ps(pY + i);
+            __m128 z = _mm_loadu_ps(pZ + i);
+            __m128 lengthSq = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, x),
+                _mm_mul_ps(y, y)), _mm_mul_ps(z, z));
+            __m128 length = _mm_div_ps(one, _mm_sqrt_ps(lengthSq));
+
+            _mm_storeu_ps(pX + i, _mm_mul_ps(x, length));
+            _mm_storeu_ps(pY + i, _mm_mul_ps(y, length));
+            _mm_storeu_ps(pZ + i, _mm_mul_ps(z, length));
+        }
+#endif
+
+        for (; i < count; ++i)
+        {
+            float length = 1.0f / sqrtf(pX[i] * pX[i] + pY[i] * pY[i] + pZ[i] * pZ[i]);
+
+            pX[i] *= length;
+            pY[i] *= length;
+            pZ[i] *= length;
+        }
+    }
+
+    // Calculates the tangent and bitangent of a triangle from its positions
+    // and texture coordinates.
+    void ComputeFaceTangent(const ModelOBJ::Vertex &vertex0,
+                            const ModelOBJ::Vertex &vertex1,
+                            const ModelOBJ::Vertex &vertex2,
+                            float tangent[3], float bitangent[3])
+    {
+        float edge1[3] = {0.0f, 0.0f, 0.0f};
+        float edge2[3] = {0.0f, 0.0f, 0.0f};
+        float texEdge1[2] = {0.0f, 0.0f};
+        float texEdge2[2] = {0.0f, 0.0f};
+        float det = 0.0f;
+
+        edge1[0] = vertex1.position[0] - vertex0.position[0];
+        edge1[1] = vertex1.position[1] - vertex0.position[1];
+        edge1[2] = vertex1.position[2] - vertex0.position[2];
+
+        edge2[0] = vertex2.position[0] - vertex0.position[0];
+        edge2[1] = vertex2.position[1] - vertex0.position[1];
+        edge2[2] = vertex2.position[2] - vertex0.position[2];
+
+        texEdge1[0] = vertex1.texCoord[0] - vertex0.texCoord[0];
+        texEdge1[1] = vertex1.texCoord[1] - vertex0.texCoord[1];
+
+        texEdge2[0] = vertex2.texCoord[0] - vertex0.texCoord[0];
+        texEdge2[1] = vertex2.texCoord[1] - vertex0.texCoord[1];
+
+        det = texEdge1[0] * texEdge2[1] - texEdge2[0] * texEdge1[1];
+
+        if (fabs(det) < 1e-6f)
+        {
+            tangent[0] = 1.0f;
+            tangent[1] = 0.0f;
+            tangent[2] = 0.0f;
+
+            bitangent[0] = 0.0f;
+            bitangent[1] = 1.0f;
+            bitangent[2] = 0.0f;
+        }
+        else
+        {
+            det = 1.0f / det;
+
+            tangent[0] = (texEdge2[1] * edge1[0] - texEdge1[1] * edge2[0]) * det;
+            tangent[1] = (texEdge2[1] * edge1[1] - texEdge1[1] * edge2[1]) * det;
+            tangent[2] = (texEdge2[1] * edge1[2] - texEdge1[1] * edge2[2]) * det;
+
+            bitangent[0] = (-texEdge2[0] * edge1[0] + texEdge1[0] * edge2[0]) * det;
+            bitangent[1] = (-texEdge2[0] * edge1[1] + texEdge1[0] * edge2[1]) * det;
+            bitangent[2] = (-texEdge2[0] * edge1[2] + texEdge1[0] * edge2[2]) * det;
+        }
+    }
+
+    // Orthogonalizes and normalizes the accumulated tangent of a vertex and
+    // replaces the accumulated bitangent with the final one.
+    void FinishTangent(ModelOBJ::Vertex &vertex)
+    {
+        float bitangent[3] = {0.0f, 0.0f, 0.0f};
+        float nDotT = 0.0f;
+        float bDotB = 0.0f;
+        float length = 0.0f;
+
+        // Gram-Schmidt orthogonalize tangent with normal.
+
+        nDotT = vertex.normal[0] * vertex.tangent[0] +
+                vertex.normal[1] * vertex.tangent[1] +
+                vertex.normal[2] * vertex.tangent[2];
+
+        vertex.tangent[0] -= vertex.normal[0] * nDotT;
+        vertex.tangent[1] -= vertex.normal[1] * nDotT;
+        vertex.tangent[2] -= vertex.normal[2] * nDotT;
+
+        // Normalize the tangent.
+
+        length = 1.0f / sqrtf(vertex.tangent[0] * vertex.tangent[0] +
+                              vertex.tangent[1] * vertex.tangent[1] +
+                              vertex.tangent[2] * vertex.tangent[2]);
+
+        vertex.tangent[0] *= length;
+        vertex.tangent[1] *= length;
+        vertex.tangent[2] *= length;
+
+        // Calculate the handedness of the local tangent space.
+        // The bitangent vector is the cross product between the triangle face
+        // normal vector and the calculated tangent vector. The resulting
+        // bitangent vector should be the same as the bitangent vector
+        // calculated from the set of linear equations above. If they point in
+        // different directions then we need to invert the cross product
+        // calculated bitangent vector. We store this scalar multiplier in the
+        // tangent vector's 'w' component so that the correct bitangent vector
+        // can be generated in the normal mapping shader's vertex shader.
+        //
+        // Normal maps have a left handed coordinate system with the origin
+        // located at the top left of the normal map texture. The x coordinates
+        // run horizontally from left to right. The y coordinates run
+        // vertically from top to bottom. The z coordinates run out of the
+        // normal map texture towards the viewer. Our handedness calculations
+        // must take this fact into account as well so that the normal mapping
+        // shader's vertex shader will generate the correct bitangent vectors.
+        // Some normal map authoring tools such as Crazybump
+        // (http://www.crazybump.com/) includes options to allow you to control
+        // the orientation of the normal map normal's y-axis.
+
+        bitangent[0] = (vertex.normal[1] * vertex.tangent[2]) - 
+                       (vertex.normal[2] * vertex.tangent[1]);
+        bitangent[1] = (vertex.normal[2] * vertex.tangent[0]) -
+                       (vertex.normal[0] * vertex.tangent[2]);
+        bitangent[2] = (vertex.normal[0] * vertex.tangent[1]) - 
+                       (vertex.normal[1] * vertex.tangent[0]);
+
+        bDotB = bitangent[0] * vertex.bitangent[0] + 
+                bitangent[1] * vertex.bitangent[1] + 
+                bitangent[2] * vertex.bitangent[2];
+
+        vertex.tangent[3] = (bDotB < 0.0f) ? 1.0f : -1.0f;
+
+        vertex.bitangent[0] = bitangent[0];
+        vertex.bitangent[1] = bitangent[1];
+        vertex.bitangent[2] = bitangent[2];
+    }
+
+    // The Mikk* helpers implement the steps of the MikkTSpace reference
+    // implementation for triangle meshes, so that tangents match those used
+    // by the tools that bake normal maps.
+
+    enum MikkTriangleFlags
+    {
+        MIKK_DEGENERATE = 1 << 0,
+        MIKK_ORIENT_PRESERVING = 1 << 1,
+        MIKK_GROUP_WITH_ANY = 1 << 2
+    };
+
+    struct MikkTriangle
+    {
+        float os[3];            // normalized tangent direction
+        int neighbors[3];       // triangle across each edge, or -1
+        int groups[3];          // group of each corner, or -1
+        int flags;
+    };
+
+    struct MikkGroup
+    {
+        float tangent[3];
+        int vertex;
+        int firstTriangle;
+        int numberOfTriangles;
+        bool orientationPreserving;
+    };
+
+    struct MikkEdge
+    {
+        int i0;                 // smaller vertex index
+        int i1;                 // larger vertex index
+        int triangle;
+    };
+
+    bool MikkEdgeCompFunc(const MikkEdge &lhs, const MikkEdge &rhs)
+    {
+        if (lhs.i0 != rhs.i0)
+            return lhs.i0 < rhs.i0;
+
+        if (lhs.i1 != rhs.i1)
+            return lhs.i1 < rhs.i1;
+
+        return lhs.triangle < rhs.triangle;
+    }
+
+    inline bool MikkNotZero(float x)
+    {
+        return fabsf(x) > FLT_MIN;
+    }
+
+    inline float MikkLength(const float v[3])
+    {
+        return sqrtf(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+    }
+
+    // Normalizes v unless all of its components are zero.
+    inline void MikkNormalize(float v[3])
+    {
+        if (MikkNotZero(v[0]) || MikkNotZero(v[1]) || MikkNotZero(v[2]))
+        {
+            float scale = 1.0f / MikkLength(v);
+
+            v[0] *= scale;
+            v[1] *= scale;
+            v[2] *= scale;
+        }
+    }
+
+    // Removes the component along n from v and normalizes the result.
+    inline void MikkProject(const float n[3], float v[3])
+    {
+        float d = n[0] * v[0] + n[1] * v[1] + n[2] * v[2];
+
+        v[0] = v[0] - d * n[0];
+        v[1] = v[1] - d * n[1];
+        v[2] = v[2] - d * n[2];
+
+        MikkNormalize(v);
+    }
+
+    inline bool SameMikkTangent(const MikkGroup &lhs, const MikkGroup &rhs)
+    {
+        return lhs.tangent[0] == rhs.tangent[0] &&
+            lhs.tangent[1] == rhs.tangent[1] &&
+            lhs.tangent[2] == rhs.tangent[2] &&
+            lhs.orientationPreserving == rhs.orientationPreserving;
+    }
+
+    // Maps every vertex to the first vertex with the same position, normal
+    // and texture coordinate.
+    void WeldVertices(const ModelOBJ::Vertex *pVertices, int count,
+                      std::vector<int> &welded)
+    {
+        int tableSize = 16;
+
+        while (tableSize < count * 2)
+            tableSize *= 2;
+
+        std::vector<int> table(tableSize, -1);
+
+        welded.resize(count);
+
+        for (int i = 0; i < count; ++i)
+        {
+            const ModelOBJ::Vertex &vertex = pVertices[i];
+            const float key[8] =
+            {
+                vertex.position[0], vertex.position[1], vertex.position[2],
+                vertex.normal[0], vertex.normal[1], vertex.normal[2],
+                vertex.texCoord[0], vertex.texCoord[1]
+            };
+            unsigned int hash = 2166136261u;
+
+            for (int j = 0; j < 8; ++j)
+            {
+                // Adding zero turns -0.0f into 0.0f so that equal values hash
+                // the same.
+                float value = key[j] + 0.0f;
+                unsigned int bits = 0;
+
+                memcpy(&bits, &value, sizeof(bits));
+                hash = (hash ^ bits) * 16777619u;
+            }
+
+            int slot = static_cast<int>(hash & (tableSize - 1));
+
+            welded[i] = i;
+
+            while (table[slot] >= 0)
+            {
+                const ModelOBJ::Vertex &other = pVertices[table[slot]];
+
+                if (other.position[0] == key[0] && other.position[1] == key[1] &&
+                    other.position[2] == key[2] && other.normal[0] == key[3] &&
+                    other.normal[1] == key[4] && other.normal[2] == key[5] &&
+                    other.texCoord[0] == key[6] && other.texCoord[1] == key[7])
+                {
+                    welded[i] = table[slot];
+                    break;
+                }
+
+                slot = (slot + 1) & (tableSize - 1);
+            }
+
+            if (welded[i] == i)
+                table[slot] = i;
+        }
+    }
+
+    // Calculates the normalized tangent direction and the flags of a
+    // triangle given by its three (welded) vertex indices.
+    void InitMikkTriangle(const ModelOBJ::Vertex *pVertices, const int *pCorners,
+                          MikkTriangle &triangle)
+    {
+        for (int i = 0; i < 3; ++i)
+        {
+            triangle.os[i] = 0.0f;
+            triangle.neighbors[i] = -1;
+            triangle.groups[i] = -1;
+        }
+
+        triangle.flags = MIKK_GROUP_WITH_ANY;
+
+        if (pCorners[0] == pCorners[1] || pCorners[0] == pCorners[2] ||
+            pCorners[1] == pCorners[2])
+        {
+            triangle.flags |= MIKK_DEGENERATE;
+            return;
+        }
+
+        const ModelOBJ::Vertex &v1 = pVertices[pCorners[0]];
+        const ModelOBJ::Vertex &v2 = pVertices[pCorners[1]];
+        const ModelOBJ::Vertex &v3 = pVertices[pCorners[2]];
+
+        float t21x = v2.texCoord[0] - v1.texCoord[0];
+        float t21y = v2.texCoord[1] - v1.texCoord[1];
+        float t31x = v3.texCoord[0] - v1.texCoord[0];
+        float t31y = v3.texCoord[1] - v1.texCoord[1];
+        float d1[3];
+        float d2[3];
+        float os[3];
+        float ot[3];
+
+        for (int i = 0; i < 3; ++i)
+        {
+            d1[i] = v2.position[i] - v1.position[i];
+            d2[i] = v3.position[i] - v1.position[i];
+        }
+
+        float signedArea = t21x * t31y - t21y * t31x;
+
+        for (int i = 0; i < 3; ++i)
+        {
+            os[i] = t31y * d1[i] - t21y * d2[i];
+            ot[i] = -t31x * d1[i] + t21x * d2[i];
+        }
+
+        if (signedArea > 0.0f)
+            triangle.flags |= MIKK_ORIENT_PRESERVING;
+
+        if (MikkNotZero(signedArea))
+        {
+            float absArea = fabsf(signedArea);
+            float lengthOs = MikkLength(os);
+            float lengthOt = MikkLength(ot);
+            float sign = (triangle.flags & MIKK_ORIENT_PRESERVING) ? 1.0f : -1.0f;
+
+            if (MikkNotZero(lengthOs))
+            {
+                float scale = sign / lengthOs;
+
+                triangle.os[0] = scale * os[0];
+                triangle.os[1] = scale * os[1];
+                triangle.os[2] = scale * os[2];
+            }
+
+            if (MikkNotZero(lengthOs / absArea) && MikkNotZero(lengthOt / absArea))
+                triangle.flags &= ~MIKK_GROUP_WITH_ANY;
+        }
+    }
+
+    // Returns the number of the edge of a triangle that connects the vertices
+    // i0 and i1 in either direction, and that edge's vertices in triangle
+    // order.
+    int GetMikkEdge(const int *pCorners, int i0, int i1, int &first, int &second)
+    {
+        if (pCorners[0] == i0 || pCorners[0] == i1)
+        {
+            if (pCorners[1] == i0 || pCorners[1] == i1)
+            {
+                first = pCorners[0];
+                second = pCorners[1];
+                return 0;
+            }
+
+            first = pCorners[2];
+            second = pCorners[0];
+            return 2;
+        }
+
+        first = pCorners[1];
+        second = pCorners[2];
+        return 1;
+    }
+
+    // Pairs up triangles that share an edge with opposite winding.
+    void BuildMikkNeighbors(const std::vector<int> &corners,
+                            std::vector<MikkTriangle> &triangles)
+    {
+        // Sort the edges by their smaller vertex, then by their larger vertex
+        // and then by triangle. A counting sort on the smaller vertex keeps
+        // the triangle order, and the few edges per vertex are then sorted
+        // by insertion.
+
+        int numberOfVertices = 0;
+
+        for (int i = 0; i < static_cast<int>(corners.size()); ++i)
+            numberOfVertices = std::max(numberOfVertices, corners[i] + 1);
+
+        std::vector<int> firstEdge(numberOfVertices + 1, 0);
+
+        for (int i = 0; i < static_cast<int>(triangles.size()); ++i)
+        {
+            if (triangles[i].flags & MIKK_DEGENERATE)
+                continue;
+
+            for (int j = 0; j < 3; ++j)
+            {
+                int i0 = corners[i * 3 + j];
+                int i1 = corners[i * 3 + (j < 2 ? j + 1 : 0)];
+
+                ++firstEdge[std::min(i0, i1) + 1];
+            }
+        }
+
+        for (int i = 0; i < numberOfVertices; ++i)
+            firstEdge[i + 1] += firstEdge[i];
+
+        std::vector<MikkEdge> edges(firstEdge[numberOfVertices]);
+        std::vector<int> next(firstEdge.begin(), firstEdge.end() - 1);
+
+        for (int i = 0; i < static_cast<int>(triangles.size()); ++i)
+        {
+            if (triangles[i].flags & MIKK_DEGENERATE)
+                continue;
+
+            for (int j = 0; j < 3; ++j)
+            {
+                int i0 = corners[i * 3 + j];
+                int i1 = corners[i * 3 + (j < 2 ? j + 1 : 0)];
+                MikkEdge edge = {std::min(i0, i1), std::max(i0, i1), i};
+
+                edges[next[edge.i0]++] = edge;
+            }
+        }
+
+        for (int i = 0; i < numberOfVertices; ++i)
+        {
+            for (int j = firstEdge[i] + 1; j < firstEdge[i + 1]; ++j)
+            {
+                MikkEdge edge = edges[j];
+                int k = j;
+
+                for (; k > firstEdge[i] && MikkEdgeCompFunc(edge, edges[k - 1]); --k)
+                    edges[k] = edges[k - 1];
+
+                edges[k] = edge;
+            }
+        }
+
+        for (int i = 0; i < static_cast<int>(edges.size()); ++i)
+        {
+            const MikkEdge &edgeA = edges[i];
+            int firstA = 0;
+            int secondA = 0;
+            int edgeNumberA = GetMikkEdge(&corners[edgeA.triangle * 3],
+                edgeA.i0, edgeA.i1, firstA, secondA);
+
+            if (triangles[edgeA.triangle].neighbors[edgeNumberA] >= 0)
+                continue;
+
+            for (int j = i + 1; j < static_cast<int>(edges.size()) &&
+                edges[j].i0 == edgeA.i0 && edges[j].i1 == edgeA.i1; ++j)
+            {
+                const MikkEdge &edgeB = edges[j];
+                int firstB = 0;
+                int secondB = 0;
+                int edgeNumberB = GetMikkEdge(&corners[edgeB.triangle * 3],
+                    edgeB.i0, edgeB.i1, firstB, secondB);
+
+                if (firstA == secondB && secondA == firstB &&
+                    triangles[edgeB.triangle].neighbors[edgeNumberB] < 0)
+                {
+                    triangles[edgeA.triangle].neighbors[edgeNumberA] = edgeB.triangle;
+                    triangles[edgeB.triangle].neighbors[edgeNumberB] = edgeA.triangle;
+                    break;
+                }
+            }
+        }
+    }
+
+    // Assigns every corner of the non degenerate triangles to a group. A
+    // group is a fan of triangles around one vertex, connected by edges and
+    // with the same texture space orientation. The triangles of each group
+    // are stored contiguously in groupTriangles.
+    void BuildMikkGroups(const std::vector<int> &corners,
+                         std::vector<MikkTriangle> &triangles,
+                         std::vector<MikkGroup> &groups,
+                         std::vector<int> &groupTriangles)
+    {
+        std::vector<int> stack;
+
+        for (int i = 0; i < static_cast<int>(triangles.size()); ++i)
+        {
+            if (triangles[i].flags & MIKK_DEGENERATE)
+                continue;
+
+            for (int j = 0; j < 3; ++j)
+            {
+                if (triangles[i].groups[j] >= 0)
+                    continue;
+
+                int groupIndex = static_cast<int>(groups.size());
+                MikkGroup group = {{0.0f, 0.0f, 0.0f}, corners[i * 3 + j],
+                    static_cast<int>(groupTriangles.size()), 0,
+                    (triangles[i].flags & MIKK_ORIENT_PRESERVING) != 0};
+
+                triangles[i].groups[j] = groupIndex;
+                groupTriangles.push_back(i);
+
+                // Walk the fan around the vertex in both directions. The
+                // stack visits the triangles in the same order as the
+                // recursive walk of the reference implementation.
+
+                stack.push_back(triangles[i].neighbors[j > 0 ? j - 1 : 2]);
+                stack.push_back(triangles[i].neighbors[j]);
+
+                while (!stack.empty())
+                {
+                    int t = stack.back();
+
+                    stack.pop_back();
+
+                    if (t < 0)
+                        continue;
+
+                    MikkTriangle &triangle = triangles[t];
+                    const int *pCorners = &corners[t * 3];
+                    int k = (pCorners[0] == group.vertex) ? 0 :
+                        ((pCorners[1] == group.vertex) ? 1 : 2);
+
+                    if (triangle.groups[k] >= 0)
+                        continue;
+
+                    // Triangles without a usable texture space join the
+                    // first group that reaches them.
+                    if ((triangle.flags & MIKK_GROUP_WITH_ANY) &&
+                        triangle.groups[0] < 0 && triangle.groups[1] < 0 &&
+                        triangle.groups[2] < 0)
+                    {
+                        triangle.flags &= ~MIKK_ORIENT_PRESERVING;
+
+                        if (group.orientationPreserving)
+                            triangle.flags |= MIKK_ORIENT_PRESERVING;
+                    }
+
+                    if (((triangle.flags & MIKK_ORIENT_PRESERVING) != 0) !=
+                        group.orientationPreserving)
+                    {
+                        continue;
+                    }
+
+                    triangle.groups[k] = groupIndex;
+                    groupTriangles.push_back(t);
+
+                    stack.push_back(triangle.neighbors[k > 0 ? k - 1 : 2]);
+                    stack.push_back(triangle.neighbors[k]);
+                }
+
+                group.numberOfTriangles = static_cast<int>(groupTriangles.size()) -
+                    group.firstTriangle;
+                groups.push_back(group);
+            }
+        }
+    }
+
+    // Calculates the tangent of a group as the angle weighted average of the
+    // tangent directions of its triangles, projected into the tangent plane
+    // of the vertex.
+    void EvalMikkGroup(const ModelOBJ::Vertex *pVertices,
+                       const std::vector<int> &corners,
+                       const std::vector<MikkTriangle> &triangles,
+                       const std::vector<int> &groupTriangles,
+                       MikkGroup &group)
+    {
+        float sum[3] = {0.0f, 0.0f, 0.0f};
+
+        for (int i = 0; i < group.numberOfTriangles; ++i)
+        {
+            int t = groupTriangles[group.firstTriangle + i];
+            const int *pCorners = &corners[t * 3];
+            int k = (pCorners[0] == group.vertex) ? 0 :
+                ((pCorners[1] == group.vertex) ? 1 : 2);
+            const float *n = pVertices[pCorners[k]].normal;
+            const float *p0 = pVertices[pCorners[k > 0 ? k - 1 : 2]].position;
+            const float *p1 = pVertices[pCorners[k]].position;
+            const float *p2 = pVertices[pCorners[k < 2 ? k + 1 : 0]].position;
+            float os[3] = {triangles[t].os[0], triangles[t].os[1], triangles[t].os[2]};
+            float v1[3] = {p0[0] - p1[0], p0[1] - p1[1], p0[2] - p1[2]};
+            float v2[3] = {p2[0] - p1[0], p2[1] - p1[1], p2[2] - p1[2]};
+
+            MikkProject(n, os);
+            MikkProject(n, v1);
+            MikkProject(n, v2);
+
+            // The weight is the angle of the triangle at the vertex.
+
+            float cosine = v1[0] * v2[0] + v1[1] * v2[1] + v1[2] * v2[2];
+            cosine = (cosine > 1.0f) ? 1.0f : ((cosine < -1.0f) ? -1.0f : cosine);
+            float angle = static_cast<float>(acos(cosine));
+
+            sum[0] = sum[0] + angle * os[0];
+            sum[1] = sum[1] + angle * os[1];
+            sum[2] = sum[2] + angle * os[2];
+        }
+
+        MikkNormalize(sum);
+
+        group.tangent[0] = sum[0];
+        group.tangent[1] = sum[1];
+        group.tangent[2] = sum[2];
+    }
+
+    // Helpers for the position, normal and tangent streams. Stride is the
+    // distance between two consecutive vectors in floats, which is 3 (or 4)
+    // for the separate vertex layout and the size of a Vertex for the
+    // interleaved one. Making it a template parameter lets the compiler
+    // vectorize the packed case, and the packed positions have SSE2
+    // versions below.
+
+    template <int Stride>
+    void PositionBounds(const float *pPositions, int count,
+                        float minimum[3], float maximum[3])
+    {
+        int i = 0;
+
+        for (int j = 0; j < 3; ++j)
+        {
+            minimum[j] = std::numeric_limits<float>::max();
+            maximum[j] = -std::numeric_limits<float>::max();
+        }
+
+#if defined(MODEL_OBJ_SSE2)
+        // Interleaved positions are followed by other attributes, so each
+        // one can be loaded as four floats. The fourth lane is ignored.
+        if (Stride > 3 && count > 0)
+        {
+            __m128 minimums = _mm_set1_ps(minimum[0]);
+            __m128 maximums = _mm_set1_ps(maximum[0]);
+
+            for (; i < count; ++i)
+            {
+                __m128 values = _mm_loadu_ps(pPositions + i * Stride);
+
+                minimums = _mm_min_ps(minimums, values);
+                maximums = _mm_max_ps(maximums, values);
+            }
+
+            float lanes[2][4];
+
+            _mm_storeu_ps(lanes[0], minimums);
+            _mm_storeu_ps(lanes[1], maximums);
+
+            for (int j = 0; j < 3; ++j)
+            {
+                minimum[j] = lanes[0][j];
+                maximum[j] = lanes[1][j];
+            }
+        }
+#endif
+
+        for (; i < count; ++i)
+        {
+            const float *pPosition = pPositions + i * Stride;
+
+            for (int j = 0; j < 3; ++j)
+            {
+                if (pPosition[j] < minimum[j])
+                    minimum[j] = pPosition[j];
+
+                if (pPosition[j] > maximum[j])
+                    maximum[j] = pPosition[j];
+            }
+        }
+    }
+
+    template <int Stride>
+    void ScalePositions(float *pPositions, int count, float scaleFactor,
+                        const float offset[3])
+    {
+        for (int i = 0; i < count; ++i)
+        {
+            float *pPosition = pPositions + i * Stride;
+
+            pPosition[0] += offset[0];
+            pPosition[1] += offset[1];
+            pPosition[2] += offset[2];
+
+            pPosition[0] *= scaleFactor;
+            pPosition[1] *= scaleFactor;
+            pPosition[2] *= scaleFactor;
+        }
+    }
+
+#if defined(MODEL_OBJ_SSE2)
+    // Packed positions are processed four at a time in three registers.
+    // Lane j of register r then always holds component (4 * r + j) % 3.
+
+    template <>
+    void PositionBounds<3>(const float *pPositions, int count,
+                           float minimum[3], float maximum[3])
+    {
+        __m128 minimums[3];
+        __m128 maximums[3];
+        int i = 0;
+
+        for (int j = 0; j < 3; ++j)
+        {
+            minimum[j] = std::numeric_limits<float>::max();
+            maximum[j] = -std::numeric_limits<float>::max();
+            minimums[j] = _mm_set1_ps(minimum[j]);
+            maximums[j] = _mm_set1_ps(maximum[j]);
+        }
+
+        for (; i + 4 <= count; i += 4)
+        {
+            for (int j = 0; j < 3; ++j)
+            {
+                __m128 values = _mm_loadu_ps(pPositions + i * 3 + j * 4);
+
+                minimums[j] = _mm_min_ps(minimums[j], values);
+                maximums[j] = _mm_max_ps(maximums[j], values);
+            }
+        }
+
+        float lanes[2][12];
+
+        for (int j = 0; j < 3; ++j)
+        {
+            _mm_storeu_ps(lanes[0] + j * 4, minimums[j]);
+            _mm_storeu_ps(lanes[1] + j * 4, maximums[j]);
+        }
+
+        for (int j = 0; j < 12; ++j)
+        {
+            minimum[j % 3] = std::min(minimum[j % 3], lanes[0][j]);
+            maximum[j % 3] = std::max(maximum[j % 3], lanes[1][j]);
+        }
+
+        for (; i < count; ++i)
+        {
+            for (int j = 0; j < 3; ++j)
+            {
+                float value = pPositions[i * 3 + j];
+
+                if (value < minimum[j])
+                    minimum[j] = value;
+
+                if (value > maximum[j])
+                    maximum[j] = value;
+            }
+        }
+    }
+
+    template <>
+    void ScalePositions<3>(float *pPositions, int count, float scaleFactor,
+                           const float offset[3])
+    {
+        const __m128 scale = _mm_set1_ps(scaleFactor);
+        const __m128 offsets[3] =
+        {
+            _mm_setr_ps(offset[0], offset[1], offset[2], offset[0]),
+            _mm_setr_ps(offset[1], offset[2], offset[0], offset[1]),
+            _mm_setr_ps(offset[2], offset[0], offset[1], offset[2])
+        };
+        int i = 0;
+
+        for (; i + 4 <= count; i += 4)
+        {
+            for (int j = 0; j < 3; ++j)
+            {
+                float *pValues = pPositions + i * 3 + j * 4;
+
+                _mm_storeu_ps(pValues, _mm_mul_ps(_mm_add_ps(
+                    _mm_loadu_ps(pValues), offsets[j]), scale));
+            }
+        }
+
+        for (; i < count; ++i)
+        {
+            float *pPosition = pPositions + i * 3;
+
+            pPosition[0] = (pPosition[0] + offset[0]) * scaleFactor;
+            pPosition[1] = (pPosition[1] + offset[1]) * scaleFactor;
+            pPosition[2] = (pPosition[2] + offset[2]) * scaleFactor;
+        }
+    }
+#endif
+
+    // Computes the bounding box of the positions referenced by count
+    // indices, or of the first count positions if pIndices is null. stride
+    // is the distance between two positions in floats. The positions are
+    // gathered four at a time into x, y and z registers.
+    void GatherPositionBounds(const float *pPositions, int stride,
+                              const int *pIndices, int count,
+                              float minimum[3], float maximum[3])
+    {
+        int i = 0;
+
+        for (int j = 0; j < 3; ++j)
+        {
+            minimum[j] = std::numeric_limits<float>::max();
+            maximum[j] = -std::numeric_limits<float>::max();
+        }
+
+#if defined(MODEL_OBJ_SSE2)
+        __m128 minimums[3];
+        __m128 maximums[3];
+
+        for (int j = 0; j < 3; ++j)
+        {
+            minimums[j] = _mm_set1_ps(minimum[j]);
+            maximums[j] = _mm_set1_ps(maximum[j]);
+        }
+
+        for (; i + 4 <= count; i += 4)
+        {
+            const float *p[4];
+
+            for (int k = 0; k < 4; ++k)
+                p[k] = pPositions + (pIndices ? pIndices[i + k] : i + k) * stride;
+
+            for (int j = 0; j < 3; ++j)
+            {
+                __m128 values = _mm_setr_ps(p[0][j], p[1][j], p[2][j], p[3][j]);
+
+                minimums[j] = _mm_min_ps(minimums[j], values);
+                maximums[j] = _mm_max_ps(maximums[j], values);
+            }
+        }
+
+        for (int j = 0; j < 3; ++j)
+        {
+            float lanes[2][4];
+
+            _mm_storeu_ps(lanes[0], minimums[j]);
+            _mm_storeu_ps(lanes[1], maximums[j]);
+
+            for (int k = 0; k < 4; ++k)
+            {
+                minimum[j] = std::min(minimum[j], lanes[0][k]);
+                maximum[j] = std::max(maximum[j], lanes[1][k]);
+            }
+        }
+#endif
+
+        for (; i < count; ++i)
+        {
+            const float *p = pPositions + (pIndices ? pIndices[i] : i) * stride;
+
+            for (int j = 0; j < 3; ++j)
+            {
+                minimum[j] = std::min(minimum[j], p[j]);
+                maximum[j] = std::max(maximum[j], p[j]);
+            }
+        }
+    }
+
+    // Returns the largest distance between center and the positions chosen
+    // as in GatherPositionBounds().
+    float GatherPositionRadius(const float *pPositions, int stride,
+                               const int *pIndices, int count,
+                               const float center[3])
+    {
+        float radiusSq = 0.0f;
+        int i = 0;
+
+#if defined(MODEL_OBJ_SSE2)
+        __m128 centers[3] =
+        {
+            _mm_set1_ps(center[0]),
+            _mm_set1_ps(center[1]),
+            _mm_set1_ps(center[2])
+        };
+        __m128 maximums = _mm_setzero_ps();
+
+        for (; i + 4 <= count; i += 4)
+        {
+            const float *p[4];
+            __m128 lengthSq = _mm_setzero_ps();
+
+            for (int k = 0; k < 4; ++k)
+                p[k] = pPositions + (pIndices ? pIndices[i + k] : i + k) * stride;
+
+            for (int j = 0; j < 3; ++j)
+            {
+                __m128 d = _mm_sub_ps(_mm_setr_ps(p[0][j], p[1][j], p[2][j], p[3][j]), centers[j]);
+                lengthSq = _mm_add_ps(lengthSq, _mm_mul_ps(d, d));
+            }
+
+            maximums = _mm_max_ps(maximums, lengthSq);
+        }
+
+        float lanes[4];
+
+        _mm_storeu_ps(lanes, maximums);
+
+        for (int k = 0; k < 4; ++k)
+            radiusSq = std::max(radiusSq, lanes[k]);
+#endif
+
+        for (; i < count; ++i)
+        {
+            const float *p = pPositions + (pIndices ? pIndices[i] : i) * stride;
+            float d[3] = {p[0] - center[0], p[1] - center[1], p[2] - center[2]};
+
+            radiusSq = std::max(radiusSq, d[0] * d[0] + d[1] * d[1] + d[2] * d[2]);
+        }
+
+        return sqrtf(radiusSq);
+    }
+
+    // Bounds of positions that ScalePositions() moved: the box is mapped
+    // the same way, the sphere stays around the center of the box.
+    void ScaleBounds(float minimum[3], float maximum[3], float center[3],
+                     float &radius, float scaleFactor, const float offset[3])
+    {
+        for (int i = 0; i < 3; ++i)
+        {
+            float a = (minimum[i] + offset[i]) * scaleFactor;
+            float b = (maximum[i] + offset[i]) * scaleFactor;
+
+            minimum[i] = std::min(a, b);
+            maximum[i] = std::max(a, b);
+            center[i] = (minimum[i] + maximum[i]) / 2.0f;
+        }
+
+        radius *= fabsf(scaleFactor);
+    }
+
+    // Bounds that enclose the bounds of count members, where member(i)
+    // returns anything with a box and a sphere. The sphere stays around the
+    // center of the box.
+    template <typename MemberFunc>
+    void UnionBounds(int count, MemberFunc member, float minimum[3],
+                     float maximum[3], float center[3], float &radius)
+    {
+        for (int i = 0; i < 3; ++i)
+        {
+            minimum[i] = (count > 0) ? FLT_MAX : 0.0f;
+            maximum[i] = (count > 0) ? -FLT_MAX : 0.0f;
+        }
+
+        for (int i = 0; i < count; ++i)
+        {
+            for (int j = 0; j < 3; ++j)
+            {
+                minimum[j] = std::min(minimum[j], member(i).minimum[j]);
+                maximum[j] = std::max(maximum[j], member(i).maximum[j]);
+            }
+        }
+
+        for (int i = 0; i < 3; ++i)
+            center[i] = (minimum[i] + maximum[i]) / 2.0f;
+
+        radius = 0.0f;
+
+        for (int i = 0; i < count; ++i)
+        {
+            const float *pCenter = member(i).center;
+            float d[3] = {pCenter[0] - center[0], pCenter[1] - center[1], pCenter[2] - center[2]};
+
+            radius = std::max(radius, sqrtf(d[0] * d[0] + d[1] * d[1] + d[2] * d[2]) +
+                member(i).radius);
+        }
+
+        // The sphere through the corners of the box encloses the members
+        // too, and is smaller when they are spread out.
+        float extent[3] = {maximum[0] - center[0], maximum[1] - center[1], maximum[2] - center[2]};
+
+        radius = std::min(radius, sqrtf(extent[0] * extent[0] +
+            extent[1] * extent[1] + extent[2] * extent[2]));
+    }
+
+    // Extracts the frustum planes from the rows of a column major matrix
+    // that transforms to clip space (Gribb and Hartmann). The planes are
+    // normalized and point inwards, in the coordinates the matrix
+    // transforms from.
+    void ExtractFrustumPlanes(const float m[16], float planes[6][4])
+    {
+        for (int i = 0; i < 3; ++i)
+        {
+            for (int j = 0; j < 4; ++j)
+            {
+                planes[i * 2][j] = m[j * 4 + 3] + m[j * 4 + i];
+                planes[i * 2 + 1][j] = m[j * 4 + 3] - m[j * 4 + i];
+            }
+        }
+
+        for (int i = 0; i < 6; ++i)
+        {
+            float length = sqrtf(planes[i][0] * planes[i][0] +
+                planes[i][1] * planes[i][1] + planes[i][2] * planes[i][2]);
+
+            if (length > 0.0f)
+            {
+                for (int j = 0; j < 4; ++j)
+                    planes[i][j] /= length;
+            }
+        }
+    }
+
+    inline bool SphereInFrustum(const float planes[6][4], const float center[3], float radius)
+    {
+        for (int i = 0; i < 6; ++i)
+        {
+            if (planes[i][0] * center[0] + planes[i][1] * center[1] +
+                planes[i][2] * center[2] + planes[i][3] < -radius)
+            {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    // Negates the x, y and z components of count vectors.
+    template <int Stride>
+    void NegateVectors(float *pVectors, int count)
+    {
+        for (int i = 0; i < count; ++i)
+        {
+            float *pVector = pVectors + i * Stride;
+
+            pVector[0] = -pVector[0];
+            pVector[1] = -pVector[1];
+            pVector[2] = -pVector[2];
+        }
+    }
+
+    // Copies count vectors of Size floats between streams with different
+    // strides. Does nothing if pSrc is null.
+    template <int Size, int SrcStride, int DestStride>
+    void CopyStream(const float *pSrc, int count, float *pDest)
+    {
+        if (!pSrc)
+            return;
+
+        for (int i = 0; i < count; ++i)
+        {
+            for (int j = 0; j < Size; ++j)
+                pDest[i * DestStride + j] = pSrc[i * SrcStride + j];
+        }
+    }
+
+    // Post-transform vertex cache optimization following Tom Forsyth's
+    // "Linear-Speed Vertex Cache Optimisation". The scores use an LRU cache
+    // of FORSYTH_CACHE_SIZE vertices. Vertices in the cache score by how
+    // recently they were used and vertices with few remaining triangles are
+    // boosted so that the last triangles of a vertex aren't left behind.
+    const int FORSYTH_CACHE_SIZE = 32;
+    const int FORSYTH_MAX_VALENCE = 32;
+    const float FORSYTH_CACHE_DECAY_POWER = 1.5f;
+    const float FORSYTH_LAST_TRIANGLE_SCORE = 0.75f;
+    const float FORSYTH_VALENCE_BOOST_SCALE = 2.0f;
+    const float FORSYTH_VALENCE_BOOST_POWER = 0.5f;
+
+    struct ForsythScores
+    {
+        float cache[FORSYTH_CACHE_SIZE];
+        float valence[FORSYTH_MAX_VALENCE + 1];
+
+        ForsythScores()
+        {
+            for (int i = 0; i < FORSYTH_CACHE_SIZE; ++i)
+            {
+                if (i < 3)
+                {
+                    // The vertices of the last triangle get a fixed score
+                    // so that strips aren't favored over fans.
+                    cache[i] = FORSYTH_LAST_TRIANGLE_SCORE;
+                }
+                else
+                {
+                    float scale = 1.0f / (FORSYTH_CACHE_SIZE - 3);
+                    cache[i] = powf(1.0f - (i - 3) * scale, FORSYTH_CACHE_DECAY_POWER);
+                }
+            }
+
+            valence[0] = 0.0f;
+
+            for (int i = 1; i <= FORSYTH_MAX_VALENCE; ++i)
+            {
+                valence[i] = FORSYTH_VALENCE_BOOST_SCALE *
+                    powf(static_cast<float>(i), -FORSYTH_VALENCE_BOOST_POWER);
+            }
+        }
+    };
+
+    // Scratch memory reused for every mesh of a model. localVertex maps the
+    // model's vertices to the mesh's and is kept at -1 between meshes.
+    struct ForsythWorkspace
+    {
+        std::vector<int> localVertex;
+        std::vector<int> indices;
+        std::vector<int> remaining;
+        std::vector<int> firstTriangle;
+        std::vector<int> triangles;
+        std::vector<int> cachePosition;
+        std::vector<float> vertexScore;
+        std::vector<float> triangleScore;
+        std::vector<char> emitted;
+    };
+
+    inline float ForsythVertexScore(const ForsythScores &scores,
+                                    int cachePosition, int remaining)
+    {
+        if (remaining == 0)
+            return -1.0f;
+
+        float score = (cachePosition >= 0) ? scores.cache[cachePosition] : 0.0f;
+        return score + scores.valence[std::min(remaining, FORSYTH_MAX_VALENCE)];
+    }
+
+    // Writes the order in which the triangleCount triangles of pIndices
+    // should be drawn to pOrder.
+    void OptimizeTriangleOrder(const int *pIndices, int triangleCount,
+                               int numberOfVertices, ForsythWorkspace &work,
+                               int *pOrder)
+    {
+        static const ForsythScores scores;
+
+        int indexCount = triangleCount * 3;
+        int vertexCount = 0;
+
+        // Renumber the mesh's vertices from 0.
+
+        work.localVertex.resize(numberOfVertices, -1);
+        work.indices.resize(indexCount);
+
+        for (int i = 0; i < indexCount; ++i)
+        {
+            int &local = work.localVertex[pIndices[i]];
+
+            if (local < 0)
+                local = vertexCount++;
+
+            work.indices[i] = local;
+        }
+
+        for (int i = 0; i < indexCount; ++i)
+            work.localVertex[pIndices[i]] = -1;
+
+        // Triangles using each vertex. The first remaining[v] entries of a
+        // vertex's list are the triangles not emitted yet.
+
+        work.remaining.assign(vertexCount, 0);
+        work.firstTriangle.resize(vertexCount + 1);
+        work.triangles.resize(indexCount);
+
+        for (int i = 0; i < indexCount; ++i)
+            ++work.remaining[work.indices[i]];
+
+        work.firstTriangle[0] = 0;
+
+        for (int i = 0; i < vertexCount; ++i)
+            work.firstTriangle[i + 1] = work.firstTriangle[i] + work.remaining[i];
+
+        work.remaining.assign(vertexCount, 0);
+
+        for (int i = 0; i < indexCount; ++i)
+        {
+            int v = work.indices[i];
+            work.triangles[work.firstTriangle[v] + work.remaining[v]++] = i / 3;
+        }
+
+        // Initial scores.
+
+        work.cachePosition.assign(vertexCount, -1);
+        work.vertexScore.resize(vertexCount);
+        work.triangleScore.assign(triangleCount, 0.0f);
+        work.emitted.assign(triangleCount, 0);
+
+        for (int i = 0; i < vertexCount; ++i)
+            work.vertexScore[i] = ForsythVertexScore(scores, -1, work.remaining[i]);
+
+        for (int i = 0; i < indexCount; ++i)
+            work.triangleScore[i / 3] += work.vertexScore[work.indices[i]];
+
+        // Emit the best scoring triangle touching the cache until all are
+        // done. When no cached vertex has triangles left, continue with the
+        // next triangle in the original order.
+
+        int cache[FORSYTH_CACHE_SIZE + 3];
+        int cacheSize = 0;
+        int nextInput = 0;
+        int best = -1;
+
+        for (int emitted = 0; emitted < triangleCount; ++emitted)
+        {
+            if (best < 0)
+            {
+                while (work.emitted[nextInput])
+                    ++nextInput;
+
+                best = nextInput;
+            }
+
+            pOrder[emitted] = best;
+            work.emitted[best] = 1;
+
+            const int *pTriangle = &work.indices[best * 3];
+
+            // Remove the triangle from its vertices' lists.
+
+            for (int j = 0; j < 3; ++j)
+            {
+                int v = pTriangle[j];
+                int *pList = &work.triangles[work.firstTriangle[v]];
+                int last = --work.remaining[v];
+
+                for (int k = 0; k <= last; ++k)
+                {
+                    if (pList[k] == best)
+                    {
+                        pList[k] = pList[last];
+                        pList[last] = best;
+                        break;
+                    }
+                }
+            }
+
+            // Move the triangle's vertices to the front of the LRU cache.
+
+            int newCache[FORSYTH_CACHE_SIZE + 3];
+            int newCacheSize = 3;
+
+            newCache[0] = pTriangle[0];
+            newCache[1] = pTriangle[1];
+            newCache[2] = pTriangle[2];
+
+            for (int j = 0; j < cacheSize; ++j)
+            {
+                int v = cache[j];
+
+                if (v != pTriangle[0] && v != pTriangle[1] && v != pTriangle[2])
+                    newCache[newCacheSize++] = v;
+            }
+
+            // Rescore the cached vertices, including the ones that just
+            // dropped out, and their remaining triangles.
+
+            for (int j = 0; j < newCacheSize; ++j)
+            {
+                int v = newCache[j];
+                int position = (j < FORSYTH_CACHE_SIZE) ? j : -1;
+                float score = ForsythVertexScore(scores, position, work.remaining[v]);
+                float delta = score - work.vertexScore[v];
+
+                work.cachePosition[v] = position;
+                work.vertexScore[v] = score;
+
+                const int *pList = &work.triangles[work.firstTriangle[v]];
+
+                for (int k = 0; k < work.remaining[v]; ++k)
+                    work.triangleScore[pList[k]] += delta;
+            }
+
+            cacheSize = std::min(newCacheSize, FORSYTH_CACHE_SIZE);
+
+            for (int j = 0; j < cacheSize; ++j)
+                cache[j] = newCache[j];
+
+            // The next triangle is the best one using a cached vertex.
+
+            float bestScore = -1.0f;
+            best = -1;
+
+            for (int j = 0; j < cacheSize; ++j)
+            {
+                int v = cache[j];
+                const int *pList = &work.triangles[work.firstTriangle[v]];
+
+                for (int k = 0; k < work.remaining[v]; ++k)
+                {
+                    if (work.triangleScore[pList[k]] > bestScore)
+                    {
+                        bestScore = work.triangleScore[pList[k]];
+                        best = pList[k];
+                    }
+                }
+            }
+        }
+    }
+
+    // A simulated FIFO post-transform vertex cache. A vertex is still cached
+    // if fewer than size other vertices were transformed since it was.
+    struct FifoVertexCache
+    {
+        std::vector<int> transformedAt;
+        int clock;
+        int size;
+
+        FifoVertexCache(int numberOfVertices, int cacheSize)
+            : transformedAt(numberOfVertices, -cacheSize), clock(0), size(cacheSize)
+        {
+        }
+
+        // Returns true if the vertex had to be transformed.
+        bool access(int v)
+        {
+            if (clock - transformedAt[v] < size)
+                return false;
+
+            transformedAt[v] = clock++;
+            return true;
+        }
+
+        // Empties the cache by aging every entry past its size.
+        void flush()
+        {
+            clock += size;
+        }
+    };
+
+    // Sorts triangle clusters by decreasing key.
+    struct TriangleCluster
+    {
+        int firstTriangle;
+        int triangleCount;
+        float key;
+    };
+
+    bool TriangleClusterCompFunc(const TriangleCluster &lhs, const TriangleCluster &rhs)
+    {
+        return lhs.key > rhs.key;
+    }
+
+    // Post-transform cache size assumed by optimizeOverdraw() and
+    // getVertexFetchStatistics().
+    const int SIMULATED_VERTEX_CACHE_SIZE = 16;
+
+    // Vertex fetch is simulated with a direct mapped cache. Real vertex
+    // fetch caches differ per GPU, so this is only meant to compare vertex
+    // orders with each other.
+    const int FETCH_CACHE_LINE_SIZE = 64;
+    const int FETCH_CACHE_LINES = 128 * 1024 / FETCH_CACHE_LINE_SIZE;
+
+    // Reorders a stream of vertices with components floats each. Vertices
+    // mapped to -1 are dropped.
+    void RemapStream(std::vector<float> &stream, int components,
+                     const std::vector<int> &remap, int count)
+    {
+        if (stream.empty())
+            return;
+
+        std::vector<float> remapped(static_cast<size_t>(count) * components);
+
+        for (int i = 0; i < static_cast<int>(remap.size()); ++i)
+        {
+            if (remap[i] < 0)
+                continue;
+
+            for (int j = 0; j < components; ++j)
+                remapped[remap[i] * components + j] = stream[i * components + j];
+        }
+
+        stream.swap(remapped);
+    }
+
+    // Quadric error metric of Garland and Heckbert. The sums are weighted,
+    // so dividing by the total weight gives the mean squared distance.
+    struct Quadric
+    {
+        double a00, a01, a02, a11, a12, a22;
+        double b0, b1, b2;
+        double c;
+        double w;
+    };
+
+    // Adds the squared distance to the plane n.p + d = 0.
+    void AddPlaneQuadric(Quadric &q, const double n[3], double d, double weight)
+    {
+        q.a00 += weight * n[0] * n[0];
+        q.a01 += weight * n[0] * n[1];
+        q.a02 += weight * n[0] * n[2];
+        q.a11 += weight * n[1] * n[1];
+        q.a12 += weight * n[1] * n[2];
+        q.a22 += weight * n[2] * n[2];
+        q.b0 += weight * n[0] * d;
+        q.b1 += weight * n[1] * d;
+        q.b2 += weight * n[2] * d;
+        q.c += weight * d * d;
+        q.w += weight;
+    }
+
+    void AddQuadric(Quadric &q, const Quadric &other)
+    {
+        q.a00 += other.a00; q.a01 += other.a01; q.a02 += other.a02;
+        q.a11 += other.a11; q.a12 += other.a12; q.a22 += other.a22;
+        q.b0 += other.b0; q.b1 += other.b1; q.b2 += other.b2;
+        q.c += other.c;
+        q.w += other.w;
+    }
+
+    double QuadricError(const Quadric &q, const float p[3])
+    {
+        double x = p[0], y = p[1], z = p[2];
+        double error = q.a00 * x * x + q.a11 * y * y + q.a22 * z * z +
+            2.0 * (q.a01 * x * y + q.a02 * x * z + q.a12 * y * z) +
+            2.0 * (q.b0 * x + q.b1 * y + q.b2 * z) + q.c;
+
+        return (q.w > 0.0) ? fabs(error) / q.w : 0.0;
+    }
+
+    // Edges on UV seams, borders and material boundaries are kept on their
+    // curve with a plane through the edge, perpendicular to the triangle.
+    const double SIMPLIFY_BOUNDARY_WEIGHT = 2.0;
+
+    // Position classes. A free position may collapse along any edge. A
+    // position on exactly two special edges is on a boundary curve and may
+    // only move along it. Anything else, e.g. the corner of a seam, is
+    // locked.
+    enum SimplifyVertexKind
+    {
+        SIMPLIFY_FREE,
+        SIMPLIFY_CURVE,
+        SIMPLIFY_LOCKED
+    };
+
+    // A triangle edge between two welded positions a < b with the vertices
+    // the triangle uses at either end.
+    struct SimplifyEdge
+    {
+        int a;
+        int b;
+        int vertexA;
+        int vertexB;
+        int material;
+        int triangle;
+        bool special;
+    };
+
+    bool SimplifyEdgeCompFunc(const SimplifyEdge &lhs, const SimplifyEdge &rhs)
+    {
+        if (lhs.a != rhs.a)
+            return lhs.a < rhs.a;
+
+        return lhs.b < rhs.b;
+    }
+
+    // Moving position 'from' onto position 'to'.
+    struct SimplifyCollapse
+    {
+        int from;
+        int to;
+        double cost;
+    };
+
+    bool SimplifyCollapseCompFunc(const SimplifyCollapse &lhs, const SimplifyCollapse &rhs)
+    {
+        return lhs.cost < rhs.cost;
+    }
+
+    // Orders vertex indices by position.
+    struct PositionLess
+    {
+        const float *pPositions;
+        int stride;
+
+        bool operator()(int lhs, int rhs) const
+        {
+            const float *p = pPositions + lhs * stride;
+            const float *q = pPositions + rhs * stride;
+
+            if (p[0] != q[0])
+                return p[0] < q[0];
+
+            if (p[1] != q[1])
+                return p[1] < q[1];
+
+            return p[2] < q[2];
+        }
+    };
+
+    // Welds vertices with identical positions. Returns the number of
+    // distinct positions and the position of every vertex in pIds.
+    int WeldPositions(const float *pPositions, int stride, int count, int *pIds)
+    {
+        std::vector<int> order(count);
+
+        for (int i = 0; i < count; ++i)
+            order[i] = i;
+
+        PositionLess less = {pPositions, stride};
+        int positions = 0;
+
+        std::sort(order.begin(), order.end(), less);
+
+        for (int i = 0; i < count; ++i)
+        {
+            if (i > 0 && less(order[i - 1], order[i]))
+                ++positions;
+
+            pIds[order[i]] = positions;
+        }
+
+        return (count > 0) ? positions + 1 : 0;
+    }
+
+    void TriangleNormal(const float *p0, const float *p1, const float *p2, double n[3])
+    {
+        double e0[3] = {p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2]};
+        double e1[3] = {p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2]};
+
+        n[0] = e0[1] * e1[2] - e0[2] * e1[1];
+        n[1] = e0[2] * e1[0] - e0[0] * e1[2];
+        n[2] = e0[0] * e1[1] - e0[1] * e1[0];
+    }
+
+    // The mesh being simplified. Triangles are stored as the vertices of
+    // their corners, -1 once collapsed, and remember the original triangle
+    // they came from.
+    struct SimplifyState
+    {
+        const float *pPositions;
+        int stride;
+        const int *pMaterials;
+        std::vector<int> positionOf;
+        std::vector<int> triangles;
+        std::vector<int> origins;
+        std::vector<Quadric> quadrics;
+        bool boundaryQuadrics;
+
+        // Scratch memory of SimplifyPass().
+        std::vector<SimplifyEdge> edges;
+        std::vector<int> specialEdges;
+        std::vector<SimplifyCollapse> collapses;
+        std::vector<int> firstIncident;
+        std::vector<int> incident;
+        std::vector<char> locked;
+        std::vector<int> wedges;
+    };
+
+    inline const float *SimplifyPosition(const SimplifyState &state, int vertex)
+    {
+        return state.pPositions + vertex * state.stride;
+    }
+
+    // Checks that position 'from' can be moved onto position 'to': every
+    // vertex at 'from' must map to a single vertex at 'to' through the
+    // triangles sharing the edge, and no remaining triangle may flip.
+    // Fills state.wedges with pairs of vertices.
+    bool CanCollapse(SimplifyState &state, int from, int to)
+    {
+        const int *pIncident = &state.incident[state.firstIncident[from]];
+        int count = state.firstIncident[from + 1] - state.firstIncident[from];
+
+        state.wedges.clear();
+
+        for (int i = 0; i < count; ++i)
+        {
+            const int *pTriangle = &state.triangles[pIncident[i] * 3];
+            int vertexFrom = -1;
+            int vertexTo = -1;
+
+            if (pTriangle[0] < 0)
+                continue;
+
+            for (int j = 0; j < 3; ++j)
+            {
+                if (state.positionOf[pTriangle[j]] == from)
+                    vertexFrom = pTriangle[j];
+                else if (state.positionOf[pTriangle[j]] == to)
+                    vertexTo = pTriangle[j];
+            }
+
+            if (vertexTo < 0)
+                continue;
+
+            bool found = false;
+
+            for (int j = 0; j < static_cast<int>(state.wedges.size()); j += 2)
+            {
+                if (state.wedges[j] == vertexFrom)
+                {
+                    if (state.wedges[j + 1] != vertexTo)
+                        return false;
+
+                    found = true;
+                }
+            }
+
+            if (!found)
+            {
+                state.wedges.push_back(vertexFrom);
+                state.wedges.push_back(vertexTo);
+            }
+        }
+
+        if (state.wedges.empty())
+            return false;
+
+        const float *pTo = SimplifyPosition(state, state.wedges[1]);
+
+        for (int i = 0; i < count; ++i)
+        {
+            const int *pTriangle = &state.triangles[pIncident[i] * 3];
+            const float *p[3];
+            const float *q[3];
+            bool mapped = false;
+            bool hasTo = false;
+
+            if (pTriangle[0] < 0)
+                continue;
+
+            for (int j = 0; j < 3; ++j)
+            {
+                int position = state.positionOf[pTriangle[j]];
+
+                p[j] = q[j] = SimplifyPosition(state, pTriangle[j]);
+                hasTo = hasTo || (position == to);
+
+                if (position != from)
+                    continue;
+
+                for (int k = 0; k < static_cast<int>(state.wedges.size()); k += 2)
+                    mapped = mapped || (state.wedges[k] == pTriangle[j]);
+
+                q[j] = pTo;
+            }
+
+            if (hasTo)
+                continue;
+
+            if (!mapped)
+                return false;
+
+            double before[3];
+            double after[3];
+
+            TriangleNormal(p[0], p[1], p[2], before);
+            TriangleNormal(q[0], q[1], q[2], after);
+
+            if (before[0] * after[0] + before[1] * after[1] + before[2] * after[2] <= 0.0)
+                return false;
+        }
+
+        return true;
+    }
+
+    // Runs one round of edge collapses, cheapest first, until the mesh is
+    // down to target triangles or no collapse within errorLimit is left.
+    // A position takes part in at most one collapse per round. Returns the
+    // number of triangles removed and raises error to the largest cost.
+    int SimplifyPass(SimplifyState &state, int numberOfPositions, int target,
+                     double errorLimit, double &error)
+    {
+        int count = static_cast<int>(state.triangles.size()) / 3;
+
+        // Collect the edges and find the special ones: borders, non
+        // manifold edges, material boundaries and seams.
+
+        state.edges.clear();
+
+        for (int i = 0; i < count; ++i)
+        {
+            const int *pTriangle = &state.triangles[i * 3];
+
+            for (int j = 0; j < 3; ++j)
+            {
+                SimplifyEdge edge;
+
+                edge.vertexA = pTriangle[j];
+                edge.vertexB = pTriangle[(j + 1) % 3];
+                edge.a = state.positionOf[edge.vertexA];
+                edge.b = state.positionOf[edge.vertexB];
+                edge.material = state.pMaterials[state.origins[i]];
+                edge.triangle = i;
+                edge.special = false;
+
+                if (edge.a > edge.b)
+                {
+                    std::swap(edge.a, edge.b);
+                    std::swap(edge.vertexA, edge.vertexB);
+                }
+
+                state.edges.push_back(edge);
+            }
+        }
+
+        std::sort(state.edges.begin(), state.edges.end(), SimplifyEdgeCompFunc);
+
+        std::vector<int> &special = state.specialEdges;
+        std::vector<char> kinds(numberOfPositions);
+
+        special.assign(numberOfPositions, 0);
+
+        int numberOfEdges = 0;
+
+        for (int i = 0; i < static_cast<int>(state.edges.size()); )
+        {
+            SimplifyEdge first = state.edges[i];
+            int end = i + 1;
+
+            while (end < static_cast<int>(state.edges.size()) &&
+                   state.edges[end].a == first.a && state.edges[end].b == first.b)
+            {
+                ++end;
+            }
+
+            bool isSpecial = (end - i != 2);
+
+            for (int j = i + 1; j < end && !isSpecial; ++j)
+            {
+                isSpecial = state.edges[j].vertexA != first.vertexA ||
+                    state.edges[j].vertexB != first.vertexB ||
+                    state.edges[j].material != first.material;
+            }
+
+            if (isSpecial)
+            {
+                ++special[first.a];
+                ++special[first.b];
+
+                for (int j = i; j < end && state.boundaryQuadrics; ++j)
+                {
+                    const SimplifyEdge &edge = state.edges[j];
+                    const int *pTriangle = &state.triangles[edge.triangle * 3];
+                    const float *pA = SimplifyPosition(state, edge.vertexA);
+                    const float *pB = SimplifyPosition(state, edge.vertexB);
+                    double n[3];
+                    double e[3] = {pB[0] - pA[0], pB[1] - pA[1], pB[2] - pA[2]};
+
+                    TriangleNormal(SimplifyPosition(state, pTriangle[0]),
+                        SimplifyPosition(state, pTriangle[1]),
+                        SimplifyPosition(state, pTriangle[2]), n);
+
+                    double m[3] =
+                    {
+                        e[1] * n[2] - e[2] * n[1],
+                        e[2] * n[0] - e[0] * n[2],
+                        e[0] * n[1] - e[1] * n[0]
+                    };
+                    double length = sqrt(m[0] * m[0] + m[1] * m[1] + m[2] * m[2]);
+
+                    if (length <= 0.0)
+                        continue;
+
+                    m[0] /= length;
+                    m[1] /= length;
+                    m[2] /= length;
+
+                    double d = -(m[0] * pA[0] + m[1] * pA[1] + m[2] * pA[2]);
+                    double weight = SIMPLIFY_BOUNDARY_WEIGHT * (e[0] * e[0] + e[1] * e[1] + e[2] * e[2]);
+
+                    AddPlaneQuadric(state.quadrics[edge.a], m, d, weight);
+                    AddPlaneQuadric(state.quadrics[edge.b], m, d, weight);
+                }
+            }
+
+            // Keep one edge per pair of positions.
+            first.special = isSpecial;
+            state.edges[numberOfEdges++] = first;
+            i = end;
+        }
+
+        state.edges.resize(numberOfEdges);
+
+        state.boundaryQuadrics = false;
+
+        for (int i = 0; i < numberOfPositions; ++i)
+        {
+            if (special[i] == 0)
+                kinds[i] = SIMPLIFY_FREE;
+            else if (special[i] == 2)
+                kinds[i] = SIMPLIFY_CURVE;
+            else
+                kinds[i] = SIMPLIFY_LOCKED;
+        }
+
+        // Cheapest direction of every edge that may collapse.
+
+        state.collapses.clear();
+
+        for (int i = 0; i < numberOfEdges; ++i)
+        {
+            const SimplifyEdge &edge = state.edges[i];
+            bool canMoveA = kinds[edge.a] == SIMPLIFY_FREE || (kinds[edge.a] == SIMPLIFY_CURVE && edge.special);
+            bool canMoveB = kinds[edge.b] == SIMPLIFY_FREE || (kinds[edge.b] == SIMPLIFY_CURVE && edge.special);
+
+            if (!canMoveA && !canMoveB)
+                continue;
+
+            Quadric sum = state.quadrics[edge.a];
+            AddQuadric(sum, state.quadrics[edge.b]);
+
+            SimplifyCollapse collapse;
+            double costAB = canMoveA ? QuadricError(sum, SimplifyPosition(state, edge.vertexB)) : DBL_MAX;
+            double costBA = canMoveB ? QuadricError(sum, SimplifyPosition(state, edge.vertexA)) : DBL_MAX;
+
+            collapse.from = (costAB <= costBA) ? edge.a : edge.b;
+            collapse.to = (costAB <= costBA) ? edge.b : edge.a;
+            collapse.cost = std::min(costAB, costBA);
+
+            if (collapse.cost <= errorLimit)
+                state.collapses.push_back(collapse);
+        }
+
+        std::sort(state.collapses.begin(), state.collapses.end(), SimplifyCollapseCompFunc);
+
+        // Triangles around each position.
+
+        state.firstIncident.assign(numberOfPositions + 1, 0);
+        state.incident.resize(count * 3);
+
+        for (int i = 0; i < count * 3; ++i)
+            ++state.firstIncident[state.positionOf[state.triangles[i]] + 1];
+
+        for (int i = 0; i < numberOfPositions; ++i)
+            state.firstIncident[i + 1] += state.firstIncident[i];
+
+        for (int i = 0; i < count * 3; ++i)
+            state.incident[state.firstIncident[state.positionOf[state.triangles[i]]]++] = i / 3;
+
+        for (int i = numberOfPositions; i > 0; --i)
+            state.firstIncident[i] = state.firstIncident[i - 1];
+
+        state.firstIncident[0] = 0;
+
+        // Collapse.
+
+        int removed = 0;
+
+        state.locked.assign(numberOfPositions, 0);
+
+        for (int i = 0; i < static_cast<int>(state.collapses.size()) && count - removed > target; ++i)
+        {
+            const SimplifyCollapse &collapse = state.collapses[i];
+
+            if (state.locked[collapse.from] || state.locked[collapse.to] ||
+                !CanCollapse(state, collapse.from, collapse.to))
+            {
+                continue;
+            }
+
+            const int *pIncident = &state.incident[state.firstIncident[collapse.from]];
+            int incidentCount = state.firstIncident[collapse.from + 1] - state.firstIncident[collapse.from];
+
+            for (int j = 0; j < incidentCount; ++j)
+            {
+                int *pTriangle = &state.triangles[pIncident[j] * 3];
+                bool hasTo = false;
+
+                if (pTriangle[0] < 0)
+                    continue;
+
+                for (int k = 0; k < 3; ++k)
+                    hasTo = hasTo || (state.positionOf[pTriangle[k]] == collapse.to);
+
+                if (hasTo)
+                {
+                    pTriangle[0] = pTriangle[1] = pTriangle[2] = -1;
+                    ++removed;
+                    continue;
+                }
+
+                for (int k = 0; k < 3; ++k)
+                {
+                    if (state.positionOf[pTriangle[k]] != collapse.from)
+                        continue;
+
+                    for (int w = 0; w < static_cast<int>(state.wedges.size()); w += 2)
+                    {
+                        if (state.wedges[w] == pTriangle[k])
+                        {
+                            pTriangle[k] = state.wedges[w + 1];
+                            break;
+                        }
+                    }
+                }
+            }
+
+            AddQuadric(state.quadrics[collapse.to], state.quadrics[collapse.from]);
+            state.locked[collapse.from] = 1;
+            state.locked[collapse.to] = 1;
+            error = std::max(error, collapse.cost);
+        }
+
+        // Drop the collapsed triangles.
+
+        int kept = 0;
+
+        for (int i = 0; i < count; ++i)
+        {
+            if (state.triangles[i * 3] < 0)
+                continue;
+
+            for (int j = 0; j < 3; ++j)
+                state.triangles[kept * 3 + j] = state.triangles[i * 3 + j];
+
+            state.origins[kept++] = state.origins[i];
+        }
+
+        state.triangles.resize(kept * 3);
+        state.origins.resize(kept);
+
+        return removed;
+    }
+
+    // Meshlet limits. 64 vertices and 124 triangles fit the per workgroup
+    // output limits of mesh shaders on most hardware.
+    const int MESHLET_MAX_VERTICES = 64;
+    const int MESHLET_MAX_TRIANGLES = 124;
+
+    // Splits a mesh into meshlets. Each meshlet grows by the triangle that
+    // adds the fewest new vertices among those sharing a vertex with it, so
+    // meshlets stay compact, which keeps their bounds tight. The current
+    // triangle order seeds new meshlets. Writes the new triangle order to
+    // pOrder and the triangle count of every meshlet to sizes.
+    void BuildMeshletOrder(const int *pIndices, int triangleCount,
+                           int numberOfVertices, ForsythWorkspace &work,
+                           int *pOrder, std::vector<int> &sizes)
+    {
+        int indexCount = triangleCount * 3;
+        int vertexCount = 0;
+
+        sizes.clear();
+
+        // Renumber the mesh's vertices from 0 and list the triangles using
+        // each of them, as in OptimizeTriangleOrder().
+
+        work.localVertex.resize(numberOfVertices, -1);
+        work.indices.resize(indexCount);
+
+        for (int i = 0; i < indexCount; ++i)
+        {
+            int &local = work.localVertex[pIndices[i]];
+
+            if (local < 0)
+                local = vertexCount++;
+
+            work.indices[i] = local;
+        }
+
+        for (int i = 0; i < indexCount; ++i)
+            work.localVertex[pIndices[i]] = -1;
+
+        work.remaining.assign(vertexCount, 0);
+        work.firstTriangle.resize(vertexCount + 1);
+        work.triangles.resize(indexCount);
+
+        for (int i = 0; i < indexCount; ++i)
+            ++work.remaining[work.indices[i]];
+
+        work.firstTriangle[0] = 0;
+
+        for (int i = 0; i < vertexCount; ++i)
+            work.firstTriangle[i + 1] = work.firstTriangle[i] + work.remaining[i];
+
+        work.remaining.assign(vertexCount, 0);
+
+        for (int i = 0; i < indexCount; ++i)
+        {
+            int v = work.indices[i];
+            work.triangles[work.firstTriangle[v] + work.remaining[v]++] = i / 3;
+        }
+
+        // cachePosition holds the meshlet a vertex was last added to.
+
+        work.cachePosition.assign(vertexCount, -1);
+        work.emitted.assign(triangleCount, 0);
+
+        int meshletVertices[MESHLET_MAX_VERTICES];
+        int vertices = 0;
+        int triangles = 0;
+        int nextInput = 0;
+
+        for (int emitted = 0; emitted < triangleCount; )
+        {
+            int meshlet = static_cast<int>(sizes.size());
+            int best = -1;
+            int bestNew = 4;
+
+            for (int i = 0; i < vertices && bestNew > 0; ++i)
+            {
+                int v = meshletVertices[i];
+                const int *pList = &work.triangles[work.firstTriangle[v]];
+
+                for (int j = 0; j < work.remaining[v]; ++j)
+                {
+                    const int *pTriangle = &work.indices[pList[j] * 3];
+                    int added = 0;
+
+                    for (int k = 0; k < 3; ++k)
+                        added += (work.cachePosition[pTriangle[k]] != meshlet) ? 1 : 0;
+
+                    if (added < bestNew)
+                    {
+                        best = pList[j];
+                        bestNew = added;
+                    }
+                }
+            }
+
+            if (best < 0)
+            {
+                while (work.emitted[nextInput])
+                    ++nextInput;
+
+                best = nextInput;
+                bestNew = 0;
+
+                for (int k = 0; k < 3; ++k)
+                    bestNew += (work.cachePosition[work.indices[best * 3 + k]] != meshlet) ? 1 : 0;
+            }
+
+            // Start a new meshlet when the triangle doesn't fit.
+            if (vertices + bestNew > MESHLET_MAX_VERTICES || triangles == MESHLET_MAX_TRIANGLES)
+            {
+                sizes.push_back(triangles);
+                vertices = 0;
+                triangles = 0;
+                continue;
+            }
+
+            const int *pTriangle = &work.indices[best * 3];
+
+            for (int k = 0; k < 3; ++k)
+            {
+                int v = pTriangle[k];
+                int *pList = &work.triangles[work.firstTriangle[v]];
+                int last = --work.remaining[v];
+
+                if (work.cachePosition[v] != meshlet)
+                {
+                    work.cachePosition[v] = meshlet;
+                    meshletVertices[vertices++] = v;
+                }
+
+                for (int j = 0; j <= last; ++j)
+                {
+                    if (pList[j] == best)
+                    {
+                        pList[j] = pList[last];
+                        pList[last] = best;
+                        break;
+                    }
+                }
+            }
+
+            work.emitted[best] = 1;
+            pOrder[emitted++] = best;
+            ++triangles;
+        }
+
+        if (triangles > 0)
+            sizes.push_back(triangles);
+    }
+
+    // Bounding volume hierarchy. Nodes are split where the surface area
+    // heuristic over BVH_BINS bins of triangle centroids per axis is lowest.
+    // Leaves keep their triangles in blocks of four that are intersected
+    // together, so the costs are counted in blocks.
+    const int BVH_BINS = 16;
+    const int BVH_MAX_LEAF_SIZE = 16;
+    const float BVH_TRAVERSAL_COST = 1.0f;
+
+    // Deeper nodes are split at the object median, which limits the depth
+    // of the tree and so the size of the traversal stack.
+    const int BVH_MEDIAN_SPLIT_DEPTH = 64;
+    const int BVH_STACK_SIZE = 128;
+
+    // The top of the tree is built one node at a time, binning the large
+    // nodes on several threads, until there are enough subtrees to build
+    // the rest of the tree in parallel.
+    const int MIN_TRIANGLES_PER_BVH_SUBTREE = 4096;
+    const int BVH_SUBTREES_PER_THREAD = 4;
+
+    // A block holds v0, e1 = v1 - v0 and e2 = v2 - v0 of four triangles as
+    // nine groups of four floats: v0.x of the four triangles, then v0.y...
+    const int BVH_BLOCK_SIZE = 4;
+    const int BVH_FLOATS_PER_TRIANGLE = 9;
+
+    // Direction components closer to zero are clamped so that the slab
+    // tests never compute 0 * infinity.
+    const float BVH_MIN_DIRECTION = 1e-20f;
+
+    struct BvhBounds
+    {
+        float minimum[3];
+        float maximum[3];
+
+        void reset()
+        {
+            for (int i = 0; i < 3; ++i)
+            {
+                minimum[i] = std::numeric_limits<float>::max();
+                maximum[i] = -std::numeric_limits<float>::max();
+            }
+        }
+
+        void grow(const float p[3])
+        {
+            for (int i = 0; i < 3; ++i)
+            {
+                minimum[i] = std::min(minimum[i], p[i]);
+                maximum[i] = std::max(maximum[i], p[i]);
+            }
+        }
+
+        void grow(const BvhBounds &other)
+        {
+            for (int i = 0; i < 3; ++i)
+            {
+                minimum[i] = std::min(minimum[i], other.minimum[i]);
+                maximum[i] = std::max(maximum[i], other.maximum[i]);
+            }
+        }
+
+        float area() const
+        {
+            float x = maximum[0] - minimum[0];
+            float y = maximum[1] - minimum[1];
+            float z = maximum[2] - minimum[2];
+
+            return (x < 0.0f) ? 0.0f : x * y + y * z + z * x;
+        }
+    };
+
+    struct BvhBinning
+    {
+        BvhBounds bounds[3][BVH_BINS];
+        int counts[3][BVH_BINS];
+    };
+
+    // A node while the tree is built. Leaves have no children. A node of the
+    // top of the tree may stand for the root of one of the subtrees.
+    struct BvhBuildNode
+    {
+        BvhBounds bounds;
+        int start;
+        int count;
+        int children[2];
+        int subtree;
+    };
+
+    struct BvhBuilder
+    {
+        std::vector<BvhBounds> bounds;      // of every triangle
+        std::vector<float> centroids;       // 3 floats per triangle
+        std::vector<int> triangles;         // partitioned as nodes are split
+    };
+
+    struct BvhCentroidLess
+    {
+        const float *pCentroids;
+        int axis;
+
+        bool operator()(int lhs, int rhs) const
+        { return pCentroids[lhs * 3 + axis] < pCentroids[rhs * 3 + axis]; }
+    };
+
+    inline int BvhBlocks(int count)
+    {
+        return (count + BVH_BLOCK_SIZE - 1) / BVH_BLOCK_SIZE;
+    }
+
+    inline int BvhBin(float centroid, float minimum, float scale)
+    {
+        int bin = static_cast<int>((centroid - minimum) * scale);
+        return (bin < 0) ? 0 : std::min(bin, BVH_BINS - 1);
+    }
+
+    inline float BvhInverse(float direction)
+    {
+        if (fabsf(direction) < BVH_MIN_DIRECTION)
+            direction = (direction < 0.0f) ? -BVH_MIN_DIRECTION : BVH_MIN_DIRECTION;
+
+        return 1.0f / direction;
+    }
+
+    // Computes the bounds of the triangles [first, last) of the builder and
+    // the bounds of their centroids.
+    void BoundBvhTriangles(const BvhBuilder &builder, int first, int last,
+                           BvhBounds &bounds, BvhBounds &centroidBounds)
+    {
+        bounds.reset();
+        centroidBounds.reset();
+
+        for (int i = first; i < last; ++i)
+        {
+            int triangle = builder.triangles[i];
+
+            bounds.grow(builder.bounds[triangle]);
+            centroidBounds.grow(&builder.centroids[triangle * 3]);
+        }
+    }
+
+    void BinBvhTriangles(const BvhBuilder &builder, int first, int last,
+                         const BvhBounds &centroidBounds, const float scales[3],
+                         BvhBinning &binning)
+    {
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            for (int bin = 0; bin < BVH_BINS; ++bin)
+            {
+                binning.bounds[axis][bin].reset();
+                binning.counts[axis][bin] = 0;
+            }
+        }
+
+        for (int i = first; i < last; ++i)
+        {
+            int triangle = builder.triangles[i];
+            const float *pCentroid = &builder.centroids[triangle * 3];
+
+            for (int axis = 0; axis < 3; ++axis)
+            {
+                if (scales[axis] <= 0.0f)
+                    continue;
+
+                int bin = BvhBin(pCentroid[axis], centroidBounds.minimum[axis], scales[axis]);
+
+                binning.bounds[axis][bin].grow(builder.bounds[triangle]);
+                ++binning.counts[axis][bin];
+            }
+        }
+    }
+
+    // Computes the bounds of a node and decides how to split it. Returns the
+    // first triangle of the node's second child, or -1 if the node is a
+    // leaf. The node's triangles are partitioned accordingly. With a pool,
+    // the triangles are bounded and binned on several threads. Either way
+    // the result is the same.
+    int SplitBvhNode(BvhBuilder &builder, BvhBuildNode &node, int depth,
+                     ThreadPool *pPool, int numberOfTasks)
+    {
+        int first = node.start;
+        int last = node.start + node.count;
+        BvhBounds centroidBounds;
+
+        if (pPool && numberOfTasks > 1)
+        {
+            std::vector<BvhBounds> bounds(numberOfTasks * 2);
+
+            pPool->run(numberOfTasks, [&](int task)
+            {
+                BoundBvhTriangles(builder,
+                    first + static_cast<int>(static_cast<long long>(node.count) * task / numberOfTasks),
+                    first + static_cast<int>(static_cast<long long>(node.count) * (task + 1) / numberOfTasks),
+                    bounds[task * 2], bounds[task * 2 + 1]);
+            });
+
+            node.bounds = bounds[0];
+            centroidBounds = bounds[1];
+
+            for (int task = 1; task < numberOfTasks; ++task)
+            {
+                node.bounds.grow(bounds[task * 2]);
+                centroidBounds.grow(bounds[task * 2 + 1]);
+            }
+        }
+        else
+        {
+            BoundBvhTriangles(builder, first, last, node.bounds, centroidBounds);
+        }
+
+        if (node.count <= BVH_BLOCK_SIZE)
+            return -1;
+
+        float scales[3];
+        int widest = 0;
+
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            float extent = centroidBounds.maximum[axis] - centroidBounds.minimum[axis];
+
+            scales[axis] = (extent > 0.0f) ? BVH_BINS * 0.99999f / extent : 0.0f;
+
+            if (extent > centroidBounds.maximum[widest] - centroidBounds.minimum[widest])
+                widest = axis;
+        }
+
+        // Triangles with the same centroid can't be told apart.
+
+        if (scales[widest] <= 0.0f)
+            return (node.count <= BVH_MAX_LEAF_SIZE) ? -1 : first + node.count / 2;
+
+        if (depth >= BVH_MEDIAN_SPLIT_DEPTH)
+        {
+            BvhCentroidLess less = {&builder.centroids[0], widest};
+            int middle = first + node.count / 2;
+
+            std::nth_element(builder.triangles.begin() + first,
+                builder.triangles.begin() + middle,
+                builder.triangles.begin() + last, less);
+
+            return middle;
+        }
+
+        BvhBinning binning;
+
+        if (pPool && numberOfTasks > 1)
+        {
+            std::vector<BvhBinning> binnings(numberOfTasks);
+
+            pPool->run(numberOfTasks, [&](int task)
+            {
+                BinBvhTriangles(builder,
+                    first + static_cast<int>(static_cast<long long>(node.count) * task / numberOfTasks),
+                    first + static_cast<int>(static_cast<long long>(node.count) * (task + 1) / numberOfTasks),
+                    centroidBounds, scales, binnings[task]);
+            });
+
+            binning = binnings[0];
+
+            for (int task = 1; task < numberOfTasks; ++task)
+            {
+                for (int axis = 0; axis < 3; ++axis)
+                {
+                    for (int bin = 0; bin < BVH_BINS; ++bin)
+                    {
+                        binning.bounds[axis][bin].grow(binnings[task].bounds[axis][bin]);
+                        binning.counts[axis][bin] += binnings[task].counts[axis][bin];
+                    }
+                }
+            }
+        }
+        else
+        {
+            BinBvhTriangles(builder, first, last, centroidBounds, scales, binning);
+        }
+
+        // Sweep the bins from both sides to find the cheapest split.
+
+        float parentArea = node.bounds.area();
+        float inverseArea = (parentArea > 0.0f) ? 1.0f / parentArea : 0.0f;
+        float bestCost = std::numeric_limits<float>::max();
+        int bestAxis = widest;
+        int bestBin = 0;
+
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            if (scales[axis] <= 0.0f)
+                continue;
+
+            float rightAreas[BVH_BINS];
+            int rightCounts[BVH_BINS];
+            BvhBounds bounds;
+            int count = 0;
+
+            bounds.reset();
+
+            for (int bin = BVH_BINS - 1; bin > 0; --bin)
+            {
+                bounds.grow(binning.bounds[axis][bin]);
+                count += binning.counts[axis][bin];
+                rightAreas[bin] = bounds.area();
+                rightCounts[bin] = count;
+            }
+
+            bounds.reset();
+            count = 0;
+
+            for (int bin = 0; bin < BVH_BINS - 1; ++bin)
+            {
+                bounds.grow(binning.bounds[axis][bin]);
+                count += binning.counts[axis][bin];
+
+                if (count == 0 || rightCounts[bin + 1] == 0)
+                    continue;
+
+                float cost = BVH_TRAVERSAL_COST + inverseArea *
+                    (bounds.area() * BvhBlocks(count) +
+                    rightAreas[bin + 1] * BvhBlocks(rightCounts[bin + 1]));
+
+                if (cost < bestCost)
+                {
+                    bestCost = cost;
+                    bestAxis = axis;
+                    bestBin = bin;
+                }
+            }
+        }
+
+        if (node.count <= BVH_MAX_LEAF_SIZE && bestCost >= BvhBlocks(node.count))
+            return -1;
+
+        int middle = first;
+
+        for (int i = first; i < last; ++i)
+        {
+            int triangle = builder.triangles[i];
+            int bin = BvhBin(builder.centroids[triangle * 3 + bestAxis],
+                centroidBounds.minimum[bestAxis], scales[bestAxis]);
+
+            if (bin <= bestBin)
+                std::swap(builder.triangles[i], builder.triangles[middle++]);
+        }
+
+        return middle;
+    }
+
+    // Builds the subtree of the triangles [start, start + count) of the
+    // builder into nodes and returns its root.
+    int BuildBvhSubtree(BvhBuilder &builder, std::vector<BvhBuildNode> &nodes,
+                        int start, int count, int depth)
+    {
+        BvhBuildNode node;
+
+        node.start = start;
+        node.count = count;
+        node.children[0] = node.children[1] = -1;
+        node.subtree = -1;
+
+        int middle = SplitBvhNode(builder, node, depth, 0, 1);
+        int index = static_cast<int>(nodes.size());
+
+        nodes.push_back(node);
+
+        if (middle >= 0)
+        {
+            int left = BuildBvhSubtree(builder, nodes, start, middle - start, depth + 1);
+            int right = BuildBvhSubtree(builder, nodes, middle, start + count - middle, depth + 1);
+
+            nodes[index].children[0] = left;
+            nodes[index].children[1] = right;
+        }
+
+        return index;
+    }
+
+    // Appends the tree below nodes[index] to the flattened nodes in depth
+    // first order, and the triangles of its leaves to the triangle slots.
+    // Every leaf starts at a new block, unused slots are -1.
+    void FlattenBvh(const BvhBuilder &builder, const std::vector<BvhBuildNode> &nodes,
+                    int index, const std::vector<std::vector<BvhBuildNode> > &subtrees,
+                    std::vector<ModelOBJ::BvhNode> &flatNodes, std::vector<int> &slots)
+    {
+        const BvhBuildNode &node = nodes[index];
+
+        if (node.subtree >= 0)
+        {
+            FlattenBvh(builder, subtrees[node.subtree], 0, subtrees, flatNodes, slots);
+            return;
+        }
+
+        int position = static_cast<int>(flatNodes.size());
+        ModelOBJ::BvhNode flatNode;
+
+        for (int i = 0; i < 3; ++i)
+        {
+            flatNode.minimum[i] = node.bounds.minimum[i];
+            flatNode.maximum[i] = node.bounds.maximum[i];
+        }
+
+        if (node.children[0] < 0)
+        {
+            flatNode.start = static_cast<int>(slots.size());
+            flatNode.count = node.count;
+            flatNodes.push_back(flatNode);
+
+            slots.insert(slots.end(), builder.triangles.begin() + node.start,
+                builder.triangles.begin() + node.start + node.count);
+            slots.resize(BvhBlocks(static_cast<int>(slots.size())) * BVH_BLOCK_SIZE, -1);
+            return;
+        }
+
+        flatNode.start = 0;
+        flatNode.count = 0;
+        flatNodes.push_back(flatNode);
+
+        FlattenBvh(builder, nodes, node.children[0], subtrees, flatNodes, slots);
+        flatNodes[position].start = static_cast<int>(flatNodes.size());
+        FlattenBvh(builder, nodes, node.children[1], subtrees, flatNodes, slots);
+    }
+
+    inline bool IntersectBvhBounds(const ModelOBJ::BvhNode &node, const float origin[3],
+                                   const float inverse[3], float tMax, float &entry)
+    {
+        float t0 = 0.0f;
+        float t1 = tMax;
+
+        for (int i = 0; i < 3; ++i)
+        {
+            float a = (node.minimum[i] - origin[i]) * inverse[i];
+            float b = (node.maximum[i] - origin[i]) * inverse[i];
+
+            t0 = std::max(t0, std::min(a, b));
+            t1 = std::min(t1, std::max(a, b));
+        }
+
+        entry = t0;
+        return t0 <= t1;
+    }
+
+    // Intersects a ray with the four triangles of a block (Moller and
+    // Trumbore, both faces) and records the hit if it is closer than the
+    // current one.
+    void IntersectBvhBlock(const float *pBlock, const int *pTriangles,
+                           const float origin[3], const float direction[3],
+                           ModelOBJ::RayHit &hit)
+    {
+        float t[BVH_BLOCK_SIZE];
+        float u[BVH_BLOCK_SIZE];
+        float v[BVH_BLOCK_SIZE];
+        int mask = 0;
+
+#if defined(MODEL_OBJ_SSE2)
+        const __m128 zero = _mm_setzero_ps();
+        const __m128 one = _mm_set1_ps(1.0f);
+
+        __m128 dx = _mm_set1_ps(direction[0]);
+        __m128 dy = _mm_set1_ps(direction[1]);
+        __m128 dz = _mm_set1_ps(direction[2]);
+
+        __m128 e1x = _mm_loadu_ps(pBlock + 12);
+        __m128 e1y = _mm_loadu_ps(pBlock + 16);
+        __m128 e1z = _mm_loadu_ps(pBlock + 20);
+        __m128 e2x = _mm_loadu_ps(pBlock + 24);
+        __m128 e2y = _mm_loadu_ps(pBlock + 28);
+        __m128 e2z = _mm_loadu_ps(pBlock + 32);
+
+        __m128 px = _mm_sub_ps(_mm_mul_ps(dy, e2z), _mm_mul_ps(dz, e2y));
+        __m128 py = _mm_sub_ps(_mm_mul_ps(dz, e2x), _mm_mul_ps(dx, e2z));
+        __m128 pz = _mm_sub_ps(_mm_mul_ps(dx, e2y), _mm_mul_ps(dy, e2x));
+
+        __m128 det = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e1x, px), _mm_mul_ps(e1y, py)), _mm_mul_ps(e1z, pz));
+        __m128 inverse = _mm_div_ps(one, det);
+
+        __m128 sx = _mm_sub_ps(_mm_set1_ps(origin[0]), _mm_loadu_ps(pBlock));
+        __m128 sy = _mm_sub_ps(_mm_set1_ps(origin[1]), _mm_loadu_ps(pBlock + 4));
+        __m128 sz = _mm_sub_ps(_mm_set1_ps(origin[2]), _mm_loadu_ps(pBlock + 8));
+
+        __m128 qx = _mm_sub_ps(_mm_mul_ps(sy, e1z), _mm_mul_ps(sz, e1y));
+        __m128 qy = _mm_sub_ps(_mm_mul_ps(sz, e1x), _mm_mul_ps(sx, e1z));
+        __m128 qz = _mm_sub_ps(_mm_mul_ps(sx, e1y), _mm_mul_ps(sy, e1x));
+
+        __m128 tu = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(sx, px), _mm_mul_ps(sy, py)), _mm_mul_ps(sz, pz)), inverse);
+        __m128 tv = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, qx), _mm_mul_ps(dy, qy)), _mm_mul_ps(dz, qz)), inverse);
+        __m128 tt = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(e2x, qx), _mm_mul_ps(e2y, qy)), _mm_mul_ps(e2z, qz)), inverse);
+
+        __m128 hits = _mm_and_ps(_mm_cmpneq_ps(det, zero), _mm_cmpge_ps(tu, zero));
+        hits = _mm_and_ps(hits, _mm_cmpge_ps(tv, zero));
+        hits = _mm_and_ps(hits, _mm_cmple_ps(_mm_add_ps(tu, tv), one));
+        hits = _mm_and_ps(hits, _mm_cmpge_ps(tt, zero));
+        hits = _mm_and_ps(hits, _mm_cmplt_ps(tt, _mm_set1_ps(hit.t)));
+
+        mask = _mm_movemask_ps(hits);
+
+        if (mask == 0)
+            return;
+
+        _mm_storeu_ps(t, tt);
+        _mm_storeu_ps(u, tu);
+        _mm_storeu_ps(v, tv);
+#else
+        for (int i = 0; i < BVH_BLOCK_SIZE; ++i)
+        {
+            const float *pE1 = pBlock + 12 + i;
+            const float *pE2 = pBlock + 24 + i;
+
+            float p[3] =
+            {
+                direction[1] * pE2[8] - direction[2] * pE2[4],
+                direction[2] * pE2[0] - direction[0] * pE2[8],
+                direction[0] * pE2[4] - direction[1] * pE2[0]
+            };
+            float det = pE1[0] * p[0] + pE1[4] * p[1] + pE1[8] * p[2];
+
+            if (det == 0.0f)
+                continue;
+
+            float inverse = 1.0f / det;
+            float s[3] =
+            {
+                origin[0] - pBlock[i],
+                origin[1] - pBlock[4 + i],
+                origin[2] - pBlock[8 + i]
+            };
+            float q[3] =
+            {
+                s[1] * pE1[8] - s[2] * pE1[4],
+                s[2] * pE1[0] - s[0] * pE1[8],
+                s[0] * pE1[4] - s[1] * pE1[0]
+            };
+
+            u[i] = (s[0] * p[0] + s[1] * p[1] + s[2] * p[2]) * inverse;
+            v[i] = (direction[0] * q[0] + direction[1] * q[1] + direction[2] * q[2]) * inverse;
+            t[i] = (pE2[0] * q[0] + pE2[4] * q[1] + pE2[8] * q[2]) * inverse;
+
+            if (u[i] >= 0.0f && v[i] >= 0.0f && u[i] + v[i] <= 1.0f &&
+                t[i] >= 0.0f && t[i] < hit.t)
+            {
+                mask |= 1 << i;
+            }
+        }
+#endif
+
+        for (int i = 0; i < BVH_BLOCK_SIZE; ++i)
+        {
+            if ((mask & (1 << i)) && t[i] < hit.t)
+            {
+                hit.triangle = pTriangles[i];
+                hit.t = t[i];
+                hit.u = u[i];
+                hit.v = v[i];
+            }
+        }
+    }
+
+#if defined(MODEL_OBJ_SSE2)
+    // Four rays traced together, one per lane. Lanes without a ray have a
+    // negative t so that they never hit anything.
+    struct BvhRayPacket
+    {
+        __m128 origin[3];
+        __m128 direction[3];
+        __m128 inverse[3];
+        __m128 t;
+        __m128 u;
+        __m128 v;
+        __m128 triangle;
+    };
+
+    inline int IntersectBvhBoundsPacket(const ModelOBJ::BvhNode &node,
+                                        const BvhRayPacket &packet, __m128 &entry)
+    {
+        __m128 t0 = _mm_setzero_ps();
+        __m128 t1 = packet.t;
+
+        for (int i = 0; i < 3; ++i)
+        {
+            __m128 a = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.minimum[i]), packet.origin[i]), packet.inverse[i]);
+            __m128 b = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.maximum[i]), packet.origin[i]), packet.inverse[i]);
+
+            t0 = _mm_max_ps(t0, _mm_min_ps(a, b));
+            t1 = _mm_min_ps(t1, _mm_max_ps(a, b));
+        }
+
+        entry = t0;
+        return _mm_movemask_ps(_mm_cmple_ps(t0, t1));
+    }
+
+    // Intersects the four rays of a packet with one triangle of a block.
+    void IntersectBvhTrianglePacket(const float *pBlock, int lane, int triangle,
+                                    BvhRayPacket &packet)
+    {
+        const __m128 zero = _mm_setzero_ps();
+        const __m128 one = _mm_set1_ps(1.0f);
+
+        __m128 e1x = _mm_set1_ps(pBlock[12 + lane]);
+        __m128 e1y = _mm_set1_ps(pBlock[16 + lane]);
+        __m128 e1z = _mm_set1_ps(pBlock[20 + lane]);
+        __m128 e2x = _mm_set1_ps(pBlock[24 + lane]);
+        __m128 e2y = _mm_set1_ps(pBlock[28 + lane]);
+        __m128 e2z = _mm_set1_ps(pBlock[32 + lane]);
+
+        const __m128 &dx = packet.direction[0];
+        const __m128 &dy = packet.direction[1];
+        const __m128 &dz = packet.direction[2];
+
+        __m128 px = _mm_sub_ps(_mm_mul_ps(dy, e2z), _mm_mul_ps(dz, e2y));
+        __m128 py = _mm_sub_ps(_mm_mul_ps(dz, e2x), _mm_mul_ps(dx, e2z));
+        __m128 pz = _mm_sub_ps(_mm_mul_ps(dx, e2y), _mm_mul_ps(dy, e2x));
+
+        __m128 det = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e1x, px), _mm_mul_ps(e1y, py)), _mm_mul_ps(e1z, pz));
+        __m128 inverse = _mm_div_ps(one, det);
+
+        __m128 sx = _mm_sub_ps(packet.origin[0], _mm_set1_ps(pBlock[lane]));
+        __m128 sy = _mm_sub_ps(packet.origin[1], _mm_set1_ps(pBlock[4 + lane]));
+        __m128 sz = _mm_sub_ps(packet.origin[2], _mm_set1_ps(pBlock[8 + lane]));
+
+        __m128 qx = _mm_sub_ps(_mm_mul_ps(sy, e1z), _mm_mul_ps(sz, e1y));
+        __m128 qy = _mm_sub_ps(_mm_mul_ps(sz, e1x), _mm_mul_ps(sx, e1z));
+        __m128 qz = _mm_sub_ps(_mm_mul_ps(sx, e1y), _mm_mul_ps(sy, e1x));
+
+        __m128 tu = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(sx, px), _mm_mul_ps(sy, py)), _mm_mul_ps(sz, pz)), inverse);
+        __m128 tv = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, qx), _mm_mul_ps(dy, qy)), _mm_mul_ps(dz, qz)), inverse);
+        __m128 tt = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(e2x, qx), _mm_mul_ps(e2y, qy)), _mm_mul_ps(e2z, qz)), inverse);
+
+        __m128 hits = _mm_and_ps(_mm_cmpneq_ps(det, zero), _mm_cmpge_ps(tu, zero));
+        hits = _mm_and_ps(hits, _mm_cmpge_ps(tv, zero));
+        hits = _mm_and_ps(hits, _mm_cmple_ps(_mm_add_ps(tu, tv), one));
+        hits = _mm_and_ps(hits, _mm_cmpge_ps(tt, zero));
+        hits = _mm_and_ps(hits, _mm_cmplt_ps(tt, packet.t));
+
+        if (_mm_movemask_ps(hits) == 0)
+            return;
+
+        __m128 id = _mm_castsi128_ps(_mm_set1_epi32(triangle));
+
+        packet.t = _mm_or_ps(_mm_and_ps(hits, tt), _mm_andnot_ps(hits, packet.t));
+        packet.u = _mm_or_ps(_mm_and_ps(hits, tu), _mm_andnot_ps(hits, packet.u));
+        packet.v = _mm_or_ps(_mm_and_ps(hits, tv), _mm_andnot_ps(hits, packet.v));
+        packet.triangle = _mm_or_ps(_mm_and_ps(hits, id), _mm_andnot_ps(hits, packet.triangle));
+    }
+#endif
+
+    // OpenGL type enums used by packVertices(). model_obj.h doesn't depend
+    // on the OpenGL headers, so the values are repeated here.
+    const unsigned int GL_TYPE_SHORT = 0x1402;
+    const unsigned int GL_TYPE_UNSIGNED_SHORT = 0x1403;
+    const unsigned int GL_TYPE_FLOAT = 0x1406;
+    const unsigned int GL_TYPE_HALF_FLOAT = 0x140B;
+    const unsigned int GL_TYPE_INT_2_10_10_10_REV = 0x8D9F;
+
+    // Converts a float to an IEEE half float, rounding to nearest even.
+    unsigned short FloatToHalf(float value)
+    {
+        unsigned int bits = 0;
+
+        memcpy(&bits, &value, sizeof(bits));
+
+        unsigned int sign = (bits >> 16) & 0x8000;
+        unsigned int exponent = (bits >> 23) & 0xFF;
+        unsigned int mantissa = bits & 0x7FFFFF;
+
+        // Infinity and NaN.
+        if (exponent == 0xFF)
+            return static_cast<unsigned short>(sign | 0x7C00 | (mantissa ? 0x200 : 0));
+
+        int halfExponent = static_cast<int>(exponent) - 127 + 15;
+
+        // Too large for a half float.
+        if (halfExponent >= 31)
+            return static_cast<unsigned short>(sign | 0x7C00);
+
+        // Denormal half floats or zero.
+        if (halfExponent <= 0)
+        {
+            if (halfExponent < -10)
+                return static_cast<unsigned short>(sign);
+
+            mantissa |= 0x800000;
+
+            unsigned int shift = static_cast<unsigned int>(14 - halfExponent);
+            unsigned int half = mantissa >> shift;
+            unsigned int rest = mantissa & ((1u << shift) - 1);
+            unsigned int halfway = 1u << (shift - 1);
+
+            if (rest > halfway || (rest == halfway && (half & 1)))
+                ++half;
+
+            return static_cast<unsigned short>(sign | half);
+        }
+
+        unsigned int half = (static_cast<unsigned int>(halfExponent) << 10) | (mantissa >> 13);
+        unsigned int rest = mantissa & 0x1FFF;
+
+        // A carry into the exponent is correct, and may round to infinity.
+        if (rest > 0x1000 || (rest == 0x1000 && (half & 1)))
+            ++half;
+
+        return static_cast<unsigned short>(sign | half);
+    }
+
+    // Maps [-1, 1] to a signed normalized integer with the given maximum.
+    inline int ToSnorm(float value, int maximum)
+    {
+        value = std::max(-1.0f, std::min(1.0f, value));
+        return static_cast<int>(floorf(value * maximum + 0.5f));
+    }
+
+    // Encodes a unit vector as two signed normalized 16 bit values with the
+    // octahedral mapping.
+    void EncodeOctahedral(const float n[3], short encoded[2])
+    {
+        float sum = fabsf(n[0]) + fabsf(n[1]) + fabsf(n[2]);
+        float x = (sum > 0.0f) ? n[0] / sum : 0.0f;
+        float y = (sum > 0.0f) ? n[1] / sum : 0.0f;
+
+        if (n[2] < 0.0f)
+        {
+            float foldedX = (1.0f - fabsf(y)) * ((x >= 0.0f) ? 1.0f : -1.0f);
+            float foldedY = (1.0f - fabsf(x)) * ((y >= 0.0f) ? 1.0f : -1.0f);
+
+            x = foldedX;
+            y = foldedY;
+        }
+
+        encoded[0] = static_cast<short>(ToSnorm(x, 32767));
+        encoded[1] = static_cast<short>(ToSnorm(y, 32767));
+    }
+
+    // Packs a tangent with its sign in w into GL_INT_2_10_10_10_REV.
+    unsigned int EncodeTangent(const float t[4])
+    {
+        unsigned int x = static_cast<unsigned int>(ToSnorm(t[0], 511)) & 0x3FF;
+        unsigned int y = static_cast<unsigned int>(ToSnorm(t[1], 511)) & 0x3FF;
+        unsigned int z = static_cast<unsigned int>(ToSnorm(t[2], 511)) & 0x3FF;
+        unsigned int w = static_cast<unsigned int>((t[3] < 0.0f) ? -1 : 1) & 0x3;
+
+        return x | (y << 10) | (z << 20) | (w << 30);
+    }
+
+    // A read only view of a whole file. On POSIX systems the file is memory
+    // mapped so it can be parsed straight from the page cache. Elsewhere the
+    // file is read into a heap buffer.
+    class MappedFile
+    {
+    public:
+        MappedFile() : m_pData(0), m_size(0), m_mapped(false) {}
+        ~MappedFile() { close(); }
+
+        bool open(const char *pszFilename);
+        void close();
+        void adviseSequential();
+
+        const char *data() const { return m_pData; }
+        size_t size() const { return m_size; }
+        bool mapped() const { return m_mapped; }
+
+    private:
+        MappedFile(const MappedFile &);
+        MappedFile &operator=(const MappedFile &);
+
+        const char *m_pData;
+        size_t m_size;
+        bool m_mapped;
+        std::vector<char> m_buffer;
+    };
+
+    bool MappedFile::open(const char *pszFilename)
+    {
+        close();
+
+#if defined(_WIN32)
+        FILE *pFile = fopen(pszFilename, "rb");
+
+        if (!pFile)
+            return false;
+
+        if (fseek(pFile, 0, SEEK_END) == 0)
+        {
+            long size = ftell(pFile);
+
+            if (size > 0)
+            {
+                m_buffer.resize(static_cast<size_t>(size));
+                rewind(pFile);
+                m_buffer.resize(fread(&m_buffer[0], 1, m_buffer.size(), pFile));
+            }
+        }
+
+        fclose(pFile);
+
+        m_pData = m_buffer.empty() ? 0 : &m_buffer[0];
+        m_size = m_buffer.size();
+        return true;
+#else
+        int fd = ::open(pszFilename, O_RDONLY);
+
+        if (fd == -1)
+            return false;
+
+        struct stat info;
+
+        if (fstat(fd, &info) == -1)
+        {
+            ::close(fd);
+            return false;
+        }
+
+        if (info.st_size > 0)
+        {
+            void *pMapping = mmap(0, static_cast<size_t>(info.st_size),
+                PROT_READ, MAP_PRIVATE, fd, 0);
+
+            if (pMapping == MAP_FAILED)
+            {
+                ::close(fd);
+                return false;
+            }
+
+            m_pData = static_cast<const char *>(pMapping);
+            m_size = static_cast<size_t>(info.st_size);
+            m_mapped = true;
+        }
+
+        // The mapping stays valid after the descriptor is closed.
+        ::close(fd);
+        return true;
+#endif
+    }
+
+    void MappedFile::close()
+    {
+#if !defined(_WIN32)
+        if (m_mapped)
+            munmap(const_cast<char *>(m_pData), m_size);
+#endif
+
+        m_pData = 0;
+        m_size = 0;
+        m_mapped = false;
+        m_buffer.clear();
+    }
+
+    void MappedFile::adviseSequential()
+    {
+#if !defined(_WIN32)
+        if (m_mapped)
+            madvise(const_cast<char *>(m_pData), m_size, MADV_SEQUENTIAL);
+#endif
+    }
+
+    // Drops the pages of a read only file mapping that lie entirely within
+    // [pBegin, pEnd) and returns where the next range to release starts.
+    // The pages are read from the file again if they are touched later.
+    const char *ReleaseMappedPages(const char *pBegin, const char *pEnd)
+    {
+#if defined(_WIN32)
+        return pBegin;
+#else
+        size_t pageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+        size_t begin = (reinterpret_cast<size_t>(pBegin) + pageSize - 1) & ~(pageSize - 1);
+        size_t end = reinterpret_cast<size_t>(pEnd) & ~(pageSize - 1);
+
+        if (begin >= end)
+            return pBegin;
+
+        madvise(reinterpret_cast<void *>(begin), end - begin, MADV_DONTNEED);
+        return reinterpret_cast<const char *>(end);
+#endif
+    }
+
+    // Makes room for count items in an array that grows with every window
+    // of a file read by ModelOBJ::importGeometry(). Rather than doubling,
+    // the array is sized for the whole file at the rate seen so far.
+    template <typename T>
+    void ReserveForFile(std::vector<T> &items, size_t count, size_t bytesRead, size_t size)
+    {
+        if (count <= items.capacity())
+            return;
+
+        if (bytesRead >= size)
+        {
+            items.reserve(count);
+            return;
+        }
+
+        double estimate = static_cast<double>(count) * size / bytesRead * 1.05;
+        items.reserve(std::max(count + count / 4, static_cast<size_t>(estimate)));
+    }
+
+    // Layout of the binary model cache written by ModelOBJ::importCached().
+    // The file starts with this header, followed by the material libraries,
+    // materials, objects and groups, meshes, vertices and indices at the
+    // given offsets. Data is stored in the native byte order and struct
+    // layout, which the magic, version and size fields guard against.
+
+    const char CACHE_MAGIC[8] = {'O', 'B', 'J', 'C', 'A', 'C', 'H', 'E'};
+    const unsigned int CACHE_VERSION = 3;
+    const unsigned long long CACHE_ALIGNMENT = 64;
+    const unsigned long long CACHE_MISSING_FILE = ~0ULL;
+
+    enum CacheFlags
+    {
+        CACHE_REBUILD_NORMALS = 1 << 0,
+        CACHE_HAS_POSITIONS = 1 << 1,
+        CACHE_HAS_TEXTURE_COORDS = 1 << 2,
+        CACHE_HAS_NORMALS = 1 << 3,
+        CACHE_HAS_TANGENTS = 1 << 4,
+        CACHE_MIKKTSPACE_TANGENTS = 1 << 5
+    };
+
+    // A file a cache was built from: the OBJ file or one of its MTL files.
+    // A file that didn't exist has a size of CACHE_MISSING_FILE.
+    struct CacheSource
+    {
+        unsigned long long size;
+        long long time;
+        unsigned long long hash;
+    };
+
+    // The import window size a cache was built with. Windows change the
+    // vertex numbering, but only if the file is read in more than one.
+    unsigned long long GetCacheWindowSize(size_t windowSize, unsigned long long fileSize)
+    {
+        return (windowSize > 0 && windowSize < fileSize) ? windowSize : 0;
+    }
+
+    struct CacheHeader
+    {
+        char magic[8];
+        unsigned int version;
+        unsigned int headerSize;
+        unsigned int vertexSize;
+        unsigned int flags;
+
+        CacheSource source;
+        unsigned long long windowSize;
+
+        int numberOfVertexCoords;
+        int numberOfTextureCoords;
+        int numberOfNormals;
+        int numberOfTriangles;
+        int numberOfMaterials;
+        int numberOfImportedMaterials;
+        int numberOfMeshes;
+        int numberOfVertices;
+        int numberOfObjects;
+        int numberOfGroups;
+        int numberOfLibraries;
+
+        unsigned long long librariesOffset;
+        unsigned long long librariesSize;
+        unsigned long long materialsOffset;
+        unsigned long long materialsSize;
+        unsigned long long groupsOffset;
+        unsigned long long groupsSize;
+        unsigned long long meshesOffset;
+        unsigned long long verticesOffset;
+        unsigned long long indicesOffset;
+        unsigned long long fileSize;
+    };
+
+    inline unsigned long long AlignCacheOffset(unsigned long long offset)
+    {
+        return (offset + CACHE_ALIGNMENT - 1) & ~(CACHE_ALIGNMENT - 1);
+    }
+
+    // Returns the size and modification time of a file.
+    bool GetFileInfo(const char *pszFilename, unsigned long long &size, long long &time)
+    {
+        struct stat info;
+
+        if (stat(pszFilename, &info) != 0)
+            return false;
+
+        size = static_cast<unsigned long long>(info.st_size);
+        time = static_cast<long long>(info.st_mtime);
+        return true;
+    }
+
+    // 64 bit FNV-1a over 8 byte words. Used to tell whether a touched OBJ
+    // file still has the contents a cache was built from.
+    unsigned long long HashBytes(const char *pData, size_t size)
+    {
+        const unsigned long long prime = 0x100000001B3ULL;
+        unsigned long long hash = 0xCBF29CE484222325ULL;
+        unsigned long long word = 0;
+        size_t i = 0;
+
+        for (; i + sizeof(word) <= size; i += sizeof(word))
+        {
+            memcpy(&word, pData + i, sizeof(word));
+            hash = (hash ^ word) * prime;
+        }
+
+        for (; i < size; ++i)
+            hash = (hash ^ static_cast<unsigned char>(pData[i])) * prime;
+
+        return hash ^ size;
+    }
+
+    // Describes a file as it is now. Returns false if it exists but can't
+    // be read.
+    bool GetCacheSource(const char *pszFilename, CacheSource &source)
+    {
+        MappedFile file;
+
+        source.time = 0;
+        source.hash = 0;
+
+        if (!GetFileInfo(pszFilename, source.size, source.time))
+        {
+            source.size = CACHE_MISSING_FILE;
+            return true;
+        }
+
+        if (!file.open(pszFilename) || file.size() != source.size)
+            return false;
+
+        source.hash = HashBytes(file.data(), file.size());
+        return true;
+    }
+
+    // Returns true if a file is still the one a cache was built from: it has
+    // the same size and either the same modification time or, if it was
+    // only touched, the same contents. A missing file must still be missing.
+    bool IsCacheSourceCurrent(const char *pszFilename, const CacheSource &source)
+    {
+        unsigned long long size = 0;
+        long long time = 0;
+        MappedFile file;
+
+        if (!GetFileInfo(pszFilename, size, time))
+            return source.size == CACHE_MISSING_FILE;
+
+        if (size != source.size)
+            return false;
+
+        if (time == source.time)
+            return true;
+
+        return file.open(pszFilename) && HashBytes(file.data(), file.size()) == source.hash;
+    }
+
+    void AppendBytes(std::vector<char> &buffer, const void *pData, size_t size)
+    {
+        const char *pBytes = static_cast<const char *>(pData);
+        buffer.insert(buffer.end(), pBytes, pBytes + size);
+    }
+
+    void AppendString(std::vector<char> &buffer, const std::string &text)
+    {
+        unsigned int length = static_cast<unsigned int>(text.size());
+        AppendBytes(buffer, &length, sizeof(length));
+        AppendBytes(buffer, text.data(), text.size());
+    }
+
+    bool ReadBytes(const char *&p, const char *pEnd, void *pData, size_t size)
+    {
+        if (static_cast<size_t>(pEnd - p) < size)
+            return false;
+
+        memcpy(pData, p, size);
+        p += size;
+        return true;
+    }
+
+    bool ReadString(const char *&p, const char *pEnd, std::string &text)
+    {
+        unsigned int length = 0;
+
+        if (!ReadBytes(p, pEnd, &length, sizeof(length)) ||
+            static_cast<size_t>(pEnd - p) < length)
+        {
+            return false;
+        }
+
+        text.assign(p, length);
+        p += length;
+        return true;
+    }
+
+    bool WriteAt(FILE *pFile, unsigned long long offset, const void *pData, size_t size)
+    {
+        if (fseek(pFile, static_cast<long>(offset), SEEK_SET) != 0)
+            return false;
+
+        return size == 0 || fwrite(pData, 1, size, pFile) == size;
+    }
+}
+
+ModelOBJ::ModelOBJ()
+{
+    m_hasPositions = false;
+    m_hasNormals = false;
+    m_hasTextureCoords = false;
+    m_hasTangents = false;
+
+    m_numberOfVertexCoords = 0;
+    m_numberOfTextureCoords = 0;
+    m_numberOfNormals = 0;
+    m_numberOfTriangles = 0;
+    m_numberOfMaterials = 0;
+    m_numberOfMeshes = 0;
+    m_numberOfThreads = 0;
+    m_importWindowSize = 0;
+    m_pImportCallback = 0;
+    m_pImportCallbackData = 0;
+    m_parallelNormals = true;
+    m_tangentMethod = TANGENTS_PARALLEL;
+    m_vertexLayout = VERTEX_LAYOUT_INTERLEAVED;
+    m_vertexCacheSize = 0;
+
+    m_center[0] = m_center[1] = m_center[2] = 0.0f;
+    m_minimum[0] = m_minimum[1] = m_minimum[2] = 0.0f;
+    m_maximum[0] = m_maximum[1] = m_maximum[2] = 0.0f;
+    m_width = m_height = m_length = m_radius = m_sphereRadius = 0.0f;
+}
+
+ModelOBJ::~ModelOBJ()
+{
+    destroy();
+}
+
+void ModelOBJ::computeBounds()
+{
+    int count = getNumberOfVertices();
+
+    if (count == 0)
+    {
+        for (int i = 0; i < 3; ++i)
+            m_minimum[i] = m_maximum[i] = 0.0f;
+
+        m_sphereRadius = 0.0f;
+        updateDimensions();
+        return;
+    }
+
+    // Positions are either packed in their own stream or spread over the
+    // interleaved vertices.
+    if (m_vertexLayout == VERTEX_LAYOUT_SEPARATE)
+    {
+        PositionBounds<3>(getPositions(), count, m_minimum, m_maximum);
+    }
+    else
+    {
+        PositionBounds<sizeof(Vertex) / sizeof(float)>(
+            m_vertexBuffer[0].position, count, m_minimum, m_maximum);
+    }
+
+    updateDimensions();
+
+    int stride = 0;
+    const float *pPositions = getPositionData(stride);
+
+    m_sphereRadius = GatherPositionRadius(pPositions, stride, 0, count, m_center);
+
+    if (m_numberOfMeshes == 0 || m_indexBuffer.empty())
+        return;
+
+    // The per mesh bounds gather every index twice, which costs several
+    // times the sweeps above. Meshes are independent, so they are shared
+    // out over the pool.
+    int numberOfThreads = GetNumberOfThreads(m_numberOfThreads);
+    int numberOfTasks = std::min(m_numberOfMeshes, GetNumberOfTasks(
+        numberOfThreads, m_numberOfTriangles, MIN_TRIANGLES_PER_TASK));
+
+    ThreadPool pool((numberOfTasks > 1) ? numberOfThreads : 1);
+
+    pool.run((numberOfTasks > 1) ? m_numberOfMeshes : 1, [&](int task)
+    {
+        int first = (numberOfTasks > 1) ? task : 0;
+        int last = (numberOfTasks > 1) ? task + 1 : m_numberOfMeshes;
+
+        for (int i = first; i < last; ++i)
+        {
+            Mesh &mesh = m_meshes[i];
+            const int *pIndices = &m_indexBuffer[0] + mesh.startIndex;
+
+            GatherPositionBounds(pPositions, stride, pIndices, mesh.triangleCount * 3,
+                mesh.minimum, mesh.maximum);
+
+            for (int j = 0; j < 3; ++j)
+                mesh.center[j] = (mesh.minimum[j] + mesh.maximum[j]) / 2.0f;
+
+            mesh.radius = GatherPositionRadius(pPositions, stride, pIndices,
+                mesh.triangleCount * 3, mesh.center);
+        }
+    });
+
+    // Groups and objects enclose their members' bounds, which is cheap and
+    // good enough for culling.
+
+    for (int i = 0; i < static_cast<int>(m_groups.size()); ++i)
+    {
+        Group &group = m_groups[i];
+        const std::vector<int> &meshes = group.meshes;
+
+        UnionBounds(static_cast<int>(meshes.size()),
+            [&](int j) -> const Mesh & { return m_meshes[meshes[j]]; },
+            group.minimum, group.maximum, group.center, group.radius);
+    }
+
+    for (int i = 0; i < static_cast<int>(m_objects.size()); ++i)
+    {
+        Object &object = m_objects[i];
+        const std::vector<int> &groups = object.groups;
+
+        UnionBounds(static_cast<int>(groups.size()),
+            [&](int j) -> const Group & { return m_groups[groups[j]]; },
+            object.minimum, object.maximum, object.center, object.radius);
+    }
+}
+
+void ModelOBJ::destroy()
+{
+    m_hasPositions = false;
+    m_hasTextureCoords = false;
+    m_hasNormals = false;
+    m_hasTangents = false;
+
+    m_numberOfVertexCoords = 0;
+    m_numberOfTextureCoords = 0;
+    m_numberOfNormals = 0;
+    m_numberOfTriangles = 0;
+    m_numberOfMaterials = 0;
+    m_numberOfMeshes = 0;
+
+    m_center[0] = m_center[1] = m_center[2] = 0.0f;
+    m_minimum[0] = m_minimum[1] = m_minimum[2] = 0.0f;
+    m_maximum[0] = m_maximum[1] = m_maximum[2] = 0.0f;
+    m_width = m_height = m_length = m_radius = m_sphereRadius = 0.0f;
+
+    m_directoryPath.clear();
+    m_materialLibraries.clear();
+
+    m_meshes.clear();
+    m_groups.clear();
+    m_objects.clear();
+    m_materials.clear();
+    m_vertexBuffer.clear();
+    m_indexBuffer.clear();
+    m_attributeBuffer.clear();
+    m_groupBuffer.clear();
+    m_shortIndexBuffer.clear();
+    m_lodIndexBuffer.clear();
+    m_shortLodIndexBuffer.clear();
+    m_levelsOfDetail.clear();
+    m_meshlets.clear();
+    m_bvhNodes.clear();
+    m_bvhTriangles.clear();
+    m_bvhTriangleData.clear();
+
+    m_positionStream.clear();
+    m_texCoordStream.clear();
+    m_normalStream.clear();
+    m_tangentStream.clear();
+    m_bitangentStream.clear();
+
+    m_vertexCoords.clear();
+    m_textureCoords.clear();
+    m_normals.clear();
+
+    m_materialCache.clear();
+    m_vertexCache.clear();
+    m_vertexCacheSize = 0;
+}
+
+bool ModelOBJ::import(const char *pszFilename, bool rebuildNormals)
+{
+    MappedFile file;
+
+    if (!file.open(pszFilename))
+        return false;
+
+    // The directory the OBJ file is in will be used to load the OBJ's
+    // associated MTL file.
+
+    m_directoryPath = DirectoryOf(pszFilename);
+
+    // The geometry is parsed front to back exactly once.
+    file.adviseSequential();
+
+    return importModel(file.data(), file.size(), rebuildNormals, file.mapped());
+}
+
+bool ModelOBJ::importCached(const char *pszFilename, bool rebuildNormals)
+{
+    std::string cacheFilename = pszFilename;
+    cacheFilename += ".cache";
+
+    if (importCache(cacheFilename.c_str(), pszFilename, rebuildNormals))
+        return true;
+
+    destroy();
+
+    if (!import(pszFilename, rebuildNormals))
+        return false;
+
+    // Failing to write the cache only costs the next start up time.
+    exportCache(cacheFilename.c_str(), pszFilename, rebuildNormals);
+    return true;
+}
+
+bool ModelOBJ::import(const void *pData, size_t size, bool rebuildNormals,
+                      const char *pszDirectoryPath)
+{
+    if (!pData && size != 0)
+        return false;
+
+    m_directoryPath = pszDirectoryPath ? pszDirectoryPath : "";
+
+    return importModel(static_cast<const char *>(pData), size, rebuildNormals, false);
+}
+
+bool ModelOBJ::importModel(const char *pBuffer, size_t size, bool rebuildNormals,
+                           bool mapped)
+{
+    // The vertices are built and processed interleaved. They are split into
+    // separate streams at the end if requested.
+
+    VertexLayout layout = m_vertexLayout;
+    m_vertexLayout = VERTEX_LAYOUT_INTERLEAVED;
+
+    // Data derived from a previous model indexes its vertices and
+    // triangles, it has to go before the new model replaces them.
+
+    m_levelsOfDetail.clear();
+    m_lodIndexBuffer.clear();
+    m_shortLodIndexBuffer.clear();
+    m_meshlets.clear();
+    m_bvhNodes.clear();
+    m_bvhTriangles.clear();
+    m_bvhTriangleData.clear();
+
+    // Import the OBJ file.
+
+    if (!importGeometry(pBuffer, size, mapped))
+    {
+        m_vertexLayout = layout;
+        destroy();
+        return false;
+    }
+
+    // Perform post import tasks.
+
+    buildMeshes();
+
+    computeBounds();
+
+    // Build vertex normals if required.
+
+    if (rebuildNormals)
+    {
+        generateNormals();
+    }
+    else
+    {
+        if (!hasNormals())
+            generateNormals();
+    }
+
+    // Build tangents is required.
+
+    for (int i = 0; i < m_numberOfMaterials; ++i)
+    {
+        if (!m_materials[i].bumpMapFilename.empty())
+        {
+            generateTangents();
+            break;
+        }
+    }
+
+    packIndices();
+
+    if (layout == VERTEX_LAYOUT_SEPARATE)
+    {
+        m_vertexLayout = layout;
+        separateVertices();
+    }
+
+    return true;
+}
+
+bool ModelOBJ::exportCache(const char *pszCacheFilename,
+                           const char *pszFilename, bool rebuildNormals) const
+{
+    CacheHeader header;
+
+    memset(&header, 0, sizeof(header));
+
+    if (!GetCacheSource(pszFilename, header.source) ||
+        header.source.size == CACHE_MISSING_FILE)
+    {
+        return false;
+    }
+
+    // Serialize the material libraries, materials, objects, groups and
+    // meshes. The libraries are recorded even if they were missing, so that
+    // the cache goes stale when any of them changes. Groups refer to their
+    // object and meshes to their material and group by index.
+
+    std::vector<char> libraries;
+    std::string directoryPath = DirectoryOf(pszFilename);
+
+    for (int i = 0; i < static_cast<int>(m_materialLibraries.size()); ++i)
+    {
+        CacheSource library;
+
+        if (!GetCacheSource((directoryPath + m_materialLibraries[i]).c_str(), library))
+            return false;
+
+        AppendBytes(libraries, &library, sizeof(library));
+        AppendString(libraries, m_materialLibraries[i]);
+    }
+
+    std::vector<char> materials;
+
+    for (int i = 0; i < static_cast<int>(m_materials.size()); ++i)
+    {
+        const Material &material = m_materials[i];
+
+        AppendBytes(materials, material.ambient, sizeof(material.ambient));
+        AppendBytes(materials, material.diffuse, sizeof(material.diffuse));
+        AppendBytes(materials, material.specular, sizeof(material.specular));
+        AppendBytes(materials, &material.shininess, sizeof(material.shininess));
+        AppendBytes(materials, &material.alpha, sizeof(material.alpha));
+        AppendString(materials, material.name);
+        AppendString(materials, material.colorMapFilename);
+        AppendString(materials, material.bumpMapFilename);
+    }
+
+    std::vector<char> groups;
+
+    for (int i = 0; i < static_cast<int>(m_objects.size()); ++i)
+        AppendString(groups, m_objects[i].name);
+
+    for (int i = 0; i < static_cast<int>(m_groups.size()); ++i)
+    {
+        AppendString(groups, m_groups[i].name);
+        AppendBytes(groups, &m_groups[i].object, sizeof(m_groups[i].object));
+    }
+
+    std::vector<int> meshes;
+
+    for (int i = 0; i < static_cast<int>(m_meshes.size()); ++i)
+    {
+        meshes.push_back(m_meshes[i].startIndex);
+        meshes.push_back(m_meshes[i].triangleCount);
+        meshes.push_back(static_cast<int>(m_meshes[i].pMaterial - &m_materials[0]));
+        meshes.push_back(m_meshes[i].group);
+    }
+
+    // The cache always stores interleaved vertices.
+
+    std::vector<Vertex> vertices(getNumberOfVertices());
+
+    if (!vertices.empty())
+        getVertices(&vertices[0]);
+
+    memcpy(header.magic, CACHE_MAGIC, sizeof(header.magic));
+    header.version = CACHE_VERSION;
+    header.headerSize = sizeof(CacheHeader);
+    header.vertexSize = sizeof(Vertex);
+    header.windowSize = GetCacheWindowSize(m_importWindowSize, header.source.size);
+    header.flags = (rebuildNormals ? CACHE_REBUILD_NORMALS : 0) |
+        (m_hasPositions ? CACHE_HAS_POSITIONS : 0) |
+        (m_hasTextureCoords ? CACHE_HAS_TEXTURE_COORDS : 0) |
+        (m_hasNormals ? CACHE_HAS_NORMALS : 0) |
+        (m_hasTangents ? CACHE_HAS_TANGENTS : 0) |
+        ((m_tangentMethod == TANGENTS_MIKKTSPACE) ? CACHE_MIKKTSPACE_TANGENTS : 0);
+
+    header.numberOfVertexCoords = m_numberOfVertexCoords;
+    header.numberOfTextureCoords = m_numberOfTextureCoords;
+    header.numberOfNormals = m_numberOfNormals;
+    header.numberOfTriangles = m_numberOfTriangles;
+    header.numberOfMaterials = static_cast<int>(m_materials.size());
+    header.numberOfImportedMaterials = m_numberOfMaterials;
+    header.numberOfMeshes = static_cast<int>(m_meshes.size());
+    header.numberOfVertices = getNumberOfVertices();
+    header.numberOfObjects = static_cast<int>(m_objects.size());
+    header.numberOfGroups = static_cast<int>(m_groups.size());
+    header.numberOfLibraries = static_cast<int>(m_materialLibraries.size());
+
+    // Every array starts on a CACHE_ALIGNMENT boundary so a mapped cache
+    // file can be read in place.
+
+    header.librariesOffset = AlignCacheOffset(sizeof(CacheHeader));
+    header.librariesSize = libraries.size();
+    header.materialsOffset = AlignCacheOffset(header.librariesOffset + header.librariesSize);
+    header.materialsSize = materials.size();
+    header.groupsOffset = AlignCacheOffset(header.materialsOffset + header.materialsSize);
+    header.groupsSize = groups.size();
+    header.meshesOffset = AlignCacheOffset(header.groupsOffset + header.groupsSize);
+    header.verticesOffset = AlignCacheOffset(header.meshesOffset + meshes.size() * sizeof(int));
+    header.indicesOffset = AlignCacheOffset(header.verticesOffset + header.numberOfVertices * sizeof(Vertex));
+    header.fileSize = header.indicesOffset + m_indexBuffer.size() * sizeof(int);
+
+    // Write to a temporary file first so a crash never leaves a truncated
+    // cache behind.
+
+    std::string tempFilename = pszCacheFilename;
+    tempFilename += ".tmp";
+
+    FILE *pFile = fopen(tempFilename.c_str(), "wb");
+
+    if (!pFile)
+        return false;
+
+    bool ok = WriteAt(pFile, 0, &header, sizeof(header)) &&
+        WriteAt(pFile, header.librariesOffset, libraries.empty() ? 0 : &libraries[0], libraries.size()) &&
+        WriteAt(pFile, header.materialsOffset, materials.empty() ? 0 : &materials[0], materials.size()) &&
+        WriteAt(pFile, header.groupsOffset, groups.empty() ? 0 : &groups[0], groups.size()) &&
+        WriteAt(pFile, header.meshesOffset, meshes.empty() ? 0 : &meshes[0], meshes.size() * sizeof(int)) &&
+        WriteAt(pFile, header.verticesOffset, vertices.empty() ? 0 : &vertices[0], vertices.size() * sizeof(Vertex)) &&
+        WriteAt(pFile, header.indicesOffset, m_indexBuffer.empty() ? 0 : &m_indexBuffer[0], m_indexBuffer.size() * sizeof(int));
+
+    ok = (fclose(pFile) == 0) && ok;
+
+    if (ok)
+    {
+        remove(pszCacheFilename);
+        ok = rename(tempFilename.c_str(), pszCacheFilename) == 0;
+    }
+
+    if (!ok)
+        remove(tempFilename.c_str());
+
+    return ok;
+}
+
+bool ModelOBJ::importCache(const char *pszCacheFilename,
+                           const char *pszFilename, bool rebuildNormals)
+{
+    MappedFile file;
+    CacheHeader header;
+
+    if (!file.open(pszCacheFilename) || file.size() < sizeof(CacheHeader))
+        return false;
+
+    memcpy(&header, file.data(), sizeof(header));
+
+    // Reject caches written by another version, for another platform, or
+    // for different import options.
+
+    unsigned long long windowSize = GetCacheWindowSize(m_importWindowSize, header.source.size);
+
+    if (memcmp(header.magic, CACHE_MAGIC, sizeof(header.magic)) != 0 ||
+        header.version != CACHE_VERSION ||
+        header.headerSize != sizeof(CacheHeader) ||
+        header.vertexSize != sizeof(Vertex) ||
+        header.fileSize != file.size() ||
+        header.windowSize != windowSize ||
+        ((header.flags & CACHE_REBUILD_NORMALS) != 0) != rebuildNormals ||
+        ((header.flags & CACHE_HAS_TANGENTS) &&
+        ((header.flags & CACHE_MIKKTSPACE_TANGENTS) != 0) != (m_tangentMethod == TANGENTS_MIKKTSPACE)))
+    {
+        return false;
+    }
+
+    if (header.numberOfTriangles < 0 || header.numberOfMaterials < 1 ||
+        header.numberOfImportedMaterials < 0 ||
+        header.numberOfImportedMaterials > header.numberOfMaterials ||
+        header.numberOfMeshes < 0 || header.numberOfVertices < 0 ||
+        header.numberOfObjects < 0 || header.numberOfGroups < 0 ||
+        header.numberOfLibraries < 0 ||
+        header.librariesOffset + header.librariesSize > header.fileSize ||
+        header.materialsOffset + header.materialsSize > header.fileSize ||
+        header.groupsOffset + header.groupsSize > header.fileSize ||
+        header.meshesOffset + header.numberOfMeshes * 4ULL * sizeof(int) > header.fileSize ||
+        header.verticesOffset + header.numberOfVertices * 1ULL * sizeof(Vertex) > header.fileSize ||
+        header.indicesOffset + header.numberOfTriangles * 3ULL * sizeof(int) > header.fileSize)
+    {
+        return false;
+    }
+
+    // The cache is still valid if neither the OBJ file nor any of its MTL
+    // files changed.
+
+    if (!IsCacheSourceCurrent(pszFilename, header.source))
+        return false;
+
+    std::vector<std::string> libraries(header.numberOfLibraries);
+    std::string directoryPath = DirectoryOf(pszFilename);
+    const char *p = file.data() + header.librariesOffset;
+    const char *pEnd = p + header.librariesSize;
+
+    for (int i = 0; i < header.numberOfLibraries; ++i)
+    {
+        CacheSource library;
+
+        if (!ReadBytes(p, pEnd, &library, sizeof(library)) ||
+            !ReadString(p, pEnd, libraries[i]) ||
+            !IsCacheSourceCurrent((directoryPath + libraries[i]).c_str(), library))
+        {
+            return false;
+        }
+    }
+
+    // Read the materials.
+
+    std::vector<Material> materials(header.numberOfMaterials);
+
+    p = file.data() + header.materialsOffset;
+    pEnd = p + header.materialsSize;
+
+    for (int i = 0; i < header.numberOfMaterials; ++i)
+    {
+        Material &material = materials[i];
+
+        if (!ReadBytes(p, pEnd, material.ambient, sizeof(material.ambient)) ||
+            !ReadBytes(p, pEnd, material.diffuse, sizeof(material.diffuse)) ||
+            !ReadBytes(p, pEnd, material.specular, sizeof(material.specular)) ||
+            !ReadBytes(p, pEnd, &material.shininess, sizeof(material.shininess)) ||
+            !ReadBytes(p, pEnd, &material.alpha, sizeof(material.alpha)) ||
+            !ReadString(p, pEnd, material.name) ||
+            !ReadString(p, pEnd, material.colorMapFilename) ||
+            !ReadString(p, pEnd, material.bumpMapFilename))
+        {
+            return false;
+        }
+    }
+
+    // Read the objects and groups.
+
+    std::vector<Object> objects(header.numberOfObjects);
+    std::vector<Group> groups(header.numberOfGroups);
+
+    p = file.data() + header.groupsOffset;
+    pEnd = p + header.groupsSize;
+
+    for (int i = 0; i < header.numberOfObjects; ++i)
+    {
+        if (!ReadString(p, pEnd, objects[i].name))
+            return false;
+    }
+
+    for (int i = 0; i < header.numberOfGroups; ++i)
+    {
+        Group &group = groups[i];
+
+        if (!ReadString(p, pEnd, group.name) ||
+            !ReadBytes(p, pEnd, &group.object, sizeof(group.object)) ||
+            group.object < 0 || group.object >= header.numberOfObjects)
+        {
+            return false;
+        }
+
+        objects[group.object].groups.push_back(i);
+    }
+
+    std::vector<int> meshes(header.numberOfMeshes * 4);
+
+    if (!meshes.empty())
+        memcpy(&meshes[0], file.data() + header.meshesOffset, meshes.size() * sizeof(int));
+
+    for (int i = 0; i < header.numberOfMeshes; ++i)
+    {
+        if (meshes[i * 4] < 0 || meshes[i * 4 + 1] < 0 ||
+            meshes[i * 4] + meshes[i * 4 + 1] * 3LL > header.numberOfTriangles * 3LL ||
+            meshes[i * 4 + 2] < 0 || meshes[i * 4 + 2] >= header.numberOfMaterials ||
+            meshes[i * 4 + 3] < 0 || meshes[i * 4 + 3] >= header.numberOfGroups)
+        {
+            return false;
+        }
+    }
+
+    // A damaged index would make the renderer read past the vertices.
+
+    const int *pIndices = reinterpret_cast<const int *>(file.data() + header.indicesOffset);
+
+    for (long long i = 0; i < header.numberOfTriangles * 3LL; ++i)
+    {
+        if (pIndices[i] < 0 || pIndices[i] >= header.numberOfVertices)
+            return false;
+    }
+
+    // The cache is good. Replace the current model with it.
+
+    destroy();
+
+    m_directoryPath = directoryPath;
+    m_materialLibraries.swap(libraries);
+
+    m_hasPositions = (header.flags & CACHE_HAS_POSITIONS) != 0;
+    m_hasTextureCoords = (header.flags & CACHE_HAS_TEXTURE_COORDS) != 0;
+    m_hasNormals = (header.flags & CACHE_HAS_NORMALS) != 0;
+    m_hasTangents = (header.flags & CACHE_HAS_TANGENTS) != 0;
+
+    m_numberOfVertexCoords = header.numberOfVertexCoords;
+    m_numberOfTextureCoords = header.numberOfTextureCoords;
+    m_numberOfNormals = header.numberOfNormals;
+    m_numberOfTriangles = header.numberOfTriangles;
+    m_numberOfMeshes = header.numberOfMeshes;
+
+    m_numberOfMaterials = header.numberOfImportedMaterials;
+
+    m_materials.swap(materials);
+
+    for (int i = 0; i < static_cast<int>(m_materials.size()); ++i)
+        m_materialCache[m_materials[i].name] = i;
+
+    m_objects.swap(objects);
+    m_groups.swap(groups);
+    m_meshes.resize(m_numberOfMeshes);
+
+    for (int i = 0; i < m_numberOfMeshes; ++i)
+    {
+        m_meshes[i].startIndex = meshes[i * 4];
+        m_meshes[i].triangleCount = meshes[i * 4 + 1];
+        m_meshes[i].pMaterial = &m_materials[meshes[i * 4 + 2]];
+        m_meshes[i].group = meshes[i * 4 + 3];
+    }
+
+    updateGroupMeshes();
+
+    const Vertex *pVertices = reinterpret_cast<const Vertex *>(file.data() + header.verticesOffset);
+
+    m_vertexBuffer.assign(pVertices, pVertices + header.numberOfVertices);
+    m_indexBuffer.assign(pIndices, pIndices + m_numberOfTriangles * 3);
+
+    packIndices();
+
+    if (m_vertexLayout == VERTEX_LAYOUT_SEPARATE)
+        separateVertices();
+
+    // The bounds aren't cached, they are quick to recompute.
+    computeBounds();
+
+    return true;
+}
+
+int ModelOBJ::packVertices(const VertexFormat &format,
+                           std::vector<unsigned char> &vertices,
+                           AttributePointer pointers[NUMBER_OF_ATTRIBUTES]) const
+{
+    // Size in floats of each attribute and whether an encoding may be used
+    // for it.
+
+    static const int attributeSizes[NUMBER_OF_ATTRIBUTES] = {3, 2, 3, 4};
+    static const bool validEncodings[NUMBER_OF_ATTRIBUTES][ENCODING_INT_2_10_10_10 + 1] =
+    {
+        // none  float  half   unorm  octa   2_10_10_10
+        {true,  true,  true,  false, false, false},     // position
+        {true,  true,  true,  true,  false, false},     // texture coordinate
+        {true,  true,  false, false, true,  false},     // normal
+        {true,  true,  false, false, false, true}       // tangent
+    };
+
+    // Find the attributes in either vertex layout. Attributes the model
+    // doesn't have are encoded as zero.
+
+    const float *pSources[NUMBER_OF_ATTRIBUTES] = {0, 0, 0, 0};
+    int sourceStrides[NUMBER_OF_ATTRIBUTES] = {0, 0, 0, 0};
+    int count = getNumberOfVertices();
+
+    if (m_vertexLayout == VERTEX_LAYOUT_SEPARATE)
+    {
+        pSources[ATTRIBUTE_POSITION] = getPositions();
+        pSources[ATTRIBUTE_TEXCOORD] = getTexCoords();
+        pSources[ATTRIBUTE_NORMAL] = getNormals();
+        pSources[ATTRIBUTE_TANGENT] = getTangents();
+
+        for (int i = 0; i < NUMBER_OF_ATTRIBUTES; ++i)
+            sourceStrides[i] = attributeSizes[i];
+    }
+    else if (count > 0)
+    {
+        pSources[ATTRIBUTE_POSITION] = m_vertexBuffer[0].position;
+        pSources[ATTRIBUTE_TEXCOORD] = m_vertexBuffer[0].texCoord;
+        pSources[ATTRIBUTE_NORMAL] = m_vertexBuffer[0].normal;
+        pSources[ATTRIBUTE_TANGENT] = m_vertexBuffer[0].tangent;
+
+        for (int i = 0; i < NUMBER_OF_ATTRIBUTES; ++i)
+            sourceStrides[i] = sizeof(Vertex) / sizeof(float);
+    }
+
+    // Lay out the packed vertex.
+
+    int stride = 0;
+
+    for (int i = 0; i < NUMBER_OF_ATTRIBUTES; ++i)
+    {
+        AttributeEncoding encoding = format.encodings[i];
+        AttributePointer &pointer = pointers[i];
+
+        if (encoding < ENCODING_NONE || encoding > ENCODING_INT_2_10_10_10 ||
+            !validEncodings[i][encoding])
+        {
+            return 0;
+        }
+
+        pointer.size = attributeSizes[i];
+        pointer.normalized = false;
+        pointer.offset = stride;
+
+        switch (encoding)
+        {
+        case ENCODING_NONE:
+            pointer.size = 0;
+            pointer.type = 0;
+            break;
+
+        case ENCODING_FLOAT:
+            pointer.type = GL_TYPE_FLOAT;
+            stride += pointer.size * 4;
+            break;
+
+        case ENCODING_HALF_FLOAT:
+            pointer.type = GL_TYPE_HALF_FLOAT;
+            stride += (pointer.size * 2 + 3) & ~3;
+            break;
+
+        case ENCODING_UNORM16:
+            pointer.type = GL_TYPE_UNSIGNED_SHORT;
+            pointer.normalized = true;
+            stride += pointer.size * 2;
+            break;
+
+        case ENCODING_OCTAHEDRAL:
+            pointer.size = 2;
+            pointer.type = GL_TYPE_SHORT;
+            pointer.normalized = true;
+            stride += 4;
+            break;
+
+        case ENCODING_INT_2_10_10_10:
+            pointer.type = GL_TYPE_INT_2_10_10_10_REV;
+            pointer.normalized = true;
+            stride += 4;
+            break;
+        }
+    }
+
+    if (stride == 0)
+        return 0;
+
+    if (format.encodings[ATTRIBUTE_TEXCOORD] == ENCODING_UNORM16 && pSources[ATTRIBUTE_TEXCOORD])
+    {
+        for (int i = 0; i < count; ++i)
+        {
+            const float *pTexCoord = pSources[ATTRIBUTE_TEXCOORD] + i * sourceStrides[ATTRIBUTE_TEXCOORD];
+
+            if (!(pTexCoord[0] >= 0.0f && pTexCoord[0] <= 1.0f &&
+                  pTexCoord[1] >= 0.0f && pTexCoord[1] <= 1.0f))
+            {
+                return 0;
+            }
+        }
+    }
+
+    // Encode the vertices.
+
+    vertices.assign(static_cast<size_t>(count) * stride, 0);
+
+    for (int i = 0; i < NUMBER_OF_ATTRIBUTES; ++i)
+    {
+        const AttributePointer &pointer = pointers[i];
+
+        if (pointer.size == 0 || !pSources[i])
+            continue;
+
+        for (int j = 0; j < count; ++j)
+        {
+            const float *pSource = pSources[i] + j * sourceStrides[i];
+            unsigned char *pDest = &vertices[static_cast<size_t>(j) * stride + pointer.offset];
+
+            switch (format.encodings[i])
+            {
+            case ENCODING_FLOAT:
+                memcpy(pDest, pSource, attributeSizes[i] * sizeof(float));
+                break;
+
+            case ENCODING_HALF_FLOAT:
+                for (int k = 0; k < attributeSizes[i]; ++k)
+                {
+                    unsigned short half = FloatToHalf(pSource[k]);
+                    memcpy(pDest + k * 2, &half, 2);
+                }
+                break;
+
+            case ENCODING_UNORM16:
+                for (int k = 0; k < attributeSizes[i]; ++k)
+                {
+                    unsigned short value = static_cast<unsigned short>(
+                        floorf(pSource[k] * 65535.0f + 0.5f));
+                    memcpy(pDest + k * 2, &value, 2);
+                }
+                break;
+
+            case ENCODING_OCTAHEDRAL:
+                {
+                    short encoded[2];
+                    EncodeOctahedral(pSource, encoded);
+                    memcpy(pDest, encoded, sizeof(encoded));
+                }
+                break;
+
+            case ENCODING_INT_2_10_10_10:
+                {
+                    unsigned int packed = EncodeTangent(pSource);
+                    memcpy(pDest, &packed, sizeof(packed));
+                }
+                break;
+
+            default:
+                break;
+            }
+        }
+    }
+
+    return stride;
+}
+
+void ModelOBJ::optimizePostTransformCache()
+{
+    // Reordering the triangles breaks up the meshlets.
+    m_meshlets.clear();
+
+    ForsythWorkspace work;
+    std::vector<int> order;
+    std::vector<int> indices;
+
+    for (int i = 0; i < m_numberOfMeshes; ++i)
+    {
+        const Mesh &mesh = m_meshes[i];
+
+        if (mesh.triangleCount < 2)
+            continue;
+
+        int *pIndices = &m_indexBuffer[mesh.startIndex];
+
+        order.resize(mesh.triangleCount);
+        OptimizeTriangleOrder(pIndices, mesh.triangleCount,
+            getNumberOfVertices(), work, &order[0]);
+
+        indices.assign(pIndices, pIndices + mesh.triangleCount * 3);
+
+        for (int j = 0; j < mesh.triangleCount; ++j)
+        {
+            const int *pTriangle = &indices[order[j] * 3];
+
+            pIndices[j * 3] = pTriangle[0];
+            pIndices[j * 3 + 1] = pTriangle[1];
+            pIndices[j * 3 + 2] = pTriangle[2];
+        }
+    }
+
+    if (!m_bvhNodes.empty())
+        buildBvh();
+
+    packIndices();
+}
+
+void ModelOBJ::buildMeshlets()
+{
+    // Reorder the triangles of each mesh so that every meshlet is a range
+    // of the index buffer.
+
+    ForsythWorkspace work;
+    std::vector<int> order;
+    std::vector<int> sizes;
+    std::vector<int> indices;
+
+    m_meshlets.clear();
+
+    for (int i = 0; i < m_numberOfMeshes; ++i)
+    {
+        const Mesh &mesh = m_meshes[i];
+
+        if (mesh.triangleCount == 0)
+            continue;
+
+        int *pIndices = &m_indexBuffer[mesh.startIndex];
+
+        order.resize(mesh.triangleCount);
+        BuildMeshletOrder(pIndices, mesh.triangleCount, getNumberOfVertices(),
+            work, &order[0], sizes);
+
+        indices.assign(pIndices, pIndices + mesh.triangleCount * 3);
+
+        for (int j = 0; j < mesh.triangleCount; ++j)
+        {
+            const int *pTriangle = &indices[order[j] * 3];
+
+            pIndices[j * 3] = pTriangle[0];
+            pIndices[j * 3 + 1] = pTriangle[1];
+            pIndices[j * 3 + 2] = pTriangle[2];
+        }
+
+        Meshlet meshlet;
+
+        meshlet.startIndex = mesh.startIndex;
+        meshlet.mesh = i;
+
+        for (int j = 0; j < static_cast<int>(sizes.size()); ++j)
+        {
+            meshlet.triangleCount = sizes[j];
+            m_meshlets.push_back(meshlet);
+
+            // Growing the meshlets ignores the post-transform cache, so
+            // optimize the triangle order within each of them again.
+
+            int *pMeshletIndices = &m_indexBuffer[meshlet.startIndex];
+
+            OptimizeTriangleOrder(pMeshletIndices, sizes[j],
+                getNumberOfVertices(), work, &order[0]);
+
+            indices.assign(pMeshletIndices, pMeshletIndices + sizes[j] * 3);
+
+            for (int k = 0; k < sizes[j]; ++k)
+            {
+                const int *pTriangle = &indices[order[k] * 3];
+
+                pMeshletIndices[k * 3] = pTriangle[0];
+                pMeshletIndices[k * 3 + 1] = pTriangle[1];
+                pMeshletIndices[k * 3 + 2] = pTriangle[2];
+            }
+
+            meshlet.startIndex += sizes[j] * 3;
+        }
+    }
+
+    computeMeshletBounds();
+
+    if (!m_bvhNodes.empty())
+        buildBvh();
+
+    packIndices();
+}
+
+int ModelOBJ::cullMeshlets(const float modelViewProjection[16],
+                           const float cameraPosition[3], int *pVisible) const
+{
+    // The frustum planes are in the model's coordinates.
+
+    float planes[6][4];
+    ExtractFrustumPlanes(modelViewProjection, planes);
+
+    int visible = 0;
+
+    for (int i = 0; i < static_cast<int>(m_meshlets.size()); ++i)
+    {
+        const Meshlet &meshlet = m_meshlets[i];
+
+        if (!SphereInFrustum(planes, meshlet.center, meshlet.radius))
+            continue;
+
+        // Every triangle faces away from a camera inside the cone behind
+        // the apex.
+
+        float d[3] =
+        {
+            meshlet.coneApex[0] - cameraPosition[0],
+            meshlet.coneApex[1] - cameraPosition[1],
+            meshlet.coneApex[2] - cameraPosition[2]
+        };
+        float length = sqrtf(d[0] * d[0] + d[1] * d[1] + d[2] * d[2]);
+        float cosine = d[0] * meshlet.coneAxis[0] + d[1] * meshlet.coneAxis[1] + d[2] * meshlet.coneAxis[2];
+
+        if (cosine >= meshlet.coneCutoff * length)
+            continue;
+
+        pVisible[visible++] = i;
+    }
+
+    return visible;
+}
+
+int ModelOBJ::buildDrawList(const float cameraPosition[3], std::vector<Draw> &draws,
+                           const float modelViewProjection[16], int level) const
+{
+    const std::vector<Mesh> &meshes = (level > 0) ?
+        m_levelsOfDetail[level - 1].meshes : m_meshes;
+
+    float planes[6][4];
+
+    if (modelViewProjection)
+        ExtractFrustumPlanes(modelViewProjection, planes);
+
+    // The key of an opaque draw, from the most significant bit:
+    //     0 | shader (8) | texture (16) | material (16) | depth bucket (4)
+    // and of a transparent draw:
+    //     1 | far to near depth (16) | shader (8) | texture (16) | material (16)
+    // Shaders differ in the maps a material uses. Textures are numbered in
+    // the order materials first use them, 0 is none.
+
+    const unsigned long long DRAW_TRANSPARENT = 1ULL << 63;
+    const unsigned long long DRAW_OPAQUE_STATE = ~((1ULL << 22) - 1);
+    const unsigned long long DRAW_TRANSPARENT_STATE = DRAW_TRANSPARENT | ((1ULL << 47) - 1);
+
+    std::vector<unsigned long long> materialKeys(m_materials.size());
+    std::map<std::string, int> textures;
+
+    for (int i = 0; i < static_cast<int>(m_materials.size()); ++i)
+    {
+        const Material &material = m_materials[i];
+        unsigned long long shader = (material.colorMapFilename.empty() ? 0 : 1) |
+            (material.bumpMapFilename.empty() ? 0 : 2);
+        unsigned long long texture = 0;
+
+        if (!material.colorMapFilename.empty())
+        {
+            texture = textures.insert(std::make_pair(material.colorMapFilename,
+                static_cast<int>(textures.size()) + 1)).first->second;
+        }
+
+        materialKeys[i] = (shader << 32) | ((texture & 0xFFFF) << 16) | (i & 0xFFFF);
+    }
+
+    // Depths are the distances of the meshes' centers from the camera,
+    // relative to the farthest point of the model.
+
+    float d[3] =
+    {
+        m_center[0] - cameraPosition[0],
+        m_center[1] - cameraPosition[1],
+        m_center[2] - cameraPosition[2]
+    };
+    float farthest = sqrtf(d[0] * d[0] + d[1] * d[1] + d[2] * d[2]) + m_sphereRadius;
+    float depthScale = (farthest > 0.0f) ? 1.0f / farthest : 0.0f;
+
+    draws.clear();
+
+    for (int i = 0; i < static_cast<int>(meshes.size()); ++i)
+    {
+        const Mesh &mesh = meshes[i];
+
+        if (mesh.triangleCount == 0 ||
+            (modelViewProjection && !SphereInFrustum(planes, mesh.center, mesh.radius)))
+        {
+            continue;
+        }
+
+        float v[3] =
+        {
+            mesh.center[0] - cameraPosition[0],
+            mesh.center[1] - cameraPosition[1],
+            mesh.center[2] - cameraPosition[2]
+        };
+        float depth = std::min(sqrtf(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]) * depthScale, 1.0f);
+        unsigned long long material = materialKeys[mesh.pMaterial - &m_materials[0]];
+        Draw draw = {0, mesh.startIndex, mesh.triangleCount, mesh.pMaterial};
+
+        if (mesh.pMaterial->alpha < 1.0f)
+        {
+            unsigned long long bucket = static_cast<unsigned long long>((1.0f - depth) * 65535.0f);
+            draw.key = DRAW_TRANSPARENT | (bucket << 47) | (material << 7);
+        }
+        else
+        {
+            unsigned long long bucket = static_cast<unsigned long long>(depth * 15.0f);
+            draw.key = (material << 22) | (bucket << 18);
+        }
+
+        draws.push_back(draw);
+    }
+
+    // Draws with the same key keep their order in the index buffer. A draw
+    // that follows another one with the same state, both in the list and in
+    // the index buffer, is merged into it. That doesn't change the order
+    // anything is drawn in, even across depth buckets.
+
+    std::sort(draws.begin(), draws.end(), [](const Draw &lhs, const Draw &rhs)
+    {
+        return lhs.key < rhs.key || (lhs.key == rhs.key && lhs.startIndex < rhs.startIndex);
+    });
+
+    int count = 0;
+
+    for (int i = 0; i < static_cast<int>(draws.size()); ++i)
+    {
+        const Draw *pLast = (count > 0) ? &draws[count - 1] : 0;
+        unsigned long long state = (draws[i].key & DRAW_TRANSPARENT) ?
+            DRAW_TRANSPARENT_STATE : DRAW_OPAQUE_STATE;
+
+        if (pLast && (pLast->key & state) == (draws[i].key & state) &&
+            pLast->startIndex + pLast->triangleCount * 3 == draws[i].startIndex)
+        {
+            draws[count - 1].triangleCount += draws[i].triangleCount;
+        }
+        else
+        {
+            draws[count++] = draws[i];
+        }
+    }
+
+    draws.resize(count);
+    return count;
+}
+
+void ModelOBJ::buildBvh()
+{
+    m_bvhNodes.clear();
+    m_bvhTriangles.clear();
+    m_bvhTriangleData.clear();
+
+    int totalTriangles = getNumberOfTriangles();
+
+    if (totalTriangles == 0)
+        return;
+
+    int stride = 0;
+    const float *pPositions = getPositionData(stride);
+    const int *pIndices = &m_indexBuffer[0];
+    int numberOfThreads = GetNumberOfThreads(m_numberOfThreads);
+    int numberOfTasks = GetNumberOfTasks(numberOfThreads, totalTriangles,
+        MIN_TRIANGLES_PER_TASK);
+
+    ThreadPool pool((numberOfTasks > 1) ? numberOfThreads : 1);
+    BvhBuilder builder;
+
+    builder.bounds.resize(totalTriangles);
+    builder.centroids.resize(totalTriangles * 3);
+    builder.triangles.resize(totalTriangles);
+
+    pool.run(numberOfTasks, [&](int task)
+    {
+        int first = static_cast<int>(static_cast<long long>(totalTriangles) * task / numberOfTasks);
+        int last = static_cast<int>(static_cast<long long>(totalTriangles) * (task + 1) / numberOfTasks);
+
+        for (int i = first; i < last; ++i)
+        {
+            BvhBounds &bounds = builder.bounds[i];
+
+            bounds.reset();
+
+            for (int j = 0; j < 3; ++j)
+                bounds.grow(pPositions + pIndices[i * 3 + j] * stride);
+
+            for (int j = 0; j < 3; ++j)
+                builder.centroids[i * 3 + j] = (bounds.minimum[j] + bounds.maximum[j]) * 0.5f;
+
+            builder.triangles[i] = i;
+        }
+    });
+
+    // Split the top of the tree breadth first, binning large nodes on all
+    // threads, until there are enough subtrees to keep the threads busy.
+
+    std::vector<BvhBuildNode> top(1);
+    std::vector<int> depths(1, 0);
+    std::vector<int> subtreeRoots;
+    int targetSubtrees = (numberOfThreads > 1) ? numberOfThreads * BVH_SUBTREES_PER_THREAD : 1;
+
+    top[0].start = 0;
+    top[0].count = totalTriangles;
+    top[0].children[0] = top[0].children[1] = -1;
+    top[0].subtree = -1;
+
+    for (int i = 0; i < static_cast<int>(top.size()); ++i)
+    {
+        int waiting = static_cast<int>(top.size()) - i + static_cast<int>(subtreeRoots.size());
+
+        if (top[i].count < MIN_TRIANGLES_PER_BVH_SUBTREE || waiting >= targetSubtrees)
+        {
+            top[i].subtree = static_cast<int>(subtreeRoots.size());
+            subtreeRoots.push_back(i);
+            continue;
+        }
+
+        BvhBuildNode node = top[i];
+        int middle = SplitBvhNode(builder, node, depths[i], &pool,
+            GetNumberOfTasks(numberOfThreads, node.count, MIN_TRIANGLES_PER_TASK));
+
+        if (middle >= 0)
+        {
+            BvhBuildNode child = node;
+
+            child.children[0] = child.children[1] = -1;
+            node.children[0] = static_cast<int>(top.size());
+            node.children[1] = node.children[0] + 1;
+
+            child.count = middle - node.start;
+            top.push_back(child);
+            depths.push_back(depths[i] + 1);
+
+            child.start = middle;
+            child.count = node.start + node.count - middle;
+            top.push_back(child);
+            depths.push_back(depths[i] + 1);
+        }
+
+        top[i] = node;
+    }
+
+    std::vector<std::vector<BvhBuildNode> > subtrees(subtreeRoots.size());
+
+    pool.run(static_cast<int>(subtreeRoots.size()), [&](int task)
+    {
+        const BvhBuildNode &root = top[subtreeRoots[task]];
+        BuildBvhSubtree(builder, subtrees[task], root.start, root.count,
+            depths[subtreeRoots[task]]);
+    });
+
+    m_bvhNodes.reserve(totalTriangles * 2 / BVH_BLOCK_SIZE + 1);
+    FlattenBvh(builder, top, 0, subtrees, m_bvhNodes, m_bvhTriangles);
+
+    // Store the triangles of the leaves in blocks for the SIMD tests.
+
+    m_bvhTriangleData.resize(m_bvhTriangles.size() * BVH_FLOATS_PER_TRIANGLE, 0.0f);
+
+    for (int i = 0; i < static_cast<int>(m_bvhTriangles.size()); ++i)
+    {
+        int triangle = m_bvhTriangles[i];
+
+        if (triangle < 0)
+            continue;
+
+        float *pBlock = &m_bvhTriangleData[(i / BVH_BLOCK_SIZE) * BVH_BLOCK_SIZE * BVH_FLOATS_PER_TRIANGLE];
+        int lane = i % BVH_BLOCK_SIZE;
+        const float *p0 = pPositions + pIndices[triangle * 3] * stride;
+        const float *p1 = pPositions + pIndices[triangle * 3 + 1] * stride;
+        const float *p2 = pPositions + pIndices[triangle * 3 + 2] * stride;
+
+        for (int j = 0; j < 3; ++j)
+        {
+            pBlock[j * 4 + lane] = p0[j];
+            pBlock[12 + j * 4 + lane] = p1[j] - p0[j];
+            pBlock[24 + j * 4 + lane] = p2[j] - p0[j];
+        }
+    }
+}
+
+bool ModelOBJ::intersectRay(const float origin[3], const float direction[3],
+                            RayHit &hit, float tMax) const
+{
+    hit.triangle = -1;
+    hit.t = tMax;
+    hit.u = 0.0f;
+    hit.v = 0.0f;
+
+    if (m_bvhNodes.empty())
+        return false;
+
+    float inverse[3] =
+    {
+        BvhInverse(direction[0]),
+        BvhInverse(direction[1]),
+        BvhInverse(direction[2])
+    };
+    int stack[BVH_STACK_SIZE];
+    float entries[BVH_STACK_SIZE];
+    int size = 0;
+    int index = 0;
+    float entry = 0.0f;
+
+    if (!IntersectBvhBounds(m_bvhNodes[0], origin, inverse, hit.t, entry))
+        return false;
+
+    for (;;)
+    {
+        const BvhNode &node = m_bvhNodes[index];
+
+        if (node.count == 0)
+        {
+            // Visit the nearer child first and come back for the other one
+            // unless a closer hit is found in the meantime.
+
+            int children[2] = {index + 1, node.start};
+            float childEntries[2];
+            bool hits[2] =
+            {
+                IntersectBvhBounds(m_bvhNodes[children[0]], origin, inverse, hit.t, childEntries[0]),
+                IntersectBvhBounds(m_bvhNodes[children[1]], origin, inverse, hit.t, childEntries[1])
+            };
+
+            if (hits[0] && hits[1])
+            {
+                int nearer = (childEntries[1] < childEntries[0]) ? 1 : 0;
+
+                stack[size] = children[1 - nearer];
+                entries[size++] = childEntries[1 - nearer];
+                index = children[nearer];
+                continue;
+            }
+
+            if (hits[0] || hits[1])
+            {
+                index = children[hits[0] ? 0 : 1];
+                continue;
+            }
+        }
+        else
+        {
+            for (int i = node.start; i < node.start + node.count; i += BVH_BLOCK_SIZE)
+            {
+                IntersectBvhBlock(&m_bvhTriangleData[i * BVH_FLOATS_PER_TRIANGLE],
+                    &m_bvhTriangles[i], origin, direction, hit);
+            }
+        }
+
+        do
+        {
+            if (size == 0)
+                return hit.triangle >= 0;
+        } while (entries[--size] > hit.t);
+
+        index = stack[size];
+    }
+}
+
+void ModelOBJ::intersectRays(const float *pOrigins, const float *pDirections,
+                             int count, RayHit *pHits, float tMax) const
+{
+#if defined(MODEL_OBJ_SSE2)
+    if (m_bvhNodes.empty())
+    {
+        for (int i = 0; i < count; ++i)
+            intersectRay(pOrigins + i * 3, pDirections + i * 3, pHits[i], tMax);
+
+        return;
+    }
+
+    for (int first = 0; first < count; first += 4)
+    {
+        int rays = std::min(4, count - first);
+        float lanes[3][3][4];
+        float t[4];
+        BvhRayPacket packet;
+
+        for (int i = 0; i < 4; ++i)
+        {
+            int ray = first + std::min(i, rays - 1);
+
+            for (int j = 0; j < 3; ++j)
+            {
+                lanes[0][j][i] = pOrigins[ray * 3 + j];
+                lanes[1][j][i] = pDirections[ray * 3 + j];
+                lanes[2][j][i] = BvhInverse(pDirections[ray * 3 + j]);
+            }
+
+            t[i] = (i < rays) ? tMax : -1.0f;
+        }
+
+        for (int j = 0; j < 3; ++j)
+        {
+            packet.origin[j] = _mm_loadu_ps(lanes[0][j]);
+            packet.direction[j] = _mm_loadu_ps(lanes[1][j]);
+            packet.inverse[j] = _mm_loadu_ps(lanes[2][j]);
+        }
+
+        packet.t = _mm_loadu_ps(t);
+        packet.u = _mm_setzero_ps();
+        packet.v = _mm_setzero_ps();
+        packet.triangle = _mm_castsi128_ps(_mm_set1_epi32(-1));
+
+        // The packet visits every node that any of its rays hits.
+
+        int stack[BVH_STACK_SIZE];
+        int size = 0;
+        int index = 0;
+        __m128 entry;
+        bool traverse = IntersectBvhBoundsPacket(m_bvhNodes[0], packet, entry) != 0;
+
+        while (traverse)
+        {
+            const BvhNode &node = m_bvhNodes[index];
+
+            if (node.count == 0)
+            {
+                int children[2] = {index + 1, node.start};
+                __m128 childEntries[2];
+                int hits[2] =
+                {
+                    IntersectBvhBoundsPacket(m_bvhNodes[children[0]], packet, childEntries[0]),
+                    IntersectBvhBoundsPacket(m_bvhNodes[children[1]], packet, childEntries[1])
+                };
+
+                if (hits[0] && hits[1])
+                {
+                    // Order the children by the entry distance of the first
+                    // ray that hits both.
+
+                    float entries[2][4];
+                    int lane = 0;
+
+                    _mm_storeu_ps(entries[0], childEntries[0]);
+                    _mm_storeu_ps(entries[1], childEntries[1]);
+
+                    while (!(hits[0] & hits[1] & (1 << lane)) && lane < 3)
+                        ++lane;
+
+                    int nearer = (entries[1][lane] < entries[0][lane]) ? 1 : 0;
+
+                    stack[size++] = children[1 - nearer];
+                    index = children[nearer];
+                    continue;
+                }
+
+                if (hits[0] || hits[1])
+                {
+                    index = children[hits[0] ? 0 : 1];
+                    continue;
+                }
+            }
+            else
+            {
+                for (int i = node.start; i < node.start + node.count; ++i)
+                {
+                    IntersectBvhTrianglePacket(
+                        &m_bvhTriangleData[(i / BVH_BLOCK_SIZE) * BVH_BLOCK_SIZE * BVH_FLOATS_PER_TRIANGLE],
+                        i % BVH_BLOCK_SIZE, m_bvhTriangles[i], packet);
+                }
+            }
+
+            traverse = size > 0;
+
+            if (traverse)
+                index = stack[--size];
+        }
+
+        float u[4];
+        float v[4];
+        int triangles[4];
+
+        _mm_storeu_ps(t, packet.t);
+        _mm_storeu_ps(u, packet.u);
+        _mm_storeu_ps(v, packet.v);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(triangles), _mm_castps_si128(packet.triangle));
+
+        for (int i = 0; i < rays; ++i)
+        {
+            RayHit &hit = pHits[first + i];
+
+            hit.triangle = triangles[i];
+            hit.t = t[i];
+            hit.u = u[i];
+            hit.v = v[i];
+        }
+    }
+#else
+    for (int i = 0; i < count; ++i)
+        intersectRay(pOrigins + i * 3, pDirections + i * 3, pHits[i], tMax);
+#endif
+}
+
+int ModelOBJ::generateLevelsOfDetail(int numberOfLevels, float reduction, float maxError)
+{
+    m_levelsOfDetail.clear();
+    m_lodIndexBuffer.clear();
+    m_shortLodIndexBuffer.clear();
+
+    if (numberOfLevels <= 0 || !(reduction > 0.0f && reduction < 1.0f) || m_numberOfTriangles == 0)
+        return 0;
+
+    SimplifyState state;
+    int numberOfVertices = getNumberOfVertices();
+
+    state.pPositions = getPositionData(state.stride);
+    std::vector<int> triangleMaterials;
+    getTriangleMaterials(triangleMaterials);
+
+    state.pMaterials = &triangleMaterials[0];
+    state.positionOf.resize(numberOfVertices);
+    state.boundaryQuadrics = true;
+
+    int numberOfPositions = WeldPositions(state.pPositions, state.stride,
+        numberOfVertices, &state.positionOf[0]);
+
+    // Start from the triangles with three distinct positions and sum up the
+    // planes of the triangles around each position.
+
+    Quadric zero = {0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0};
+    float minimum[3] = {FLT_MAX, FLT_MAX, FLT_MAX};
+    float maximum[3] = {-FLT_MAX, -FLT_MAX, -FLT_MAX};
+
+    state.quadrics.assign(numberOfPositions, zero);
+
+    for (int i = 0; i < m_numberOfTriangles; ++i)
+    {
+        const int *pTriangle = &m_indexBuffer[i * 3];
+        int a = state.positionOf[pTriangle[0]];
+        int b = state.positionOf[pTriangle[1]];
+        int c = state.positionOf[pTriangle[2]];
+
+        if (a == b || b == c || a == c)
+            continue;
+
+        const float *p[3];
+        double n[3];
+
+        for (int j = 0; j < 3; ++j)
+        {
+            p[j] = SimplifyPosition(state, pTriangle[j]);
+            state.triangles.push_back(pTriangle[j]);
+
+            for (int k = 0; k < 3; ++k)
+            {
+                minimum[k] = std::min(minimum[k], p[j][k]);
+                maximum[k] = std::max(maximum[k], p[j][k]);
+            }
+        }
+
+        state.origins.push_back(i);
+        TriangleNormal(p[0], p[1], p[2], n);
+
+        double length = sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+
+        if (length <= 0.0)
+            continue;
+
+        n[0] /= length;
+        n[1] /= length;
+        n[2] /= length;
+
+        double d = -(n[0] * p[0][0] + n[1] * p[0][1] + n[2] * p[0][2]);
+
+        AddPlaneQuadric(state.quadrics[a], n, d, 0.5 * length);
+        AddPlaneQuadric(state.quadrics[b], n, d, 0.5 * length);
+        AddPlaneQuadric(state.quadrics[c], n, d, 0.5 * length);
+    }
+
+    if (state.origins.empty())
+        return 0;
+
+    // Errors are measured relative to the diagonal of the bounding box.
+
+    double extent = sqrt(
+        static_cast<double>(maximum[0] - minimum[0]) * (maximum[0] - minimum[0]) +
+        static_cast<double>(maximum[1] - minimum[1]) * (maximum[1] - minimum[1]) +
+        static_cast<double>(maximum[2] - minimum[2]) * (maximum[2] - minimum[2]));
+    double errorLimit = (maxError * extent) * (maxError * extent);
+    double error = 0.0;
+    float target = static_cast<float>(m_numberOfTriangles);
+
+    while (static_cast<int>(m_levelsOfDetail.size()) < numberOfLevels)
+    {
+        target *= reduction;
+
+        int count = static_cast<int>(state.origins.size());
+        int previous = m_levelsOfDetail.empty() ? m_numberOfTriangles :
+            m_levelsOfDetail.back().triangleCount;
+
+        while (count > target && SimplifyPass(state, numberOfPositions,
+            static_cast<int>(target), errorLimit, error) > 0)
+        {
+            count = static_cast<int>(state.origins.size());
+        }
+
+        float relativeError = (extent > 0.0) ? static_cast<float>(sqrt(error) / extent) : 0.0f;
+
+        // Out of collapses within maxError. Keep what was reached as the
+        // last level.
+        if (count > target)
+        {
+            if (count < previous)
+                addLevelOfDetail(state.triangles, state.origins, relativeError);
+
+            break;
+        }
+
+        addLevelOfDetail(state.triangles, state.origins, relativeError);
+    }
+
+    packIndices();
+    return static_cast<int>(m_levelsOfDetail.size());
+}
+
+void ModelOBJ::optimizeOverdraw(float threshold)
+{
+    // Each mesh is split into clusters of consecutive triangles that are
+    // cheap to draw from a cold vertex cache: a cluster ends as soon as its
+    // ACMR is within threshold of the mesh's. The clusters are then drawn
+    // in order of how much they face away from the mesh's center, as those
+    // tend to hide the others.
+
+    int stride = 0;
+    const float *pPositions = getPositionData(stride);
+
+    // Reordering the triangles breaks up the meshlets.
+    m_meshlets.clear();
+
+    FifoVertexCache cache(getNumberOfVertices(), SIMULATED_VERTEX_CACHE_SIZE);
+    std::vector<TriangleCluster> clusters;
+    std::vector<float> centroids;
+    std::vector<float> normals;
+    std::vector<int> indices;
+
+    for (int i = 0; i < m_numberOfMeshes; ++i)
+    {
+        const Mesh &mesh = m_meshes[i];
+
+        if (mesh.triangleCount < 2)
+            continue;
+
+        int *pIndices = &m_indexBuffer[mesh.startIndex];
+        int misses = 0;
+
+        cache.flush();
+
+        for (int j = 0; j < mesh.triangleCount * 3; ++j)
+            misses += cache.access(pIndices[j]) ? 1 : 0;
+
+        float limit = threshold * misses / mesh.triangleCount;
+
+        // Find the clusters.
+
+        TriangleCluster cluster = {0, 0, 0.0f};
+
+        clusters.clear();
+        cache.flush();
+        misses = 0;
+
+        for (int j = 0; j < mesh.triangleCount; ++j)
+        {
+            for (int k = 0; k < 3; ++k)
+                misses += cache.access(pIndices[j * 3 + k]) ? 1 : 0;
+
+            if (++cluster.triangleCount * limit >= misses && j + 1 < mesh.triangleCount)
+            {
+                clusters.push_back(cluster);
+                cluster.firstTriangle = j + 1;
+                cluster.triangleCount = 0;
+                cache.flush();
+                misses = 0;
+            }
+        }
+
+        clusters.push_back(cluster);
+
+        if (clusters.size() < 2)
+            continue;
+
+        // Area weighted centroid and normal of each cluster and the mesh.
+
+        float meshCentroid[3] = {0.0f, 0.0f, 0.0f};
+        float meshArea = 0.0f;
+
+        centroids.assign(clusters.size() * 3, 0.0f);
+        normals.assign(clusters.size() * 3, 0.0f);
+
+        for (int j = 0; j < static_cast<int>(clusters.size()); ++j)
+        {
+            const TriangleCluster &current = clusters[j];
+            float *pCentroid = &centroids[j * 3];
+            float *pNormal = &normals[j * 3];
+            float area = 0.0f;
+
+            for (int k = current.firstTriangle; k < current.firstTriangle + current.triangleCount; ++k)
+            {
+                const float *p0 = pPositions + pIndices[k * 3] * stride;
+                const float *p1 = pPositions + pIndices[k * 3 + 1] * stride;
+                const float *p2 = pPositions + pIndices[k * 3 + 2] * stride;
+
+                float e0[3] = {p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2]};
+                float e1[3] = {p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2]};
+                float n[3] =
+                {
+                    e0[1] * e1[2] - e0[2] * e1[1],
+                    e0[2] * e1[0] - e0[0] * e1[2],
+                    e0[0] * e1[1] - e0[1] * e1[0]
+                };
+                float w = sqrtf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+
+                for (int c = 0; c < 3; ++c)
+                {
+                    pCentroid[c] += w * (p0[c] + p1[c] + p2[c]) / 3.0f;
+                    pNormal[c] += n[c];
+                }
+
+                area += w;
+            }
+
+            for (int c = 0; c < 3; ++c)
+                meshCentroid[c] += pCentroid[c];
+
+            meshArea += area;
+
+            if (area > 0.0f)
+            {
+                for (int c = 0; c < 3; ++c)
+                    pCentroid[c] /= area;
+            }
+        }
+
+        if (meshArea > 0.0f)
+        {
+            for (int c = 0; c < 3; ++c)
+                meshCentroid[c] /= meshArea;
+        }
+
+        for (int j = 0; j < static_cast<int>(clusters.size()); ++j)
+        {
+            const float *pCentroid = &centroids[j * 3];
+            const float *pNormal = &normals[j * 3];
+            float length = sqrtf(pNormal[0] * pNormal[0] + pNormal[1] * pNormal[1] + pNormal[2] * pNormal[2]);
+
+            clusters[j].key = 0.0f;
+
+            if (length > 0.0f)
+            {
+                for (int c = 0; c < 3; ++c)
+                    clusters[j].key += (pCentroid[c] - meshCentroid[c]) * pNormal[c] / length;
+            }
+        }
+
+        // Draw the clusters facing outwards first.
+
+        std::stable_sort(clusters.begin(), clusters.end(), TriangleClusterCompFunc);
+
+        indices.assign(pIndices, pIndices + mesh.triangleCount * 3);
+
+        int triangle = 0;
+
+        for (int j = 0; j < static_cast<int>(clusters.size()); ++j)
+        {
+            const TriangleCluster &current = clusters[j];
+
+            for (int k = current.firstTriangle; k < current.firstTriangle + current.triangleCount; ++k, ++triangle)
+            {
+                pIndices[triangle * 3] = indices[k * 3];
+                pIndices[triangle * 3 + 1] = indices[k * 3 + 1];
+                pIndices[triangle * 3 + 2] = indices[k * 3 + 2];
+            }
+        }
+    }
+
+    if (!m_bvhNodes.empty())
+        buildBvh();
+
+    packIndices();
+}
+
+void ModelOBJ::optimizeVertexFetch()
+{
+    // Renumber the vertices in the order the index buffer first uses them.
+
+    int count = getNumberOfVertices();
+    int used = 0;
+    std::vector<int> remap(count, -1);
+
+    for (int i = 0; i < static_cast<int>(m_indexBuffer.size()); ++i)
+    {
+        int &index = remap[m_indexBuffer[i]];
+
+        if (index < 0)
+            index = used++;
+
+        m_indexBuffer[i] = index;
+    }
+
+    // Levels of detail only use vertices of the full detail model.
+    for (int i = 0; i < static_cast<int>(m_lodIndexBuffer.size()); ++i)
+        m_lodIndexBuffer[i] = remap[m_lodIndexBuffer[i]];
+
+    if (m_vertexLayout == VERTEX_LAYOUT_SEPARATE)
+    {
+        RemapStream(m_positionStream, 3, remap, used);
+        RemapStream(m_texCoordStream, 2, remap, used);
+        RemapStream(m_normalStream, 3, remap, used);
+        RemapStream(m_tangentStream, 4, remap, used);
+        RemapStream(m_bitangentStream, 3, remap, used);
+    }
+    else
+    {
+        std::vector<Vertex> vertices(used);
+
+        for (int i = 0; i < count; ++i)
+        {
+            if (remap[i] >= 0)
+                vertices[remap[i]] = m_vertexBuffer[i];
+        }
+
+        m_vertexBuffer.swap(vertices);
+    }
 
-#include <algorithm>
-#include <cmath>
-#include <cstring>
-#include <limits>
-#include <string>
-#include "model_obj.h"
+    packIndices();
+}
 
-namespace
+ModelOBJ::VertexFetchStatistics ModelOBJ::getVertexFetchStatistics(int vertexSize) const
 {
-    bool MeshCompFunc(const ModelOBJ::Mesh &lhs, const ModelOBJ::Mesh &rhs)
+    // Every vertex that misses the post-transform cache reads its bytes
+    // through the fetch cache. Overfetch is the ratio of the bytes read to
+    // the size of the vertex buffer.
+
+    VertexFetchStatistics statistics = {0, 0.0f};
+    FifoVertexCache cache(getNumberOfVertices(), SIMULATED_VERTEX_CACHE_SIZE);
+    std::vector<size_t> lines(FETCH_CACHE_LINES, static_cast<size_t>(-1));
+    size_t size = static_cast<size_t>(std::max(vertexSize, 1));
+
+    for (int i = 0; i < static_cast<int>(m_indexBuffer.size()); ++i)
     {
-        return lhs.pMaterial->alpha > rhs.pMaterial->alpha;
+        int v = m_indexBuffer[i];
+
+        if (!cache.access(v))
+            continue;
+
+        size_t first = v * size / FETCH_CACHE_LINE_SIZE;
+        size_t last = (v * size + size - 1) / FETCH_CACHE_LINE_SIZE;
+
+        for (size_t line = first; line <= last; ++line)
+        {
+            size_t &cached = lines[line % FETCH_CACHE_LINES];
+
+            if (cached != line)
+            {
+                cached = line;
+                statistics.bytesFetched += FETCH_CACHE_LINE_SIZE;
+            }
+        }
     }
+
+    if (getNumberOfVertices() > 0)
+        statistics.overfetch = static_cast<float>(statistics.bytesFetched) / (getNumberOfVertices() * size);
+
+    return statistics;
 }
 
-ModelOBJ::ModelOBJ()
+ModelOBJ::PostTransformCacheStatistics ModelOBJ::getPostTransformCacheStatistics(int cacheSize) const
 {
-    m_hasPositions = false;
-    m_hasNormals = false;
-    m_hasTextureCoords = false;
-    m_hasTangents = false;
+    PostTransformCacheStatistics statistics = {0, 0.0f, 0.0f};
+    FifoVertexCache cache(getNumberOfVertices(), std::max(cacheSize, 1));
+    std::vector<char> referenced(getNumberOfVertices(), 0);
+    int transforms = 0;
+    int vertices = 0;
 
-    m_numberOfVertexCoords = 0;
-    m_numberOfTextureCoords = 0;
-    m_numberOfNormals = 0;
-    m_numberOfTriangles = 0;
-    m_numberOfMaterials = 0;
-    m_numberOfMeshes = 0;
+    for (int i = 0; i < static_cast<int>(m_indexBuffer.size()); ++i)
+    {
+        int v = m_indexBuffer[i];
 
-    m_center[0] = m_center[1] = m_center[2] = 0.0f;
-    m_width = m_height = m_length = m_radius = 0.0f;
+        if (cache.access(v))
+            ++transforms;
+
+        if (!referenced[v])
+        {
+            referenced[v] = 1;
+            ++vertices;
+        }
+    }
+
+    statistics.vertexShaderInvocations = transforms;
+
+    if (m_numberOfTriangles > 0)
+        statistics.acmr = static_cast<float>(transforms) / m_numberOfTriangles;
+
+    if (vertices > 0)
+        statistics.atvr = static_cast<float>(transforms) / vertices;
+
+    return statistics;
 }
 
-ModelOBJ::~ModelOBJ()
+void ModelOBJ::normalize(float scaleTo, bool center)
 {
-    destroy();
+    // scale() keeps the bounds up to date, so there is no need to compute
+    // them here.
+
+    float scalingFactor = scaleTo / m_radius;
+    float offset[3] = {0.0f};
+
+    if (center)
+    {
+        offset[0] = -m_center[0];
+        offset[1] = -m_center[1];
+        offset[2] = -m_center[2];
+    }
+    else
+    {
+        offset[0] = 0.0f;
+        offset[1] = 0.0f;
+        offset[2] = 0.0f;
+    }
+
+    scale(scalingFactor, offset);
+}
+
+void ModelOBJ::setNumberOfThreads(int numberOfThreads)
+{
+    m_numberOfThreads = (numberOfThreads < 0) ? 0 : numberOfThreads;
 }
 
-void ModelOBJ::bounds(float center[3], float &width, float &height,
-                      float &length, float &radius) const
+void ModelOBJ::setImportCallback(ImportCallback pCallback, void *pUserData)
 {
-    float xMax = std::numeric_limits<float>::min();
-    float yMax = std::numeric_limits<float>::min();
-    float zMax = std::numeric_limits<float>::min();
+    m_pImportCallback = pCallback;
+    m_pImportCallbackData = pUserData;
+}
+
+void ModelOBJ::setImportWindowSize(size_t windowSize)
+{
+    m_importWindowSize = windowSize;
+}
+
+void ModelOBJ::setParallelNormals(bool enable)
+{
+    m_parallelNormals = enable;
+}
+
+void ModelOBJ::setTangentMethod(TangentMethod method)
+{
+    m_tangentMethod = method;
+}
+
+void ModelOBJ::setVertexLayout(VertexLayout layout)
+{
+    if (layout == m_vertexLayout)
+        return;
 
-    float xMin = std::numeric_limits<float>::max();
-    float yMin = std::numeric_limits<float>::max();
-    float zMin = std::numeric_limits<float>::max();
+    m_vertexLayout = layout;
 
-    float x = 0.0f;
-    float y = 0.0f;
-    float z = 0.0f;
+    if (layout == VERTEX_LAYOUT_SEPARATE)
+        separateVertices();
+    else
+        interleaveVertices();
+}
 
-    int numVerts = static_cast<int>(m_vertexBuffer.size());
+void ModelOBJ::getVertices(Vertex *pVertices) const
+{
+    int count = getNumberOfVertices();
 
-    for (int i = 0; i < numVerts; ++i)
+    if (m_vertexLayout == VERTEX_LAYOUT_INTERLEAVED)
     {
-        x = m_vertexBuffer[i].position[0];
-        y = m_vertexBuffer[i].position[1];
-        z = m_vertexBuffer[i].position[2];
+        if (count > 0)
+            memcpy(pVertices, &m_vertexBuffer[0], count * sizeof(Vertex));
 
-        if (x < xMin)
-            xMin = x;
+        return;
+    }
 
-        if (x > xMax)
-            xMax = x;
+    // Attributes the model doesn't have are zero.
 
-        if (y < yMin)
-            yMin = y;
+    memset(pVertices, 0, count * sizeof(Vertex));
 
-        if (y > yMax)
-            yMax = y;
+    CopyStream<3, 3, sizeof(Vertex) / sizeof(float)>(getPositions(), count, pVertices->position);
+    CopyStream<2, 2, sizeof(Vertex) / sizeof(float)>(getTexCoords(), count, pVertices->texCoord);
+    CopyStream<3, 3, sizeof(Vertex) / sizeof(float)>(getNormals(), count, pVertices->normal);
+    CopyStream<4, 4, sizeof(Vertex) / sizeof(float)>(getTangents(), count, pVertices->tangent);
+    CopyStream<3, 3, sizeof(Vertex) / sizeof(float)>(getBitangents(), count, pVertices->bitangent);
+}
 
-        if (z < zMin)
-            zMin = z;
+void ModelOBJ::reverseWinding()
+{
+    int swap = 0;
 
-        if (z > zMax)
-            zMax = z;
+    // Reverse face winding.
+    for (int i = 0; i < static_cast<int>(m_indexBuffer.size()); i += 3)
+    {
+        swap = m_indexBuffer[i + 1];
+        m_indexBuffer[i + 1] = m_indexBuffer[i + 2];
+        m_indexBuffer[i + 2] = swap;
     }
 
-    center[0] = (xMin + xMax) / 2.0f;
-    center[1] = (yMin + yMax) / 2.0f;
-    center[2] = (zMin + zMax) / 2.0f;
+    for (int i = 0; i < static_cast<int>(m_lodIndexBuffer.size()); i += 3)
+        std::swap(m_lodIndexBuffer[i + 1], m_lodIndexBuffer[i + 2]);
+
+    computeMeshletBounds();
+
+    if (!m_bvhNodes.empty())
+        buildBvh();
+
+    packIndices();
+
+    // Invert normals and tangents.
+    if (m_vertexLayout == VERTEX_LAYOUT_SEPARATE)
+    {
+        int count = getNumberOfVertices();
 
-    width = xMax - xMin;
-    height = yMax - yMin;
-    length = zMax - zMin;
+        NegateVectors<3>(m_normalStream.empty() ? 0 : &m_normalStream[0],
+            m_normalStream.empty() ? 0 : count);
+        NegateVectors<4>(m_tangentStream.empty() ? 0 : &m_tangentStream[0],
+            m_tangentStream.empty() ? 0 : count);
+    }
+    else
+    {
+        const int stride = sizeof(Vertex) / sizeof(float);
+        Vertex *pVertices = m_vertexBuffer.empty() ? 0 : &m_vertexBuffer[0];
 
-    radius = std::max(std::max(width, height), length);
+        NegateVectors<stride>(pVertices ? pVertices->normal : 0, getNumberOfVertices());
+        NegateVectors<stride>(pVertices ? pVertices->tangent : 0, getNumberOfVertices());
+    }
 }
 
-void ModelOBJ::destroy()
+void ModelOBJ::separateVertices()
 {
-    m_hasPositions = false;
-    m_hasTextureCoords = false;
-    m_hasNormals = false;
-    m_hasTangents = false;
+    // Only the attributes the model has get a stream.
 
-    m_numberOfVertexCoords = 0;
-    m_numberOfTextureCoords = 0;
-    m_numberOfNormals = 0;
-    m_numberOfTriangles = 0;
-    m_numberOfMaterials = 0;
-    m_numberOfMeshes = 0;
+    const int stride = sizeof(Vertex) / sizeof(float);
+    int count = static_cast<int>(m_vertexBuffer.size());
+    const Vertex *pVertices = m_vertexBuffer.empty() ? 0 : &m_vertexBuffer[0];
 
-    m_center[0] = m_center[1] = m_center[2] = 0.0f;
-    m_width = m_height = m_length = m_radius = 0.0f;
+    m_positionStream.resize(count * 3);
+    m_texCoordStream.resize(m_hasTextureCoords ? count * 2 : 0);
+    m_normalStream.resize(m_hasNormals ? count * 3 : 0);
+    m_tangentStream.resize(m_hasTangents ? count * 4 : 0);
+    m_bitangentStream.resize(m_hasTangents ? count * 3 : 0);
 
-    m_directoryPath.clear();
+    if (count > 0)
+    {
+        CopyStream<3, stride, 3>(pVertices->position, count, &m_positionStream[0]);
 
-    m_meshes.clear();
-    m_materials.clear();
-    m_vertexBuffer.clear();
-    m_indexBuffer.clear();
-    m_attributeBuffer.clear();
+        if (m_hasTextureCoords)
+            CopyStream<2, stride, 2>(pVertices->texCoord, count, &m_texCoordStream[0]);
 
-    m_vertexCoords.clear();
-    m_textureCoords.clear();
-    m_normals.clear();
+        if (m_hasNormals)
+            CopyStream<3, stride, 3>(pVertices->normal, count, &m_normalStream[0]);
 
-    m_materialCache.clear();
-    m_vertexCache.clear();
+        if (m_hasTangents)
+        {
+            CopyStream<4, stride, 4>(pVertices->tangent, count, &m_tangentStream[0]);
+            CopyStream<3, stride, 3>(pVertices->bitangent, count, &m_bitangentStream[0]);
+        }
+    }
+
+    std::vector<Vertex>().swap(m_vertexBuffer);
 }
 
-bool ModelOBJ::import(const char *pszFilename, bool rebuildNormals)
+void ModelOBJ::interleaveVertices()
 {
-    FILE *pFile = fopen(pszFilename, "r");
+    int count = static_cast<int>(m_positionStream.size() / 3);
 
-    if (!pFile)
-        return false;
+    m_vertexBuffer.resize(count);
 
-    // Extract the directory the OBJ file is in from the file name.
-    // This directory path will be used to load the OBJ's associated MTL file.
+    // getVertices() reads the streams as long as they exist.
+    m_vertexLayout = VERTEX_LAYOUT_SEPARATE;
 
-    m_directoryPath.clear();
+    if (count > 0)
+        getVertices(&m_vertexBuffer[0]);
+
+    m_vertexLayout = VERTEX_LAYOUT_INTERLEAVED;
+
+    std::vector<float>().swap(m_positionStream);
+    std::vector<float>().swap(m_texCoordStream);
+    std::vector<float>().swap(m_normalStream);
+    std::vector<float>().swap(m_tangentStream);
+    std::vector<float>().swap(m_bitangentStream);
+}
+
+void ModelOBJ::addLevelOfDetail(const std::vector<int> &triangles,
+                                const std::vector<int> &origins, float error)
+{
+    // Group the triangles by the mesh they came from, in the order of the
+    // model's meshes, and optimize each mesh for the vertex cache.
+
+    LevelOfDetail level;
+    std::vector<int> meshOf(m_numberOfTriangles);
+    std::vector<int> next(m_numberOfMeshes);
 
-    std::string filename = pszFilename;
-    std::string::size_type offset = filename.find_last_of('\\');
+    level.startIndex = static_cast<int>(m_lodIndexBuffer.size());
+    level.triangleCount = static_cast<int>(origins.size());
+    level.error = error;
+    level.meshes = m_meshes;
 
-    if (offset != std::string::npos)
+    for (int i = 0; i < m_numberOfMeshes; ++i)
     {
-        m_directoryPath = filename.substr(0, ++offset);
+        const Mesh &mesh = m_meshes[i];
+
+        for (int j = 0; j < mesh.triangleCount; ++j)
+            meshOf[mesh.startIndex / 3 + j] = i;
+
+        level.meshes[i].triangleCount = 0;
     }
-    else
+
+    for (int i = 0; i < level.triangleCount; ++i)
+        ++level.meshes[meshOf[origins[i]]].triangleCount;
+
+    for (int i = 0, start = level.startIndex; i < m_numberOfMeshes; ++i)
+    {
+        level.meshes[i].startIndex = start;
+        next[i] = start;
+        start += level.meshes[i].triangleCount * 3;
+    }
+
+    m_lodIndexBuffer.resize(level.startIndex + level.triangleCount * 3);
+
+    for (int i = 0; i < level.triangleCount; ++i)
     {
-        offset = filename.find_last_of('/');
+        int &index = next[meshOf[origins[i]]];
 
-        if (offset != std::string::npos)
-            m_directoryPath = filename.substr(0, ++offset);
+        m_lodIndexBuffer[index++] = triangles[i * 3];
+        m_lodIndexBuffer[index++] = triangles[i * 3 + 1];
+        m_lodIndexBuffer[index++] = triangles[i * 3 + 2];
     }
 
-    // Import the OBJ file.
+    ForsythWorkspace work;
+    std::vector<int> order;
+    std::vector<int> indices;
 
-    importGeometryFirstPass(pFile);
-    rewind(pFile);
-    importGeometrySecondPass(pFile);
-    fclose(pFile);
+    for (int i = 0; i < m_numberOfMeshes; ++i)
+    {
+        const Mesh &mesh = level.meshes[i];
 
-    // Perform post import tasks.
+        if (mesh.triangleCount < 2)
+            continue;
 
-    buildMeshes();
-    bounds(m_center, m_width, m_height, m_length, m_radius);
+        int *pIndices = &m_lodIndexBuffer[mesh.startIndex];
 
-    // Build vertex normals if required.
+        order.resize(mesh.triangleCount);
+        OptimizeTriangleOrder(pIndices, mesh.triangleCount,
+            getNumberOfVertices(), work, &order[0]);
+        indices.assign(pIndices, pIndices + mesh.triangleCount * 3);
 
-    if (rebuildNormals)
-    {
-        generateNormals();
-    }
-    else
-    {
-        if (!hasNormals())
-            generateNormals();
+        for (int j = 0; j < mesh.triangleCount; ++j)
+        {
+            pIndices[j * 3] = indices[order[j] * 3];
+            pIndices[j * 3 + 1] = indices[order[j] * 3 + 1];
+            pIndices[j * 3 + 2] = indices[order[j] * 3 + 2];
+        }
     }
 
-    // Build tangents is required.
+    m_levelsOfDetail.push_back(level);
+}
 
-    for (int i = 0; i < m_numberOfMaterials; ++i)
+void ModelOBJ::computeMeshletBounds()
+{
+    int stride = 0;
+    const float *pPositions = getPositionData(stride);
+    std::vector<float> normals;
+
+    for (int i = 0; i < static_cast<int>(m_meshlets.size()); ++i)
     {
-        if (!m_materials[i].bumpMapFilename.empty())
+        Meshlet &meshlet = m_meshlets[i];
+        const int *pIndices = &m_indexBuffer[meshlet.startIndex];
+        int indexCount = meshlet.triangleCount * 3;
+
+        // Bounding sphere around the center of the bounding box.
+
+        float minimum[3] = {FLT_MAX, FLT_MAX, FLT_MAX};
+        float maximum[3] = {-FLT_MAX, -FLT_MAX, -FLT_MAX};
+
+        for (int j = 0; j < indexCount; ++j)
         {
-            generateTangents();
-            break;
+            const float *p = pPositions + pIndices[j] * stride;
+
+            for (int k = 0; k < 3; ++k)
+            {
+                minimum[k] = std::min(minimum[k], p[k]);
+                maximum[k] = std::max(maximum[k], p[k]);
+            }
+        }
+
+        float radiusSquared = 0.0f;
+
+        for (int k = 0; k < 3; ++k)
+            meshlet.center[k] = (minimum[k] + maximum[k]) * 0.5f;
+
+        for (int j = 0; j < indexCount; ++j)
+        {
+            const float *p = pPositions + pIndices[j] * stride;
+            float dx = p[0] - meshlet.center[0];
+            float dy = p[1] - meshlet.center[1];
+            float dz = p[2] - meshlet.center[2];
+
+            radiusSquared = std::max(radiusSquared, dx * dx + dy * dy + dz * dz);
+        }
+
+        meshlet.radius = sqrtf(radiusSquared);
+
+        // Normal cone: the axis is the mean of the triangle normals and the
+        // cutoff is the sine of the widest angle between the two. Cones of
+        // more than 90 degrees can't cull anything.
+
+        // Degenerate triangles get a zero normal and are skipped.
+
+        float axis[3] = {0.0f, 0.0f, 0.0f};
+
+        normals.assign(meshlet.triangleCount * 3, 0.0f);
+
+        for (int j = 0; j < meshlet.triangleCount; ++j)
+        {
+            double n[3];
+
+            TriangleNormal(pPositions + pIndices[j * 3] * stride,
+                pPositions + pIndices[j * 3 + 1] * stride,
+                pPositions + pIndices[j * 3 + 2] * stride, n);
+
+            double length = sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+
+            if (length <= 0.0)
+                continue;
+
+            for (int k = 0; k < 3; ++k)
+            {
+                normals[j * 3 + k] = static_cast<float>(n[k] / length);
+                axis[k] += normals[j * 3 + k];
+            }
+        }
+
+        float axisLength = sqrtf(axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2]);
+        float minimumDot = 1.0f;
+
+        for (int k = 0; k < 3 && axisLength > 0.0f; ++k)
+            axis[k] /= axisLength;
+
+        for (int j = 0; j < meshlet.triangleCount; ++j)
+        {
+            const float *n = &normals[j * 3];
+
+            if (n[0] != 0.0f || n[1] != 0.0f || n[2] != 0.0f)
+                minimumDot = std::min(minimumDot, n[0] * axis[0] + n[1] * axis[1] + n[2] * axis[2]);
+        }
+
+        if (axisLength <= 0.0f || minimumDot <= 0.0f)
+        {
+            for (int k = 0; k < 3; ++k)
+            {
+                meshlet.coneApex[k] = meshlet.center[k];
+                meshlet.coneAxis[k] = 0.0f;
+            }
+
+            meshlet.coneCutoff = 1.0f;
+            continue;
         }
+
+        // The apex is the point on the axis, behind the center, that lies
+        // behind the plane of every triangle.
+
+        float maximumT = 0.0f;
+
+        for (int j = 0; j < meshlet.triangleCount; ++j)
+        {
+            const float *n = &normals[j * 3];
+            const float *p = pPositions + pIndices[j * 3] * stride;
+            float dc = (meshlet.center[0] - p[0]) * n[0] +
+                (meshlet.center[1] - p[1]) * n[1] + (meshlet.center[2] - p[2]) * n[2];
+            float dn = axis[0] * n[0] + axis[1] * n[1] + axis[2] * n[2];
+
+            maximumT = std::max(maximumT, dc / dn);
+        }
+
+        for (int k = 0; k < 3; ++k)
+        {
+            meshlet.coneApex[k] = meshlet.center[k] - axis[k] * maximumT;
+            meshlet.coneAxis[k] = axis[k];
+        }
+
+        meshlet.coneCutoff = sqrtf(1.0f - minimumDot * minimumDot);
     }
+}
 
-    return true;
+const float *ModelOBJ::getPositionData(int &stride) const
+{
+    if (m_vertexLayout == VERTEX_LAYOUT_SEPARATE)
+    {
+        stride = 3;
+        return getPositions();
+    }
+
+    stride = sizeof(Vertex) / sizeof(float);
+    return m_vertexBuffer.empty() ? 0 : m_vertexBuffer[0].position;
 }
 
-void ModelOBJ::normalize(float scaleTo, bool center)
+void ModelOBJ::packIndices()
 {
-    float width = 0.0f;
-    float height = 0.0f;
-    float length = 0.0f;
-    float radius = 0.0f;
-    float centerPos[3] = {0.0f};
+    // The 32 bit indices are kept for the CPU side processing. Models with
+    // few enough vertices get a 16 bit copy, half the size, for the GPU.
 
-    bounds(centerPos, width, height, length, radius);
+    m_shortIndexBuffer.clear();
+    m_shortLodIndexBuffer.clear();
 
-    float scalingFactor = scaleTo / radius;
-    float offset[3] = {0.0f};
+    if (getNumberOfVertices() > 65536)
+        return;
 
-    if (center)
+    m_shortIndexBuffer.resize(m_indexBuffer.size());
+    m_shortLodIndexBuffer.resize(m_lodIndexBuffer.size());
+
+    for (int i = 0; i < static_cast<int>(m_indexBuffer.size()); ++i)
+        m_shortIndexBuffer[i] = static_cast<unsigned short>(m_indexBuffer[i]);
+
+    for (int i = 0; i < static_cast<int>(m_lodIndexBuffer.size()); ++i)
+        m_shortLodIndexBuffer[i] = static_cast<unsigned short>(m_lodIndexBuffer[i]);
+}
+
+void ModelOBJ::scale(float scaleFactor, float offset[3])
+{
+    if (m_vertexLayout == VERTEX_LAYOUT_SEPARATE)
     {
-        offset[0] = -centerPos[0];
-        offset[1] = -centerPos[1];
-        offset[2] = -centerPos[2];
+        ScalePositions<3>(m_positionStream.empty() ? 0 : &m_positionStream[0],
+            getNumberOfVertices(), scaleFactor, offset);
     }
     else
     {
-        offset[0] = 0.0f;
-        offset[1] = 0.0f;
-        offset[2] = 0.0f;
+        ScalePositions<sizeof(Vertex) / sizeof(float)>(
+            m_vertexBuffer.empty() ? 0 : m_vertexBuffer[0].position,
+            getNumberOfVertices(), scaleFactor, offset);
     }
 
-    scale(scalingFactor, offset);
-    bounds(m_center, m_width, m_height, m_length, m_radius);
-}
+    // Every position moved the same way, so the bounds can be moved too.
+    ScaleBounds(m_minimum, m_maximum, m_center, m_sphereRadius, scaleFactor, offset);
+    updateDimensions();
 
-void ModelOBJ::reverseWinding()
-{
-    int swap = 0;
+    for (int i = 0; i < m_numberOfMeshes; ++i)
+    {
+        Mesh &mesh = m_meshes[i];
+        ScaleBounds(mesh.minimum, mesh.maximum, mesh.center, mesh.radius, scaleFactor, offset);
+    }
 
-    // Reverse face winding.
-    for (int i = 0; i < static_cast<int>(m_indexBuffer.size()); i += 3)
+    for (int i = 0; i < static_cast<int>(m_groups.size()); ++i)
     {
-        swap = m_indexBuffer[i + 1];
-        m_indexBuffer[i + 1] = m_indexBuffer[i + 2];
-        m_indexBuffer[i + 2] = swap;
+        Group &group = m_groups[i];
+        ScaleBounds(group.minimum, group.maximum, group.center, group.radius, scaleFactor, offset);
+    }
+
+    for (int i = 0; i < static_cast<int>(m_objects.size()); ++i)
+    {
+        Object &object = m_objects[i];
+        ScaleBounds(object.minimum, object.maximum, object.center, object.radius, scaleFactor, offset);
     }
 
-    float *pNormal = 0;
-    float *pTangent = 0;
+    for (int i = 0; i < static_cast<int>(m_levelsOfDetail.size()); ++i)
+    {
+        for (int j = 0; j < static_cast<int>(m_levelsOfDetail[i].meshes.size()); ++j)
+        {
+            Mesh &mesh = m_levelsOfDetail[i].meshes[j];
+            ScaleBounds(mesh.minimum, mesh.maximum, mesh.center, mesh.radius, scaleFactor, offset);
+        }
+    }
 
-    // Invert normals and tangents.
-    for (int i = 0; i < static_cast<int>(m_vertexBuffer.size()); ++i)
-    {
-        pNormal = m_vertexBuffer[i].normal;
-        pNormal[0] = -pNormal[0];
-        pNormal[1] = -pNormal[1];
-        pNormal[2] = -pNormal[2];
+    computeMeshletBounds();
 
-        pTangent = m_vertexBuffer[i].tangent;
-        pTangent[0] = -pTangent[0];
-        pTangent[1] = -pTangent[1];
-        pTangent[2] = -pTangent[2];
-    }
+    if (!m_bvhNodes.empty())
+        buildBvh();
 }
 
-void ModelOBJ::scale(float scaleFactor, float offset[3])
+void ModelOBJ::updateDimensions()
 {
-    float *pPosition = 0;
+    for (int i = 0; i < 3; ++i)
+        m_center[i] = (m_minimum[i] + m_maximum[i]) / 2.0f;
 
-    for (int i = 0; i < static_cast<int>(m_vertexBuffer.size()); ++i)
-    {
-        pPosition = m_vertexBuffer[i].position;
-
-        pPosition[0] += offset[0];
-        pPosition[1] += offset[1];
-        pPosition[2] += offset[2];
+    m_width = m_maximum[0] - m_minimum[0];
+    m_height = m_maximum[1] - m_minimum[1];
+    m_length = m_maximum[2] - m_minimum[2];
 
-        pPosition[0] *= scaleFactor;
-        pPosition[1] *= scaleFactor;
-        pPosition[2] *= scaleFactor;
-    }
+    m_radius = std::max(std::max(m_width, m_height), m_length);
 }
 
-void ModelOBJ::addTrianglePos(int index, int material, int v0, int v1, int v2)
+void ModelOBJ::addTrianglePos(int index, int material, int smoothing,
+                              int v0, int v1, int v2)
 {
     Vertex vertex =
     {
@@ -318,17 +6281,17 @@ void ModelOBJ::addTrianglePos(int index, int material, int v0, int v1, int v2)
     vertex.position[0] = m_vertexCoords[v0 * 3];
     vertex.position[1] = m_vertexCoords[v0 * 3 + 1];
     vertex.position[2] = m_vertexCoords[v0 * 3 + 2];
-    m_indexBuffer[index * 3] = addVertex(v0, &vertex);
+    m_indexBuffer[index * 3] = addVertex(v0, -1, smoothing, &vertex);
 
     vertex.position[0] = m_vertexCoords[v1 * 3];
     vertex.position[1] = m_vertexCoords[v1 * 3 + 1];
     vertex.position[2] = m_vertexCoords[v1 * 3 + 2];
-    m_indexBuffer[index * 3 + 1] = addVertex(v1, &vertex);
+    m_indexBuffer[index * 3 + 1] = addVertex(v1, -1, smoothing, &vertex);
 
     vertex.position[0] = m_vertexCoords[v2 * 3];
     vertex.position[1] = m_vertexCoords[v2 * 3 + 1];
     vertex.position[2] = m_vertexCoords[v2 * 3 + 2];
-    m_indexBuffer[index * 3 + 2] = addVertex(v2, &vertex);
+    m_indexBuffer[index * 3 + 2] = addVertex(v2, -1, smoothing, &vertex);
 }
 
 void ModelOBJ::addTrianglePosNormal(int index, int material, int v0, int v1,
@@ -350,7 +6313,7 @@ void ModelOBJ::addTrianglePosNormal(int index, int material, int v0, int v1,
     vertex.normal[0] = m_normals[vn0 * 3];
     vertex.normal[1] = m_normals[vn0 * 3 + 1];
     vertex.normal[2] = m_normals[vn0 * 3 + 2];
-    m_indexBuffer[index * 3] = addVertex(v0, &vertex);
+    m_indexBuffer[index * 3] = addVertex(v0, -1, vn0, &vertex);
 
     vertex.position[0] = m_vertexCoords[v1 * 3];
     vertex.position[1] = m_vertexCoords[v1 * 3 + 1];
@@ -358,7 +6321,7 @@ void ModelOBJ::addTrianglePosNormal(int index, int material, int v0, int v1,
     vertex.normal[0] = m_normals[vn1 * 3];
     vertex.normal[1] = m_normals[vn1 * 3 + 1];
     vertex.normal[2] = m_normals[vn1 * 3 + 2];
-    m_indexBuffer[index * 3 + 1] = addVertex(v1, &vertex);
+    m_indexBuffer[index * 3 + 1] = addVertex(v1, -1, vn1, &vertex);
 
     vertex.position[0] = m_vertexCoords[v2 * 3];
     vertex.position[1] = m_vertexCoords[v2 * 3 + 1];
@@ -366,11 +6329,12 @@ void ModelOBJ::addTrianglePosNormal(int index, int material, int v0, int v1,
     vertex.normal[0] = m_normals[vn2 * 3];
     vertex.normal[1] = m_normals[vn2 * 3 + 1];
     vertex.normal[2] = m_normals[vn2 * 3 + 2];
-    m_indexBuffer[index * 3 + 2] = addVertex(v2, &vertex);
+    m_indexBuffer[index * 3 + 2] = addVertex(v2, -1, vn2, &vertex);
 }
 
-void ModelOBJ::addTrianglePosTexCoord(int index, int material, int v0, int v1,
-                                      int v2, int vt0, int vt1, int vt2)
+void ModelOBJ::addTrianglePosTexCoord(int index, int material, int smoothing,
+                                      int v0, int v1, int v2,
+                                      int vt0, int vt1, int vt2)
 {
     Vertex vertex =
     {
@@ -387,21 +6351,21 @@ void ModelOBJ::addTrianglePosTexCoord(int index, int material, int v0, int v1,
     vertex.position[2] = m_vertexCoords[v0 * 3 + 2];
     vertex.texCoord[0] = m_textureCoords[vt0 * 2];
     vertex.texCoord[1] = m_textureCoords[vt0 * 2 + 1];
-    m_indexBuffer[index * 3] = addVertex(v0, &vertex);
+    m_indexBuffer[index * 3] = addVertex(v0, vt0, smoothing, &vertex);
 
     vertex.position[0] = m_vertexCoords[v1 * 3];
     vertex.position[1] = m_vertexCoords[v1 * 3 + 1];
     vertex.position[2] = m_vertexCoords[v1 * 3 + 2];
     vertex.texCoord[0] = m_textureCoords[vt1 * 2];
     vertex.texCoord[1] = m_textureCoords[vt1 * 2 + 1];
-    m_indexBuffer[index * 3 + 1] = addVertex(v1, &vertex);
+    m_indexBuffer[index * 3 + 1] = addVertex(v1, vt1, smoothing, &vertex);
 
     vertex.position[0] = m_vertexCoords[v2 * 3];
     vertex.position[1] = m_vertexCoords[v2 * 3 + 1];
     vertex.position[2] = m_vertexCoords[v2 * 3 + 2];
     vertex.texCoord[0] = m_textureCoords[vt2 * 2];
     vertex.texCoord[1] = m_textureCoords[vt2 * 2 + 1];
-    m_indexBuffer[index * 3 + 2] = addVertex(v2, &vertex);
+    m_indexBuffer[index * 3 + 2] = addVertex(v2, vt2, smoothing, &vertex);
 }
 
 void ModelOBJ::addTrianglePosTexCoordNormal(int index, int material, int v0,
@@ -426,7 +6390,7 @@ void ModelOBJ::addTrianglePosTexCoordNormal(int index, int material, int v0,
     vertex.normal[0] = m_normals[vn0 * 3];
     vertex.normal[1] = m_normals[vn0 * 3 + 1];
     vertex.normal[2] = m_normals[vn0 * 3 + 2];
-    m_indexBuffer[index * 3] = addVertex(v0, &vertex);
+    m_indexBuffer[index * 3] = addVertex(v0, vt0, vn0, &vertex);
 
     vertex.position[0] = m_vertexCoords[v1 * 3];
     vertex.position[1] = m_vertexCoords[v1 * 3 + 1];
@@ -436,7 +6400,7 @@ void ModelOBJ::addTrianglePosTexCoordNormal(int index, int material, int v0,
     vertex.normal[0] = m_normals[vn1 * 3];
     vertex.normal[1] = m_normals[vn1 * 3 + 1];
     vertex.normal[2] = m_normals[vn1 * 3 + 2];
-    m_indexBuffer[index * 3 + 1] = addVertex(v1, &vertex);
+    m_indexBuffer[index * 3 + 1] = addVertex(v1, vt1, vn1, &vertex);
 
     vertex.position[0] = m_vertexCoords[v2 * 3];
     vertex.position[1] = m_vertexCoords[v2 * 3 + 1];
@@ -446,97 +6410,221 @@ void ModelOBJ::addTrianglePosTexCoordNormal(int index, int material, int v0,
     vertex.normal[0] = m_normals[vn2 * 3];
     vertex.normal[1] = m_normals[vn2 * 3 + 1];
     vertex.normal[2] = m_normals[vn2 * 3 + 2];
-    m_indexBuffer[index * 3 + 2] = addVertex(v2, &vertex);
+    m_indexBuffer[index * 3 + 2] = addVertex(v2, vt2, vn2, &vertex);
 }
 
-int ModelOBJ::addVertex(int hash, const Vertex *pVertex)
+int ModelOBJ::addVertex(int v, int vt, int vn, const Vertex *pVertex)
 {
-    int index = -1;
-    std::map<int, std::vector<int> >::const_iterator iter = m_vertexCache.find(hash);
+    // Vertices are looked up by their OBJ index triple in an open addressing
+    // hash table with linear probing. Identical triples always produce
+    // identical vertices, so no vertex data needs to be compared.
 
-    if (iter == m_vertexCache.end())
-    {
-        // Vertex hash doesn't exist in the cache.
+    if ((m_vertexCacheSize + 1) * 2 > static_cast<int>(m_vertexCache.size()))
+        reserveVertexCache(static_cast<int>(m_vertexCache.size()));
 
-        index = static_cast<int>(m_vertexBuffer.size());
-        m_vertexBuffer.push_back(*pVertex);
-        m_vertexCache.insert(std::make_pair(hash, std::vector<int>(1, index)));
-    }
-    else
-    {
-        // One or more vertices have been hashed to this entry in the cache.
+    unsigned int mask = static_cast<unsigned int>(m_vertexCache.size()) - 1;
+    unsigned int slot = HashIndexTriple(v, vt, vn) & mask;
 
-        const std::vector<int> &vertices = iter->second;
-        const Vertex *pCachedVertex = 0;
-        bool found = false;
+    for (;;)
+    {
+        VertexCacheEntry &entry = m_vertexCache[slot];
 
-        for (std::vector<int>::const_iterator i = vertices.begin(); i != vertices.end(); ++i)
+        if (entry.index < 0)
         {
-            index = *i;
-            pCachedVertex = &m_vertexBuffer[index];
-
-            if (memcmp(pCachedVertex, pVertex, sizeof(Vertex)) == 0)
-            {
-                found = true;
-                break;
-            }
-        }
+            // The triple doesn't exist in the cache.
 
-        if (!found)
-        {
-            index = static_cast<int>(m_vertexBuffer.size());
+            entry.v = v;
+            entry.vt = vt;
+            entry.vn = vn;
+            entry.index = static_cast<int>(m_vertexBuffer.size());
             m_vertexBuffer.push_back(*pVertex);
-            m_vertexCache[hash].push_back(index);
+            ++m_vertexCacheSize;
+            return entry.index;
         }
+
+        if (entry.v == v && entry.vt == vt && entry.vn == vn)
+            return entry.index;
+
+        slot = (slot + 1) & mask;
     }
+}
+
+void ModelOBJ::reserveVertexCache(int numberOfVertices)
+{
+    // Keep the table at most half full.
+    int capacity = 16;
+
+    while (capacity < numberOfVertices * 2)
+        capacity *= 2;
+
+    if (capacity <= static_cast<int>(m_vertexCache.size()))
+        return;
+
+    VertexCacheEntry empty = {0, 0, 0, -1};
+    std::vector<VertexCacheEntry> entries(capacity, empty);
+    unsigned int mask = static_cast<unsigned int>(capacity) - 1;
+
+    entries.swap(m_vertexCache);
+
+    for (int i = 0; i < static_cast<int>(entries.size()); ++i)
+    {
+        const VertexCacheEntry &entry = entries[i];
+
+        if (entry.index < 0)
+            continue;
+
+        unsigned int slot = HashIndexTriple(entry.v, entry.vt, entry.vn) & mask;
+
+        while (m_vertexCache[slot].index >= 0)
+            slot = (slot + 1) & mask;
 
-    return index;
+        m_vertexCache[slot] = entry;
+    }
 }
 
 void ModelOBJ::buildMeshes()
 {
-    // Group the model's triangles based on material type.
+    // Sort the triangles by material and then by group, keeping the file
+    // order otherwise, and make a mesh of each material and group. Every
+    // material ends up as one range of indices however often the file
+    // switches between materials, so all of its meshes can be drawn at
+    // once. Materials are ordered by alpha: fully opaque ones towards the
+    // front and fully transparent ones towards the back.
+
+    int numMaterials = static_cast<int>(m_materials.size());
+    int numGroups = std::max(static_cast<int>(m_groups.size()), 1);
+    std::vector<int> materialOrder(numMaterials);
+    std::vector<int> materialRanks(numMaterials);
+
+    for (int i = 0; i < numMaterials; ++i)
+        materialOrder[i] = i;
+
+    std::stable_sort(materialOrder.begin(), materialOrder.end(), [this](int lhs, int rhs)
+    {
+        return m_materials[lhs].alpha > m_materials[rhs].alpha;
+    });
+
+    for (int i = 0; i < numMaterials; ++i)
+        materialRanks[materialOrder[i]] = i;
+
+    // Radix sort on the material rank and group of the triangles: a stable
+    // counting sort by group, then one by rank. Time and memory grow with
+    // the number of materials plus the number of groups, not their product.
+
+    bool sorted = true;
+
+    for (int i = 1; i < m_numberOfTriangles && sorted; ++i)
+    {
+        int rank = materialRanks[m_attributeBuffer[i]];
+        int lastRank = materialRanks[m_attributeBuffer[i - 1]];
+
+        sorted = rank > lastRank ||
+            (rank == lastRank && m_groupBuffer[i] >= m_groupBuffer[i - 1]);
+    }
 
-    Mesh *pMesh = 0;
-    int materialId = -1;
-    int numMeshes = 0;
+    std::vector<int> order;
 
-    // Count the number of meshes.
-    for (int i = 0; i < static_cast<int>(m_attributeBuffer.size()); ++i)
+    if (!sorted)
     {
-        if (m_attributeBuffer[i] != materialId)
+        std::vector<int> byGroup(m_numberOfTriangles);
+        std::vector<int> starts(numGroups + 1, 0);
+
+        for (int i = 0; i < m_numberOfTriangles; ++i)
+            ++starts[m_groupBuffer[i] + 1];
+
+        for (int i = 0; i < numGroups; ++i)
+            starts[i + 1] += starts[i];
+
+        for (int i = 0; i < m_numberOfTriangles; ++i)
+            byGroup[starts[m_groupBuffer[i]]++] = i;
+
+        starts.assign(numMaterials + 1, 0);
+
+        for (int i = 0; i < m_numberOfTriangles; ++i)
+            ++starts[materialRanks[m_attributeBuffer[i]] + 1];
+
+        for (int i = 0; i < numMaterials; ++i)
+            starts[i + 1] += starts[i];
+
+        order.resize(m_numberOfTriangles);
+
+        for (int i = 0; i < m_numberOfTriangles; ++i)
         {
-            materialId = m_attributeBuffer[i];
-            ++numMeshes;
+            int triangle = byGroup[i];
+            order[starts[materialRanks[m_attributeBuffer[triangle]]]++] = triangle;
         }
     }
 
-    // Allocate memory for the meshes and reset counters.
-    m_numberOfMeshes = numMeshes;
-    m_meshes.resize(m_numberOfMeshes);
-    numMeshes = 0;
-    materialId = -1;
+    // A mesh for every run of triangles with the same material and group.
+
+    m_meshes.clear();
 
-    // Build the meshes. One mesh for each unique material.
-    for (int i = 0; i < static_cast<int>(m_attributeBuffer.size()); ++i)
+    for (int i = 0; i < m_numberOfTriangles; ++i)
     {
-        if (m_attributeBuffer[i] != materialId)
+        int triangle = sorted ? i : order[i];
+        const Material *pMaterial = &m_materials[m_attributeBuffer[triangle]];
+        int group = m_groupBuffer[triangle];
+
+        if (m_meshes.empty() || m_meshes.back().pMaterial != pMaterial ||
+            m_meshes.back().group != group)
         {
-            materialId = m_attributeBuffer[i];
-            pMesh = &m_meshes[numMeshes++];            
-            pMesh->pMaterial = &m_materials[materialId];
-            pMesh->startIndex = i * 3;
-            ++pMesh->triangleCount;
+            Mesh mesh = Mesh();
+
+            mesh.startIndex = i * 3;
+            mesh.pMaterial = pMaterial;
+            mesh.group = group;
+            m_meshes.push_back(mesh);
         }
-        else
+
+        ++m_meshes.back().triangleCount;
+    }
+
+    m_numberOfMeshes = static_cast<int>(m_meshes.size());
+
+    if (!sorted)
+    {
+        std::vector<int> indices(m_indexBuffer.size());
+
+        for (int i = 0; i < m_numberOfTriangles; ++i)
         {
-            ++pMesh->triangleCount;
+            const int *pTriangle = &m_indexBuffer[order[i] * 3];
+
+            indices[i * 3] = pTriangle[0];
+            indices[i * 3 + 1] = pTriangle[1];
+            indices[i * 3 + 2] = pTriangle[2];
         }
+
+        m_indexBuffer.swap(indices);
     }
 
-    // Sort the meshes based on its material alpha. Fully opaque meshes
-    // towards the front and fully transparent towards the back.
-    std::sort(m_meshes.begin(), m_meshes.end(), MeshCompFunc);
+    // The meshes now hold the material and group of every triangle.
+    std::vector<int>().swap(m_attributeBuffer);
+    std::vector<int>().swap(m_groupBuffer);
+
+    updateGroupMeshes();
+}
+
+void ModelOBJ::updateGroupMeshes()
+{
+    for (int i = 0; i < static_cast<int>(m_groups.size()); ++i)
+        m_groups[i].meshes.clear();
+
+    for (int i = 0; i < m_numberOfMeshes; ++i)
+        m_groups[m_meshes[i].group].meshes.push_back(i);
+}
+
+void ModelOBJ::getTriangleMaterials(std::vector<int> &materials) const
+{
+    materials.assign(m_numberOfTriangles, 0);
+
+    for (int i = 0; i < m_numberOfMeshes; ++i)
+    {
+        const Mesh &mesh = m_meshes[i];
+        int material = static_cast<int>(mesh.pMaterial - &m_materials[0]);
+
+        std::fill(materials.begin() + mesh.startIndex / 3,
+            materials.begin() + mesh.startIndex / 3 + mesh.triangleCount, material);
+    }
 }
 
 void ModelOBJ::generateNormals()
@@ -552,6 +6640,15 @@ void ModelOBJ::generateNormals()
     int totalVertices = getNumberOfVertices();
     int totalTriangles = getNumberOfTriangles();
 
+    // The parallel version only pays off once there are enough triangles
+    // to keep more than one thread busy.
+    if (m_parallelNormals &&
+        GetNumberOfRanges(totalTriangles, MIN_TRIANGLES_PER_TASK) > 1)
+    {
+        generateNormalsParallel();
+        return;
+    }
+
     // Initialize all the vertex normals.
     for (int i = 0; i < totalVertices; ++i)
     {
@@ -616,22 +6713,177 @@ void ModelOBJ::generateNormals()
     m_hasNormals = true;
 }
 
+void ModelOBJ::generateNormalsParallel()
+{
+    int totalVertices = getNumberOfVertices();
+    int totalTriangles = getNumberOfTriangles();
+    int numberOfThreads = GetNumberOfThreads(m_numberOfThreads);
+    int numberOfTasks = GetNumberOfRanges(totalTriangles, MIN_TRIANGLES_PER_TASK);
+
+    ThreadPool pool((numberOfTasks > 1) ? numberOfThreads : 1);
+
+    // Every task sums the face normals of its range of triangles into its
+    // own copy of the vertex normals. The first task uses the normals in the
+    // vertex buffer, the others use temporary arrays that are added to the
+    // vertex buffer afterwards, in range order. No two tasks ever write to
+    // the same memory, and the ranges don't depend on the number of threads,
+    // so neither do the normals.
+
+    size_t accumulatorSize = static_cast<size_t>(totalVertices) * 3;
+    std::vector<float> accumulators(accumulatorSize * (numberOfTasks - 1));
+    Vertex *pVertices = m_vertexBuffer.empty() ? 0 : &m_vertexBuffer[0];
+    const int *pIndices = m_indexBuffer.empty() ? 0 : &m_indexBuffer[0];
+
+    pool.run(numberOfTasks, [&](int task)
+    {
+        int first = static_cast<int>(static_cast<long long>(totalTriangles) * task / numberOfTasks);
+        int last = static_cast<int>(static_cast<long long>(totalTriangles) * (task + 1) / numberOfTasks);
+        float *pSums = (task > 0) ? &accumulators[accumulatorSize * (task - 1)] : 0;
+        int stride = 3;
+        float normals[3][NORMALS_BATCH_SIZE];
+
+        if (task == 0)
+        {
+            for (int i = 0; i < totalVertices; ++i)
+            {
+                pVertices[i].normal[0] = 0.0f;
+                pVertices[i].normal[1] = 0.0f;
+                pVertices[i].normal[2] = 0.0f;
+            }
+
+            pSums = pVertices->normal;
+            stride = sizeof(Vertex) / sizeof(float);
+        }
+
+        for (int batch = first; batch < last; batch += NORMALS_BATCH_SIZE)
+        {
+            int count = std::min(NORMALS_BATCH_SIZE, last - batch);
+
+            ComputeFaceNormals(pVertices, pIndices + batch * 3, count,
+                normals[0], normals[1], normals[2]);
+
+            for (int i = 0; i < count; ++i)
+            {
+                const int *pTriangle = pIndices + (batch + i) * 3;
+                float x = normals[0][i];
+                float y = normals[1][i];
+                float z = normals[2][i];
+
+                for (int j = 0; j < 3; ++j)
+                {
+                    float *pSum = pSums + pTriangle[j] * stride;
+
+                    pSum[0] += x;
+                    pSum[1] += y;
+                    pSum[2] += z;
+                }
+            }
+        }
+    });
+
+    // Add up the copies and normalize the result. Each task now owns a range
+    // of vertices.
+
+    int numberOfAccumulators = numberOfTasks - 1;
+
+    numberOfTasks = GetNumberOfTasks(numberOfThreads, totalVertices,
+        MIN_VERTICES_PER_TASK);
+
+    pool.run(numberOfTasks, [&](int task)
+    {
+        int first = static_cast<int>(static_cast<long long>(totalVertices) * task / numberOfTasks);
+        int last = static_cast<int>(static_cast<long long>(totalVertices) * (task + 1) / numberOfTasks);
+        float normals[3][NORMALS_BATCH_SIZE];
+
+        for (int batch = first; batch < last; batch += NORMALS_BATCH_SIZE)
+        {
+            int count = std::min(NORMALS_BATCH_SIZE, last - batch);
+
+            for (int i = 0; i < count; ++i)
+            {
+                const float *pNormal = pVertices[batch + i].normal;
+                float x = pNormal[0];
+                float y = pNormal[1];
+                float z = pNormal[2];
+
+                for (int j = 0; j < numberOfAccumulators; ++j)
+                {
+                    const float *pSum = &accumulators[accumulatorSize * j + (batch + i) * 3];
+
+                    x += pSum[0];
+                    y += pSum[1];
+                    z += pSum[2];
+                }
+
+                normals[0][i] = x;
+                normals[1][i] = y;
+                normals[2][i] = z;
+            }
+
+            NormalizeNormals(normals[0], normals[1], normals[2], count);
+
+            for (int i = 0; i < count; ++i)
+            {
+                float *pNormal = pVertices[batch + i].normal;
+
+                pNormal[0] = normals[0][i];
+                pNormal[1] = normals[1][i];
+                pNormal[2] = normals[2][i];
+            }
+        }
+    });
+
+    m_hasNormals = true;
+}
+
 void ModelOBJ::generateTangents()
+{
+    // The tangents are computed on interleaved vertices.
+
+    bool separate = (m_vertexLayout == VERTEX_LAYOUT_SEPARATE);
+
+    if (separate)
+        setVertexLayout(VERTEX_LAYOUT_INTERLEAVED);
+
+    int numberOfVertices = getNumberOfVertices();
+
+    if (m_tangentMethod == TANGENTS_MIKKTSPACE)
+        generateTangentsMikkTSpace();
+    else if (m_tangentMethod == TANGENTS_PARALLEL &&
+        GetNumberOfRanges(getNumberOfTriangles(), MIN_TRIANGLES_PER_TASK) > 1)
+        generateTangentsParallel();
+    else
+        generateTangentsSerial();
+
+    // MikkTSpace duplicates the vertices on tangent seams. The meshlets may
+    // then have too many vertices and the levels of detail would keep the
+    // old ones, so they go as in import().
+
+    if (getNumberOfVertices() != numberOfVertices)
+    {
+        m_levelsOfDetail.clear();
+        m_lodIndexBuffer.clear();
+        m_shortLodIndexBuffer.clear();
+        m_meshlets.clear();
+
+        if (!m_bvhNodes.empty())
+            buildBvh();
+
+        packIndices();
+    }
+
+    if (separate)
+        setVertexLayout(VERTEX_LAYOUT_SEPARATE);
+}
+
+void ModelOBJ::generateTangentsSerial()
 {
     const int *pTriangle = 0;
     Vertex *pVertex0 = 0;
     Vertex *pVertex1 = 0;
     Vertex *pVertex2 = 0;
-    float edge1[3] = {0.0f, 0.0f, 0.0f};
-    float edge2[3] = {0.0f, 0.0f, 0.0f};
-    float texEdge1[2] = {0.0f, 0.0f};
-    float texEdge2[2] = {0.0f, 0.0f};
     float tangent[3] = {0.0f, 0.0f, 0.0f};
     float bitangent[3] = {0.0f, 0.0f, 0.0f};
-    float det = 0.0f;
-    float nDotT = 0.0f;
-    float bDotB = 0.0f;
-    float length = 0.0f;
     int totalVertices = getNumberOfVertices();
     int totalTriangles = getNumberOfTriangles();
 
@@ -661,44 +6913,7 @@ void ModelOBJ::generateTangents()
 
         // Calculate the triangle face tangent and bitangent.
 
-        edge1[0] = pVertex1->position[0] - pVertex0->position[0];
-        edge1[1] = pVertex1->position[1] - pVertex0->position[1];
-        edge1[2] = pVertex1->position[2] - pVertex0->position[2];
-
-        edge2[0] = pVertex2->position[0] - pVertex0->position[0];
-        edge2[1] = pVertex2->position[1] - pVertex0->position[1];
-        edge2[2] = pVertex2->position[2] - pVertex0->position[2];
-
-        texEdge1[0] = pVertex1->texCoord[0] - pVertex0->texCoord[0];
-        texEdge1[1] = pVertex1->texCoord[1] - pVertex0->texCoord[1];
-
-        texEdge2[0] = pVertex2->texCoord[0] - pVertex0->texCoord[0];
-        texEdge2[1] = pVertex2->texCoord[1] - pVertex0->texCoord[1];
-
-        det = texEdge1[0] * texEdge2[1] - texEdge2[0] * texEdge1[1];
-
-        if (fabs(det) < 1e-6f)
-        {
-            tangent[0] = 1.0f;
-            tangent[1] = 0.0f;
-            tangent[2] = 0.0f;
-
-            bitangent[0] = 0.0f;
-            bitangent[1] = 1.0f;
-            bitangent[2] = 0.0f;
-        }
-        else
-        {
-            det = 1.0f / det;
-
-            tangent[0] = (texEdge2[1] * edge1[0] - texEdge1[1] * edge2[0]) * det;
-            tangent[1] = (texEdge2[1] * edge1[1] - texEdge1[1] * edge2[1]) * det;
-            tangent[2] = (texEdge2[1] * edge1[2] - texEdge1[1] * edge2[2]) * det;
-
-            bitangent[0] = (-texEdge2[0] * edge1[0] + texEdge1[0] * edge2[0]) * det;
-            bitangent[1] = (-texEdge2[0] * edge1[1] + texEdge1[0] * edge2[1]) * det;
-            bitangent[2] = (-texEdge2[0] * edge1[2] + texEdge1[0] * edge2[2]) * det;
-        }
+        ComputeFaceTangent(*pVertex0, *pVertex1, *pVertex2, tangent, bitangent);
 
         // Accumulate the tangents and bitangents.
 
@@ -726,72 +6941,265 @@ void ModelOBJ::generateTangents()
 
     // Orthogonalize and normalize the vertex tangents.
     for (int i = 0; i < totalVertices; ++i)
+        FinishTangent(m_vertexBuffer[i]);
+
+    m_hasTangents = true;
+}
+
+void ModelOBJ::generateTangentsParallel()
+{
+    int totalVertices = getNumberOfVertices();
+    int totalTriangles = getNumberOfTriangles();
+    int numberOfThreads = GetNumberOfThreads(m_numberOfThreads);
+    int numberOfTasks = GetNumberOfRanges(totalTriangles, MIN_TRIANGLES_PER_TASK);
+
+    ThreadPool pool((numberOfTasks > 1) ? numberOfThreads : 1);
+
+    // Same scheme as generateNormalsParallel(), including ranges that don't
+    // depend on the number of threads. Every task sums the face tangents and
+    // bitangents of its range of triangles into its own copy, the first task
+    // into the vertex buffer itself. Each copy stores the tangent and
+    // bitangent sums of a vertex next to each other.
+
+    const int stride = 6;
+    size_t accumulatorSize = static_cast<size_t>(totalVertices) * stride;
+    std::vector<float> accumulators(accumulatorSize * (numberOfTasks - 1));
+    Vertex *pVertices = m_vertexBuffer.empty() ? 0 : &m_vertexBuffer[0];
+    const int *pIndices = m_indexBuffer.empty() ? 0 : &m_indexBuffer[0];
+
+    pool.run(numberOfTasks, [&](int task)
     {
-        pVertex0 = &m_vertexBuffer[i];
+        int first = static_cast<int>(static_cast<long long>(totalTriangles) * task / numberOfTasks);
+        int last = static_cast<int>(static_cast<long long>(totalTriangles) * (task + 1) / numberOfTasks);
+        float *pSums = (task > 0) ? &accumulators[accumulatorSize * (task - 1)] : 0;
+        float tangent[3];
+        float bitangent[3];
 
-        // Gram-Schmidt orthogonalize tangent with normal.
+        if (task == 0)
+        {
+            for (int i = 0; i < totalVertices; ++i)
+            {
+                memset(pVertices[i].tangent, 0, sizeof(pVertices[i].tangent));
+                memset(pVertices[i].bitangent, 0, sizeof(pVertices[i].bitangent));
+            }
+        }
+
+        for (int i = first; i < last; ++i)
+        {
+            const int *pTriangle = pIndices + i * 3;
+
+            ComputeFaceTangent(pVertices[pTriangle[0]], pVertices[pTriangle[1]],
+                pVertices[pTriangle[2]], tangent, bitangent);
+
+            for (int j = 0; j < 3; ++j)
+            {
+                float *pTangent = pVertices[pTriangle[j]].tangent;
+                float *pBitangent = pVertices[pTriangle[j]].bitangent;
+
+                if (pSums)
+                {
+                    pTangent = pSums + pTriangle[j] * stride;
+                    pBitangent = pTangent + 3;
+                }
+
+                pTangent[0] += tangent[0];
+                pTangent[1] += tangent[1];
+                pTangent[2] += tangent[2];
+                pBitangent[0] += bitangent[0];
+                pBitangent[1] += bitangent[1];
+                pBitangent[2] += bitangent[2];
+            }
+        }
+    });
+
+    // Add up the copies, then orthogonalize and normalize the tangents.
+
+    int numberOfAccumulators = numberOfTasks - 1;
+
+    numberOfTasks = GetNumberOfTasks(numberOfThreads, totalVertices,
+        MIN_VERTICES_PER_TASK);
+
+    pool.run(numberOfTasks, [&](int task)
+    {
+        int first = static_cast<int>(static_cast<long long>(totalVertices) * task / numberOfTasks);
+        int last = static_cast<int>(static_cast<long long>(totalVertices) * (task + 1) / numberOfTasks);
+
+        for (int i = first; i < last; ++i)
+        {
+            Vertex &vertex = pVertices[i];
+
+            for (int j = 0; j < numberOfAccumulators; ++j)
+            {
+                const float *pSum = &accumulators[accumulatorSize * j + i * stride];
+
+                vertex.tangent[0] += pSum[0];
+                vertex.tangent[1] += pSum[1];
+                vertex.tangent[2] += pSum[2];
+                vertex.bitangent[0] += pSum[3];
+                vertex.bitangent[1] += pSum[4];
+                vertex.bitangent[2] += pSum[5];
+            }
+
+            FinishTangent(vertex);
+        }
+    });
+
+    m_hasTangents = true;
+}
+
+void ModelOBJ::generateTangentsMikkTSpace()
+{
+    int totalVertices = getNumberOfVertices();
+    int totalTriangles = getNumberOfTriangles();
+    int numberOfThreads = GetNumberOfThreads(m_numberOfThreads);
+    int numberOfTasks = GetNumberOfTasks(numberOfThreads, totalTriangles,
+        MIN_TRIANGLES_PER_TASK);
+
+    ThreadPool pool((numberOfTasks > 1) ? numberOfThreads : 1);
+
+    // Every parallel pass below computes each triangle, group or vertex on
+    // its own and nothing is summed across tasks, so splitting the passes
+    // per thread doesn't change the tangents.
+
+    const Vertex *pVertices = m_vertexBuffer.empty() ? 0 : &m_vertexBuffer[0];
+
+    // MikkTSpace treats vertices with the same position, normal and texture
+    // coordinate as one vertex, even if the OBJ file used different indices
+    // for them. Build the corner list in terms of these welded vertices.
+
+    std::vector<int> welded;
+    std::vector<int> corners(totalTriangles * 3);
+
+    WeldVertices(pVertices, totalVertices, welded);
+
+    for (int i = 0; i < totalTriangles * 3; ++i)
+        corners[i] = welded[m_indexBuffer[i]];
+
+    // Calculate the per triangle tangent directions.
+
+    std::vector<MikkTriangle> triangles(totalTriangles);
+
+    pool.run(numberOfTasks, [&](int task)
+    {
+        int first = static_cast<int>(static_cast<long long>(totalTriangles) * task / numberOfTasks);
+        int last = static_cast<int>(static_cast<long long>(totalTriangles) * (task + 1) / numberOfTasks);
+
+        for (int i = first; i < last; ++i)
+            InitMikkTriangle(pVertices, &corners[i * 3], triangles[i]);
+    });
+
+    // Split the triangles around every vertex into groups of triangles that
+    // are connected through shared edges and have the same texture space
+    // orientation. Every group gets its own tangent. This walk is cheap but
+    // order dependent, so it runs on a single thread.
+
+    BuildMikkNeighbors(corners, triangles);
+
+    std::vector<MikkGroup> groups;
+    std::vector<int> groupTriangles;
+
+    BuildMikkGroups(corners, triangles, groups, groupTriangles);
+
+    // Calculate the tangent of every group.
+
+    int numberOfGroups = static_cast<int>(groups.size());
+    int numberOfGroupTasks = GetNumberOfTasks(numberOfThreads, numberOfGroups,
+        MIN_VERTICES_PER_TASK);
+
+    pool.run(numberOfGroupTasks, [&](int task)
+    {
+        int first = static_cast<int>(static_cast<long long>(numberOfGroups) * task / numberOfGroupTasks);
+        int last = static_cast<int>(static_cast<long long>(numberOfGroups) * (task + 1) / numberOfGroupTasks);
+
+        for (int i = first; i < last; ++i)
+            EvalMikkGroup(pVertices, corners, triangles, groupTriangles, groups[i]);
+    });
+
+    // Corners of degenerate triangles copy the tangent of the first corner
+    // of a proper triangle that uses the same vertex.
+
+    std::vector<int> firstCorner(totalVertices, -1);
+
+    for (int i = totalTriangles * 3 - 1; i >= 0; --i)
+    {
+        if (!(triangles[i / 3].flags & MIKK_DEGENERATE))
+            firstCorner[corners[i]] = i;
+    }
+
+    // Assign the tangents to the vertices. A vertex used by triangles of
+    // different groups is duplicated once per distinct tangent.
+
+    std::vector<int> vertexCopies(totalVertices, -1);
+    std::vector<int> nextCopy;
+    std::vector<const MikkGroup *> vertexGroups(totalVertices, 0);
+    MikkGroup defaultGroup = {{1.0f, 0.0f, 0.0f}, 0, 0, 0, false};
+
+    for (int i = 0; i < totalTriangles * 3; ++i)
+    {
+        int corner = i;
 
-        nDotT = pVertex0->normal[0] * pVertex0->tangent[0] +
-                pVertex0->normal[1] * pVertex0->tangent[1] +
-                pVertex0->normal[2] * pVertex0->tangent[2];
+        if (triangles[i / 3].flags & MIKK_DEGENERATE)
+            corner = firstCorner[corners[i]];
 
-        pVertex0->tangent[0] -= pVertex0->normal[0] * nDotT;
-        pVertex0->tangent[1] -= pVertex0->normal[1] * nDotT;
-        pVertex0->tangent[2] -= pVertex0->normal[2] * nDotT;
+        const MikkGroup *pGroup = (corner < 0) ? &defaultGroup :
+            &groups[triangles[corner / 3].groups[corner % 3]];
 
-        // Normalize the tangent.
+        int vertex = m_indexBuffer[i];
 
-        length = 1.0f / sqrtf(pVertex0->tangent[0] * pVertex0->tangent[0] +
-                              pVertex0->tangent[1] * pVertex0->tangent[1] +
-                              pVertex0->tangent[2] * pVertex0->tangent[2]);
+        while (vertexGroups[vertex] && !SameMikkTangent(*vertexGroups[vertex], *pGroup))
+        {
+            if (vertexCopies[vertex] < 0)
+            {
+                vertexCopies[vertex] = static_cast<int>(m_vertexBuffer.size());
+                vertexCopies.push_back(-1);
+                vertexGroups.push_back(0);
+                m_vertexBuffer.push_back(m_vertexBuffer[vertex]);
+            }
 
-        pVertex0->tangent[0] *= length;
-        pVertex0->tangent[1] *= length;
-        pVertex0->tangent[2] *= length;
+            vertex = vertexCopies[vertex];
+        }
 
-        // Calculate the handedness of the local tangent space.
-        // The bitangent vector is the cross product between the triangle face
-        // normal vector and the calculated tangent vector. The resulting
-        // bitangent vector should be the same as the bitangent vector
-        // calculated from the set of linear equations above. If they point in
-        // different directions then we need to invert the cross product
-        // calculated bitangent vector. We store this scalar multiplier in the
-        // tangent vector's 'w' component so that the correct bitangent vector
-        // can be generated in the normal mapping shader's vertex shader.
-        //
-        // Normal maps have a left handed coordinate system with the origin
-        // located at the top left of the normal map texture. The x coordinates
-        // run horizontally from left to right. The y coordinates run
-        // vertically from top to bottom. The z coordinates run out of the
-        // normal map texture towards the viewer. Our handedness calculations
-        // must take this fact into account as well so that the normal mapping
-        // shader's vertex shader will generate the correct bitangent vectors.
-        // Some normal map authoring tools such as Crazybump
-        // (http://www.crazybump.com/) includes options to allow you to control
-        // the orientation of the normal map normal's y-axis.
+        vertexGroups[vertex] = pGroup;
+        m_indexBuffer[i] = vertex;
+    }
 
-        bitangent[0] = (pVertex0->normal[1] * pVertex0->tangent[2]) - 
-                       (pVertex0->normal[2] * pVertex0->tangent[1]);
-        bitangent[1] = (pVertex0->normal[2] * pVertex0->tangent[0]) -
-                       (pVertex0->normal[0] * pVertex0->tangent[2]);
-        bitangent[2] = (pVertex0->normal[0] * pVertex0->tangent[1]) - 
-                       (pVertex0->normal[1] * pVertex0->tangent[0]);
+    // Store the tangents. The tangent's w component holds the sign of the
+    // bitangent as defined by MikkTSpace: bitangent = w * cross(normal,
+    // tangent).
 
-        bDotB = bitangent[0] * pVertex0->bitangent[0] + 
-                bitangent[1] * pVertex0->bitangent[1] + 
-                bitangent[2] * pVertex0->bitangent[2];
+    totalVertices = getNumberOfVertices();
+    numberOfTasks = GetNumberOfTasks(numberOfThreads, totalVertices,
+        MIN_VERTICES_PER_TASK);
 
-        pVertex0->tangent[3] = (bDotB < 0.0f) ? 1.0f : -1.0f;
+    pool.run(numberOfTasks, [&](int task)
+    {
+        int first = static_cast<int>(static_cast<long long>(totalVertices) * task / numberOfTasks);
+        int last = static_cast<int>(static_cast<long long>(totalVertices) * (task + 1) / numberOfTasks);
 
-        pVertex0->bitangent[0] = bitangent[0];
-        pVertex0->bitangent[1] = bitangent[1];
-        pVertex0->bitangent[2] = bitangent[2];
-    }
+        for (int i = first; i < last; ++i)
+        {
+            Vertex &vertex = m_vertexBuffer[i];
+            const MikkGroup *pGroup = vertexGroups[i] ? vertexGroups[i] : &defaultGroup;
+            float sign = pGroup->orientationPreserving ? 1.0f : -1.0f;
+
+            vertex.tangent[0] = pGroup->tangent[0];
+            vertex.tangent[1] = pGroup->tangent[1];
+            vertex.tangent[2] = pGroup->tangent[2];
+            vertex.tangent[3] = sign;
+
+            vertex.bitangent[0] = sign * ((vertex.normal[1] * vertex.tangent[2]) -
+                                          (vertex.normal[2] * vertex.tangent[1]));
+            vertex.bitangent[1] = sign * ((vertex.normal[2] * vertex.tangent[0]) -
+                                          (vertex.normal[0] * vertex.tangent[2]));
+            vertex.bitangent[2] = sign * ((vertex.normal[0] * vertex.tangent[1]) -
+                                          (vertex.normal[1] * vertex.tangent[0]));
+        }
+    });
 
     m_hasTangents = true;
 }
 
-void ModelOBJ::importGeometryFirstPass(FILE *pFile)
+bool ModelOBJ::importGeometry(const char *pBuffer, size_t size, bool mapped)
 {
     m_hasTextureCoords = false;
     m_hasNormals = false;
@@ -801,487 +7209,617 @@ void ModelOBJ::importGeometryFirstPass(FILE *pFile)
     m_numberOfNormals = 0;
     m_numberOfTriangles = 0;
 
-    int v = 0;
-    int vt = 0;
-    int vn = 0;
-    char buffer[256] = {0};
-    std::string name;
+    m_vertexCoords.clear();
+    m_textureCoords.clear();
+    m_normals.clear();
+    m_indexBuffer.clear();
+    m_attributeBuffer.clear();
+    m_groupBuffer.clear();
+    m_groups.clear();
+    m_objects.clear();
+
+    // Materials are appended by every 'mtllib', so the ones of a previous
+    // import must go first or 'usemtl' names would resolve to them.
+    m_numberOfMaterials = 0;
+    m_materials.clear();
+    m_materialCache.clear();
+    m_materialLibraries.clear();
 
-    while (fscanf(pFile, "%s", buffer) != EOF)
+    m_vertexCache.clear();
+    m_vertexCacheSize = 0;
+
+    // The file is read in windows, by default a single one. Faces are
+    // triangulated and their indices resolved while scanning, and the
+    // vertices of a window are built before the next window is read. Faces
+    // that refer to attributes further down the file are held back until
+    // the end, and materials are only looked up once every 'mtllib' has
+    // been loaded. This keeps forward references and late 'mtllib'
+    // statements working the same way the old two pass importer handled
+    // them.
+    //
+    // Large windows are split on line boundaries into one chunk per thread.
+    // The chunks are scanned in parallel and then merged in file order, so
+    // the result does not depend on the number of threads.
+
+    size_t windowSize = (m_importWindowSize > 0) ? m_importWindowSize : size;
+    int numberOfThreads = GetNumberOfThreads(m_numberOfThreads);
+    size_t maxChunks = std::min<size_t>(numberOfThreads,
+        std::min(windowSize, size) / OBJ_MIN_CHUNK_SIZE);
+
+    ThreadPool pool((maxChunks > 1) ? numberOfThreads : 1);
+
+    // Triangle materials are stored as slots of 'usemtl' names until the
+    // materials are known. -1 is the first material.
+
+    std::map<std::string, int> materialSlots;
+    std::map<std::string, int>::const_iterator slot;
+    std::vector<std::string> materialNames;
+    int activeMaterial = -1;
+
+    // Groups are created in the order faces first use them and are looked
+    // up by their object and group name.
+
+    std::map<std::pair<std::string, std::string>, int> groupSlots;
+    std::map<std::string, int> objectSlots;
+    std::string activeObjectName;
+    std::string activeGroupName;
+    int activeSmoothing = -1;
+
+    auto addGroup = [&](const std::string &objectName, const std::string &groupName)
     {
-        switch (buffer[0])
+        std::pair<std::string, std::string> key(objectName, groupName);
+        std::map<std::pair<std::string, std::string>, int>::const_iterator iter = groupSlots.find(key);
+
+        if (iter != groupSlots.end())
+            return iter->second;
+
+        std::map<std::string, int>::const_iterator object = objectSlots.find(objectName);
+
+        if (object == objectSlots.end())
         {
-        case 'f':   // v, v//vn, v/vt, v/vt/vn.
-            fscanf(pFile, "%s", buffer);
+            Object newObject;
+            newObject.name = objectName;
+            object = objectSlots.insert(std::make_pair(objectName,
+                static_cast<int>(m_objects.size()))).first;
+            m_objects.push_back(newObject);
+        }
 
-            if (strstr(buffer, "//")) // v//vn
-            {
-                sscanf(buffer, "%d//%d", &v, &vn);
-                fscanf(pFile, "%d//%d", &v, &vn);
-                fscanf(pFile, "%d//%d", &v, &vn);
-                ++m_numberOfTriangles;
+        Group group;
+        group.name = groupName;
+        group.object = object->second;
 
-                while (fscanf(pFile, "%d//%d", &v, &vn) > 0)
-                    ++m_numberOfTriangles;
-            }
-            else if (sscanf(buffer, "%d/%d/%d", &v, &vt, &vn) == 3) // v/vt/vn
-            {
-                fscanf(pFile, "%d/%d/%d", &v, &vt, &vn);
-                fscanf(pFile, "%d/%d/%d", &v, &vt, &vn);
-                ++m_numberOfTriangles;
+        int id = static_cast<int>(m_groups.size());
+        groupSlots[key] = id;
+        m_groups.push_back(group);
+        m_objects[object->second].groups.push_back(id);
+        return id;
+    };
 
-                while (fscanf(pFile, "%d/%d/%d", &v, &vt, &vn) > 0)
-                    ++m_numberOfTriangles;
-            }
-            else if (sscanf(buffer, "%d/%d", &v, &vt) == 2) // v/vt
-            {
-                fscanf(pFile, "%d/%d", &v, &vt);
-                fscanf(pFile, "%d/%d", &v, &vt);
-                ++m_numberOfTriangles;
+    // Faces without normals share vertices within their smoothing group.
+    // Every group gets its own negative key for the vertex cache, and every
+    // face outside of a group ('s off') a key of its own so it stays flat.
+    // Faces in files without 's' lines keep the key -1.
 
-                while (fscanf(pFile, "%d/%d", &v, &vt) > 0)
-                    ++m_numberOfTriangles;
-            }
-            else // v
+    std::map<int, int> smoothingKeys;
+    int numberOfSmoothingKeys = 0;
+    int lastSmoothing = 0;
+    int lastSmoothingKey = -1;
+    int flatKey = -1;
+    int lastIndex = -1;
+
+    std::vector<ObjTriangle> heldBack;
+    std::vector<int> heldBackIndices;
+
+    auto addTriangle = [&](int index, const ObjTriangle &t)
+    {
+        bool hasNormals = (t.type == TRIANGLE_POS_NORMAL ||
+            t.type == TRIANGLE_POS_TEXCOORD_NORMAL);
+        int smoothing = -1;
+
+        m_groupBuffer[index] = t.group;
+
+        if (!hasNormals && t.smoothing == 0)
+        {
+            // The triangles of a polygon are added one after the other
+            // unless one of them was held back.
+            if (!(t.relative & FACE_CONTINUED) || index != lastIndex + 1)
+                flatKey = -2 - numberOfSmoothingKeys++;
+
+            smoothing = flatKey;
+        }
+        else if (!hasNormals && t.smoothing > 0)
+        {
+            if (t.smoothing != lastSmoothing)
             {
-                fscanf(pFile, "%d", &v);
-                fscanf(pFile, "%d", &v);
-                ++m_numberOfTriangles;
+                std::map<int, int>::const_iterator key = smoothingKeys.find(t.smoothing);
+
+                if (key == smoothingKeys.end())
+                {
+                    key = smoothingKeys.insert(std::make_pair(t.smoothing,
+                        -2 - numberOfSmoothingKeys++)).first;
+                }
 
-                while (fscanf(pFile, "%d", &v) > 0)
-                    ++m_numberOfTriangles;
+                lastSmoothing = t.smoothing;
+                lastSmoothingKey = key->second;
             }
-            break;
 
-        case 'm':   // mtllib
-            fgets(buffer, sizeof(buffer), pFile);
-            sscanf(buffer, "%s %s", buffer, buffer);
-            name = m_directoryPath;
-            name += buffer;
-            importMaterials(name.c_str());
-            break;
+            smoothing = lastSmoothingKey;
+        }
 
-        case 'v':   // v, vt, or vn
-            switch (buffer[1])
-            {
-            case '\0':
-                fgets(buffer, sizeof(buffer), pFile);
-                ++m_numberOfVertexCoords;
-                break;
+        lastIndex = index;
 
-            case 'n':
-                fgets(buffer, sizeof(buffer), pFile);
-                ++m_numberOfNormals;
-                break;
+        switch (t.type)
+        {
+        case TRIANGLE_POS:
+            addTrianglePos(index, t.material, smoothing, t.v[0], t.v[1], t.v[2]);
+            break;
 
-            case 't':
-                fgets(buffer, sizeof(buffer), pFile);
-                ++m_numberOfTextureCoords;
+        case TRIANGLE_POS_TEXCOORD:
+            addTrianglePosTexCoord(index, t.material, smoothing,
+                t.v[0], t.v[1], t.v[2], t.vt[0], t.vt[1], t.vt[2]);
+            break;
 
-            default:
-                break;
-            }
+        case TRIANGLE_POS_NORMAL:
+            addTrianglePosNormal(index, t.material,
+                t.v[0], t.v[1], t.v[2], t.vn[0], t.vn[1], t.vn[2]);
             break;
 
-        default:
-            fgets(buffer, sizeof(buffer), pFile);
+        case TRIANGLE_POS_TEXCOORD_NORMAL:
+            addTrianglePosTexCoordNormal(index, t.material,
+                t.v[0], t.v[1], t.v[2], t.vt[0], t.vt[1], t.vt[2],
+                t.vn[0], t.vn[1], t.vn[2]);
             break;
         }
-    }
-
-    m_hasPositions = m_numberOfVertexCoords > 0;
-    m_hasNormals = m_numberOfNormals > 0;
-    m_hasTextureCoords = m_numberOfTextureCoords > 0;
+    };
 
-    // Allocate memory for the OBJ model data.
-    m_vertexCoords.resize(m_numberOfVertexCoords * 3);
-    m_textureCoords.resize(m_numberOfTextureCoords * 2);
-    m_normals.resize(m_numberOfNormals * 3);
-    m_indexBuffer.resize(m_numberOfTriangles * 3);
-    m_attributeBuffer.resize(m_numberOfTriangles);
+    const char *pWindow = pBuffer;
+    const char *pEnd = pBuffer + size;
+    const char *pReleased = pBuffer;
 
-    // Define a default material if no materials were loaded.
-    if (m_numberOfMaterials == 0)
+    while (pWindow != pEnd)
     {
-        Material defaultMaterial =
-        {
-            0.2f, 0.2f, 0.2f, 1.0f,
-            0.8f, 0.8f, 0.8f, 1.0f,
-            0.0f, 0.0f, 0.0f, 1.0f,
-            0.0f,
-            1.0f,
-            std::string("default"),
-            std::string(),
-            std::string()
-        };
+        const char *pWindowEnd = pEnd;
 
-        m_materials.push_back(defaultMaterial);
-        m_materialCache[defaultMaterial.name] = 0;
-    }
-}
+        if (static_cast<size_t>(pEnd - pWindow) > windowSize)
+            pWindowEnd = SkipLine(pWindow + windowSize, pEnd);
 
-void ModelOBJ::importGeometrySecondPass(FILE *pFile)
-{
-    int v[3] = {0};
-    int vt[3] = {0};
-    int vn[3] = {0};
-    int numVertices = 0;
-    int numTexCoords = 0;
-    int numNormals = 0;
-    int numTriangles = 0;
-    int activeMaterial = 0;
-    char buffer[256] = {0};
-    std::string name;
-    std::map<std::string, int>::const_iterator iter;
+        size_t windowBytes = static_cast<size_t>(pWindowEnd - pWindow);
+        size_t bytesRead = static_cast<size_t>(pWindowEnd - pBuffer);
+        int numberOfChunks = static_cast<int>(std::min<size_t>(
+            numberOfThreads, windowBytes / OBJ_MIN_CHUNK_SIZE));
 
-    while (fscanf(pFile, "%s", buffer) != EOF)
-    {
-        switch (buffer[0])
-        {
-        case 'f': // v, v//vn, v/vt, or v/vt/vn.
-            v[0]  = v[1]  = v[2]  = 0;
-            vt[0] = vt[1] = vt[2] = 0;
-            vn[0] = vn[1] = vn[2] = 0;
+        if (numberOfChunks < 1)
+            numberOfChunks = 1;
+
+        std::vector<ObjChunk> chunks(numberOfChunks);
+        const char *pChunk = pWindow;
 
-            fscanf(pFile, "%s", buffer);
+        for (int i = 0; i < numberOfChunks; ++i)
+        {
+            const char *pChunkEnd = pWindowEnd;
 
-            if (strstr(buffer, "//")) // v//vn
+            if (i + 1 < numberOfChunks)
             {
-                sscanf(buffer, "%d//%d", &v[0], &vn[0]);
-                fscanf(pFile, "%d//%d", &v[1], &vn[1]);
-                fscanf(pFile, "%d//%d", &v[2], &vn[2]);
+                pChunkEnd = pWindow + windowBytes / numberOfChunks * (i + 1);
+                pChunkEnd = (pChunkEnd < pChunk) ? pChunk : SkipLine(pChunkEnd, pWindowEnd);
+            }
 
-                v[0] = (v[0] < 0) ? v[0] + numVertices - 1 : v[0] - 1;
-                v[1] = (v[1] < 0) ? v[1] + numVertices - 1 : v[1] - 1;
-                v[2] = (v[2] < 0) ? v[2] + numVertices - 1 : v[2] - 1;
+            chunks[i].pBegin = pChunk;
+            chunks[i].pEnd = pChunkEnd;
+            pChunk = pChunkEnd;
+        }
 
-                vn[0] = (vn[0] < 0) ? vn[0] + numNormals - 1 : vn[0] - 1;
-                vn[1] = (vn[1] < 0) ? vn[1] + numNormals - 1 : vn[1] - 1;
-                vn[2] = (vn[2] < 0) ? vn[2] + numNormals - 1 : vn[2] - 1;
+        pool.run(numberOfChunks, [&chunks](int i)
+        {
+            ParseObjChunk(chunks[i]);
+        });
+
+        // Load the material libraries in the order they appear in the file
+        // and compute where each chunk's data starts in the merged arrays.
+        // This prefix sum is also what relative (negative) indices are
+        // resolved against. Faces at the start of a chunk inherit the
+        // material, group and smoothing group that were active at the end of
+        // the previous chunk.
+
+        int numVertices = m_numberOfVertexCoords;
+        int numTexCoords = m_numberOfTextureCoords;
+        int numNormals = m_numberOfNormals;
+        int numTriangles = m_numberOfTriangles;
+
+        for (int i = 0; i < numberOfChunks; ++i)
+        {
+            ObjChunk &chunk = chunks[i];
 
-                addTrianglePosNormal(numTriangles++, activeMaterial,
-                    v[0], v[1], v[2], vn[0], vn[1], vn[2]);
+            for (int j = 0; j < static_cast<int>(chunk.materialLibraries.size()); ++j)
+            {
+                m_materialLibraries.push_back(chunk.materialLibraries[j]);
+                importMaterials((m_directoryPath + chunk.materialLibraries[j]).c_str());
+            }
 
-                v[1] = v[2];
-                vn[1] = vn[2];
+            chunk.firstVertex = numVertices;
+            chunk.firstTexCoord = numTexCoords;
+            chunk.firstNormal = numNormals;
+            chunk.firstTriangle = numTriangles;
+            chunk.inheritedMaterial = activeMaterial;
 
-                while (fscanf(pFile, "%d//%d", &v[2], &vn[2]) > 0)
-                {
-                    v[2] = (v[2] < 0) ? v[2] + numVertices - 1 : v[2] - 1;
-                    vn[2] = (vn[2] < 0) ? vn[2] + numNormals - 1 : vn[2] - 1;
+            numVertices += static_cast<int>(chunk.vertexCoords.size() / 3);
+            numTexCoords += static_cast<int>(chunk.textureCoords.size() / 2);
+            numNormals += static_cast<int>(chunk.normals.size() / 3);
+            numTriangles += static_cast<int>(chunk.triangles.size());
 
-                    addTrianglePosNormal(numTriangles++, activeMaterial,
-                        v[0], v[1], v[2], vn[0], vn[1], vn[2]);
+            chunk.materialIds.resize(chunk.materialNames.size());
 
-                    v[1] = v[2];
-                    vn[1] = vn[2];
+            for (int j = 0; j < static_cast<int>(chunk.materialNames.size()); ++j)
+            {
+                slot = materialSlots.find(chunk.materialNames[j]);
+
+                if (slot == materialSlots.end())
+                {
+                    chunk.materialIds[j] = static_cast<int>(materialNames.size());
+                    materialSlots[chunk.materialNames[j]] = chunk.materialIds[j];
+                    materialNames.push_back(chunk.materialNames[j]);
+                }
+                else
+                {
+                    chunk.materialIds[j] = slot->second;
                 }
             }
-            else if (sscanf(buffer, "%d/%d/%d", &v[0], &vt[0], &vn[0]) == 3) // v/vt/vn
-            {
-                fscanf(pFile, "%d/%d/%d", &v[1], &vt[1], &vn[1]);
-                fscanf(pFile, "%d/%d/%d", &v[2], &vt[2], &vn[2]);
 
-                v[0] = (v[0] < 0) ? v[0] + numVertices - 1 : v[0] - 1;
-                v[1] = (v[1] < 0) ? v[1] + numVertices - 1 : v[1] - 1;
-                v[2] = (v[2] < 0) ? v[2] + numVertices - 1 : v[2] - 1;
+            if (chunk.activeMaterial >= 0)
+                activeMaterial = chunk.materialIds[chunk.activeMaterial];
 
-                vt[0] = (vt[0] < 0) ? vt[0] + numTexCoords - 1 : vt[0] - 1;
-                vt[1] = (vt[1] < 0) ? vt[1] + numTexCoords - 1 : vt[1] - 1;
-                vt[2] = (vt[2] < 0) ? vt[2] + numTexCoords - 1 : vt[2] - 1;
+            // Only the faces before the chunk's first 'o' or 'g' line can
+            // inherit a group, so the first face tells whether any do.
+            chunk.inheritedGroup = (!chunk.triangles.empty() && chunk.triangles[0].group < 0) ?
+                addGroup(activeObjectName, activeGroupName) : -1;
 
-                vn[0] = (vn[0] < 0) ? vn[0] + numNormals - 1 : vn[0] - 1;
-                vn[1] = (vn[1] < 0) ? vn[1] + numNormals - 1 : vn[1] - 1;
-                vn[2] = (vn[2] < 0) ? vn[2] + numNormals - 1 : vn[2] - 1;
+            chunk.groupIds.resize(chunk.groups.size());
 
-                addTrianglePosTexCoordNormal(numTriangles++, activeMaterial,
-                    v[0], v[1], v[2], vt[0], vt[1], vt[2], vn[0], vn[1], vn[2]);
+            for (int j = 0; j < static_cast<int>(chunk.groups.size()); ++j)
+            {
+                int object = chunk.groups[j].first;
+                int group = chunk.groups[j].second;
 
-                v[1] = v[2];
-                vt[1] = vt[2];
-                vn[1] = vn[2];
+                chunk.groupIds[j] = addGroup(
+                    (object < 0) ? activeObjectName : chunk.objectNames[object],
+                    (group < 0) ? activeGroupName : chunk.groupNames[group]);
+            }
 
-                while (fscanf(pFile, "%d/%d/%d", &v[2], &vt[2], &vn[2]) > 0)
-                {
-                    v[2] = (v[2] < 0) ? v[2] + numVertices - 1 : v[2] - 1;
-                    vt[2] = (vt[2] < 0) ? vt[2] + numTexCoords - 1 : vt[2] - 1;
-                    vn[2] = (vn[2] < 0) ? vn[2] + numNormals - 1 : vn[2] - 1;
+            if (chunk.activeObject >= 0)
+                activeObjectName = chunk.objectNames[chunk.activeObject];
 
-                    addTrianglePosTexCoordNormal(numTriangles++, activeMaterial,
-                        v[0], v[1], v[2], vt[0], vt[1], vt[2], vn[0], vn[1], vn[2]);
+            if (chunk.activeGroup >= 0)
+                activeGroupName = chunk.groupNames[chunk.activeGroup];
 
-                    v[1] = v[2];
-                    vt[1] = vt[2];
-                    vn[1] = vn[2];
-                }
-            }
-            else if (sscanf(buffer, "%d/%d", &v[0], &vt[0]) == 2) // v/vt
-            {
-                fscanf(pFile, "%d/%d", &v[1], &vt[1]);
-                fscanf(pFile, "%d/%d", &v[2], &vt[2]);
+            chunk.inheritedSmoothing = activeSmoothing;
 
-                v[0] = (v[0] < 0) ? v[0] + numVertices - 1 : v[0] - 1;
-                v[1] = (v[1] < 0) ? v[1] + numVertices - 1 : v[1] - 1;
-                v[2] = (v[2] < 0) ? v[2] + numVertices - 1 : v[2] - 1;
+            if (chunk.activeSmoothing != SMOOTHING_INHERITED)
+                activeSmoothing = chunk.activeSmoothing;
+        }
 
-                vt[0] = (vt[0] < 0) ? vt[0] + numTexCoords - 1 : vt[0] - 1;
-                vt[1] = (vt[1] < 0) ? vt[1] + numTexCoords - 1 : vt[1] - 1;
-                vt[2] = (vt[2] < 0) ? vt[2] + numTexCoords - 1 : vt[2] - 1;
+        // Merge the chunks. A single chunk hands over its arrays as they
+        // are if nothing has been read before it.
 
-                addTrianglePosTexCoord(numTriangles++, activeMaterial,
-                    v[0], v[1], v[2], vt[0], vt[1], vt[2]);
+        bool swapArrays = (numberOfChunks == 1 && m_numberOfVertexCoords == 0 &&
+            m_numberOfTextureCoords == 0 && m_numberOfNormals == 0);
 
-                v[1] = v[2];
-                vt[1] = vt[2];
+        if (swapArrays)
+        {
+            m_vertexCoords.swap(chunks[0].vertexCoords);
+            m_textureCoords.swap(chunks[0].textureCoords);
+            m_normals.swap(chunks[0].normals);
+        }
+        else
+        {
+            ReserveForFile(m_vertexCoords, numVertices * 3, bytesRead, size);
+            ReserveForFile(m_textureCoords, numTexCoords * 2, bytesRead, size);
+            ReserveForFile(m_normals, numNormals * 3, bytesRead, size);
 
-                while (fscanf(pFile, "%d/%d", &v[2], &vt[2]) > 0)
-                {
-                    v[2] = (v[2] < 0) ? v[2] + numVertices - 1 : v[2] - 1;
-                    vt[2] = (vt[2] < 0) ? vt[2] + numTexCoords - 1 : vt[2] - 1;
+            m_vertexCoords.resize(numVertices * 3);
+            m_textureCoords.resize(numTexCoords * 2);
+            m_normals.resize(numNormals * 3);
+        }
 
-                    addTrianglePosTexCoord(numTriangles++, activeMaterial,
-                        v[0], v[1], v[2], vt[0], vt[1], vt[2]);
+        pool.run(numberOfChunks, [this, &chunks, swapArrays](int i)
+        {
+            ObjChunk &chunk = chunks[i];
 
-                    v[1] = v[2];
-                    vt[1] = vt[2];
-                }
+            if (!swapArrays)
+            {
+                std::copy(chunk.vertexCoords.begin(), chunk.vertexCoords.end(),
+                    m_vertexCoords.begin() + chunk.firstVertex * 3);
+                std::copy(chunk.textureCoords.begin(), chunk.textureCoords.end(),
+                    m_textureCoords.begin() + chunk.firstTexCoord * 2);
+                std::copy(chunk.normals.begin(), chunk.normals.end(),
+                    m_normals.begin() + chunk.firstNormal * 3);
+
+                std::vector<float>().swap(chunk.vertexCoords);
+                std::vector<float>().swap(chunk.textureCoords);
+                std::vector<float>().swap(chunk.normals);
             }
-            else // v
+
+            for (int j = 0; j < static_cast<int>(chunk.triangles.size()); ++j)
             {
-                sscanf(buffer, "%d", &v[0]);
-                fscanf(pFile, "%d", &v[1]);
-                fscanf(pFile, "%d", &v[2]);
+                ObjTriangle &t = chunk.triangles[j];
 
-                v[0] = (v[0] < 0) ? v[0] + numVertices - 1 : v[0] - 1;
-                v[1] = (v[1] < 0) ? v[1] + numVertices - 1 : v[1] - 1;
-                v[2] = (v[2] < 0) ? v[2] + numVertices - 1 : v[2] - 1;
+                t.material = (t.material < 0) ?
+                    chunk.inheritedMaterial : chunk.materialIds[t.material];
+                t.group = (t.group < 0) ?
+                    chunk.inheritedGroup : chunk.groupIds[t.group];
 
-                addTrianglePos(numTriangles++, activeMaterial, v[0], v[1], v[2]);
+                if (t.smoothing == SMOOTHING_INHERITED)
+                    t.smoothing = chunk.inheritedSmoothing;
 
-                v[1] = v[2];
+                if ((t.relative & RELATIVE_INDICES) == 0)
+                    continue;
 
-                while (fscanf(pFile, "%d", &v[2]) > 0)
+                for (int k = 0; k < 3; ++k)
                 {
-                    v[2] = (v[2] < 0) ? v[2] + numVertices - 1 : v[2] - 1;
+                    if (t.relative & (1 << (3 * k)))
+                        t.v[k] += chunk.firstVertex;
 
-                    addTrianglePos(numTriangles++, activeMaterial, v[0], v[1], v[2]);
+                    if (t.relative & (2 << (3 * k)))
+                        t.vt[k] += chunk.firstTexCoord;
 
-                    v[1] = v[2];
+                    if (t.relative & (4 << (3 * k)))
+                        t.vn[k] += chunk.firstNormal;
                 }
             }
-            break;
+        });
 
-        case 'u': // usemtl
-            fgets(buffer, sizeof(buffer), pFile);
-            sscanf(buffer, "%s %s", buffer, buffer);
-            name = buffer;
-            iter = m_materialCache.find(buffer);
-            activeMaterial = (iter == m_materialCache.end()) ? 0 : iter->second;
-            break;
+        m_numberOfVertexCoords = numVertices;
+        m_numberOfTextureCoords = numTexCoords;
+        m_numberOfNormals = numNormals;
+        m_numberOfTriangles = numTriangles;
 
-        case 'v': // v, vn, or vt.
-            switch (buffer[1])
-            {
-            case '\0': // v
-                fscanf(pFile, "%f %f %f",
-                    &m_vertexCoords[3 * numVertices],
-                    &m_vertexCoords[3 * numVertices + 1],
-                    &m_vertexCoords[3 * numVertices + 2]);
-                ++numVertices;
-                break;
+        // Build the window's vertices and indices. Vertices are shared
+        // between triangles in file order, so this step stays serial.
+        // Closed meshes have about half as many vertices as triangles,
+        // which is what the vertex cache is sized for up front.
 
-            case 'n': // vn
-                fscanf(pFile, "%f %f %f",
-                    &m_normals[3 * numNormals],
-                    &m_normals[3 * numNormals + 1],
-                    &m_normals[3 * numNormals + 2]);
-                ++numNormals;
-                break;
+        ReserveForFile(m_indexBuffer, numTriangles * 3, bytesRead, size);
+        ReserveForFile(m_attributeBuffer, numTriangles, bytesRead, size);
+        ReserveForFile(m_groupBuffer, numTriangles, bytesRead, size);
+        ReserveForFile(m_vertexBuffer, numTriangles / 2 + 1, bytesRead, size);
 
-            case 't': // vt
-                fscanf(pFile, "%f %f",
-                    &m_textureCoords[2 * numTexCoords],
-                    &m_textureCoords[2 * numTexCoords + 1]);
-                ++numTexCoords;
-                break;
+        m_indexBuffer.resize(numTriangles * 3);
+        m_attributeBuffer.resize(numTriangles);
+        m_groupBuffer.resize(numTriangles);
+        reserveVertexCache(static_cast<int>(m_vertexBuffer.capacity()));
 
-            default:
-                break;
+        for (int i = 0; i < numberOfChunks; ++i)
+        {
+            ObjChunk &chunk = chunks[i];
+
+            for (int j = 0; j < static_cast<int>(chunk.triangles.size()); ++j)
+            {
+                const ObjTriangle &t = chunk.triangles[j];
+                bool forward = false;
+
+                for (int k = 0; k < 3; ++k)
+                {
+                    forward = forward || t.v[k] >= numVertices ||
+                        t.vt[k] >= numTexCoords || t.vn[k] >= numNormals;
+                }
+
+                if (forward)
+                {
+                    heldBack.push_back(t);
+                    heldBackIndices.push_back(chunk.firstTriangle + j);
+                }
+                else
+                {
+                    addTriangle(chunk.firstTriangle + j, t);
+                }
             }
-            break;
 
-        default:
-            fgets(buffer, sizeof(buffer), pFile);
-            break;
+            std::vector<ObjTriangle>().swap(chunk.triangles);
+        }
+
+        chunks.clear();
+
+        if (mapped)
+            pReleased = ReleaseMappedPages(pReleased, pWindowEnd);
+
+        pWindow = pWindowEnd;
+
+        if (m_pImportCallback && !m_pImportCallback(
+            static_cast<float>(static_cast<double>(bytesRead) / size),
+            m_pImportCallbackData))
+        {
+            return false;
         }
     }
+
+    for (int i = 0; i < static_cast<int>(heldBack.size()); ++i)
+        addTriangle(heldBackIndices[i], heldBack[i]);
+
+    m_hasPositions = m_numberOfVertexCoords > 0;
+    m_hasNormals = m_numberOfNormals > 0;
+    m_hasTextureCoords = m_numberOfTextureCoords > 0;
+
+    // Define a default material if no materials were loaded.
+    if (m_numberOfMaterials == 0)
+    {
+        Material defaultMaterial =
+        {
+            0.2f, 0.2f, 0.2f, 1.0f,
+            0.8f, 0.8f, 0.8f, 1.0f,
+            0.0f, 0.0f, 0.0f, 1.0f,
+            0.0f,
+            1.0f,
+            std::string("default"),
+            std::string(),
+            std::string()
+        };
+
+        m_materials.push_back(defaultMaterial);
+        m_materialCache[defaultMaterial.name] = 0;
+    }
+
+    // Replace the slots with the materials. Unknown materials fall back to
+    // the first material.
+
+    std::map<std::string, int>::const_iterator iter;
+    std::vector<int> materialIds(materialNames.size(), 0);
+
+    for (int i = 0; i < static_cast<int>(materialNames.size()); ++i)
+    {
+        iter = m_materialCache.find(materialNames[i]);
+
+        if (iter != m_materialCache.end())
+            materialIds[i] = iter->second;
+    }
+
+    for (int i = 0; i < m_numberOfTriangles; ++i)
+    {
+        int material = m_attributeBuffer[i];
+        m_attributeBuffer[i] = (material < 0) ? 0 : materialIds[material];
+    }
+
+    // The OBJ records and the cache are only needed while the vertices are
+    // built.
+    std::vector<float>().swap(m_vertexCoords);
+    std::vector<float>().swap(m_textureCoords);
+    std::vector<float>().swap(m_normals);
+    std::vector<VertexCacheEntry>().swap(m_vertexCache);
+    m_vertexCacheSize = 0;
+
+    return true;
 }
 
 bool ModelOBJ::importMaterials(const char *pszFilename)
 {
-    FILE *pFile = fopen(pszFilename, "r");
+    MappedFile file;
 
-    if (!pFile)
+    if (!file.open(pszFilename))
         return false;
 
+    importMaterials(file.data(), file.size());
+    return true;
+}
+
+void ModelOBJ::importMaterials(const char *pBuffer, size_t size)
+{
     Material *pMaterial = 0;
     int illum = 0;
-    int numMaterials = 0;
-    char buffer[256] = {0};
+    float value = 0.0f;
 
-    // Count the number of materials in the MTL file.
-    while (fscanf(pFile, "%s", buffer) != EOF)
+    const char *p = pBuffer;
+    const char *pEnd = pBuffer + size;
+    const char *pToken = 0;
+    const char *pTokenEnd = 0;
+
+    // Materials are appended so that several 'mtllib' statements can be used
+    // by the same OBJ file.
+    std::vector<Material> materials;
+    materials.swap(m_materials);
+
+    // Load the materials in the MTL file.
+    while (p != pEnd)
     {
-        switch (buffer[0])
-        {
-        case 'n': // newmtl
-            ++numMaterials;
-            fgets(buffer, sizeof(buffer), pFile);
-            sscanf(buffer, "%s %s", buffer, buffer);
-            break;
+        p = SkipSpaces(p, pEnd);
+        pToken = p;
+        p = SkipToken(p, pEnd);
+        pTokenEnd = p;
+        p = SkipSpaces(p, pEnd);
 
-        default:
-            fgets(buffer, sizeof(buffer), pFile);
-            break;
+        if (pToken == pTokenEnd)
+        {
+            p = SkipLine(p, pEnd);
+            continue;
         }
-    }
 
-    rewind(pFile);
+        if (pToken[0] == 'n') // newmtl
+        {
+            Material material =
+            {
+                0.2f, 0.2f, 0.2f, 1.0f,
+                0.8f, 0.8f, 0.8f, 1.0f,
+                0.0f, 0.0f, 0.0f, 1.0f,
+                0.0f,
+                1.0f,
+                std::string(p, SkipToken(p, pEnd)),
+                std::string(),
+                std::string()
+            };
+
+            m_materialCache[material.name] = static_cast<int>(materials.size());
+            materials.push_back(material);
+            pMaterial = &materials.back();
+        }
+        else if (pMaterial)
+        {
+            switch (pToken[0])
+            {
+            case 'N': // Ns
+                if (pTokenEnd - pToken == 2 && pToken[1] == 's' &&
+                    ParseFloat(p, pEnd, pMaterial->shininess))
+                {
+                    // Wavefront .MTL file shininess is from [0,1000].
+                    // Scale back to a generic [0,1] range.
+                    pMaterial->shininess /= 1000.0f;
+                }
+                break;
 
-    m_numberOfMaterials = numMaterials;
-    numMaterials = 0;
-    m_materials.resize(m_numberOfMaterials);
+            case 'K': // Ka, Kd, or Ks
+                switch (pToken[1])
+                {
+                case 'a': // Ka
+                    ParseColor(p, pEnd, pMaterial->ambient);
+                    break;
 
-    // Load the materials in the MTL file.
-    while (fscanf(pFile, "%s", buffer) != EOF)
-    {
-        switch (buffer[0])
-        {
-        case 'N': // Ns
-            fscanf(pFile, "%f", &pMaterial->shininess);
+                case 'd': // Kd
+                    ParseColor(p, pEnd, pMaterial->diffuse);
+                    break;
 
-            // Wavefront .MTL file shininess is from [0,1000].
-            // Scale back to a generic [0,1] range.
-            pMaterial->shininess /= 1000.0f;
-            break;
+                case 's': // Ks
+                    ParseColor(p, pEnd, pMaterial->specular);
+                    break;
 
-        case 'K': // Ka, Kd, or Ks
-            switch (buffer[1])
-            {
-            case 'a': // Ka
-                fscanf(pFile, "%f %f %f",
-                    &pMaterial->ambient[0],
-                    &pMaterial->ambient[1],
-                    &pMaterial->ambient[2]);
-                pMaterial->ambient[3] = 1.0f;
+                default:
+                    break;
+                }
                 break;
 
-            case 'd': // Kd
-                fscanf(pFile, "%f %f %f",
-                    &pMaterial->diffuse[0],
-                    &pMaterial->diffuse[1],
-                    &pMaterial->diffuse[2]);
-                pMaterial->diffuse[3] = 1.0f;
+            case 'T': // Tr
+                if (pToken[1] == 'r' && ParseFloat(p, pEnd, value))
+                    pMaterial->alpha = 1.0f - value;
                 break;
 
-            case 's': // Ks
-                fscanf(pFile, "%f %f %f",
-                    &pMaterial->specular[0],
-                    &pMaterial->specular[1],
-                    &pMaterial->specular[2]);
-                pMaterial->specular[3] = 1.0f;
+            case 'd':
+                ParseFloat(p, pEnd, pMaterial->alpha);
                 break;
 
-            default:
-                fgets(buffer, sizeof(buffer), pFile);
+            case 'i': // illum
+                if (ParseInt(p, pEnd, illum) && illum == 1)
+                {
+                    pMaterial->specular[0] = 0.0f;
+                    pMaterial->specular[1] = 0.0f;
+                    pMaterial->specular[2] = 0.0f;
+                    pMaterial->specular[3] = 1.0f;
+                }
                 break;
-            }
-            break;
 
-        case 'T': // Tr
-            switch (buffer[1])
-            {
-            case 'r': // Tr
-                fscanf(pFile, "%f", &pMaterial->alpha);
-                pMaterial->alpha = 1.0f - pMaterial->alpha;
+            case 'm': // map_Kd, map_bump
+                // Texture options may precede the file name, so use the last
+                // token on the line.
+                if (std::string(pToken, pTokenEnd).find("map_Kd") != std::string::npos)
+                    pMaterial->colorMapFilename = LastToken(p, pEnd);
+                else if (std::string(pToken, pTokenEnd).find("map_bump") != std::string::npos)
+                    pMaterial->bumpMapFilename = LastToken(p, pEnd);
                 break;
 
             default:
-                fgets(buffer, sizeof(buffer), pFile);
                 break;
             }
-            break;
-
-        case 'd':
-            fscanf(pFile, "%f", &pMaterial->alpha);
-            break;
-
-        case 'i': // illum
-            fscanf(pFile, "%d", &illum);
-
-            if (illum == 1)
-            {
-                pMaterial->specular[0] = 0.0f;
-                pMaterial->specular[1] = 0.0f;
-                pMaterial->specular[2] = 0.0f;
-                pMaterial->specular[3] = 1.0f;
-            }
-            break;
-
-        case 'm': // map_Kd, map_bump
-            if (strstr(buffer, "map_Kd") != 0)
-            {
-                fgets(buffer, sizeof(buffer), pFile);
-                sscanf(buffer, "%s %s", buffer, buffer);
-                pMaterial->colorMapFilename = buffer;
-            }
-            else if (strstr(buffer, "map_bump") != 0)
-            {
-                fgets(buffer, sizeof(buffer), pFile);
-                sscanf(buffer, "%s %s", buffer, buffer);
-                pMaterial->bumpMapFilename = buffer;
-            }
-            else
-            {
-                fgets(buffer, sizeof(buffer), pFile);
-            }
-            break;
-
-        case 'n': // newmtl
-            fgets(buffer, sizeof(buffer), pFile);
-            sscanf(buffer, "%s %s", buffer, buffer);
-
-            pMaterial = &m_materials[numMaterials];
-            pMaterial->ambient[0] = 0.2f;
-            pMaterial->ambient[1] = 0.2f;
-            pMaterial->ambient[2] = 0.2f;
-            pMaterial->ambient[3] = 1.0f;
-            pMaterial->diffuse[0] = 0.8f;
-            pMaterial->diffuse[1] = 0.8f;
-            pMaterial->diffuse[2] = 0.8f;
-            pMaterial->diffuse[3] = 1.0f;
-            pMaterial->specular[0] = 0.0f;
-            pMaterial->specular[1] = 0.0f;
-            pMaterial->specular[2] = 0.0f;
-            pMaterial->specular[3] = 1.0f;
-            pMaterial->shininess = 0.0f;
-            pMaterial->alpha = 1.0f;
-            pMaterial->name = buffer;
-            pMaterial->colorMapFilename.clear();
-            pMaterial->bumpMapFilename.clear();
-
-            m_materialCache[pMaterial->name] = numMaterials;
-            ++numMaterials;
-            break;
-
-        default:
-            fgets(buffer, sizeof(buffer), pFile);
-            break;
         }
+
+        p = SkipLine(p, pEnd);
     }
 
-    fclose(pFile);
-    return true;
+    materials.swap(m_materials);
+    m_numberOfMaterials = static_cast<int>(m_materials.size());
 }
 
 #undef _CRT_SECURE_NO_WARNINGS
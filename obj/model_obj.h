@@ -25,6 +25,7 @@
 
 #define _CRT_SECURE_NO_WARNINGS // suppress warnings for unsafe methods
 
+#include <cfloat>
 #include <cstdio>
 #include <map>
 #include <string>
@@ -34,19 +35,122 @@
 // Alias|Wavefront OBJ file loader.
 //
 // This OBJ file loader contains the following restrictions:
-// 1. Group information is ignored. Faces are grouped based on the material
-//    that each face uses.
-// 2. Object information is ignored. This loader will merge everything into a
-//    single object.
+// 1. Everything is merged into a single vertex and index buffer. Objects
+//    ('o') and groups ('g') are kept as lists of meshes, see getObject() and
+//    getGroup(). A 'g' line with several names is one group.
+// 2. Smoothing groups ('s') only affect faces without normals. Normals are
+//    generated per smoothing group and faces with 's off' are flat shaded.
 // 3. The MTL file must be located in the same directory as the OBJ file. If
 //    it isn't then the MTL file will fail to load and a default material is
 //    used instead.
 // 4. This loader triangulates all polygonal faces during importing.
+//
+// OBJ and MTL files are memory mapped on platforms that support it. A model
+// that is already in memory can be imported with the import() overload that
+// takes a pointer and a size. Its MTL files are then looked up relative to
+// the given directory path.
+//
+// Large OBJ files are scanned on several threads (see setNumberOfThreads()).
+// The result is identical to a single threaded import. Very large files can
+// be read in windows to bound the memory used while importing, and report
+// progress as they go (see setImportWindowSize() and setImportCallback()).
+//
+// importCached() keeps a binary copy of the imported model next to the OBJ
+// file ("<file>.cache"). Later calls load that copy instead of parsing the
+// OBJ file again, as long as neither the OBJ file nor its MTL files have
+// changed and the import window size is the same.
 //-----------------------------------------------------------------------------
 
 class ModelOBJ
 {
 public:
+    // How tangents are generated for models with bump maps.
+    // TANGENTS_SERIAL is the original single threaded implementation.
+    // TANGENTS_PARALLEL computes them on several threads. Large models sum
+    // in a different order, which can change the last bits, but the result
+    // is the same whatever the number of threads.
+    // TANGENTS_MIKKTSPACE gives MikkTSpace tangents, matching the tangent
+    // space most tools bake normal maps in. Vertices shared by triangles
+    // with different MikkTSpace tangents are duplicated. The tangent's w
+    // component holds the bitangent sign as defined by MikkTSpace.
+    enum TangentMethod
+    {
+        TANGENTS_SERIAL,
+        TANGENTS_PARALLEL,
+        TANGENTS_MIKKTSPACE
+    };
+
+    // How the vertices are stored.
+    // VERTEX_LAYOUT_INTERLEAVED keeps an array of Vertex structures, see
+    // getVertexBuffer().
+    // VERTEX_LAYOUT_SEPARATE keeps every attribute in its own packed array,
+    // see getPositions() and friends. Attributes the model doesn't have use
+    // no memory. Use getVertices() to build interleaved vertices for upload.
+    enum VertexLayout
+    {
+        VERTEX_LAYOUT_INTERLEAVED,
+        VERTEX_LAYOUT_SEPARATE
+    };
+
+    // Attributes and encodings of packed vertices, see packVertices().
+    enum VertexAttribute
+    {
+        ATTRIBUTE_POSITION,
+        ATTRIBUTE_TEXCOORD,
+        ATTRIBUTE_NORMAL,
+        ATTRIBUTE_TANGENT,
+        NUMBER_OF_ATTRIBUTES
+    };
+
+    enum AttributeEncoding
+    {
+        ENCODING_NONE,              // attribute is left out
+        ENCODING_FLOAT,             // 32 bit floats
+        ENCODING_HALF_FLOAT,        // 16 bit floats (positions, texture coordinates)
+        ENCODING_UNORM16,           // 16 bit fixed point in [0, 1] (texture coordinates)
+        ENCODING_OCTAHEDRAL,        // 2 x 16 bit octahedral unit vector (normals)
+        ENCODING_INT_2_10_10_10     // 10-10-10-2 with the sign in w (tangents)
+    };
+
+    struct VertexFormat
+    {
+        AttributeEncoding encodings[NUMBER_OF_ATTRIBUTES];
+    };
+
+    // Where an attribute is stored in packed vertices. The members are the
+    // arguments to pass to glVertexAttribPointer().
+    struct AttributePointer
+    {
+        int size;               // number of components, 0 if left out
+        unsigned int type;      // OpenGL type, e.g. GL_HALF_FLOAT
+        bool normalized;
+        int offset;             // in bytes from the start of a vertex
+    };
+
+    // The cost of drawing the model through a simulated FIFO post-transform
+    // vertex cache. ACMR is the number of vertex shader invocations per
+    // triangle (0.5 at best, 3 at worst) and ATVR the number per vertex
+    // (1 at best).
+    struct PostTransformCacheStatistics
+    {
+        int vertexShaderInvocations;
+        float acmr;
+        float atvr;
+    };
+
+    // The bytes read to fetch the vertices that miss the post-transform
+    // cache, through a simulated vertex fetch cache. Overfetch is relative
+    // to the size of the vertex buffer (1 when every byte is read once).
+    struct VertexFetchStatistics
+    {
+        size_t bytesFetched;
+        float overfetch;
+    };
+
+    // Called by import() with the fraction of the OBJ data read so far, in
+    // [0, 1]. Returning false cancels the import.
+    typedef bool (*ImportCallback)(float progress, void *pUserData);
+
     struct Material
     {
         float ambient[4];
@@ -69,11 +173,105 @@ public:
         float bitangent[3];
     };
 
+    // A range of triangles that share a material and a group. All meshes of
+    // a material are next to each other in the index buffer. The bounding
+    // box and the bounding sphere around its center enclose the mesh's
+    // vertices. The meshes of a level of detail keep the bounds of the full
+    // detail ones.
     struct Mesh
     {
         int startIndex;
         int triangleCount;
         const Material *pMaterial;
+        int group;
+        float minimum[3];
+        float maximum[3];
+        float center[3];
+        float radius;
+    };
+
+    // The meshes of an OBJ group ('g') within an object ('o'). Faces before
+    // the first 'o' or 'g' line belong to an object and a group with an
+    // empty name. The bounds enclose the bounds of the meshes.
+    struct Group
+    {
+        std::string name;
+        int object;
+        std::vector<int> meshes;
+        float minimum[3];
+        float maximum[3];
+        float center[3];
+        float radius;
+    };
+
+    // The groups of an OBJ object, with bounds that enclose theirs.
+    struct Object
+    {
+        std::string name;
+        std::vector<int> groups;
+        float minimum[3];
+        float maximum[3];
+        float center[3];
+        float radius;
+    };
+
+    // A simplified version of the model. Its meshes match getMesh() but
+    // index getLodIndexBuffer(), which uses the model's vertex buffer.
+    struct LevelOfDetail
+    {
+        int startIndex;
+        int triangleCount;
+        float error;                // relative to the bounding box diagonal
+        std::vector<Mesh> meshes;
+    };
+
+    // A cluster of up to 64 vertices and 124 triangles of one mesh, stored
+    // as a range of getIndexBuffer(), with bounds for culling. The triangles
+    // all face away from a camera for which
+    // dot(normalize(coneApex - camera), coneAxis) >= coneCutoff.
+    struct Meshlet
+    {
+        int startIndex;
+        int triangleCount;
+        int mesh;
+        float center[3];
+        float radius;
+        float coneApex[3];
+        float coneAxis[3];
+        float coneCutoff;
+    };
+
+    // A node of the bounding volume hierarchy built by buildBvh(). Nodes are
+    // stored depth first, so the first child of an inner node follows it.
+    // Inner nodes have a count of 0 and start is their second child. Leaves
+    // hold the count triangles of getBvhTriangles() from start on.
+    struct BvhNode
+    {
+        float minimum[3];
+        int start;
+        float maximum[3];
+        int count;
+    };
+
+    // The closest intersection of a ray with the model. triangle is -1 if
+    // the ray misses. The hit point is
+    // origin + t * direction = (1 - u - v) * p0 + u * p1 + v * p2.
+    struct RayHit
+    {
+        int triangle;
+        float t;
+        float u;
+        float v;
+    };
+
+    // A range of indices to draw with one material, see buildDrawList().
+    // Draws with the same key need the same GPU state.
+    struct Draw
+    {
+        unsigned long long key;
+        int startIndex;
+        int triangleCount;
+        const Material *pMaterial;
     };
 
     ModelOBJ();
@@ -81,9 +279,115 @@ public:
 
     void destroy();
     bool import(const char *pszFilename, bool rebuildNormals = false);
+    bool import(const void *pData, size_t size, bool rebuildNormals = false,
+        const char *pszDirectoryPath = 0);
+    bool importCached(const char *pszFilename, bool rebuildNormals = false);
     void normalize(float scaleTo = 1.0f, bool center = true);
     void reverseWinding();
 
+    // Reorders the triangles of each mesh so that they reuse the vertices
+    // in the GPU's post-transform vertex cache as much as possible.
+    void optimizePostTransformCache();
+    PostTransformCacheStatistics getPostTransformCacheStatistics(int cacheSize = 16) const;
+
+    // Reorders clusters of triangles within each mesh so that the ones
+    // facing outwards are drawn first, which reduces overdraw. threshold is
+    // how much worse (1.05 = 5%) the ACMR of the clusters may get. Run after
+    // optimizePostTransformCache().
+    void optimizeOverdraw(float threshold = 1.05f);
+
+    // Splits every mesh into meshlets, reordering its triangles so each
+    // meshlet is a range of indices. The triangles of each meshlet are then
+    // ordered for the post-transform vertex cache. Reordering the triangles
+    // again, e.g. with optimizePostTransformCache(), removes the meshlets.
+    void buildMeshlets();
+
+    // Writes the indices of the meshlets that may be visible to pVisible
+    // and returns how many there are. Meshlets outside the frustum or
+    // facing away from the camera are culled. The column major matrix
+    // transforms the model to clip space and cameraPosition is in the
+    // model's coordinates.
+    int cullMeshlets(const float modelViewProjection[16],
+        const float cameraPosition[3], int *pVisible) const;
+
+    // Fills draws with the meshes of a level of detail (0 is the full
+    // detail model) that may be visible and returns how many there are.
+    // Meshes outside the frustum are culled, unless modelViewProjection is
+    // null. The draws are sorted by a 64 bit key: opaque ones first, by
+    // shader (which maps the material uses), texture, material and then
+    // front to back in coarse depth buckets, followed by the transparent
+    // ones back to front. Neighbouring meshes with the same key are merged
+    // into one draw. The start indices of a level of detail's draws are in
+    // getLodIndexBuffer().
+    int buildDrawList(const float cameraPosition[3], std::vector<Draw> &draws,
+        const float modelViewProjection[16] = 0, int level = 0) const;
+
+    // Builds a bounding volume hierarchy over the triangles for ray queries,
+    // on several threads for large models. Methods that change the
+    // triangles or the positions rebuild it.
+    void buildBvh();
+
+    // Finds the closest triangle hit by origin + t * direction for
+    // 0 <= t < tMax. Both faces of a triangle are hit. Returns false if the
+    // ray misses or there is no BVH.
+    bool intersectRay(const float origin[3], const float direction[3],
+        RayHit &hit, float tMax = FLT_MAX) const;
+
+    // Same for count rays, with 3 floats per origin and direction. The rays
+    // are traced in packets of four, which is fastest when neighbouring rays
+    // are coherent, e.g. for 2 x 2 pixel tiles.
+    void intersectRays(const float *pOrigins, const float *pDirections,
+        int count, RayHit *pHits, float tMax = FLT_MAX) const;
+
+    // Builds up to numberOfLevels simplified versions of the model with
+    // quadric error edge collapses. Each level has 'reduction' times the
+    // triangles of the previous one. Vertices only ever collapse onto other
+    // vertices, so all levels share the model's vertex buffer. Material
+    // boundaries, UV seams and borders are kept. Stops early rather than
+    // exceed maxError (relative to the bounding box diagonal). Returns the
+    // number of levels built.
+    int generateLevelsOfDetail(int numberOfLevels, float reduction = 0.5f,
+        float maxError = 0.02f);
+
+    // Renumbers the vertices in the order the triangles first use them so
+    // that vertex fetches read memory in order. Unused vertices are removed.
+    // Run after the triangle order is final.
+    void optimizeVertexFetch();
+    VertexFetchStatistics getVertexFetchStatistics(int vertexSize = static_cast<int>(sizeof(Vertex))) const;
+
+    // Number of threads used by import(). 0 uses one thread per core.
+    void setNumberOfThreads(int numberOfThreads);
+
+    // Called after every window import() reads. A cancelled import returns
+    // false and leaves the model empty.
+    void setImportCallback(ImportCallback pCallback, void *pUserData = 0);
+
+    // Number of bytes of OBJ data import() reads at a time. The faces of a
+    // window are turned into vertices before the next window is read, so
+    // the parsed records never take more memory than one window's worth,
+    // and pages of a memory mapped file are released once read. 0 (the
+    // default) reads the whole file at once. Faces that refer to vertices
+    // defined further down the file are built at the end, which numbers
+    // their vertices differently than a single window import would.
+    void setImportWindowSize(size_t windowSize);
+
+    // Generate normals with the multithreaded SIMD implementation (the
+    // default) or with the original serial one. Models too small to split
+    // over several threads always use the serial one.
+    void setParallelNormals(bool enable);
+
+    // Method used to generate tangents. Defaults to TANGENTS_PARALLEL.
+    void setTangentMethod(TangentMethod method);
+
+    // Builds the tangents with the method set by setTangentMethod(). import()
+    // already does it when a material has a bump map. TANGENTS_MIKKTSPACE
+    // may add vertices, which drops the meshlets and levels of detail.
+    void generateTangents();
+
+    // Vertex layout used by the next import. Changing the layout of a loaded
+    // model converts its vertices. Defaults to VERTEX_LAYOUT_INTERLEAVED.
+    void setVertexLayout(VertexLayout layout);
+
     // Getter methods.
 
     void getCenter(float &x, float &y, float &z) const;
@@ -92,52 +396,142 @@ public:
     float getLength() const;
     float getRadius() const;
 
+    // The bounding box of the vertices and a bounding sphere around its
+    // center. Unlike getRadius(), which is the largest dimension of the
+    // box, the sphere's radius is the distance to the farthest vertex.
+    void getBounds(float minimum[3], float maximum[3]) const;
+    void getBoundingSphere(float center[3], float &radius) const;
+
+    // getIndexBuffer() always returns 32 bit indices. getIndexData() returns
+    // the indices to upload to the GPU, which are 16 bit when every vertex
+    // can be addressed with them. getIndexSize() is the size of those.
     const int *getIndexBuffer() const;
+    const void *getIndexData() const;
     int getIndexSize() const;
 
+    // Levels of detail, from the most detailed. getLodIndexData() has the
+    // same index size as getIndexData().
+    const LevelOfDetail &getLevelOfDetail(int i) const;
+    int getNumberOfLevelsOfDetail() const;
+    const int *getLodIndexBuffer() const;
+    const void *getLodIndexData() const;
+    int getNumberOfLodIndices() const;
+
+    // The BVH. Unused slots of getBvhTriangles() are -1.
+    const BvhNode &getBvhNode(int i) const;
+    int getNumberOfBvhNodes() const;
+    const int *getBvhTriangles() const;
+
+    const Group &getGroup(int i) const;
     const Material &getMaterial(int i) const;
     const Mesh &getMesh(int i) const;
+    const Meshlet &getMeshlet(int i) const;
+    const Object &getObject(int i) const;
 
+    int getNumberOfGroups() const;
     int getNumberOfIndices() const;
     int getNumberOfMaterials() const;
     int getNumberOfMeshes() const;
+    int getNumberOfMeshlets() const;
+    int getNumberOfObjects() const;
     int getNumberOfTriangles() const;
     int getNumberOfVertices() const;
 
     const std::string &getPath() const;
+    size_t getImportWindowSize() const;
+    int getNumberOfThreads() const;
+    bool getParallelNormals() const;
+    TangentMethod getTangentMethod() const;
+    VertexLayout getVertexLayout() const;
 
+    // Interleaved vertex layout only.
     const Vertex &getVertex(int i) const;
     const Vertex *getVertexBuffer() const;
     int getVertexSize() const;
 
+    // Separate vertex layout only. Return null if the model doesn't have
+    // the attribute.
+    const float *getPositions() const;      // 3 floats per vertex
+    const float *getTexCoords() const;      // 2 floats per vertex
+    const float *getNormals() const;        // 3 floats per vertex
+    const float *getTangents() const;       // 4 floats per vertex
+    const float *getBitangents() const;     // 3 floats per vertex
+
+    // Copies the vertices into pVertices, which must have room for
+    // getNumberOfVertices() vertices. Works with either layout.
+    void getVertices(Vertex *pVertices) const;
+
+    // Encodes the vertices in a compact format for upload and returns the
+    // size of a packed vertex in bytes, or 0 if the format can't be used.
+    // Every attribute starts on a 4 byte boundary. Texture coordinates
+    // outside [0, 1] can't be encoded with ENCODING_UNORM16. Octahedral
+    // normals are decoded in the shader as:
+    //     vec3 n = vec3(e.xy, 1.0 - abs(e.x) - abs(e.y));
+    //     if (n.z < 0.0) n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+    //     n = normalize(n);
+    int packVertices(const VertexFormat &format,
+        std::vector<unsigned char> &vertices,
+        AttributePointer pointers[NUMBER_OF_ATTRIBUTES]) const;
+
     bool hasNormals() const;
     bool hasPositions() const;
     bool hasTangents() const;
     bool hasTextureCoords() const;
 
 private:
-    void addTrianglePos(int index, int material,
+    // An entry of the vertex cache used to share vertices while importing.
+    // Unused entries have a negative index.
+    struct VertexCacheEntry
+    {
+        int v;
+        int vt;
+        int vn;
+        int index;
+    };
+
+    // Faces without normals pass their smoothing group's key (a negative
+    // number) as the normal index, so they only share vertices within it.
+    void addTrianglePos(int index, int material, int smoothing,
         int v0, int v1, int v2);
     void addTrianglePosNormal(int index, int material,
         int v0, int v1, int v2,
         int vn0, int vn1, int vn2);
-    void addTrianglePosTexCoord(int index, int material,
+    void addTrianglePosTexCoord(int index, int material, int smoothing,
         int v0, int v1, int v2,
         int vt0, int vt1, int vt2);
     void addTrianglePosTexCoordNormal(int index, int material,
         int v0, int v1, int v2,
         int vt0, int vt1, int vt2,
         int vn0, int vn1, int vn2);
-    int addVertex(int hash, const Vertex *pVertex);
-    void bounds(float center[3], float &width, float &height,
-        float &length, float &radius) const;
+    void addLevelOfDetail(const std::vector<int> &triangles,
+        const std::vector<int> &origins, float error);
+    int addVertex(int v, int vt, int vn, const Vertex *pVertex);
     void buildMeshes();
+    void computeBounds();
+    void computeMeshletBounds();
+    bool exportCache(const char *pszCacheFilename, const char *pszFilename,
+        bool rebuildNormals) const;
     void generateNormals();
-    void generateTangents();
-    void importGeometryFirstPass(FILE *pFile);
-    void importGeometrySecondPass(FILE *pFile);
+    void generateNormalsParallel();
+    void generateTangentsMikkTSpace();
+    void generateTangentsParallel();
+    void generateTangentsSerial();
+    void getTriangleMaterials(std::vector<int> &materials) const;
+    bool importCache(const char *pszCacheFilename, const char *pszFilename,
+        bool rebuildNormals);
+    const float *getPositionData(int &stride) const;
+    bool importGeometry(const char *pBuffer, size_t size, bool mapped);
+    bool importModel(const char *pBuffer, size_t size, bool rebuildNormals,
+        bool mapped);
     bool importMaterials(const char *pszFilename);
+    void importMaterials(const char *pBuffer, size_t size);
+    void interleaveVertices();
+    void packIndices();
+    void reserveVertexCache(int numberOfVertices);
     void scale(float scaleFactor, float offset[3]);
+    void separateVertices();
+    void updateDimensions();
+    void updateGroupMeshes();
 
     bool m_hasPositions;
     bool m_hasTextureCoords;
@@ -150,26 +544,54 @@ private:
     int m_numberOfTriangles;
     int m_numberOfMaterials;
     int m_numberOfMeshes;
+    int m_numberOfThreads;
+    size_t m_importWindowSize;
+    ImportCallback m_pImportCallback;
+    void *m_pImportCallbackData;
+    bool m_parallelNormals;
+    TangentMethod m_tangentMethod;
+    VertexLayout m_vertexLayout;
 
     float m_center[3];
     float m_width;
     float m_height;
     float m_length;
     float m_radius;
+    float m_minimum[3];
+    float m_maximum[3];
+    float m_sphereRadius;
 
     std::string m_directoryPath;
+    std::vector<std::string> m_materialLibraries;
 
     std::vector<Mesh> m_meshes;
+    std::vector<Group> m_groups;
+    std::vector<Object> m_objects;
     std::vector<Material> m_materials;
     std::vector<Vertex> m_vertexBuffer;
     std::vector<int> m_indexBuffer;
     std::vector<int> m_attributeBuffer;
+    std::vector<int> m_groupBuffer;
+    std::vector<unsigned short> m_shortIndexBuffer;
+    std::vector<LevelOfDetail> m_levelsOfDetail;
+    std::vector<Meshlet> m_meshlets;
+    std::vector<BvhNode> m_bvhNodes;
+    std::vector<int> m_bvhTriangles;
+    std::vector<float> m_bvhTriangleData;
+    std::vector<int> m_lodIndexBuffer;
+    std::vector<unsigned short> m_shortLodIndexBuffer;
+    std::vector<float> m_positionStream;
+    std::vector<float> m_texCoordStream;
+    std::vector<float> m_normalStream;
+    std::vector<float> m_tangentStream;
+    std::vector<float> m_bitangentStream;
     std::vector<float> m_vertexCoords;
     std::vector<float> m_textureCoords;
     std::vector<float> m_normals;
 
     std::map<std::string, int> m_materialCache;
-    std::map<int, std::vector<int> > m_vertexCache;
+    std::vector<VertexCacheEntry> m_vertexCache;
+    int m_vertexCacheSize;
 };
 
 //-----------------------------------------------------------------------------
@@ -189,11 +611,71 @@ inline float ModelOBJ::getLength() const
 inline float ModelOBJ::getRadius() const
 { return m_radius; }
 
+inline void ModelOBJ::getBounds(float minimum[3], float maximum[3]) const
+{
+    for (int i = 0; i < 3; ++i)
+    {
+        minimum[i] = m_minimum[i];
+        maximum[i] = m_maximum[i];
+    }
+}
+
+inline void ModelOBJ::getBoundingSphere(float center[3], float &radius) const
+{
+    center[0] = m_center[0];
+    center[1] = m_center[1];
+    center[2] = m_center[2];
+    radius = m_sphereRadius;
+}
+
 inline const int *ModelOBJ::getIndexBuffer() const
 { return &m_indexBuffer[0]; }
 
+inline const void *ModelOBJ::getIndexData() const
+{
+    if (!m_shortIndexBuffer.empty())
+        return &m_shortIndexBuffer[0];
+
+    return m_indexBuffer.empty() ? 0 : &m_indexBuffer[0];
+}
+
 inline int ModelOBJ::getIndexSize() const
-{ return static_cast<int>(sizeof(int)); }
+{
+    return static_cast<int>(m_shortIndexBuffer.empty() ?
+        sizeof(int) : sizeof(unsigned short));
+}
+
+inline const ModelOBJ::LevelOfDetail &ModelOBJ::getLevelOfDetail(int i) const
+{ return m_levelsOfDetail[i]; }
+
+inline int ModelOBJ::getNumberOfLevelsOfDetail() const
+{ return static_cast<int>(m_levelsOfDetail.size()); }
+
+inline const int *ModelOBJ::getLodIndexBuffer() const
+{ return m_lodIndexBuffer.empty() ? 0 : &m_lodIndexBuffer[0]; }
+
+inline const void *ModelOBJ::getLodIndexData() const
+{
+    if (!m_shortLodIndexBuffer.empty())
+        return &m_shortLodIndexBuffer[0];
+
+    return getLodIndexBuffer();
+}
+
+inline int ModelOBJ::getNumberOfLodIndices() const
+{ return static_cast<int>(m_lodIndexBuffer.size()); }
+
+inline const ModelOBJ::BvhNode &ModelOBJ::getBvhNode(int i) const
+{ return m_bvhNodes[i]; }
+
+inline int ModelOBJ::getNumberOfBvhNodes() const
+{ return static_cast<int>(m_bvhNodes.size()); }
+
+inline const int *ModelOBJ::getBvhTriangles() const
+{ return m_bvhTriangles.empty() ? 0 : &m_bvhTriangles[0]; }
+
+inline const ModelOBJ::Group &ModelOBJ::getGroup(int i) const
+{ return m_groups[i]; }
 
 inline const ModelOBJ::Material &ModelOBJ::getMaterial(int i) const
 { return m_materials[i]; }
@@ -201,6 +683,15 @@ inline const ModelOBJ::Material &ModelOBJ::getMaterial(int i) const
 inline const ModelOBJ::Mesh &ModelOBJ::getMesh(int i) const
 { return m_meshes[i]; }
 
+inline const ModelOBJ::Meshlet &ModelOBJ::getMeshlet(int i) const
+{ return m_meshlets[i]; }
+
+inline const ModelOBJ::Object &ModelOBJ::getObject(int i) const
+{ return m_objects[i]; }
+
+inline int ModelOBJ::getNumberOfGroups() const
+{ return static_cast<int>(m_groups.size()); }
+
 inline int ModelOBJ::getNumberOfIndices() const
 { return m_numberOfTriangles * 3; }
 
@@ -210,15 +701,39 @@ inline int ModelOBJ::getNumberOfMaterials() const
 inline int ModelOBJ::getNumberOfMeshes() const
 { return m_numberOfMeshes; }
 
+inline int ModelOBJ::getNumberOfMeshlets() const
+{ return static_cast<int>(m_meshlets.size()); }
+
+inline int ModelOBJ::getNumberOfObjects() const
+{ return static_cast<int>(m_objects.size()); }
+
 inline int ModelOBJ::getNumberOfTriangles() const
 { return m_numberOfTriangles; }
 
 inline int ModelOBJ::getNumberOfVertices() const
-{ return static_cast<int>(m_vertexBuffer.size()); }
+{
+    return static_cast<int>((m_vertexLayout == VERTEX_LAYOUT_SEPARATE) ?
+        m_positionStream.size() / 3 : m_vertexBuffer.size());
+}
 
 inline const std::string &ModelOBJ::getPath() const
 { return m_directoryPath; }
 
+inline size_t ModelOBJ::getImportWindowSize() const
+{ return m_importWindowSize; }
+
+inline int ModelOBJ::getNumberOfThreads() const
+{ return m_numberOfThreads; }
+
+inline bool ModelOBJ::getParallelNormals() const
+{ return m_parallelNormals; }
+
+inline ModelOBJ::TangentMethod ModelOBJ::getTangentMethod() const
+{ return m_tangentMethod; }
+
+inline ModelOBJ::VertexLayout ModelOBJ::getVertexLayout() const
+{ return m_vertexLayout; }
+
 inline const ModelOBJ::Vertex &ModelOBJ::getVertex(int i) const
 { return m_vertexBuffer[i]; }
 
@@ -228,6 +743,21 @@ inline const ModelOBJ::Vertex *ModelOBJ::getVertexBuffer() const
 inline int ModelOBJ::getVertexSize() const
 { return static_cast<int>(sizeof(Vertex)); }
 
+inline const float *ModelOBJ::getPositions() const
+{ return m_positionStream.empty() ? 0 : &m_positionStream[0]; }
+
+inline const float *ModelOBJ::getTexCoords() const
+{ return m_texCoordStream.empty() ? 0 : &m_texCoordStream[0]; }
+
+inline const float *ModelOBJ::getNormals() const
+{ return m_normalStream.empty() ? 0 : &m_normalStream[0]; }
+
+inline const float *ModelOBJ::getTangents() const
+{ return m_tangentStream.empty() ? 0 : &m_tangentStream[0]; }
+
+inline const float *ModelOBJ::getBitangents() const
+{ return m_bitangentStream.empty() ? 0 : &m_bitangentStream[0]; }
+
 inline bool ModelOBJ::hasNormals() const
 { return m_hasNormals; }
 
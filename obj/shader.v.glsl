@@ -1,8 +1,7 @@
 #version 330	// GLSL version
 
-// Translation to apply to vertices (constant for every vertex)
-uniform vec3 translation;
-uniform float scaling;
+// Model, camera and projection transformation (constant for every vertex)
+uniform mat4 transformation;
 
 // The position of a vertex (per-vertex, from the VBO)
 layout (location = 0) in vec3 position; 
@@ -11,15 +10,12 @@ layout (location = 0) in vec3 position;
 out vec4 color;
 
 void main() {
-	// translate the vertex
-    gl_Position = vec4(scaling * position.x + translation.x, 
-					   scaling * position.y + translation.y, 
-					   scaling * position.z, 
-					   1.0);
+	// transform the vertex
+    gl_Position = transformation * vec4(position, 1.0);
 	
 	// set the color of the vertex
-	color.r = clamp(gl_Position.x, 0., 1.);
-	color.g = clamp(gl_Position.y, 0., 1.);
-	color.b = clamp(gl_Position.z, 0., 1.);
+	color.r = clamp(position.x, 0., 1.);
+	color.g = clamp(position.y, 0., 1.);
+	color.b = clamp(position.z, 0., 1.);
 	color.a = 1.;	
 }
\ No newline at end of file
@@ -0,0 +1,86 @@
+//-----------------------------------------------------------------------------
+// A bounded lock free queue for handing work from one thread to another.
+//-----------------------------------------------------------------------------
+
+#if !defined(SPSC_QUEUE_H)
+#define SPSC_QUEUE_H
+
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+//-----------------------------------------------------------------------------
+// A single producer, single consumer ring buffer. Exactly one thread may
+// call push() and exactly one (other) thread may call pop(). Neither call
+// blocks or takes a lock: push() returns false when the queue is full and
+// pop() returns false when it is empty. The two indices live on separate
+// cache lines so the threads don't invalidate each other's line on every
+// call.
+//-----------------------------------------------------------------------------
+
+template <typename T>
+class SpscQueue
+{
+public:
+    explicit SpscQueue(size_t capacity);
+
+    bool push(const T &item);
+    bool pop(T &item);
+
+    bool empty() const;
+
+private:
+    SpscQueue(const SpscQueue &);
+    SpscQueue &operator=(const SpscQueue &);
+
+    // One slot always stays free to tell a full queue from an empty one.
+    std::vector<T> m_items;
+
+    alignas(64) std::atomic<size_t> m_head;     // next item to pop
+    alignas(64) std::atomic<size_t> m_tail;     // next slot to push to
+};
+
+//-----------------------------------------------------------------------------
+
+template <typename T>
+SpscQueue<T>::SpscQueue(size_t capacity) : m_items(capacity + 1), m_head(0), m_tail(0)
+{
+}
+
+template <typename T>
+bool SpscQueue<T>::push(const T &item)
+{
+    size_t tail = m_tail.load(std::memory_order_relaxed);
+    size_t next = (tail + 1 == m_items.size()) ? 0 : tail + 1;
+
+    if (next == m_head.load(std::memory_order_acquire))
+        return false;
+
+    // Publish the item before the consumer can see the new tail.
+    m_items[tail] = item;
+    m_tail.store(next, std::memory_order_release);
+    return true;
+}
+
+template <typename T>
+bool SpscQueue<T>::pop(T &item)
+{
+    size_t head = m_head.load(std::memory_order_relaxed);
+
+    if (head == m_tail.load(std::memory_order_acquire))
+        return false;
+
+    // Read the item before the producer may reuse its slot.
+    item = m_items[head];
+    m_head.store((head + 1 == m_items.size()) ? 0 : head + 1, std::memory_order_release);
+    return true;
+}
+
+template <typename T>
+inline bool SpscQueue<T>::empty() const
+{
+    return m_head.load(std::memory_order_acquire) ==
+        m_tail.load(std::memory_order_acquire);
+}
+
+#endif
@@ -0,0 +1,128 @@
+#include "thread_pool.h"
+
+ThreadPool::ThreadPool(int numberOfThreads)
+{
+    m_pTask = 0;
+    m_taskCount = 0;
+    m_nextTask = 0;
+    m_finishedTasks = 0;
+    m_activeWorkers = 0;
+    m_generation = 0;
+    m_stop = false;
+
+    if (numberOfThreads <= 0)
+        numberOfThreads = getHardwareConcurrency();
+
+    // The calling thread counts as one of the pool's threads.
+    for (int i = 1; i < numberOfThreads; ++i)
+        m_workers.push_back(std::thread(&ThreadPool::workerMain, this));
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+
+    m_wakeCondition.notify_all();
+
+    for (int i = 0; i < static_cast<int>(m_workers.size()); ++i)
+        m_workers[i].join();
+}
+
+int ThreadPool::getHardwareConcurrency()
+{
+    unsigned int count = std::thread::hardware_concurrency();
+    return (count == 0) ? 1 : static_cast<int>(count);
+}
+
+void ThreadPool::run(int count, const Task &task)
+{
+    if (count <= 0)
+        return;
+
+    if (m_workers.empty() || count == 1)
+    {
+        for (int i = 0; i < count; ++i)
+            task(i);
+
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_pTask = &task;
+        m_taskCount = count;
+        m_nextTask = 0;
+        m_finishedTasks = 0;
+        ++m_generation;
+    }
+
+    m_wakeCondition.notify_all();
+    work();
+
+    // Wait for the remaining tasks and for every worker to leave work() so
+    // the next batch can safely reuse the shared state.
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    while (m_finishedTasks < m_taskCount || m_activeWorkers > 0)
+        m_doneCondition.wait(lock);
+
+    m_pTask = 0;
+}
+
+void ThreadPool::work()
+{
+    int finished = 0;
+
+    for (;;)
+    {
+        int index = m_nextTask.fetch_add(1);
+
+        if (index >= m_taskCount)
+            break;
+
+        (*m_pTask)(index);
+        ++finished;
+    }
+
+    if (finished > 0)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_finishedTasks += finished;
+
+        if (m_finishedTasks == m_taskCount)
+            m_doneCondition.notify_all();
+    }
+}
+
+void ThreadPool::workerMain()
+{
+    unsigned int generation = 0;
+
+    for (;;)
+    {
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+
+            while (!m_stop && m_generation == generation)
+                m_wakeCondition.wait(lock);
+
+            if (m_stop)
+                return;
+
+            generation = m_generation;
+            ++m_activeWorkers;
+        }
+
+        work();
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+
+            if (--m_activeWorkers == 0)
+                m_doneCondition.notify_all();
+        }
+    }
+}
@@ -0,0 +1,63 @@
+//-----------------------------------------------------------------------------
+// A minimal fixed size thread pool used by ModelOBJ to spread import and
+// post processing work over several cores.
+//-----------------------------------------------------------------------------
+
+#if !defined(THREAD_POOL_H)
+#define THREAD_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+//-----------------------------------------------------------------------------
+// The pool runs batches of independent tasks. run() hands out the task
+// indices [0, count) to the worker threads and to the calling thread, and
+// returns once every task has finished. Tasks of one batch must not depend
+// on each other. A pool with a single thread runs everything on the caller.
+//-----------------------------------------------------------------------------
+
+class ThreadPool
+{
+public:
+    typedef std::function<void(int)> Task;
+
+    explicit ThreadPool(int numberOfThreads = 0);
+    ~ThreadPool();
+
+    void run(int count, const Task &task);
+
+    int getNumberOfThreads() const;
+
+    static int getHardwareConcurrency();
+
+private:
+    ThreadPool(const ThreadPool &);
+    ThreadPool &operator=(const ThreadPool &);
+
+    void work();
+    void workerMain();
+
+    std::vector<std::thread> m_workers;
+    std::mutex m_mutex;
+    std::condition_variable m_wakeCondition;
+    std::condition_variable m_doneCondition;
+
+    const Task *m_pTask;
+    int m_taskCount;
+    std::atomic<int> m_nextTask;
+    int m_finishedTasks;
+    int m_activeWorkers;
+    unsigned int m_generation;
+    bool m_stop;
+};
+
+//-----------------------------------------------------------------------------
+
+inline int ThreadPool::getNumberOfThreads() const
+{ return static_cast<int>(m_workers.size()) + 1; }
+
+#endif
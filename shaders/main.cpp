@@ -13,6 +13,8 @@
 #include <string>
 
 #include "Vector3.h"
+#include "Geometry.h"
+#include "ProgramReflection.h"
 
 using namespace std;
 
@@ -35,8 +37,11 @@ const int NUMBER_OF_TRIANGLES = 2; ///< The number of triangles to draw
 
 GLuint VBO = 0; ///< A vertex buffer object
 GLuint IBO = 0; ///< An index buffer object
+Geometry Quad;  ///< The buffers and vertex format of the two triangles
 
 GLuint ShaderProgram = 0; ///< A shader program
+ProgramReflection Uniforms; ///< The active uniforms of ShaderProgram (updated by initShaders())
+const int TranslationUniform = Uniforms.addUniform("translation"); ///< Uniforms[] handle
 
 int MouseX, MouseY; ///< The last position of the mouse
 int MouseButton;	///< The last mouse button pressed or released
@@ -97,18 +102,14 @@ void display()
 	assert(ShaderProgram != 0);
 	glUseProgram(ShaderProgram);
 
-	// Enable the "position" vertex attribute (0 in the fixed pipeline) and set its format
-	glEnableVertexAttribArray(0);
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, 0);
+	// Set the uniform variable for the translation (its location was read
+	// when the program was linked)
+	assert(Uniforms[TranslationUniform] != -1); // check for errors (variable not found)
+	glUniform3fv(Uniforms[TranslationUniform], 1, Translation.get());
 
-	// Set the uniform variable for the translation
-	GLint trUniformLocation = glGetUniformLocation(ShaderProgram, "translation");
-	assert(trUniformLocation != -1); // check for errors (variable not found)
-	glUniform3fv(trUniformLocation, 1, Translation.get());
-
-	// Bind the buffers
-	glBindBuffer(GL_ARRAY_BUFFER, VBO);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, IBO);
+	// Bind the buffers and enable the "position" vertex attribute (0 in the
+	// fixed pipeline) with the format set in initBuffers()
+	Quad.bind();
 
 	// Draw the elements on the GPU
 	glDrawElements(
@@ -117,8 +118,8 @@ void display()
 		GL_UNSIGNED_INT,		 // the type of the indices
 		0);						 // offset of the first index
 
-	// Disable the "position" vertex attribute (not necessary but recommended)
-	glDisableVertexAttribArray(0);
+	// Unbind the buffers and the vertex attribute (not necessary but recommended)
+	Quad.unbind();
 
 	// Disable the shader program (not necessary but recommended)
 	glUseProgram(0);
@@ -217,21 +218,16 @@ void initBuffers()
 				 3 * NUMBER_OF_TRIANGLES * sizeof(unsigned int),
 				 indices,
 				 GL_STATIC_DRAW);
+
+	// Record the buffers and the vertex format once (a position per vertex,
+	// tightly packed), display() only has to bind them
+	Quad.addAttribute(0, 3, GL_FLOAT, GL_FALSE, 0, 0);
+	Quad.create(VBO, IBO);
 } /* initBuffers() */
 
 /// Initialize shaders. Return false if initialization fail.
 bool initShaders()
 {
-	// Create the shader program and check for errors
-	if (ShaderProgram != 0)
-		glDeleteProgram(ShaderProgram);
-	ShaderProgram = glCreateProgram();
-	if (ShaderProgram == 0)
-	{
-		cerr << "Error: cannot create shader program." << endl;
-		return false;
-	}
-
 	// Create the shader objects and check for errors
 	GLuint vertShader = glCreateShader(GL_VERTEX_SHADER);
 	GLuint fragShader = glCreateShader(GL_FRAGMENT_SHADER);
@@ -281,34 +277,52 @@ bool initShaders()
 		return false;
 	}
 
+	// Create the shader program and check for errors. It only replaces the
+	// program in use once it is linked, so that a failed reload keeps the
+	// previous shaders (and their uniform locations)
+	GLuint program = glCreateProgram();
+	if (program == 0)
+	{
+		cerr << "Error: cannot create shader program." << endl;
+		return false;
+	}
+
 	// Attach the shader to the program and link it
-	glAttachShader(ShaderProgram, vertShader);
-	glAttachShader(ShaderProgram, fragShader);
-	glLinkProgram(ShaderProgram);
+	glAttachShader(program, vertShader);
+	glAttachShader(program, fragShader);
+	glLinkProgram(program);
 
 	// Check for linking error
-	glGetProgramiv(ShaderProgram, GL_LINK_STATUS, &success);
+	glGetProgramiv(program, GL_LINK_STATUS, &success);
 	if (!success)
 	{
-		glGetProgramInfoLog(ShaderProgram, 1024, nullptr, errorLog);
+		glGetProgramInfoLog(program, 1024, nullptr, errorLog);
 		cerr << "Error: cannot link shader program.\nError log:\n"
 			 << errorLog << endl;
+		glDeleteProgram(program);
 		return false;
 	}
 
 	// Make sure that the shader program can run
-	glValidateProgram(ShaderProgram);
+	glValidateProgram(program);
 
 	// Check for validation error
-	glGetProgramiv(ShaderProgram, GL_VALIDATE_STATUS, &success);
+	glGetProgramiv(program, GL_VALIDATE_STATUS, &success);
 	if (!success)
 	{
-		glGetProgramInfoLog(ShaderProgram, 1024, nullptr, errorLog);
+		glGetProgramInfoLog(program, 1024, nullptr, errorLog);
 		cerr << "Error: cannot validate shader program.\nError log:\n"
 			 << errorLog << endl;
+		glDeleteProgram(program);
 		return false;
 	}
 
+	// Replace the program in use and read its active uniforms
+	if (ShaderProgram != 0)
+		glDeleteProgram(ShaderProgram);
+	ShaderProgram = program;
+	Uniforms.reflect(ShaderProgram);
+
 	// Shaders can be deleted now
 	glDeleteShader(vertShader);
 	glDeleteShader(fragShader);
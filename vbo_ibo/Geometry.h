@@ -0,0 +1,160 @@
+#ifndef __GEOMETRY_H__
+#define __GEOMETRY_H__
+
+#include <GL/glew.h>
+
+#include <cassert>
+#include <cstddef>
+
+/// The buffers and vertex format of a mesh, set up once and then bound with a
+/// single call. The state is recorded in a vertex array object (VAO); without
+/// VAO support (e.g. an OpenGL 2.1 context) bind() sets the attributes itself.
+///
+/// Usage: fill the VBO and IBO, call addAttribute() for every vertex attribute
+/// (and addInstanceAttribute() for every per-instance one) and then create().
+/// In display(), draw between bind() and unbind().
+class Geometry
+{
+public:
+	/// The maximum number of vertex attributes of a mesh
+	static const int MAX_ATTRIBUTES = 8;
+
+	/// Create an empty geometry (create() must be called before bind())
+	Geometry() : mVAO(0), mVBO(0), mIBO(0), mNumAttributes(0) {}
+
+	/// Add a vertex attribute. The parameters are the ones of
+	/// glVertexAttribPointer(), the data is read from the VBO given to create()
+	void addAttribute(GLuint index, GLint size, GLenum type, GLboolean normalized,
+					  GLsizei stride, size_t offset)
+	{
+		assert(mNumAttributes < MAX_ATTRIBUTES);
+		Attribute &attribute = mAttributes[mNumAttributes++];
+		attribute.index = index;
+		attribute.size = size;
+		attribute.type = type;
+		attribute.normalized = normalized;
+		attribute.stride = stride;
+		attribute.offset = offset;
+		attribute.buffer = 0;
+		attribute.divisor = 0;
+	}
+
+	/// Add a per-instance attribute, read from the given buffer and advanced
+	/// once per instance by glDrawElementsInstanced() (a mat4 takes 4
+	/// consecutive indices, one per column)
+	void addInstanceAttribute(GLuint buffer, GLuint index, GLint size, GLenum type,
+							  GLboolean normalized, GLsizei stride, size_t offset)
+	{
+		addAttribute(index, size, type, normalized, stride, offset);
+		mAttributes[mNumAttributes - 1].buffer = buffer;
+		mAttributes[mNumAttributes - 1].divisor = 1;
+	}
+
+	/// Record the vertex and index buffers and the attributes added so far.
+	/// The buffers are not owned by the geometry. Leaves no VAO bound
+	void create(GLuint vbo, GLuint ibo)
+	{
+		mVBO = vbo;
+		mIBO = ibo;
+
+		if (!hasVertexArrays())
+			return;
+
+		if (mVAO == 0)
+			glGenVertexArrays(1, &mVAO);
+		glBindVertexArray(mVAO);
+		setAttributes();
+		glBindVertexArray(0);
+	}
+
+	/// Bind the buffers and enable the vertex attributes
+	void bind() const
+	{
+		if (mVAO != 0)
+			glBindVertexArray(mVAO);
+		else
+			setAttributes();
+	}
+
+	/// Undo bind(). The VAO must be unbound before any other IBO is bound,
+	/// or the VAO would keep it
+	void unbind() const
+	{
+		if (mVAO != 0)
+		{
+			glBindVertexArray(0);
+			return;
+		}
+
+		for (int i = 0; i < mNumAttributes; ++i)
+		{
+			glDisableVertexAttribArray(mAttributes[i].index);
+			if (mAttributes[i].divisor != 0)
+				glVertexAttribDivisor(mAttributes[i].index, 0);
+		}
+	}
+
+	/// Delete the VAO (the buffers are left alone). It isn't done by a
+	/// destructor because the OpenGL context may be gone by then
+	void destroy()
+	{
+		if (mVAO != 0)
+			glDeleteVertexArrays(1, &mVAO);
+		mVAO = 0;
+		mVBO = 0;
+		mIBO = 0;
+		mNumAttributes = 0;
+	}
+
+	/// Return the vertex buffer object
+	GLuint getVBO() const { return mVBO; }
+
+	/// Return the index buffer object
+	GLuint getIBO() const { return mIBO; }
+
+	/// Return true if the current OpenGL context supports VAOs
+	static bool hasVertexArrays()
+	{
+		return GLEW_VERSION_3_0 || GLEW_ARB_vertex_array_object;
+	}
+
+private:
+	/// The parameters of glVertexAttribPointer()
+	struct Attribute
+	{
+		GLuint index;
+		GLint size;
+		GLenum type;
+		GLboolean normalized;
+		GLsizei stride;
+		size_t offset;
+		GLuint buffer;	 ///< the buffer to read from, 0 for the VBO
+		GLuint divisor;	 ///< 1 for a per-instance attribute, 0 otherwise
+	};
+
+	/// Bind the buffers, then enable the attributes and set their format
+	void setAttributes() const
+	{
+		for (int i = 0; i < mNumAttributes; ++i)
+		{
+			// the attribute pointers refer to the buffer bound to GL_ARRAY_BUFFER
+			const Attribute &attribute = mAttributes[i];
+			glBindBuffer(GL_ARRAY_BUFFER, attribute.buffer != 0 ? attribute.buffer : mVBO);
+			glEnableVertexAttribArray(attribute.index);
+			glVertexAttribPointer(attribute.index, attribute.size, attribute.type,
+								  attribute.normalized, attribute.stride,
+								  reinterpret_cast<const GLvoid *>(attribute.offset));
+			if (attribute.divisor != 0)
+				glVertexAttribDivisor(attribute.index, attribute.divisor);
+		}
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mIBO);
+	}
+
+	GLuint mVAO; ///< The vertex array object, 0 without VAO support
+	GLuint mVBO; ///< The vertex buffer object
+	GLuint mIBO; ///< The index buffer object
+	Attribute mAttributes[MAX_ATTRIBUTES]; ///< The vertex format
+	int mNumAttributes; ///< The number of vertex attributes
+};
+
+#endif
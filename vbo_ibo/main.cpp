@@ -10,6 +10,7 @@
 
 #include <iostream>
 #include "Vector3.h"
+#include "Geometry.h"
 
 using namespace std; // to avoid specifying std:: before methods and classes of
 					 // the C++ Standard library
@@ -27,6 +28,7 @@ const int NUMBER_OF_TRIANGLES = 2; ///< The number of triangles to draw
 
 GLuint VBO; ///< A vertex buffer object
 GLuint IBO; ///< An index buffer object
+Geometry Quad; ///< The buffers and vertex format of the two triangles
 
 // --- main() -------------------------------------------------------------------------------------
 /// The entry point of the application
@@ -71,23 +73,9 @@ void display()
 	// Clear the screen
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-	// Enable the "position" vertex attribute (location 0 in the fixed pipeline)
-	glEnableVertexAttribArray(0);
-
-	// Bind the VBO
-	glBindBuffer(GL_ARRAY_BUFFER, VBO);
-
-	// Specify how the data should be interpreted
-	glVertexAttribPointer(
-		0,		  // the attribute we are referring to
-		3,		  // the number of components (x, y, z)
-		GL_FLOAT, // the basic type of data
-		GL_FALSE, // should the data be normalized?
-		0,		  // number of bytes between 2 values
-		0);		  // offset of the first byte
-
-	// Bind the IBO
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, IBO);
+	// Bind the VBO and the IBO and enable the "position" vertex attribute
+	// (location 0 in the fixed pipeline), as recorded in initBuffers()
+	Quad.bind();
 
 	// Draw the elements on the GPU
 	glDrawElements(
@@ -96,8 +84,8 @@ void display()
 		GL_UNSIGNED_INT,		 // the type of the indices
 		0);						 // offset of the first index
 
-	// Disable the "position" vertex attribute (not necessary, but recommended)
-	glDisableVertexAttribArray(0);
+	// Unbind the buffers and disable the vertex attribute (not necessary, but recommended)
+	Quad.unbind();
 
 	// Swap the frame buffers (off-screen rendering)
 	glutSwapBuffers();
@@ -153,4 +141,15 @@ void initBuffers()
 				 3 * NUMBER_OF_TRIANGLES * sizeof(unsigned int), // the size of the data
 				 indices,										 // pointer to the data
 				 GL_STATIC_DRAW);								 // static vs dynamic
+
+	// Specify how the data should be interpreted. This is recorded once
+	// in a vertex array object (VAO), so display() only has to bind it
+	Quad.addAttribute(
+		0,		  // the attribute we are referring to
+		3,		  // the number of components (x, y, z)
+		GL_FLOAT, // the basic type of data
+		GL_FALSE, // should the data be normalized?
+		0,		  // number of bytes between 2 values
+		0);		  // offset of the first byte
+	Quad.create(VBO, IBO);
 }